@@ -0,0 +1,223 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bench.h"
+
+bench_options_t g_bench_options = {"", 0.5};
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+bench_state_t::bench_state_t(int64_t iterations, int arg)
+{
+    m_iterations = iterations;
+    m_remaining = iterations;
+    m_arg = arg;
+    m_frames = 0;
+    m_bytes = 0;
+    m_start = 0;
+    m_elapsed = 0;
+    m_running = false;
+}
+
+bool bench_state_t::keep_running()
+{
+    if (!m_error.empty())
+    {
+        return false;
+    }
+
+    if (!m_running && m_remaining == m_iterations)
+    {
+        m_running = true;
+        m_start = now();
+    }
+
+    if (m_remaining > 0)
+    {
+        m_remaining--;
+        return true;
+    }
+
+    if (m_running)
+    {
+        m_elapsed += now() - m_start;
+        m_running = false;
+    }
+
+    return false;
+}
+
+void bench_state_t::pause_timing()
+{
+    if (m_running)
+    {
+        m_elapsed += now() - m_start;
+        m_running = false;
+    }
+}
+
+void bench_state_t::resume_timing()
+{
+    if (!m_running)
+    {
+        m_running = true;
+        m_start = now();
+    }
+}
+
+void bench_state_t::skip_with_error(const string& error)
+{
+    m_error = error;
+    m_running = false;
+}
+
+vector<bench_entry_t>& bench_registry()
+{
+    static vector<bench_entry_t> registry;
+
+    return registry;
+}
+
+bench_registrar_t::bench_registrar_t(const char* name, bench_func_t func, int arg, bool has_arg)
+{
+    bench_entry_t entry;
+
+    entry.name = name;
+    entry.func = func;
+    entry.arg = arg;
+
+    if (has_arg)
+    {
+        entry.name += "/" + to_string(arg);
+    }
+
+    bench_registry().push_back(entry);
+}
+
+// Runs a benchmark with more and more passes until a run takes at least the minimum time, prints the last run
+static void run_entry(bench_entry_t& entry)
+{
+    int64_t iterations = 1;
+
+    for (;;)
+    {
+        bench_state_t state(iterations, entry.arg);
+
+        entry.func(state);
+
+        if (!state.get_error().empty())
+        {
+            printf("%-40s ERROR: %s\n", entry.name.c_str(), state.get_error().c_str());
+            return;
+        }
+
+        double elapsed = state.get_elapsed();
+
+        if (elapsed >= g_bench_options.min_time || iterations >= 1000000000)
+        {
+            double frames = state.get_frames() * iterations;
+            double bytes = state.get_bytes() * iterations;
+
+            printf("%-40s %12lld %14.1f %12.2f  %s\n", entry.name.c_str(), (long long)iterations, frames > 0 ? elapsed * 1e9 / frames : 0.0, elapsed > 0 ? bytes / elapsed / 1e6 : 0.0, state.get_label().c_str());
+            fflush(stdout);
+            return;
+        }
+
+        // Aim a bit above the minimum time, but never more than 10 times the passes at once
+        double multiplier = elapsed > 0 ? g_bench_options.min_time * 1.4 / elapsed : 10;
+        multiplier = multiplier > 10 ? 10 : multiplier < 1.1 ? 1.1 : multiplier;
+        iterations = (int64_t)(iterations * multiplier) + 1;
+    }
+}
+
+static void print_usage(const char* name)
+{
+    printf("Usage: %s [options]\n", name);
+    printf("  --filter=<text>    Only run the benchmarks whose name contains text\n");
+    printf("  --min_time=<s>     Minimum time of a measured run in seconds (default 0.5)\n");
+    printf("  --dst=<file>       Take the DST frames from a DSDIFF file or disc image instead of encoding synthetic DSD\n");
+    printf("  --list             List the benchmarks\n");
+}
+
+int main(int argc, char* argv[])
+{
+    string filter;
+    bool list = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--filter=", 9) == 0)
+        {
+            filter = argv[i] + 9;
+        }
+        else if (strncmp(argv[i], "--min_time=", 11) == 0)
+        {
+            g_bench_options.min_time = atof(argv[i] + 11);
+        }
+        else if (strncmp(argv[i], "--dst=", 6) == 0)
+        {
+            g_bench_options.dst_path = argv[i] + 6;
+        }
+        else if (strcmp(argv[i], "--list") == 0)
+        {
+            list = true;
+        }
+        else
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!list)
+    {
+        printf("%-40s %12s %14s %12s\n", "Benchmark", "Iterations", "ns/frame", "MB/s");
+        printf("%s\n", string(82, '-').c_str());
+    }
+
+    for (auto& entry : bench_registry())
+    {
+        if (!filter.empty() && entry.name.find(filter) == string::npos)
+        {
+            continue;
+        }
+
+        if (list)
+        {
+            printf("%s\n", entry.name.c_str());
+        }
+        else
+        {
+            run_entry(entry);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,132 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#ifndef _BENCH_H_INCLUDED
+#define _BENCH_H_INCLUDED
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Microbenchmarks in the manner of Google Benchmark. A benchmark is a function that prepares its input and then runs
+// the code to be measured once per pass of "while (state.keep_running())". The runner repeats it with more passes until
+// one run takes at least the minimum time. Every benchmark states how many frames (1/75 s of audio unless it says
+// otherwise) and how many bytes of input a pass processes, the report shows the time per frame and the throughput.
+//
+//  static void BM_Kernel(bench_state_t& state)
+//  {
+//      ...setup...
+//      while (state.keep_running())
+//      {
+//          bench_do_not_optimize(kernel(...));
+//      }
+//      state.set_frames_processed(1);
+//      state.set_bytes_processed(4704);
+//  }
+//  BENCHMARK(BM_Kernel);
+//  BENCHMARK_ARG(BM_Kernel, 6);
+
+class bench_state_t
+{
+    int64_t m_iterations;
+    int64_t m_remaining;
+    int m_arg;
+    double m_frames;
+    double m_bytes;
+    double m_start;
+    double m_elapsed;
+    bool m_running;
+    string m_label;
+    string m_error;
+public:
+    bench_state_t(int64_t iterations, int arg);
+
+    // true for every pass of the measured loop, the clock runs from the first call to the last
+    bool keep_running();
+
+    // Excludes per pass setup (rewinding a file, refilling a buffer) from the measurement
+    void pause_timing();
+    void resume_timing();
+
+    int arg() { return m_arg; }
+    int64_t iterations() { return m_iterations; }
+
+    // Per pass of the loop
+    void set_frames_processed(double frames) { m_frames = frames; }
+    void set_bytes_processed(double bytes) { m_bytes = bytes; }
+
+    // Shown after the numbers, e.g. the source of the input
+    void set_label(const string& label) { m_label = label; }
+
+    // Marks the benchmark as failed, it is reported but not timed
+    void skip_with_error(const string& error);
+
+    double get_frames() { return m_frames; }
+    double get_bytes() { return m_bytes; }
+    double get_elapsed() { return m_elapsed; }
+    const string& get_label() { return m_label; }
+    const string& get_error() { return m_error; }
+};
+
+typedef void (*bench_func_t)(bench_state_t& state);
+
+struct bench_entry_t
+{
+    string name;
+    bench_func_t func;
+    int arg;
+};
+
+vector<bench_entry_t>& bench_registry();
+
+class bench_registrar_t
+{
+public:
+    bench_registrar_t(const char* name, bench_func_t func, int arg, bool has_arg);
+};
+
+// Keeps the compiler from dropping a computation whose result is not used
+template <class T>
+inline void bench_do_not_optimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+inline void bench_clobber_memory()
+{
+    asm volatile("" : : : "memory");
+}
+
+// Options of the command line the benchmarks may look at
+struct bench_options_t
+{
+    string dst_path; // DST input (DSDIFF or disc image) whose frames replace the synthetic ones
+    double min_time;
+};
+
+extern bench_options_t g_bench_options;
+
+#define BENCH_CONCAT2(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT2(a, b)
+#define BENCHMARK(func) static bench_registrar_t BENCH_CONCAT(bench_registrar_, __LINE__)(#func, func, 0, false)
+#define BENCHMARK_ARG(func, value) static bench_registrar_t BENCH_CONCAT(bench_registrar_, __LINE__)(#func, func, value, true)
+
+#endif
@@ -0,0 +1,546 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "dst_decoder.h"
+#include "dst_encoder.h"
+#include "ac_data.h"
+#include "dsd_pcm_converter.h"
+#include "upsampler.h"
+#include "sacd_media.h"
+#include "sacd_dsf.h"
+#include "sacd_session.h"
+#include "dsd_writer.h"
+#include "pcm_writer.h"
+#include "dsd_signal.h"
+#include "bench.h"
+
+using namespace std;
+
+// A frame is 1/75 s of DSD64, the unit in which the decoders get their input: all channels for the decoders and the
+// reader, one channel for the filters. The bytes are those the kernel reads (the decoders: the DSD they produce).
+// Benchmarks that count otherwise say so.
+#define BENCH_FS44 64
+#define BENCH_DSD_SAMPLERATE (44100 * BENCH_FS44)
+#define BENCH_FRAME_BYTES (BENCH_DSD_SAMPLERATE / 8 / 75)
+#define BENCH_FRAME_BITS (BENCH_FRAME_BYTES * 8)
+#define BENCH_SECONDS 2
+
+static vector<uint8_t> make_dsd(int channels, int samples)
+{
+    vector<uint8_t> dsd((size_t)channels * samples);
+    dsd_signal_t signal(channels, BENCH_DSD_SAMPLERATE);
+
+    signal.generate(dsd.data(), samples);
+
+    return dsd;
+}
+
+// ±1 per bit, as the HQ converter feeds its resamplers
+static vector<double> make_bits(int bits, int padding)
+{
+    vector<uint8_t> dsd = make_dsd(1, (bits + 7) / 8);
+    vector<double> x(bits + padding, 0.0);
+
+    for (int i = 0; i < bits; i++)
+    {
+        x[i] = (dsd[i >> 3] & (0x80 >> (i & 7))) ? 1.0 : -1.0;
+    }
+
+    return x;
+}
+
+struct dst_stream_t
+{
+    int channels;
+    int fs44;
+    string label;
+    string error;
+    vector<vector<uint8_t>> frames;
+};
+
+// DST frames from the file given with --dst, or the synthetic signal through CDSTEncoder. Kept for the following runs
+static dst_stream_t& get_dst_stream(int channels)
+{
+    static map<int, dst_stream_t> streams;
+    auto it = streams.find(channels);
+
+    if (it != streams.end())
+    {
+        return it->second;
+    }
+
+    dst_stream_t& stream = streams[channels];
+
+    stream.channels = channels;
+    stream.fs44 = BENCH_FS44;
+
+    if (!g_bench_options.dst_path.empty())
+    {
+        sacd_session_t session(1);
+        area_id_e area = channels == 2 ? AREA_TWOCH : AREA_MULCH;
+
+        stream.label = g_bench_options.dst_path;
+
+        // The session prints nothing, its error goes into the table row of the benchmark
+        if (session.open(g_bench_options.dst_path) == 0)
+        {
+            stream.error = "cannot open " + g_bench_options.dst_path + ": " + session.get_error();
+            return stream;
+        }
+
+        if (session.get_reader()->get_track_count(area) == 0)
+        {
+            area = area == AREA_TWOCH ? AREA_MULCH : AREA_TWOCH;
+        }
+
+        if (!session.select_track(0, area, 0))
+        {
+            stream.error = "cannot read " + g_bench_options.dst_path + ": " + session.get_error();
+        }
+        else if (session.get_channels() != channels)
+        {
+            stream.error = "input has " + to_string(session.get_channels()) + " channels";
+        }
+        else
+        {
+            vector<uint8_t> frame(session.get_frame_size() + 1);
+            size_t size = frame.size();
+            frame_type_e type = FRAME_DST;
+
+            stream.fs44 = session.get_dsd_samplerate() / 44100;
+
+            // The first frame tells if the input is DST encoded, reading stops at the first one that is not
+            while (stream.frames.size() < 75 * BENCH_SECONDS && type == FRAME_DST && session.read_frame(frame.data(), &size, &type))
+            {
+                if (type == FRAME_DST)
+                {
+                    stream.frames.push_back(vector<uint8_t>(frame.begin(), frame.begin() + size));
+                }
+
+                size = frame.size();
+            }
+
+            if (stream.frames.empty())
+            {
+                stream.error = g_bench_options.dst_path + " is not DST encoded";
+            }
+        }
+
+        return stream;
+    }
+
+    CDSTEncoder* encoder = new CDSTEncoder;
+    vector<uint8_t> dsd = make_dsd(channels, BENCH_FRAME_BYTES * 75 * BENCH_SECONDS);
+    vector<uint8_t> dst(BENCH_FRAME_BYTES * channels + 1);
+
+    stream.label = "synthetic, effort " + to_string(DST_EFFORT_DEFAULT);
+    encoder->init(channels, BENCH_FS44);
+
+    for (int i = 0; i < 75 * BENCH_SECONDS; i++)
+    {
+        int size = encoder->encode(dsd.data() + (size_t)i * BENCH_FRAME_BYTES * channels, dst.data());
+
+        stream.frames.push_back(vector<uint8_t>(dst.begin(), dst.begin() + size));
+    }
+
+    encoder->close();
+    delete encoder;
+
+    return stream;
+}
+
+// One frame of all channels per pass, the recorded frames in turn
+static void BM_CDSTDecoder_decode(bench_state_t& state)
+{
+    dst_stream_t& stream = get_dst_stream(state.arg());
+
+    if (!stream.error.empty())
+    {
+        state.skip_with_error(stream.error);
+        return;
+    }
+
+    int frame_bytes = stream.fs44 * 44100 / 8 / 75;
+    CDSTDecoder* decoder = new CDSTDecoder;
+    vector<uint8_t> dsd((size_t)frame_bytes * stream.channels);
+    size_t frame_nr = 0;
+
+    decoder->init(stream.channels, stream.fs44);
+
+    while (state.keep_running())
+    {
+        vector<uint8_t>& frame = stream.frames[frame_nr];
+
+        decoder->decode(frame.data(), (int)frame.size() * 8, dsd.data());
+        bench_clobber_memory();
+        frame_nr = frame_nr + 1 < stream.frames.size() ? frame_nr + 1 : 0;
+    }
+
+    decoder->close();
+    delete decoder;
+
+    state.set_frames_processed(1);
+    state.set_bytes_processed(dsd.size());
+    state.set_label(stream.label);
+}
+BENCHMARK_ARG(BM_CDSTDecoder_decode, 2);
+BENCHMARK_ARG(BM_CDSTDecoder_decode, 6);
+
+// The arithmetic decoder alone on the bits of one frame of two channels. The residuals of a real frame are mostly
+// right, the less probable symbol (0) turns up with the probability it is coded with, 1/256 to 1/5 here
+static void BM_CACData_decodeBit(bench_state_t& state)
+{
+    const int bits = BENCH_FRAME_BITS * 2;
+    vector<uint8_t> symbols(bits);
+    vector<int> probs(bits);
+    vector<ADataByte> code(bits / 8 + 1);
+    uint32_t seed = 1;
+    CACData ac;
+
+    for (int i = 0; i < bits; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        probs[i] = 1 + (seed >> 16) % 52;
+        seed = seed * 1103515245 + 12345;
+        symbols[i] = (int)((seed >> 16) & 0xff) < probs[i] ? 0 : 1;
+    }
+
+    ac.encodeBit_Init(code.data(), bits);
+
+    for (int i = 0; i < bits; i++)
+    {
+        ac.encodeBit_Encode(symbols[i], probs[i], code.data(), bits);
+    }
+
+    int code_bits = ac.encodeBit_Flush(code.data(), bits);
+
+    if (code_bits > bits)
+    {
+        state.skip_with_error("test stream does not compress");
+        return;
+    }
+
+    uint8_t b;
+    int errors = 0;
+
+    while (state.keep_running())
+    {
+        ac.decodeBit_Init(code.data(), code_bits);
+
+        for (int i = 0; i < bits; i++)
+        {
+            ac.decodeBit_Decode(&b, probs[i], code.data(), code_bits);
+            errors += b != symbols[i];
+        }
+
+        bench_do_not_optimize(errors);
+    }
+
+    if (errors)
+    {
+        state.skip_with_error("decoded bits differ from the encoded ones");
+        return;
+    }
+
+    state.set_frames_processed(1);
+    state.set_bytes_processed(bits / 8);
+    state.set_label(to_string(bits) + " bits in " + to_string(code_bits));
+}
+BENCHMARK(BM_CACData_decodeBit);
+
+// First stage of the multistage converters, the decimation (8, 16 or 64) selects the filter
+static void BM_DSDPCMFir_run(bench_state_t& state)
+{
+    DSDPCMFilterSetup setup;
+    DSDPCMFir fir;
+    vector<uint8_t> dsd = make_dsd(1, BENCH_FRAME_BYTES);
+    vector<double> pcm(BENCH_FRAME_BYTES);
+
+    switch (state.arg())
+    {
+        case 8:
+            fir.init(setup.get_fir1_8_ctables(), setup.get_fir1_8_length(), 8);
+            break;
+        case 16:
+            fir.init(setup.get_fir1_16_ctables(), setup.get_fir1_16_length(), 16);
+            break;
+        default:
+            fir.init(setup.get_fir1_64_ctables(), setup.get_fir1_64_length(), 64);
+            break;
+    }
+
+    while (state.keep_running())
+    {
+        fir.run(dsd.data(), pcm.data(), BENCH_FRAME_BYTES);
+        bench_clobber_memory();
+    }
+
+    state.set_frames_processed(1);
+    state.set_bytes_processed(BENCH_FRAME_BYTES);
+}
+BENCHMARK_ARG(BM_DSDPCMFir_run, 8);
+BENCHMARK_ARG(BM_DSDPCMFir_run, 16);
+BENCHMARK_ARG(BM_DSDPCMFir_run, 64);
+
+// Halfband stages of the multistage converters (2: fir2_2, 3: fir3_2) on the output of a 1/8 first stage
+static void BM_PCMPCMFir_run(bench_state_t& state)
+{
+    DSDPCMFilterSetup setup;
+    PCMPCMFir fir;
+    vector<double> in = make_bits(BENCH_FRAME_BYTES, 0);
+    vector<double> out(BENCH_FRAME_BYTES);
+
+    if (state.arg() == 2)
+    {
+        fir.init(setup.get_fir2_2_coefs(), setup.get_fir2_2_length(), 2);
+    }
+    else
+    {
+        fir.init(setup.get_fir3_2_coefs(), setup.get_fir3_2_length(), 2);
+    }
+
+    for (auto& x : in)
+    {
+        x *= 0.5;
+    }
+
+    while (state.keep_running())
+    {
+        fir.run(in.data(), out.data(), BENCH_FRAME_BYTES);
+        bench_clobber_memory();
+    }
+
+    state.set_frames_processed(1);
+    state.set_bytes_processed(BENCH_FRAME_BYTES * sizeof(double));
+}
+BENCHMARK_ARG(BM_PCMPCMFir_run, 2);
+BENCHMARK_ARG(BM_PCMPCMFir_run, 3);
+
+// The full length HQ prototype filter (DSD64 to 96 kHz), one output sample per call. A frame is the 1280 samples
+// of one channel at 96 kHz
+static void BM_FirFilter_fast_convolve(bench_state_t& state)
+{
+    const int taps = 2878 + 1;
+    const int outputs = 96000 / 75;
+    vector<double> impulse(taps);
+    vector<double> x = make_bits(outputs + taps, 8);
+
+    generateFilter(impulse.data(), taps, 350);
+
+    FirFilter fir(impulse.data(), taps);
+    double y = 0;
+
+    while (state.keep_running())
+    {
+        for (int i = 0; i < outputs; i++)
+        {
+            y += fir.fast_convolve(&x[i]);
+        }
+
+        bench_do_not_optimize(y);
+    }
+
+    state.set_frames_processed(1);
+    state.set_bytes_processed(outputs * sizeof(double));
+}
+BENCHMARK(BM_FirFilter_fast_convolve);
+
+// The HQ converter's resampler of one channel, DSD64 to 96 or 192 kHz
+static void BM_ResamplerNxMx_processSample(bench_state_t& state)
+{
+    const int divisor = state.arg() == 192 ? 2 : 1;
+    const int decimation = 147;
+    const int taps = 2878 * divisor + 1;
+    vector<double> impulse(taps);
+    vector<double> x = make_bits(BENCH_FRAME_BITS, 0);
+    double y[16];
+    unsigned int y_n;
+
+    generateFilter(impulse.data(), taps, 350 * divisor);
+
+    PolyphaseFilter filter(5 * divisor, impulse.data(), taps);
+    ResamplerNxMx resampler(decimation, &filter);
+
+    while (state.keep_running())
+    {
+        for (int i = 0; i + decimation <= BENCH_FRAME_BITS; i += decimation)
+        {
+            resampler.processSample(&x[i], decimation, y, &y_n);
+        }
+
+        bench_clobber_memory();
+    }
+
+    state.set_frames_processed(1);
+    state.set_bytes_processed(BENCH_FRAME_BYTES);
+}
+BENCHMARK_ARG(BM_ResamplerNxMx_processSample, 96);
+BENCHMARK_ARG(BM_ResamplerNxMx_processSample, 192);
+
+// Stereo DSF written once per process, removed at exit
+static string bench_dsf_path;
+
+static void remove_dsf()
+{
+    unlink(bench_dsf_path.c_str());
+}
+
+static const string& get_dsf_path()
+{
+    if (bench_dsf_path.empty())
+    {
+        const char* tmpdir = getenv("TMPDIR");
+        string path = string(tmpdir ? tmpdir : "/tmp") + "/sacd_bench_XXXXXX";
+        vector<char> name(path.begin(), path.end());
+        name.push_back(0);
+
+        int fd = mkstemp(name.data());
+
+        if (fd < 0)
+        {
+            return bench_dsf_path;
+        }
+
+        close(fd);
+
+        dsd_writer_t writer(DSD_CONTAINER_DSF);
+        vector<uint8_t> dsd = make_dsd(2, BENCH_FRAME_BYTES * 75 * BENCH_SECONDS);
+
+        if (writer.open(name.data(), 2, BENCH_DSD_SAMPLERATE, 0) && writer.write(dsd.data(), BENCH_FRAME_BYTES * 75 * BENCH_SECONDS) && writer.close())
+        {
+            bench_dsf_path = name.data();
+            atexit(remove_dsf);
+        }
+        else
+        {
+            unlink(name.data());
+        }
+    }
+
+    return bench_dsf_path;
+}
+
+// Reading a stereo DSF frame by frame, interleaved, back to the start at the end of the file. The argument is the
+// media access mode (0 buffered, 1 direct, 2 mmap, 3 stream cannot rewind)
+static void BM_sacd_dsf_t_read_frame(bench_state_t& state)
+{
+    const string& path = get_dsf_path();
+
+    if (path.empty())
+    {
+        state.skip_with_error("cannot write a DSF file");
+        return;
+    }
+
+    sacd_media_t* media = sacd_media_t::create((media_access_t)state.arg());
+    sacd_dsf_t* reader = new sacd_dsf_t;
+    vector<uint8_t> frame(BENCH_FRAME_BYTES * 2);
+    size_t size;
+    frame_type_e type;
+
+    if (!media->open(path.c_str()) || reader->open(media) == 0)
+    {
+        state.skip_with_error("cannot open " + path);
+        delete reader;
+        delete media;
+        return;
+    }
+
+    reader->set_track(0);
+
+    while (state.keep_running())
+    {
+        size = frame.size();
+
+        if (!reader->read_frame(frame.data(), &size, &type) || size < frame.size())
+        {
+            state.pause_timing();
+            reader->set_track(0);
+            state.resume_timing();
+        }
+    }
+
+    reader->close();
+    media->close();
+    delete reader;
+    delete media;
+
+    state.set_frames_processed(1);
+    state.set_bytes_processed(frame.size());
+}
+BENCHMARK_ARG(BM_sacd_dsf_t_read_frame, 0);
+BENCHMARK_ARG(BM_sacd_dsf_t_read_frame, 1);
+BENCHMARK_ARG(BM_sacd_dsf_t_read_frame, 2);
+
+// SACD::writeData() lives in main.cpp, its work is the pcm_writer_t::write() call it makes for every converted frame.
+// Stereo 88.2 kHz to /dev/null, the argument is the pcm_format_t (WAV) or 5 for FLAC at 24 bits. A frame is 1/75 s of
+// both channels
+static void BM_SACD_writeData(bench_state_t& state)
+{
+    static const char* names[] = {"s16 wav", "s24 wav", "s32 wav", "f32 wav", "f64 wav", "s24 flac"};
+    const int samples = 88200 / 75;
+    bool flac = state.arg() == 5;
+    pcm_writer_t* writer = pcm_writer_t::create(flac ? PCM_S24 : (pcm_format_t)state.arg(), flac ? CONTAINER_FLAC : CONTAINER_WAV);
+    vector<float> pcm(samples * 2);
+    int fd = open("/dev/null", O_WRONLY);
+
+    for (int i = 0; i < samples; i++)
+    {
+        pcm[2 * i] = 0.5f * (float)((i * 7919) % 2000 - 1000) / 1000.0f;
+        pcm[2 * i + 1] = -pcm[2 * i] * 0.75f;
+    }
+
+    if (fd < 0 || !writer->open_fd(fd, 2, 88200, 3))
+    {
+        state.skip_with_error("cannot open /dev/null");
+        delete writer;
+
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+
+        return;
+    }
+
+    while (state.keep_running())
+    {
+        writer->write(pcm.data(), samples);
+    }
+
+    writer->close();
+    delete writer;
+    close(fd);
+
+    state.set_frames_processed(1);
+    state.set_bytes_processed(pcm.size() * sizeof(float));
+    state.set_label(names[state.arg()]);
+}
+BENCHMARK_ARG(BM_SACD_writeData, 0);
+BENCHMARK_ARG(BM_SACD_writeData, 1);
+BENCHMARK_ARG(BM_SACD_writeData, 3);
+BENCHMARK_ARG(BM_SACD_writeData, 5);
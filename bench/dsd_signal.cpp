@@ -0,0 +1,83 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#include <math.h>
+#include <string.h>
+#include "dsd_signal.h"
+
+#define SDM_ORDER 5
+
+// Error feedback loop filter, noise transfer function zeros at DC and poles that keep the modulator stable up to
+// about -6 dB
+static const double SDM_A[SDM_ORDER + 1] = {1.0, -4.192282151138504, 7.085791415708283, -6.029607383511101, 2.581207938963348, -0.4444444440120955};
+static const double SDM_B[SDM_ORDER + 1] = {1.0, -5.0, 10.0, -10.0, 5.0, -1.0};
+
+dsd_signal_t::dsd_signal_t(int channels, int samplerate, uint32_t seed)
+{
+    m_channels = channels;
+    m_samplerate = samplerate;
+    m_seed = seed;
+    m_position = 0;
+    m_error.assign(channels * (SDM_ORDER + 1), 0.0);
+    m_feedback.assign(channels * (SDM_ORDER + 1), 0.0);
+}
+
+void dsd_signal_t::generate(uint8_t* dsd_data, int samples)
+{
+    memset(dsd_data, 0, (size_t)samples * m_channels);
+
+    for (int i = 0; i < samples * 8; i++, m_position++)
+    {
+        double t = (double)m_position / m_samplerate;
+
+        for (int ch = 0; ch < m_channels; ch++)
+        {
+            double* e = &m_error[ch * (SDM_ORDER + 1)];
+            double* g = &m_feedback[ch * (SDM_ORDER + 1)];
+            double x = 0.25 * sin(2 * M_PI * 440 * (ch + 1) * t) + 0.15 * sin(2 * M_PI * 3150.7 * t + ch);
+
+            m_seed = m_seed * 1103515245 + 12345;
+            x += ((m_seed >> 8) / 16777216.0 - 0.5) * 1e-4;
+
+            double gn = 0;
+
+            for (int k = 1; k <= SDM_ORDER; k++)
+            {
+                gn += (SDM_B[k] - SDM_A[k]) * e[k] - SDM_A[k] * g[k];
+            }
+
+            double u = x + gn;
+            double y = u >= 0 ? 1 : -1;
+
+            for (int k = SDM_ORDER; k > 1; k--)
+            {
+                e[k] = e[k - 1];
+                g[k] = g[k - 1];
+            }
+
+            e[1] = y - u;
+            g[1] = gn;
+
+            if (y > 0)
+            {
+                dsd_data[(i >> 3) * m_channels + ch] |= 0x80 >> (i & 7);
+            }
+        }
+    }
+}
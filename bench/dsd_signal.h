@@ -0,0 +1,46 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#ifndef _DSD_SIGNAL_H_INCLUDED
+#define _DSD_SIGNAL_H_INCLUDED
+
+#include <stdint.h>
+#include <vector>
+
+using namespace std;
+
+// Synthetic DSD with the statistics of real recordings, so that nothing copyrighted has to be shipped to measure or
+// test the decoders: two tones per channel (a different pitch in every channel) and a little noise through a 5th order
+// sigma-delta modulator. The output depends on nothing but the arguments, every run produces the same bits.
+class dsd_signal_t
+{
+    int m_channels;
+    int m_samplerate;
+    uint32_t m_seed;
+    uint64_t m_position;
+    vector<double> m_error; // [channel][order + 1], most recent first
+    vector<double> m_feedback;
+public:
+    dsd_signal_t(int channels, int samplerate, uint32_t seed = 1);
+
+    // The next 'samples' bytes of every channel, interleaved byte by byte and MSB first (as in DSDIFF)
+    void generate(uint8_t* dsd_data, int samples);
+};
+
+#endif
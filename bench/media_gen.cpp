@@ -0,0 +1,588 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "endianess.h"
+#include "scarletbook.h"
+#include "dsd_writer.h"
+#include "dst_encoder_mt.h"
+#include "dsd_signal.h"
+#include "media_gen.h"
+
+#define AREA_TOC_SIZE 4 // Area TOC, SACDTTxt, SACDTRL1, SACDTRL2
+#define MAX_PACKET_LENGTH 2047
+#define MAX_SECTOR_PACKETS 7
+#define MAX_SECTOR_FRAMES 7
+
+static unsigned int get_channel_map(int channels)
+{
+    static const unsigned int channel_maps[] = {0, 1<<2, 1<<0 | 1<<1, 1<<0 | 1<<1 | 1<<2, 1<<0 | 1<<1 | 1<<4 | 1<<5, 1<<0 | 1<<1 | 1<<2 | 1<<4 | 1<<5, 1<<0 | 1<<1 | 1<<2 | 1<<3 | 1<<4 | 1<<5};
+
+    return channel_maps[channels];
+}
+
+static int get_cpu_count()
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return cpus > 1 ? (int)cpus : 1;
+}
+
+// The frames of the synthetic signal one after the other, plain or DST encoded on all CPUs
+class frame_source_t
+{
+    dsd_signal_t m_signal;
+    dst_encoder_t* m_encoder;
+    vector<uint8_t> m_dsd;
+    int m_samples;
+    int m_frames_left;
+    int m_flushes;
+    bool m_error;
+public:
+    frame_source_t(int channels, int samplerate, int frames, bool dst, int effort) : m_signal(channels, samplerate)
+    {
+        m_samples = samplerate / 8 / 75;
+        m_dsd.resize((size_t)m_samples * channels);
+        m_frames_left = frames;
+        m_flushes = 0;
+        m_encoder = nullptr;
+        m_error = false;
+
+        if (dst)
+        {
+            m_encoder = new dst_encoder_t(get_cpu_count());
+
+            if (m_encoder->init(channels, samplerate, 75, effort) != 0)
+            {
+                delete m_encoder;
+                m_encoder = nullptr;
+                m_frames_left = 0;
+                m_error = true;
+            }
+        }
+    }
+
+    ~frame_source_t()
+    {
+        delete m_encoder;
+    }
+
+    bool failed()
+    {
+        return m_error;
+    }
+
+    // The next frame, false after the last one
+    bool next(const uint8_t** frame_data, size_t* frame_size)
+    {
+        uint8_t* dst_data;
+        size_t dst_size;
+
+        for (;;)
+        {
+            if (m_frames_left > 0)
+            {
+                m_signal.generate(m_dsd.data(), m_samples);
+                m_frames_left--;
+
+                if (!m_encoder)
+                {
+                    *frame_data = m_dsd.data();
+                    *frame_size = m_dsd.size();
+                    return true;
+                }
+
+                m_encoder->encode(m_dsd.data(), m_dsd.size(), &dst_data, &dst_size);
+            }
+            else if (m_encoder && m_flushes < m_encoder->get_thread_count())
+            {
+                m_encoder->encode(nullptr, 0, &dst_data, &dst_size);
+                m_flushes++;
+            }
+            else
+            {
+                return false;
+            }
+
+            if (dst_size > 0)
+            {
+                *frame_data = dst_data;
+                *frame_size = dst_size;
+                return true;
+            }
+        }
+    }
+};
+
+static int get_track_frames(const media_spec_t& spec)
+{
+    int frames = (int)(spec.seconds * 75 + 0.5);
+
+    return frames > 0 ? frames : 1;
+}
+
+static bool generate_dsd_file(const string& path, const media_spec_t& spec)
+{
+    dsd_writer_t writer(spec.format == MEDIA_DSF ? DSD_CONTAINER_DSF : spec.dst ? DSD_CONTAINER_DST : DSD_CONTAINER_DFF);
+    int track_frames = get_track_frames(spec);
+    int frame_samples = spec.samplerate / 8 / 75;
+    frame_source_t source(spec.channels, spec.samplerate, track_frames * spec.tracks, spec.dst, spec.effort);
+    const uint8_t* frame_data;
+    size_t frame_size;
+
+    if (source.failed() || !writer.open(path, spec.channels, spec.samplerate, get_channel_map(spec.channels)))
+    {
+        return false;
+    }
+
+    for (int i = 0; spec.format == MEDIA_DFF && spec.tracks > 1 && i < spec.tracks; i++)
+    {
+        writer.add_marker((uint64_t)i * track_frames * frame_samples * 8);
+    }
+
+    while (source.next(&frame_data, &frame_size) && !writer.failed())
+    {
+        if (spec.dst)
+        {
+            writer.write_frame(frame_data, frame_size);
+        }
+        else
+        {
+            writer.write(frame_data, frame_samples);
+        }
+    }
+
+    return writer.close();
+}
+
+// Disc image
+
+static void set_time(uint8_t* msf, int frames)
+{
+    msf[0] = (uint8_t)(frames / 75 / 60);
+    msf[1] = (uint8_t)(frames / 75 % 60);
+    msf[2] = (uint8_t)(frames % 75);
+}
+
+// Packs the frames of an area into audio sectors. A frame takes the rest of the current sector and as many more as it
+// needs, with a packet per sector and a frame info in the sector it starts in. flush() ends the sector early (tracks
+// start in a new sector).
+class sector_writer_t
+{
+    FILE* m_file;
+    bool m_dst;
+    int m_channels;
+    uint32_t m_sectors;
+    audio_sector_t m_sector;
+    int m_packets;
+    int m_frames;
+    vector<uint8_t> m_payload;
+    bool m_error;
+
+    size_t header_size()
+    {
+        return AUDIO_SECTOR_HEADER_SIZE + m_packets * AUDIO_PACKET_INFO_SIZE + m_frames * frame_info_size();
+    }
+
+    size_t frame_info_size()
+    {
+        return m_dst ? AUDIO_FRAME_INFO_SIZE : AUDIO_FRAME_INFO_SIZE - 1;
+    }
+
+public:
+    sector_writer_t(FILE* file, bool dst, int channels)
+    {
+        m_file = file;
+        m_dst = dst;
+        m_channels = channels;
+        m_sectors = 0;
+        m_packets = 0;
+        m_frames = 0;
+        m_error = false;
+        memset(&m_sector, 0, sizeof(m_sector));
+    }
+
+    uint32_t get_sector_count()
+    {
+        return m_sectors;
+    }
+
+    bool failed()
+    {
+        return m_error;
+    }
+
+    void add_frame(const uint8_t* frame_data, size_t frame_size, int frame_nr)
+    {
+        size_t pos = 0;
+
+        while (pos < frame_size)
+        {
+            bool start = pos == 0;
+            size_t cost = AUDIO_PACKET_INFO_SIZE + (start ? frame_info_size() : 0);
+
+            if (m_packets == MAX_SECTOR_PACKETS || (start && m_frames == MAX_SECTOR_FRAMES) || header_size() + m_payload.size() + cost >= SACD_LSN_SIZE)
+            {
+                flush();
+                continue;
+            }
+
+            size_t length = SACD_LSN_SIZE - header_size() - m_payload.size() - cost;
+            length = length < frame_size - pos ? length : frame_size - pos;
+            length = length < MAX_PACKET_LENGTH ? length : MAX_PACKET_LENGTH;
+
+            audio_packet_info_t& packet = m_sector.packet[m_packets++];
+            packet.frame_start = start ? 1 : 0;
+            packet.data_type = DATA_TYPE_AUDIO;
+            packet.packet_length = (uint16_t)length;
+
+            if (start)
+            {
+                audio_frame_info_t& frame = m_sector.frame[m_frames++];
+                set_time(&frame.timecode.minutes, frame_nr);
+
+                if (m_dst)
+                {
+                    // Sectors the frame has data in: this one, then one packet of SACD_LSN_SIZE - 3 bytes per sector
+                    size_t rest = frame_size - length;
+                    size_t full = SACD_LSN_SIZE - AUDIO_SECTOR_HEADER_SIZE - AUDIO_PACKET_INFO_SIZE;
+                    frame.sector_count = (uint8_t)(1 + (rest + full - 1) / full);
+                    frame.channel_bit_1 = 0;
+                    frame.channel_bit_2 = m_channels == 6 ? 1 : 0;
+                    frame.channel_bit_3 = m_channels == 5 ? 1 : 0;
+                }
+            }
+
+            m_payload.insert(m_payload.end(), frame_data + pos, frame_data + pos + length);
+            pos += length;
+        }
+    }
+
+    void flush()
+    {
+        if (m_packets == 0)
+        {
+            return;
+        }
+
+        uint8_t data[SACD_LSN_SIZE];
+        size_t offset = 0;
+
+        memset(data, 0, sizeof(data));
+        m_sector.header.dst_encoded = m_dst ? 1 : 0;
+        m_sector.header.frame_info_count = m_frames;
+        m_sector.header.packet_info_count = m_packets;
+        memcpy(data, &m_sector.header, AUDIO_SECTOR_HEADER_SIZE);
+        offset += AUDIO_SECTOR_HEADER_SIZE;
+
+        // Packet infos are big endian bit fields, the reader takes them apart by hand
+        for (int i = 0; i < m_packets; i++)
+        {
+            data[offset++] = (uint8_t)(m_sector.packet[i].frame_start << 7 | m_sector.packet[i].data_type << 3 | m_sector.packet[i].packet_length >> 8);
+            data[offset++] = (uint8_t)(m_sector.packet[i].packet_length & 0xff);
+        }
+
+        for (int i = 0; i < m_frames; i++)
+        {
+            memcpy(data + offset, &m_sector.frame[i], frame_info_size());
+            offset += frame_info_size();
+        }
+
+        memcpy(data + offset, m_payload.data(), m_payload.size());
+        write_sector(data);
+
+        memset(&m_sector, 0, sizeof(m_sector));
+        m_payload.clear();
+        m_packets = 0;
+        m_frames = 0;
+    }
+
+    // A sector with nothing but a padding packet
+    void pad()
+    {
+        uint8_t data[SACD_LSN_SIZE];
+
+        flush();
+        memset(data, 0, sizeof(data));
+        m_sector.header.packet_info_count = 1;
+        memcpy(data, &m_sector.header, AUDIO_SECTOR_HEADER_SIZE);
+        data[1] = (uint8_t)(DATA_TYPE_PADDING << 3 | (SACD_LSN_SIZE - 3) >> 8);
+        data[2] = (uint8_t)((SACD_LSN_SIZE - 3) & 0xff);
+        write_sector(data);
+        memset(&m_sector, 0, sizeof(m_sector));
+    }
+
+    void write_sector(const uint8_t* data)
+    {
+        if (fwrite(data, 1, SACD_LSN_SIZE, m_file) != SACD_LSN_SIZE)
+        {
+            m_error = true;
+        }
+
+        m_sectors++;
+    }
+};
+
+struct area_layout_t
+{
+    int channels;
+    uint32_t toc_start; // first copy, the second one follows the audio
+    uint32_t track_start[255];
+    uint32_t track_length[255];
+    uint32_t audio_start;
+    uint32_t audio_end; // last sector, a padding sector
+};
+
+static bool write_at(FILE* file, uint32_t lsn, const uint8_t* data, size_t sectors)
+{
+    return fseeko(file, (off_t)lsn * SACD_LSN_SIZE, SEEK_SET) == 0 && fwrite(data, SACD_LSN_SIZE, sectors, file) == sectors;
+}
+
+static void put_text(uint8_t* sector, size_t& offset, uint8_t type, const string& text)
+{
+    sector[offset++] = type;
+    sector[offset++] = 0x20;
+    memcpy(sector + offset, text.c_str(), text.size() + 1);
+    offset = (offset + text.size() + 1 + 3) & ~3;
+}
+
+// Area TOC with the track text and both track lists
+static void make_area_toc(uint8_t* data, const media_spec_t& spec, const area_layout_t& area)
+{
+    int track_frames = get_track_frames(spec);
+    area_toc_t* toc = (area_toc_t*)data;
+
+    memset(data, 0, AREA_TOC_SIZE * SACD_LSN_SIZE);
+    memcpy(toc->id, area.channels == 2 ? "TWOCHTOC" : "MULCHTOC", 8);
+    toc->version.major = SUPPORTED_VERSION_MAJOR;
+    toc->version.minor = SUPPORTED_VERSION_MINOR;
+    toc->size = hton16(AREA_TOC_SIZE);
+    toc->max_byte_rate = hton32((uint32_t)(SACD_SAMPLING_FREQUENCY / 8 * area.channels));
+    toc->sample_frequency = 4;
+    toc->frame_format = spec.dst ? FRAME_FORMAT_DST : FRAME_FORMAT_DSD_3_IN_14;
+    toc->channel_count = area.channels;
+    toc->loudspeaker_config = area.channels == 2 ? 0 : area.channels == 5 ? 3 : 4;
+    toc->max_available_channels = area.channels;
+    set_time(&toc->total_playtime.minutes, track_frames * spec.tracks);
+    toc->track_offset = 0;
+    toc->track_count = spec.tracks;
+    toc->track_start = hton32(area.audio_start);
+    toc->track_end = hton32(area.audio_end);
+    toc->text_area_count = 1;
+    memcpy(toc->languages[0].language_code, "en", 2);
+    toc->languages[0].character_set = CHAR_SET_ISO646;
+    toc->track_text_offset = hton16(1);
+
+    uint8_t* text = data + SACD_LSN_SIZE;
+    size_t offset = (8 + 2 * spec.tracks + 3) & ~3;
+    char title[32];
+
+    memcpy(text, "SACDTTxt", 8);
+
+    for (int i = 0; i < spec.tracks; i++)
+    {
+        uint16_t position = hton16((uint16_t)offset);
+
+        memcpy(text + 8 + 2 * i, &position, 2);
+        text[offset] = 2;
+        offset += 4;
+        snprintf(title, sizeof(title), "Track %.2i", i + 1);
+        put_text(text, offset, TRACK_TYPE_TITLE, title);
+        put_text(text, offset, TRACK_TYPE_PERFORMER, "Synthetic");
+    }
+
+    area_tracklist_offset_t* trl1 = (area_tracklist_offset_t*)(data + 2 * SACD_LSN_SIZE);
+    area_tracklist_time_t* trl2 = (area_tracklist_time_t*)(data + 3 * SACD_LSN_SIZE);
+
+    memcpy(trl1->id, "SACDTRL1", 8);
+    memcpy(trl2->id, "SACDTRL2", 8);
+
+    for (int i = 0; i < spec.tracks; i++)
+    {
+        trl1->track_start_lsn[i] = hton32(area.track_start[i]);
+        trl1->track_length_lsn[i] = hton32(area.track_length[i]);
+        set_time(&trl2->start[i].minutes, track_frames * i);
+        set_time(&trl2->duration[i].minutes, track_frames);
+    }
+}
+
+static void make_master_toc(uint8_t* data, area_layout_t* areas, int area_count)
+{
+    static const char* title = "Synthetic SACD";
+    master_toc_t* toc = (master_toc_t*)data;
+
+    memset(data, 0, MASTER_TOC_LEN * SACD_LSN_SIZE);
+    memcpy(toc->id, "SACDMTOC", 8);
+    toc->version.major = SUPPORTED_VERSION_MAJOR;
+    toc->version.minor = SUPPORTED_VERSION_MINOR;
+    toc->album_set_size = hton16(1);
+    toc->album_sequence_number = hton16(1);
+    toc->area_1_toc_1_start = hton32(areas[0].toc_start);
+    toc->area_1_toc_2_start = hton32(areas[0].audio_end + 1);
+    toc->area_1_toc_size = hton16(AREA_TOC_SIZE);
+
+    if (area_count > 1)
+    {
+        toc->area_2_toc_1_start = hton32(areas[1].toc_start);
+        toc->area_2_toc_2_start = hton32(areas[1].audio_end + 1);
+        toc->area_2_toc_size = hton16(AREA_TOC_SIZE);
+    }
+
+    toc->disc_date_year = hton16(2000);
+    toc->disc_date_month = 1;
+    toc->disc_date_day = 1;
+    toc->text_area_count = 1;
+    memcpy(toc->locales[0].language_code, "en", 2);
+    toc->locales[0].character_set = CHAR_SET_ISO646;
+
+    // Every text channel has its sector, only the first one holds text
+    for (int i = 0; i < MAX_LANGUAGE_COUNT; i++)
+    {
+        master_sacd_text_t* text = (master_sacd_text_t*)(data + (1 + i) * SACD_LSN_SIZE);
+
+        memcpy(text->id, "SACDText", 8);
+
+        if (i == 0)
+        {
+            uint16_t position = (uint16_t)((uint8_t*)text->data - (uint8_t*)text);
+
+            strcpy((char*)text->data, title);
+            text->album_title_position = hton16(position);
+            text->disc_title_position = hton16(position);
+        }
+    }
+
+    memcpy(data + (1 + MAX_LANGUAGE_COUNT) * SACD_LSN_SIZE, "SACD_Man", 8);
+}
+
+// File system area, master TOC, then per area its TOC, the audio of all tracks, a padding sector and the second copy
+// of the TOC. The TOCs are written once the layout of the audio is known.
+static bool generate_iso(const string& path, const media_spec_t& spec)
+{
+    area_layout_t areas[2];
+    int area_count = spec.channels == 2 ? 1 : 2;
+    int track_frames = get_track_frames(spec);
+    vector<uint8_t> zero(SACD_LSN_SIZE * START_OF_MASTER_TOC, 0);
+    vector<uint8_t> master(MASTER_TOC_LEN * SACD_LSN_SIZE);
+    vector<uint8_t> area_toc(AREA_TOC_SIZE * SACD_LSN_SIZE);
+    FILE* file = fopen(path.c_str(), "wb");
+    bool ok = file != nullptr;
+    uint32_t lsn = START_OF_MASTER_TOC + MASTER_TOC_LEN;
+
+    if (!ok)
+    {
+        return false;
+    }
+
+    ok = write_at(file, 0, zero.data(), START_OF_MASTER_TOC);
+
+    for (int a = 0; a < area_count && ok; a++)
+    {
+        area_layout_t& area = areas[a];
+        const uint8_t* frame_data;
+        size_t frame_size;
+        int frame_nr = 0;
+
+        area.channels = a == 0 ? 2 : spec.channels;
+        area.toc_start = lsn;
+        area.audio_start = lsn + AREA_TOC_SIZE;
+
+        frame_source_t source(area.channels, SACD_SAMPLING_FREQUENCY, track_frames * spec.tracks, spec.dst, spec.effort);
+        sector_writer_t sectors(file, spec.dst, area.channels);
+
+        ok = !source.failed() && fseeko(file, (off_t)area.audio_start * SACD_LSN_SIZE, SEEK_SET) == 0;
+
+        while (ok && source.next(&frame_data, &frame_size))
+        {
+            if (frame_nr % track_frames == 0)
+            {
+                sectors.flush();
+                area.track_start[frame_nr / track_frames] = area.audio_start + sectors.get_sector_count();
+            }
+
+            sectors.add_frame(frame_data, frame_size, frame_nr);
+            frame_nr++;
+        }
+
+        sectors.pad();
+        ok = ok && !sectors.failed();
+        area.audio_end = area.audio_start + sectors.get_sector_count() - 1;
+
+        for (int i = 0; i < spec.tracks; i++)
+        {
+            area.track_length[i] = (i + 1 < spec.tracks ? area.track_start[i + 1] : area.audio_end) - area.track_start[i];
+        }
+
+        make_area_toc(area_toc.data(), spec, area);
+        ok = ok && write_at(file, area.toc_start, area_toc.data(), AREA_TOC_SIZE) && write_at(file, area.audio_end + 1, area_toc.data(), AREA_TOC_SIZE);
+        lsn = area.audio_end + 1 + AREA_TOC_SIZE;
+    }
+
+    if (ok)
+    {
+        make_master_toc(master.data(), areas, area_count);
+        ok = write_at(file, START_OF_MASTER_TOC, master.data(), MASTER_TOC_LEN);
+    }
+
+    return fclose(file) == 0 && ok;
+}
+
+bool media_generate(const string& path, const media_spec_t& spec)
+{
+    if (spec.channels < 1 || spec.channels > 6 || spec.tracks < 1 || spec.tracks > 255 || spec.seconds <= 0)
+    {
+        return false;
+    }
+
+    if (spec.samplerate != 44100 * 64 && spec.samplerate != 44100 * 128 && spec.samplerate != 44100 * 256)
+    {
+        return false;
+    }
+
+    switch (spec.format)
+    {
+        case MEDIA_ISO:
+            if (spec.samplerate != SACD_SAMPLING_FREQUENCY || (spec.channels != 2 && spec.channels != 5 && spec.channels != 6))
+            {
+                return false;
+            }
+
+            return generate_iso(path, spec);
+        case MEDIA_DSF:
+            return !spec.dst && generate_dsd_file(path, spec);
+        case MEDIA_DFF:
+            return generate_dsd_file(path, spec);
+    }
+
+    return false;
+}
+
+string media_describe(const media_spec_t& spec)
+{
+    static const char* formats[] = {"iso", "dsf", "dff"};
+    string channels = spec.format == MEDIA_ISO && spec.channels != 2 ? "2+" + to_string(spec.channels) : to_string(spec.channels);
+    char length[32];
+
+    snprintf(length, sizeof(length), "%ix%gs", spec.tracks, spec.seconds);
+
+    return string(formats[spec.format]) + " " + channels + "ch " + (spec.dst ? "dst " : "dsd ") + to_string(spec.samplerate / 44100) + "fs " + length;
+}
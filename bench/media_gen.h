@@ -0,0 +1,62 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#ifndef _MEDIA_GEN_H_INCLUDED
+#define _MEDIA_GEN_H_INCLUDED
+
+#include <stdint.h>
+#include <string>
+
+using namespace std;
+
+enum media_format_t {MEDIA_ISO = 0, MEDIA_DSF = 1, MEDIA_DFF = 2};
+
+// What to generate. Disc images always have a stereo area, 5 or 6 channels add a multichannel area next to it, as on a
+// hybrid disc. Their rate is DSD64, DST encoding applies to every area. DSF has no tracks and no DST, the tracks of a
+// DSDIFF file are markers in a DIIN chunk, DST DSDIFF gets a DSTI index.
+struct media_spec_t
+{
+    media_format_t format;
+    int channels;
+    int samplerate; // DSD samplerate in Hz
+    double seconds; // length of every track
+    int tracks;
+    bool dst;
+    int effort; // DST encoder effort
+
+    media_spec_t()
+    {
+        format = MEDIA_DSF;
+        channels = 2;
+        samplerate = 44100 * 64;
+        seconds = 10;
+        tracks = 1;
+        dst = false;
+        effort = 1;
+    }
+};
+
+// Writes synthetic media (see dsd_signal_t) in the format of the spec to path. Every call with the same spec writes
+// the same bytes. Returns false if the spec is not possible or the file cannot be written
+bool media_generate(const string& path, const media_spec_t& spec);
+
+// Short description of a spec, e.g. "iso 2+6ch dst 64fs 3x10s"
+string media_describe(const media_spec_t& spec);
+
+#endif
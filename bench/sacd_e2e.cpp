@@ -0,0 +1,559 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+#include "sacd_media.h"
+#include "sacd_disc.h"
+#include "sacd_dsdiff.h"
+#include "sacd_dsf.h"
+#include "dst_decoder.h"
+#include "dst_encoder.h"
+#include "dsd_pcm_converter_engine.h"
+#include "dsd_pcm_converter_hq.h"
+#include "pcm_writer.h"
+#include "dsd_writer.h"
+#include "media_gen.h"
+
+using namespace std;
+
+// End to end runs: every configuration converts a generated input to a real output file, in a process of its own so
+// that the peak RSS is its alone. The stages (reading, DST decoding, DSD to PCM, DST encoding, writing) run one after
+// the other on one thread, the CPU time between them (including the converter's worker threads) is the stage's.
+
+enum stage_t {STAGE_READ, STAGE_DST_DECODE, STAGE_CONVERT, STAGE_DST_ENCODE, STAGE_WRITE, STAGE_COUNT};
+
+static const char* stage_names[STAGE_COUNT] = {"read", "dst", "convert", "encode", "write"};
+
+struct e2e_config_t
+{
+    media_format_t format;
+    int channels;
+    int fs44;
+    bool dst;
+    int pcm_samplerate; // 0: DSD output
+    pcm_format_t pcm_format;
+    pcm_container_t pcm_container;
+    dsd_container_t dsd_container;
+};
+
+static const e2e_config_t e2e_configs[] =
+{
+    {MEDIA_ISO, 2, 64, false, 88200, PCM_S24, CONTAINER_WAV, DSD_CONTAINER_DSF},
+    {MEDIA_ISO, 2, 64, true, 88200, PCM_S24, CONTAINER_WAV, DSD_CONTAINER_DSF},
+    {MEDIA_ISO, 6, 64, true, 88200, PCM_S24, CONTAINER_WAV, DSD_CONTAINER_DSF},
+    {MEDIA_ISO, 2, 64, true, 96000, PCM_S24, CONTAINER_WAV, DSD_CONTAINER_DSF},
+    {MEDIA_ISO, 2, 64, true, 176400, PCM_S24, CONTAINER_FLAC, DSD_CONTAINER_DSF},
+    {MEDIA_ISO, 6, 64, true, 0, PCM_S24, CONTAINER_WAV, DSD_CONTAINER_DSF},
+    {MEDIA_ISO, 2, 64, true, 0, PCM_S24, CONTAINER_WAV, DSD_CONTAINER_DST},
+    {MEDIA_DSF, 2, 64, false, 88200, PCM_S24, CONTAINER_WAV, DSD_CONTAINER_DSF},
+    {MEDIA_DSF, 2, 128, false, 176400, PCM_F32, CONTAINER_WAV, DSD_CONTAINER_DSF},
+    {MEDIA_DSF, 2, 256, false, 192000, PCM_S24, CONTAINER_WAV, DSD_CONTAINER_DSF},
+    {MEDIA_DFF, 6, 64, true, 88200, PCM_S16, CONTAINER_FLAC, DSD_CONTAINER_DSF},
+    {MEDIA_DFF, 2, 64, false, 0, PCM_S24, CONTAINER_WAV, DSD_CONTAINER_DST},
+};
+
+#define E2E_CONFIG_COUNT (int)(sizeof(e2e_configs) / sizeof(e2e_configs[0]))
+
+struct e2e_result_t
+{
+    double audio_seconds;
+    double wall_seconds;
+    double stage_seconds[STAGE_COUNT];
+};
+
+static double wall_clock()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double cpu_clock()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static media_spec_t get_input_spec(const e2e_config_t& config, double seconds)
+{
+    media_spec_t spec;
+
+    spec.format = config.format;
+    spec.channels = config.channels;
+    spec.samplerate = 44100 * config.fs44;
+    spec.seconds = seconds;
+    spec.dst = config.dst;
+
+    return spec;
+}
+
+static string describe_output(const e2e_config_t& config)
+{
+    static const char* pcm_formats[] = {"s16", "s24", "s32", "f32", "f64"};
+    static const char* pcm_containers[] = {"wav", "raw", "flac"};
+    static const char* dsd_containers[] = {"dsf", "dff", "dst"};
+
+    if (config.pcm_samplerate == 0)
+    {
+        return dsd_containers[config.dsd_container];
+    }
+
+    return to_string(config.pcm_samplerate) + " " + pcm_formats[config.pcm_format] + " " + pcm_containers[config.pcm_container];
+}
+
+// Stage clock: charge the CPU time since the last call to a stage
+class stage_clock_t
+{
+    double m_last;
+    double* m_seconds;
+public:
+    stage_clock_t(double* seconds)
+    {
+        m_seconds = seconds;
+        m_last = cpu_clock();
+    }
+
+    void charge(stage_t stage)
+    {
+        double now = cpu_clock();
+
+        m_seconds[stage] += now - m_last;
+        m_last = now;
+    }
+};
+
+// The conversion of one configuration, in the child process
+static bool run_config(const e2e_config_t& config, const string& input, const string& output, e2e_result_t& result)
+{
+    sacd_media_t* media = sacd_media_t::create(ACCESS_BUFFERED);
+    sacd_reader_t* reader = config.format == MEDIA_ISO ? (sacd_reader_t*)new sacd_disc_t : config.format == MEDIA_DFF ? (sacd_reader_t*)new sacd_dsdiff_t : (sacd_reader_t*)new sacd_dsf_t;
+    area_id_e area = config.channels == 2 ? AREA_TWOCH : AREA_MULCH;
+
+    memset(&result, 0, sizeof(result));
+
+    if (!media->open(input.c_str()) || reader->open(media) == 0)
+    {
+        printf("PANIC: Failed to open %s\n", input.c_str());
+        return false;
+    }
+
+    reader->set_track(0, area, 0, reader->get_track_count(area));
+
+    int channels = reader->get_channels();
+    int samplerate = reader->get_samplerate();
+    int frame_samples = samplerate / 8 / 75;
+    int frame_size = frame_samples * channels;
+    bool pcm = config.pcm_samplerate != 0;
+    bool planar = pcm && reader->set_planar(true);
+    unsigned int channel_map = channels == 2 ? 1<<0 | 1<<1 : 1<<0 | 1<<1 | 1<<2 | 1<<3 | 1<<4 | 1<<5;
+    int pcm_samples = config.pcm_samplerate / 75;
+    vector<uint8_t> frame(frame_size + 1);
+    vector<uint8_t> dsd(frame_size);
+    vector<uint8_t> dst(frame_size + 1);
+    vector<float> pcm_data((size_t)pcm_samples * channels);
+    CDSTDecoder* decoder = nullptr;
+    CDSTEncoder* encoder = nullptr;
+    DSDPCMConverterEngine* converter = nullptr;
+    dsdpcm_converter_hq* converter_hq = nullptr;
+    pcm_writer_t* pcm_writer = nullptr;
+    dsd_writer_t* dsd_writer = nullptr;
+    bool ok = true;
+
+    if (pcm)
+    {
+        if (config.pcm_samplerate == 96000 || config.pcm_samplerate == 192000)
+        {
+            converter_hq = new dsdpcm_converter_hq;
+            ok = converter_hq->init(channels, samplerate, config.pcm_samplerate) == 0;
+            converter_hq->set_planar(planar);
+        }
+        else
+        {
+            converter = new DSDPCMConverterEngine;
+            ok = converter->init(channels, 75, samplerate, config.pcm_samplerate) >= 0;
+            converter->set_planar(planar);
+        }
+
+        pcm_writer = pcm_writer_t::create(config.pcm_format, config.pcm_container);
+        ok = ok && pcm_writer->open(output, channels, config.pcm_samplerate, channel_map);
+    }
+    else
+    {
+        if (config.dsd_container == DSD_CONTAINER_DST && !reader->is_dst())
+        {
+            encoder = new CDSTEncoder;
+            ok = encoder->init(channels, samplerate / 44100) == 0;
+        }
+
+        dsd_writer = new dsd_writer_t(config.dsd_container);
+        ok = ok && dsd_writer->open(output, channels, samplerate, channel_map);
+    }
+
+    if (!ok)
+    {
+        printf("PANIC: Failed to set up the conversion\n");
+    }
+
+    double start = wall_clock();
+    stage_clock_t clock(result.stage_seconds);
+    size_t size = frame.size();
+    frame_type_e type;
+
+    while (ok && reader->read_frame(frame.data(), &size, &type))
+    {
+        uint8_t* dsd_data = frame.data();
+        size_t dsd_size = size;
+
+        clock.charge(STAGE_READ);
+
+        if (type == FRAME_INVALID)
+        {
+            dsd_size = frame_size;
+            memset(dsd_data, DSD_SILENCE_BYTE, dsd_size);
+        }
+        else if (type == FRAME_DST && !(dsd_writer && config.dsd_container == DSD_CONTAINER_DST))
+        {
+            if (!decoder)
+            {
+                decoder = new CDSTDecoder;
+                decoder->init(channels, samplerate / 44100, planar);
+            }
+
+            decoder->decode(frame.data(), (int)size * 8, dsd.data());
+            dsd_data = dsd.data();
+            dsd_size = frame_size;
+            clock.charge(STAGE_DST_DECODE);
+        }
+
+        if (converter || converter_hq)
+        {
+            if (converter_hq)
+            {
+                converter_hq->convert(dsd_data, (int)dsd_size, pcm_data.data());
+            }
+            else
+            {
+                converter->convert(dsd_data, (int)dsd_size, pcm_data.data());
+            }
+
+            clock.charge(STAGE_CONVERT);
+            pcm_writer->write(pcm_data.data(), pcm_samples);
+        }
+        else if (type == FRAME_DST && config.dsd_container == DSD_CONTAINER_DST)
+        {
+            dsd_writer->write_frame(dsd_data, dsd_size);
+        }
+        else if (encoder)
+        {
+            int dst_size = encoder->encode(dsd_data, dst.data());
+
+            clock.charge(STAGE_DST_ENCODE);
+            dsd_writer->write_frame(dst.data(), dst_size);
+        }
+        else
+        {
+            dsd_writer->write(dsd_data, (int)(dsd_size / channels));
+        }
+
+        clock.charge(STAGE_WRITE);
+        result.audio_seconds += 1.0 / 75;
+        size = frame.size();
+    }
+
+    ok = ok && (pcm_writer ? pcm_writer->close() : dsd_writer->close());
+    clock.charge(STAGE_WRITE);
+    result.wall_seconds = wall_clock() - start;
+
+    delete pcm_writer;
+    delete dsd_writer;
+    delete converter;
+    delete converter_hq;
+
+    if (decoder)
+    {
+        decoder->close();
+        delete decoder;
+    }
+
+    if (encoder)
+    {
+        encoder->close();
+        delete encoder;
+    }
+
+    reader->close();
+    media->close();
+    delete reader;
+    delete media;
+
+    return ok;
+}
+
+// Runs configuration nr in a new process, the peak RSS comes from its resource usage
+static bool spawn_config(const string& self, int nr, const string& input, const string& output, e2e_result_t& result, long& max_rss_kb)
+{
+    int pipe_fd[2];
+
+    if (pipe(pipe_fd) != 0)
+    {
+        return false;
+    }
+
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        string run = "--run=" + to_string(nr);
+        string in = "--input=" + input;
+        string out = "--output=" + output;
+
+        dup2(pipe_fd[1], STDOUT_FILENO);
+        close(pipe_fd[0]);
+        close(pipe_fd[1]);
+        execl(self.c_str(), self.c_str(), run.c_str(), in.c_str(), out.c_str(), (char*)NULL);
+        _exit(127);
+    }
+
+    close(pipe_fd[1]);
+
+    string text;
+    char buf[256];
+    ssize_t n;
+
+    while ((n = read(pipe_fd[0], buf, sizeof(buf))) > 0)
+    {
+        text.append(buf, n);
+    }
+
+    close(pipe_fd[0]);
+
+    int status = 0;
+    struct rusage usage;
+
+    if (pid < 0 || wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        printf("%s", text.c_str());
+        return false;
+    }
+
+    max_rss_kb = usage.ru_maxrss;
+
+    return sscanf(text.c_str(), "RESULT %lf %lf %lf %lf %lf %lf %lf", &result.audio_seconds, &result.wall_seconds, &result.stage_seconds[0], &result.stage_seconds[1], &result.stage_seconds[2], &result.stage_seconds[3], &result.stage_seconds[4]) == 7;
+}
+
+static void print_usage(const char* name)
+{
+    printf("Usage: %s [options]\n", name);
+    printf("  --seconds=<s>      Length of the generated inputs (default 10)\n");
+    printf("  --filter=<text>    Only run the configurations whose description contains text\n");
+    printf("  --dir=<path>       Folder for the generated inputs and the outputs (default $TMPDIR or /tmp)\n");
+    printf("  --keep             Keep the generated inputs\n");
+    printf("  --list             List the configurations\n");
+}
+
+int main(int argc, char* argv[])
+{
+    double seconds = 10;
+    string filter;
+    const char* tmpdir = getenv("TMPDIR");
+    string dir = tmpdir ? tmpdir : "/tmp";
+    bool keep = false;
+    bool list = false;
+    int run = -1;
+    string input;
+    string output;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--seconds=", 10) == 0)
+        {
+            seconds = atof(argv[i] + 10);
+        }
+        else if (strncmp(argv[i], "--filter=", 9) == 0)
+        {
+            filter = argv[i] + 9;
+        }
+        else if (strncmp(argv[i], "--dir=", 6) == 0)
+        {
+            dir = argv[i] + 6;
+        }
+        else if (strcmp(argv[i], "--keep") == 0)
+        {
+            keep = true;
+        }
+        else if (strcmp(argv[i], "--list") == 0)
+        {
+            list = true;
+        }
+        else if (strncmp(argv[i], "--run=", 6) == 0)
+        {
+            run = atoi(argv[i] + 6);
+        }
+        else if (strncmp(argv[i], "--input=", 8) == 0)
+        {
+            input = argv[i] + 8;
+        }
+        else if (strncmp(argv[i], "--output=", 9) == 0)
+        {
+            output = argv[i] + 9;
+        }
+        else
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Child: one conversion, the result goes to the parent on stdout
+    if (run >= 0)
+    {
+        e2e_result_t result;
+
+        if (run >= E2E_CONFIG_COUNT || !run_config(e2e_configs[run], input, output, result))
+        {
+            return 1;
+        }
+
+        printf("RESULT %f %f", result.audio_seconds, result.wall_seconds);
+
+        for (int s = 0; s < STAGE_COUNT; s++)
+        {
+            printf(" %f", result.stage_seconds[s]);
+        }
+
+        printf("\n");
+
+        return 0;
+    }
+
+    char self[4096];
+    ssize_t self_len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    string self_path = self_len > 0 ? string(self, self_len) : string(argv[0]);
+    vector<string> inputs;
+    bool failed = false;
+
+    if (!list)
+    {
+        printf("%-44s %8s %9s %8s", "Configuration", "Audio s", "Realtime", "CPU s");
+
+        for (int s = 0; s < STAGE_COUNT; s++)
+        {
+            printf(" %8s", stage_names[s]);
+        }
+
+        printf(" %9s\n%s\n", "Peak RSS", string(44 + 9 + 10 + 9 + 9 * STAGE_COUNT + 10, '-').c_str());
+    }
+
+    for (int nr = 0; nr < E2E_CONFIG_COUNT; nr++)
+    {
+        const e2e_config_t& config = e2e_configs[nr];
+        media_spec_t spec = get_input_spec(config, seconds);
+        string name = media_describe(spec) + " -> " + describe_output(config);
+
+        if (!filter.empty() && name.find(filter) == string::npos)
+        {
+            continue;
+        }
+
+        if (list)
+        {
+            printf("%s\n", name.c_str());
+            continue;
+        }
+
+        // Inputs are generated once and shared by the configurations that read the same one
+        static const char* extensions[] = {".iso", ".dsf", ".dff"};
+        string path = dir + "/sacd_e2e_" + to_string(nr) + extensions[config.format];
+
+        for (int prev = 0; prev < nr; prev++)
+        {
+            media_spec_t prev_spec = get_input_spec(e2e_configs[prev], seconds);
+
+            if (media_describe(prev_spec) == media_describe(spec) && prev_spec.format == spec.format)
+            {
+                path = dir + "/sacd_e2e_" + to_string(prev) + extensions[config.format];
+                break;
+            }
+        }
+
+        if (access(path.c_str(), F_OK) != 0)
+        {
+            if (!media_generate(path, spec))
+            {
+                printf("%-44s PANIC: Failed to write %s\n", name.c_str(), path.c_str());
+                failed = true;
+                continue;
+            }
+
+            inputs.push_back(path);
+        }
+
+        e2e_result_t result;
+        long max_rss_kb = 0;
+        string out_path = dir + "/sacd_e2e_out";
+
+        if (!spawn_config(self_path, nr, path, out_path, result, max_rss_kb))
+        {
+            printf("%-44s FAILED\n", name.c_str());
+            failed = true;
+            unlink(out_path.c_str());
+            continue;
+        }
+
+        unlink(out_path.c_str());
+
+        double cpu = 0;
+
+        for (int s = 0; s < STAGE_COUNT; s++)
+        {
+            cpu += result.stage_seconds[s];
+        }
+
+        printf("%-44s %8.2f %8.1fx %8.3f", name.c_str(), result.audio_seconds, result.wall_seconds > 0 ? result.audio_seconds / result.wall_seconds : 0.0, cpu);
+
+        for (int s = 0; s < STAGE_COUNT; s++)
+        {
+            printf(" %8.3f", result.stage_seconds[s]);
+        }
+
+        printf(" %6.1f MB\n", max_rss_kb / 1024.0);
+        fflush(stdout);
+    }
+
+    for (size_t i = 0; i < inputs.size() && !keep; i++)
+    {
+        unlink(inputs[i].c_str());
+    }
+
+    return failed ? 1 : 0;
+}
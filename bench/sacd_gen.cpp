@@ -0,0 +1,121 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <getopt.h>
+#include "media_gen.h"
+
+static void print_usage()
+{
+    printf("Usage: sacd_gen [options] <output.iso|output.dsf|output.dff>\n");
+    printf("Writes synthetic DSD media for benchmarks and tests, the format follows the extension\n\n");
+    printf("  -c, --channels=<n>   Channels, 1-6 (disc images: 2, or 5/6 for a multichannel area next to the stereo one)\n");
+    printf("  -r, --rate=<n>       DSD rate as multiple of 44.1 kHz: 64, 128 or 256 (disc images: 64)\n");
+    printf("  -s, --seconds=<n>    Length of every track\n");
+    printf("  -t, --tracks=<n>     Number of tracks, 1-255 (DSF: 1)\n");
+    printf("  -d, --dst            DST encoded (disc images and DSDIFF)\n");
+    printf("  -x, --effort=<n>     DST encoder effort, 0-3\n");
+    printf("  -h, --help           This help\n");
+}
+
+int main(int argc, char* argv[])
+{
+    media_spec_t spec;
+    int nOpt;
+
+    static struct option tOptionsTable[] =
+    {
+        {"channels", required_argument, NULL, 'c'},
+        {"rate", required_argument, NULL, 'r'},
+        {"seconds", required_argument, NULL, 's'},
+        {"tracks", required_argument, NULL, 't'},
+        {"dst", no_argument, NULL, 'd'},
+        {"effort", required_argument, NULL, 'x'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    while ((nOpt = getopt_long(argc, argv, "c:r:s:t:dx:h", tOptionsTable, NULL)) >= 0)
+    {
+        switch (nOpt)
+        {
+            case 'c':
+                spec.channels = atoi(optarg);
+                break;
+            case 'r':
+                spec.samplerate = 44100 * atoi(optarg);
+                break;
+            case 's':
+                spec.seconds = atof(optarg);
+                break;
+            case 't':
+                spec.tracks = atoi(optarg);
+                break;
+            case 'd':
+                spec.dst = true;
+                break;
+            case 'x':
+                spec.effort = atoi(optarg);
+                break;
+            default:
+                print_usage();
+                return nOpt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (optind != argc - 1)
+    {
+        print_usage();
+        return 1;
+    }
+
+    string strPath = argv[optind];
+    size_t nDot = strPath.rfind('.');
+    string strExt = nDot == string::npos ? "" : strPath.substr(nDot + 1);
+
+    if (strcasecmp(strExt.c_str(), "iso") == 0)
+    {
+        spec.format = MEDIA_ISO;
+    }
+    else if (strcasecmp(strExt.c_str(), "dsf") == 0)
+    {
+        spec.format = MEDIA_DSF;
+    }
+    else if (strcasecmp(strExt.c_str(), "dff") == 0)
+    {
+        spec.format = MEDIA_DFF;
+    }
+    else
+    {
+        printf("PANIC: Unknown output format %s\n", strPath.c_str());
+        return 1;
+    }
+
+    if (!media_generate(strPath, spec))
+    {
+        printf("PANIC: Failed to write %s (%s)\n", strPath.c_str(), media_describe(spec).c_str());
+        return 1;
+    }
+
+    printf("%s: %s\n", strPath.c_str(), media_describe(spec).c_str());
+
+    return 0;
+}
@@ -0,0 +1,1000 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <limits.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "sacd_media.h"
+#include "sacd_disc.h"
+#include "sacd_dsdiff.h"
+#include "sacd_dsf.h"
+#include "dst_decoder.h"
+#include "dst_decoder_mt.h"
+#include "dsd_pcm_converter_engine.h"
+#include "dsd_pcm_converter_hq.h"
+#include "dsd_writer.h"
+#include "dsd_signal.h"
+#include "media_gen.h"
+
+using namespace std;
+
+// Golden output regression test. Every DSD path (the readers, planar and interleaved, single and multithreaded DST
+// decoding) has to reproduce the synthetic signal bit for bit, every PCM path (the multistage converters at every
+// decimation, the HQ resampler at 96 and 192 kHz) is compared against bench/golden.txt: an identical hash passes right
+// away, otherwise a set of stored samples has to be within the tolerance. With --ref the complete outputs are written
+// to (--update) or compared against a folder, which also covers recorded media given with --input.
+
+#define GOLDEN_SECONDS 0.2 // per track
+#define GOLDEN_FRAMES 30 // PCM cases
+#define GOLDEN_PROBES 64
+#define GOLDEN_TOLERANCE (1.0 / (1 << 20)) // 8 LSB at 24 bits
+#define GOLDEN_DST_THREADS 4
+
+struct dsd_case_t
+{
+    const char* name;
+    media_format_t format;
+    int channels;
+    int fs44;
+    bool dst;
+    int tracks;
+};
+
+static const dsd_case_t dsd_cases[] =
+{
+    {"iso-2ch-dsd64", MEDIA_ISO, 2, 64, false, 2},
+    {"iso-2ch-dst64", MEDIA_ISO, 2, 64, true, 2},
+    {"iso-6ch-dst64", MEDIA_ISO, 6, 64, true, 2},
+    {"dsf-2ch-dsd64", MEDIA_DSF, 2, 64, false, 1},
+    {"dsf-1ch-dsd128", MEDIA_DSF, 1, 128, false, 1},
+    {"dsf-5ch-dsd256", MEDIA_DSF, 5, 256, false, 1},
+    {"dff-2ch-dsd128", MEDIA_DFF, 2, 128, false, 2},
+    {"dff-2ch-dst64", MEDIA_DFF, 2, 64, true, 2},
+    {"dff-6ch-dst64", MEDIA_DFF, 6, 64, true, 2},
+    {"dff-3ch-dst128", MEDIA_DFF, 3, 128, true, 1},
+};
+
+#define DSD_CASE_COUNT (int)(sizeof(dsd_cases) / sizeof(dsd_cases[0]))
+
+// Rates of the PCM cases, the multistage converters decimate by 8 to 512
+static const int engine_rates[] = {44100, 88200, 176400, 352800};
+static const int hq_rates[] = {96000, 192000};
+
+struct golden_entry_t
+{
+    string hash;
+    size_t size;
+    vector<double> probes;
+};
+
+struct golden_options_t
+{
+    string golden_path;
+    string ref_dir;
+    string input_path;
+    string filter;
+    string dir;
+    double tolerance;
+    int frames;
+    bool update;
+};
+
+static golden_options_t options;
+static map<string, golden_entry_t> golden;
+static int failures = 0;
+
+static void report(const string& name, bool ok, const string& text)
+{
+    printf("%-36s %-5s %s\n", name.c_str(), ok ? "ok" : "FAIL", text.c_str());
+    fflush(stdout);
+
+    if (!ok)
+    {
+        failures++;
+    }
+}
+
+// FNV-1a
+static string get_hash(const void* data, size_t size)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    char text[17];
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ p[i]) * 0x100000001b3ULL;
+    }
+
+    snprintf(text, sizeof(text), "%016llx", (unsigned long long)hash);
+
+    return text;
+}
+
+static size_t get_probe_index(int nr, size_t size)
+{
+    return (size_t)((nr + 0.5) * size / GOLDEN_PROBES);
+}
+
+static bool read_file(const string& path, vector<uint8_t>& data)
+{
+    FILE* f = fopen(path.c_str(), "rb");
+
+    if (!f)
+    {
+        return false;
+    }
+
+    uint8_t buf[65536];
+    size_t n;
+
+    data.clear();
+
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    {
+        data.insert(data.end(), buf, buf + n);
+    }
+
+    fclose(f);
+
+    return true;
+}
+
+static bool write_file(const string& path, const void* data, size_t size)
+{
+    FILE* f = fopen(path.c_str(), "wb");
+
+    if (!f)
+    {
+        return false;
+    }
+
+    bool ok = fwrite(data, 1, size, f) == size;
+
+    return fclose(f) == 0 && ok;
+}
+
+// Golden file: "<name> <hash> <size> [probes]", one line per output, # starts a comment
+static void load_golden()
+{
+    FILE* f = fopen(options.golden_path.c_str(), "r");
+    char line[8192];
+
+    if (!f)
+    {
+        return;
+    }
+
+    while (fgets(line, sizeof(line), f))
+    {
+        char* save;
+        char* name = strtok_r(line, " \t\r\n", &save);
+        char* hash = strtok_r(nullptr, " \t\r\n", &save);
+        char* size = strtok_r(nullptr, " \t\r\n", &save);
+
+        if (!name || name[0] == '#' || !hash || !size)
+        {
+            continue;
+        }
+
+        golden_entry_t& entry = golden[name];
+
+        entry.hash = hash;
+        entry.size = strtoull(size, nullptr, 10);
+        entry.probes.clear();
+
+        for (char* probe = strtok_r(nullptr, " \t\r\n", &save); probe; probe = strtok_r(nullptr, " \t\r\n", &save))
+        {
+            entry.probes.push_back((float)atof(probe)); // %.9g gives back the float exactly
+        }
+    }
+
+    fclose(f);
+}
+
+static bool save_golden()
+{
+    FILE* f = fopen(options.golden_path.c_str(), "w");
+
+    if (!f)
+    {
+        printf("PANIC: Cannot write %s\n", options.golden_path.c_str());
+        return false;
+    }
+
+    fprintf(f, "# Golden outputs of bench/sacd_golden, rewritten by sacd_golden --update\n");
+    fprintf(f, "# <name> <FNV-1a hash> <bytes (media, dsd) or samples (pcm)> [%d probe samples (pcm)]\n", GOLDEN_PROBES);
+
+    for (auto& it : golden)
+    {
+        fprintf(f, "%s %s %zu", it.first.c_str(), it.second.hash.c_str(), it.second.size);
+
+        for (double probe : it.second.probes)
+        {
+            fprintf(f, " %.9g", probe);
+        }
+
+        fprintf(f, "\n");
+    }
+
+    return fclose(f) == 0;
+}
+
+// Outputs that have to stay bit exact: generated media and decoded DSD
+static void check_exact(const string& name, const vector<uint8_t>& data, bool synthetic)
+{
+    string hash = get_hash(data.data(), data.size());
+    string text;
+    bool ok = true;
+
+    if (synthetic)
+    {
+        auto it = golden.find(name);
+
+        if (options.update)
+        {
+            golden_entry_t& entry = golden[name];
+
+            entry.hash = hash;
+            entry.size = data.size();
+            entry.probes.clear();
+            text = "updated";
+        }
+        else if (it == golden.end())
+        {
+            ok = false;
+            text = "not in " + options.golden_path;
+        }
+        else if (it->second.hash != hash || it->second.size != data.size())
+        {
+            ok = false;
+            text = "hash " + hash + ", " + to_string(data.size()) + " bytes, expected " + it->second.hash + ", " + to_string(it->second.size) + " bytes";
+        }
+        else
+        {
+            text = "exact";
+        }
+    }
+
+    if (!options.ref_dir.empty())
+    {
+        string path = options.ref_dir + "/" + name + ".bin";
+        vector<uint8_t> ref;
+
+        if (options.update)
+        {
+            ok = write_file(path, data.data(), data.size()) && ok;
+            text = "updated";
+        }
+        else if (read_file(path, ref))
+        {
+            size_t pos = 0;
+
+            while (pos < ref.size() && pos < data.size() && ref[pos] == data[pos])
+            {
+                pos++;
+            }
+
+            if (pos < ref.size() || pos < data.size())
+            {
+                ok = false;
+                text += (text.empty() ? "" : ", ") + string("differs from the reference at byte ") + to_string(pos);
+            }
+            else
+            {
+                text += (text.empty() ? "" : ", ") + string("same as the reference");
+            }
+        }
+        else if (!synthetic)
+        {
+            ok = false;
+            text = "no reference " + path;
+        }
+    }
+
+    report(name, ok, text);
+}
+
+// PCM: the hash, failing that the probes (or the complete reference output) have to be within the tolerance
+static void check_pcm(const string& name, const vector<float>& pcm, bool synthetic)
+{
+    string hash = get_hash(pcm.data(), pcm.size() * sizeof(float));
+    char text[256] = "";
+    bool ok = true;
+
+    if (synthetic)
+    {
+        auto it = golden.find(name);
+
+        if (options.update)
+        {
+            golden_entry_t& entry = golden[name];
+
+            entry.hash = hash;
+            entry.size = pcm.size();
+            entry.probes.clear();
+
+            for (int nr = 0; nr < GOLDEN_PROBES && !pcm.empty(); nr++)
+            {
+                entry.probes.push_back(pcm[get_probe_index(nr, pcm.size())]);
+            }
+
+            snprintf(text, sizeof(text), "updated");
+        }
+        else if (it == golden.end())
+        {
+            ok = false;
+            snprintf(text, sizeof(text), "not in %s", options.golden_path.c_str());
+        }
+        else if (it->second.size != pcm.size())
+        {
+            ok = false;
+            snprintf(text, sizeof(text), "%zu samples, expected %zu", pcm.size(), it->second.size);
+        }
+        else if (it->second.hash == hash)
+        {
+            snprintf(text, sizeof(text), "exact");
+        }
+        else
+        {
+            double max_error = 0;
+
+            for (int nr = 0; nr < (int)it->second.probes.size(); nr++)
+            {
+                max_error = max(max_error, fabs(pcm[get_probe_index(nr, pcm.size())] - it->second.probes[nr]));
+            }
+
+            ok = max_error <= options.tolerance;
+            snprintf(text, sizeof(text), "hash differs, max probe error %.3g", max_error);
+        }
+    }
+
+    if (!options.ref_dir.empty())
+    {
+        string path = options.ref_dir + "/" + name + ".f32";
+        vector<uint8_t> ref;
+        size_t len = strlen(text);
+
+        if (options.update)
+        {
+            ok = write_file(path, pcm.data(), pcm.size() * sizeof(float)) && ok;
+            snprintf(text, sizeof(text), "updated");
+        }
+        else if (read_file(path, ref) && ref.size() == pcm.size() * sizeof(float))
+        {
+            const float* ref_pcm = (const float*)ref.data();
+            double max_error = 0;
+
+            for (size_t i = 0; i < pcm.size(); i++)
+            {
+                max_error = max(max_error, fabs((double)pcm[i] - ref_pcm[i]));
+            }
+
+            ok = ok && max_error <= options.tolerance;
+            snprintf(text + len, sizeof(text) - len, "%sreference max error %.3g", len ? ", " : "", max_error);
+        }
+        else
+        {
+            ok = false;
+            snprintf(text + len, sizeof(text) - len, "%sno reference %s of %zu samples", len ? ", " : "", path.c_str(), pcm.size());
+        }
+    }
+
+    report(name, ok, text);
+}
+
+static bool selected(const string& name)
+{
+    return options.filter.empty() || name.find(options.filter) != string::npos;
+}
+
+// Byte per channel blocks to interleaved bytes
+static void interleave(const uint8_t* planar, size_t size, int channels, uint8_t* interleaved)
+{
+    size_t samples = size / channels;
+
+    for (int ch = 0; ch < channels; ch++)
+    {
+        for (size_t i = 0; i < samples; i++)
+        {
+            interleaved[i * channels + ch] = planar[ch * samples + i];
+        }
+    }
+}
+
+static void deinterleave(const uint8_t* interleaved, size_t size, int channels, uint8_t* planar)
+{
+    size_t samples = size / channels;
+
+    for (int ch = 0; ch < channels; ch++)
+    {
+        for (size_t i = 0; i < samples; i++)
+        {
+            planar[ch * samples + i] = interleaved[i * channels + ch];
+        }
+    }
+}
+
+enum dst_mode_t {DST_SINGLE, DST_PLANAR, DST_MT};
+
+// Reads the frames of all tracks as they are stored, DST frames stay encoded. Every frame has to have the type that
+// the reader's is_dst promises
+static bool read_frames(const string& path, media_format_t format, area_id_e area, vector<vector<uint8_t>>& frames, int& channels, int& samplerate, bool& is_dst)
+{
+    sacd_media_t* media = sacd_media_t::create(ACCESS_BUFFERED);
+    sacd_reader_t* reader = format == MEDIA_ISO ? (sacd_reader_t*)new sacd_disc_t : format == MEDIA_DFF ? (sacd_reader_t*)new sacd_dsdiff_t : (sacd_reader_t*)new sacd_dsf_t;
+    bool opened = media->open(path.c_str());
+    bool ok = opened && reader->open(media) != 0;
+
+    frames.clear();
+    is_dst = false;
+
+    if (ok)
+    {
+        if (reader->get_track_count(area) == 0)
+        {
+            area = area == AREA_MULCH ? AREA_TWOCH : AREA_MULCH;
+        }
+
+        reader->set_track(0, area, 0, reader->get_track_count(area));
+        channels = reader->get_channels();
+        samplerate = reader->get_samplerate();
+        is_dst = reader->is_dst();
+
+        vector<uint8_t> frame((size_t)samplerate / 8 / 75 * channels + 1);
+        size_t size = frame.size();
+        frame_type_e type;
+
+        while (ok && reader->read_frame(frame.data(), &size, &type))
+        {
+            ok = type == (is_dst ? FRAME_DST : FRAME_DSD);
+            frames.emplace_back(frame.begin(), frame.begin() + size);
+            size = frame.size();
+        }
+
+        reader->close();
+    }
+
+    if (opened)
+    {
+        media->close();
+    }
+
+    delete reader;
+    delete media;
+
+    return ok;
+}
+
+// Reads all tracks of the media and decodes it to interleaved DSD. Planar DSD frames and DST frames decoded to planar
+// are interleaved again, so that every mode has to give the same bytes. is_dst tells if there were DST frames
+static bool read_media(const string& path, media_format_t format, area_id_e area, dst_mode_t mode, int max_frames, vector<uint8_t>& dsd, int& channels, int& samplerate, bool& is_dst)
+{
+    sacd_media_t* media = sacd_media_t::create(ACCESS_BUFFERED);
+    sacd_reader_t* reader = format == MEDIA_ISO ? (sacd_reader_t*)new sacd_disc_t : format == MEDIA_DFF ? (sacd_reader_t*)new sacd_dsdiff_t : (sacd_reader_t*)new sacd_dsf_t;
+    bool opened = media->open(path.c_str());
+    bool ok = opened && reader->open(media) != 0;
+
+    dsd.clear();
+    is_dst = false;
+
+    if (ok)
+    {
+        if (reader->get_track_count(area) == 0)
+        {
+            area = area == AREA_MULCH ? AREA_TWOCH : AREA_MULCH;
+        }
+
+        reader->set_track(0, area, 0, reader->get_track_count(area));
+        channels = reader->get_channels();
+        samplerate = reader->get_samplerate();
+
+        bool planar = mode == DST_PLANAR && reader->set_planar(true);
+        size_t frame_size = (size_t)samplerate / 8 / 75 * channels;
+        int slot_count = mode == DST_MT ? GOLDEN_DST_THREADS : 1;
+        vector<vector<uint8_t>> frames(slot_count, vector<uint8_t>(frame_size + 1)); // the threads decode from here
+        vector<vector<uint8_t>> outs(slot_count, vector<uint8_t>(frame_size));
+        vector<uint8_t> interleaved(frame_size);
+        CDSTDecoder* decoder = nullptr;
+        dst_decoder_t* decoder_mt = nullptr;
+        int slot = 0;
+        frame_type_e type;
+        int frame_count = 0;
+
+        while (ok && frame_count < max_frames)
+        {
+            uint8_t* frame = frames[slot].data();
+            uint8_t* dsd_data = outs[slot].data();
+            size_t size = frame_size + 1;
+            size_t dsd_size = 0;
+
+            if (!reader->read_frame(frame, &size, &type))
+            {
+                break;
+            }
+
+            if (type == FRAME_INVALID)
+            {
+                ok = false;
+                break;
+            }
+
+            if (type == FRAME_DST && mode == DST_MT)
+            {
+                if (!decoder_mt)
+                {
+                    decoder_mt = new dst_decoder_t(GOLDEN_DST_THREADS);
+                    ok = decoder_mt->init(channels, samplerate, 75, false) == 0;
+                }
+
+                decoder_mt->decode(frame, size, &dsd_data, &dsd_size);
+                slot = decoder_mt->slot_nr;
+            }
+            else if (type == FRAME_DST)
+            {
+                if (!decoder)
+                {
+                    decoder = new CDSTDecoder;
+                    ok = decoder->init(channels, samplerate / 44100, planar) == 0;
+                }
+
+                decoder->decode(frame, (int)size * 8, dsd_data);
+                dsd_size = frame_size;
+            }
+            else
+            {
+                dsd_data = frame;
+                dsd_size = size;
+            }
+
+            if (planar && dsd_size > 0)
+            {
+                interleave(dsd_data, dsd_size, channels, interleaved.data());
+                dsd_data = interleaved.data();
+            }
+
+            is_dst = is_dst || type == FRAME_DST;
+            dsd.insert(dsd.end(), dsd_data, dsd_data + dsd_size);
+            frame_count++;
+        }
+
+        for (int i = 0; decoder_mt && i < GOLDEN_DST_THREADS; i++)
+        {
+            uint8_t* dsd_data = outs[decoder_mt->slot_nr].data();
+            size_t dsd_size = 0;
+
+            decoder_mt->decode(nullptr, 0, &dsd_data, &dsd_size);
+
+            if (dsd_data)
+            {
+                dsd.insert(dsd.end(), dsd_data, dsd_data + dsd_size);
+            }
+        }
+
+        if (decoder)
+        {
+            decoder->close();
+            delete decoder;
+        }
+
+        delete decoder_mt;
+        reader->close();
+    }
+
+    if (opened)
+    {
+        media->close();
+    }
+
+    delete reader;
+    delete media;
+
+    return ok;
+}
+
+// Converts interleaved DSD frame by frame, with the input in planar layout if asked for. 0 rate: not supported
+static bool convert_pcm(const vector<uint8_t>& dsd, int channels, int dsd_samplerate, int pcm_samplerate, bool hq, bool planar, vector<float>& pcm)
+{
+    size_t frame_size = (size_t)dsd_samplerate / 8 / 75 * channels;
+    int pcm_samples = pcm_samplerate / 75;
+    vector<uint8_t> frame(frame_size);
+    vector<float> out((size_t)pcm_samples * channels);
+    DSDPCMConverterEngine* converter = nullptr;
+    dsdpcm_converter_hq* converter_hq = nullptr;
+    bool ok;
+
+    if (hq)
+    {
+        converter_hq = new dsdpcm_converter_hq;
+        ok = converter_hq->init(channels, dsd_samplerate, pcm_samplerate) == 0;
+        converter_hq->set_planar(planar);
+    }
+    else
+    {
+        converter = new DSDPCMConverterEngine;
+        ok = converter->init(channels, 75, dsd_samplerate, pcm_samplerate) == 0;
+        converter->set_planar(planar);
+    }
+
+    pcm.clear();
+
+    for (size_t pos = 0; ok && pos + frame_size <= dsd.size(); pos += frame_size)
+    {
+        uint8_t* dsd_data = (uint8_t*)dsd.data() + pos;
+        int samples;
+
+        if (planar)
+        {
+            deinterleave(dsd_data, frame_size, channels, frame.data());
+            dsd_data = frame.data();
+        }
+
+        if (hq)
+        {
+            samples = converter_hq->convert(dsd_data, (int)frame_size, out.data());
+        }
+        else
+        {
+            samples = converter->convert(dsd_data, (int)frame_size, out.data());
+        }
+
+        pcm.insert(pcm.end(), out.begin(), out.begin() + samples);
+    }
+
+    delete converter;
+    delete converter_hq;
+
+    return ok;
+}
+
+// Every converter and rate for the DSD, planar input has to give what interleaved input gives. Exactly for the multistage
+// converters; the HQ converter dithers with a seed that counts up with every instance, so only within the tolerance
+// there (and its golden hashes only hold for a run of all cases in the same order, the probes catch the rest)
+static void check_pcm_paths(const string& prefix, const vector<uint8_t>& dsd, int channels, int dsd_samplerate, bool synthetic)
+{
+    for (int hq = 0; hq < 2; hq++)
+    {
+        const int* rates = hq ? hq_rates : engine_rates;
+        int rate_count = hq ? (int)(sizeof(hq_rates) / sizeof(hq_rates[0])) : (int)(sizeof(engine_rates) / sizeof(engine_rates[0]));
+
+        for (int i = 0; i < rate_count; i++)
+        {
+            int decimation = dsd_samplerate / rates[i];
+            string name = prefix + (hq ? "-hq-" : "-engine-") + to_string(rates[i]);
+            vector<float> pcm;
+            vector<float> pcm_planar;
+
+            if ((!hq && (decimation < 8 || decimation > 512)) || !selected(name))
+            {
+                continue;
+            }
+
+            if (!convert_pcm(dsd, channels, dsd_samplerate, rates[i], hq != 0, false, pcm) || !convert_pcm(dsd, channels, dsd_samplerate, rates[i], hq != 0, true, pcm_planar))
+            {
+                report(name, false, "converter setup failed");
+                continue;
+            }
+
+            double max_error = pcm.size() == pcm_planar.size() ? 0 : INFINITY;
+
+            for (size_t n = 0; n < pcm.size() && n < pcm_planar.size(); n++)
+            {
+                max_error = max(max_error, fabs((double)pcm[n] - pcm_planar[n]));
+            }
+
+            if (hq ? max_error > options.tolerance : max_error != 0)
+            {
+                report(name, false, "planar input gives different PCM, max error " + to_string(max_error));
+                continue;
+            }
+
+            check_pcm(name, pcm, synthetic);
+        }
+    }
+}
+
+// DST frames copied into a DST DSDIFF file, as sacd -c dst does with DST input, have to come back byte for byte
+static void check_remux(const dsd_case_t& c, const string& path)
+{
+    string name = string(c.name) + "-remux";
+    string remux_path = options.dir + "/sacd_golden_" + name + ".dff";
+    area_id_e area = c.channels == 2 ? AREA_TWOCH : AREA_MULCH;
+    vector<vector<uint8_t>> frames;
+    vector<vector<uint8_t>> remuxed;
+    int channels = 0;
+    int samplerate = 0;
+    bool is_dst = false;
+
+    if (!read_frames(path, c.format, area, frames, channels, samplerate, is_dst) || !is_dst)
+    {
+        report(name, false, "cannot read the DST frames of " + path);
+        return;
+    }
+
+    dsd_writer_t writer(DSD_CONTAINER_DST);
+    bool ok = writer.open(remux_path, channels, samplerate, (1U << channels) - 1);
+
+    for (size_t i = 0; ok && i < frames.size(); i++)
+    {
+        ok = writer.write_frame(frames[i].data(), frames[i].size());
+    }
+
+    ok = writer.close() && ok;
+
+    if (!ok || !read_frames(remux_path, MEDIA_DFF, area, remuxed, channels, samplerate, is_dst) || !is_dst)
+    {
+        report(name, false, "cannot remux to " + remux_path);
+    }
+    else if (remuxed != frames)
+    {
+        size_t nr = 0;
+
+        while (nr < remuxed.size() && nr < frames.size() && remuxed[nr] == frames[nr])
+        {
+            nr++;
+        }
+
+        report(name, false, "differs from the DST frames of the source at frame " + to_string(nr) + " of " + to_string(frames.size()));
+    }
+    else
+    {
+        report(name, true, to_string(frames.size()) + " DST frames identical");
+    }
+
+    unlink(remux_path.c_str());
+}
+
+static void run_dsd_case(const dsd_case_t& c)
+{
+    static const char* extensions[] = {".iso", ".dsf", ".dff"};
+    string path = options.dir + "/sacd_golden_" + c.name + extensions[c.format];
+    media_spec_t spec;
+    vector<uint8_t> file;
+    vector<uint8_t> expected;
+    bool ok;
+
+    spec.format = c.format;
+    spec.channels = c.channels;
+    spec.samplerate = 44100 * c.fs44;
+    spec.seconds = GOLDEN_SECONDS;
+    spec.tracks = c.tracks;
+    spec.dst = c.dst;
+
+    ok = media_generate(path, spec) && read_file(path, file);
+
+    if (!ok)
+    {
+        report(c.name, false, "cannot generate " + path);
+        unlink(path.c_str());
+        return;
+    }
+
+    check_exact(string(c.name) + "-media", file, true);
+
+    // The source signal, a lossless path has to give back exactly this
+    int frame_samples = spec.samplerate / 8 / 75;
+    int frames = (int)(GOLDEN_SECONDS * 75 + 0.5) * c.tracks;
+    dsd_signal_t signal(c.channels, spec.samplerate);
+
+    expected.resize((size_t)frame_samples * c.channels * frames);
+    signal.generate(expected.data(), frame_samples * frames);
+
+    static const char* mode_names[] = {"", "planar", "mt"};
+
+    for (int mode = DST_SINGLE; mode <= DST_MT; mode++)
+    {
+        vector<uint8_t> dsd;
+        int channels = 0;
+        int samplerate = 0;
+        bool is_dst = false;
+
+        if (mode == DST_MT && !c.dst)
+        {
+            continue;
+        }
+
+        if (!read_media(path, c.format, c.channels == 2 ? AREA_TWOCH : AREA_MULCH, (dst_mode_t)mode, INT_MAX, dsd, channels, samplerate, is_dst))
+        {
+            report(string(c.name) + "-" + mode_names[mode], false, "cannot read " + path);
+            continue;
+        }
+
+        if (dsd != expected)
+        {
+            size_t pos = 0;
+
+            while (pos < dsd.size() && pos < expected.size() && dsd[pos] == expected[pos])
+            {
+                pos++;
+            }
+
+            report(string(c.name) + (mode ? "-" : "") + mode_names[mode], false, "differs from the source signal at byte " + to_string(pos) + " of " + to_string(expected.size()));
+        }
+    }
+
+    check_exact(string(c.name) + "-dsd", expected, true);
+
+    if (c.dst)
+    {
+        check_remux(c, path);
+    }
+
+    unlink(path.c_str());
+}
+
+// Recorded media: no golden hashes (the media is not in the tree), the reference folder holds its outputs
+static void run_input()
+{
+    string name = options.input_path.substr(options.input_path.find_last_of('/') + 1);
+    string extension = name.substr(name.find_last_of('.') + 1);
+    media_format_t format = strcasecmp(extension.c_str(), "iso") == 0 ? MEDIA_ISO : strcasecmp(extension.c_str(), "dsf") == 0 ? MEDIA_DSF : MEDIA_DFF;
+    vector<uint8_t> dsd;
+    int channels = 0;
+    int samplerate = 0;
+    bool is_dst = false;
+
+    if (options.ref_dir.empty())
+    {
+        report(name, false, "recorded media needs a reference folder (--ref)");
+        return;
+    }
+
+    if (!read_media(options.input_path, format, AREA_TWOCH, DST_SINGLE, options.frames, dsd, channels, samplerate, is_dst))
+    {
+        report(name, false, "cannot read " + options.input_path);
+        return;
+    }
+
+    for (int mode = DST_PLANAR; mode <= DST_MT; mode++)
+    {
+        vector<uint8_t> other;
+
+        if (mode == DST_MT && !is_dst)
+        {
+            continue;
+        }
+
+        if (!read_media(options.input_path, format, AREA_TWOCH, (dst_mode_t)mode, options.frames, other, channels, samplerate, is_dst) || other != dsd)
+        {
+            report(name + (mode == DST_PLANAR ? "-planar" : "-mt"), false, "differs from single threaded interleaved decoding");
+        }
+    }
+
+    if (selected(name + "-dsd"))
+    {
+        check_exact(name + "-dsd", dsd, false);
+    }
+
+    check_pcm_paths(name, dsd, channels, samplerate, false);
+}
+
+static void print_usage(const char* name)
+{
+    printf("Usage: %s [options]\n", name);
+    printf("  --golden=<path>    Golden file (default bench/golden.txt)\n");
+    printf("  --update           Write the current outputs to the golden file (and the reference folder)\n");
+    printf("  --ref=<path>       Reference folder with complete outputs, compared in full\n");
+    printf("  --input=<path>     Recorded media (iso, dsf or dff) to check against the reference folder as well\n");
+    printf("  --frames=<n>       Frames of the recorded media to use (default 750)\n");
+    printf("  --tolerance=<x>    Largest PCM sample error allowed when the hash differs (default %g)\n", GOLDEN_TOLERANCE);
+    printf("  --filter=<text>    Only run the cases whose name contains text\n");
+    printf("  --dir=<path>       Folder for the generated media (default $TMPDIR or /tmp)\n");
+}
+
+int main(int argc, char* argv[])
+{
+    const char* tmpdir = getenv("TMPDIR");
+
+    options.golden_path = "bench/golden.txt";
+    options.dir = tmpdir ? tmpdir : "/tmp";
+    options.tolerance = GOLDEN_TOLERANCE;
+    options.frames = 750;
+    options.update = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--golden=", 9) == 0)
+        {
+            options.golden_path = argv[i] + 9;
+        }
+        else if (strcmp(argv[i], "--update") == 0)
+        {
+            options.update = true;
+        }
+        else if (strncmp(argv[i], "--ref=", 6) == 0)
+        {
+            options.ref_dir = argv[i] + 6;
+        }
+        else if (strncmp(argv[i], "--input=", 8) == 0)
+        {
+            options.input_path = argv[i] + 8;
+        }
+        else if (strncmp(argv[i], "--frames=", 9) == 0)
+        {
+            options.frames = atoi(argv[i] + 9);
+        }
+        else if (strncmp(argv[i], "--tolerance=", 12) == 0)
+        {
+            options.tolerance = atof(argv[i] + 12);
+        }
+        else if (strncmp(argv[i], "--filter=", 9) == 0)
+        {
+            options.filter = argv[i] + 9;
+        }
+        else if (strncmp(argv[i], "--dir=", 6) == 0)
+        {
+            options.dir = argv[i] + 6;
+        }
+        else
+        {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    load_golden();
+
+    for (int i = 0; i < DSD_CASE_COUNT; i++)
+    {
+        if (selected(dsd_cases[i].name))
+        {
+            run_dsd_case(dsd_cases[i]);
+        }
+    }
+
+    // PCM from the synthetic signal at every DSD rate, one multichannel run for the converter's channel slots
+    static const int pcm_cases[][2] = {{2, 64}, {2, 128}, {2, 256}, {6, 64}};
+
+    for (auto& pcm_case : pcm_cases)
+    {
+        int channels = pcm_case[0];
+        int samplerate = 44100 * pcm_case[1];
+        int frame_samples = samplerate / 8 / 75;
+        vector<uint8_t> dsd((size_t)frame_samples * channels * GOLDEN_FRAMES);
+        dsd_signal_t signal(channels, samplerate);
+
+        signal.generate(dsd.data(), frame_samples * GOLDEN_FRAMES);
+        check_pcm_paths("pcm-" + to_string(channels) + "ch-dsd" + to_string(pcm_case[1]), dsd, channels, samplerate, true);
+    }
+
+    if (!options.input_path.empty())
+    {
+        run_input();
+    }
+
+    if (options.update && !save_golden())
+    {
+        return 1;
+    }
+
+    if (failures > 0)
+    {
+        printf("%d failed\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
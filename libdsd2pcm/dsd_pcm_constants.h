@@ -46,7 +46,7 @@ static const int MEM_ALIGN = 64;
 #define PCMFIR_OFFSET 0x7fffffff
 #define PCMFIR_SCALE 31
 
-const double DSDFIR1_8_COEFS[DSDFIR1_8_LENGTH] =
+constexpr double DSDFIR1_8_COEFS[DSDFIR1_8_LENGTH] =
 {
     -142,
     -651,
@@ -130,7 +130,7 @@ const double DSDFIR1_8_COEFS[DSDFIR1_8_LENGTH] =
     -142,
 };
 
-const double DSDFIR1_16_COEFS[DSDFIR1_16_LENGTH] =
+constexpr double DSDFIR1_16_COEFS[DSDFIR1_16_LENGTH] =
 {
     -42,
     -102,
@@ -294,7 +294,7 @@ const double DSDFIR1_16_COEFS[DSDFIR1_16_LENGTH] =
     -42,
 };
 
-const double DSDFIR1_64_COEFS[DSDFIR1_64_LENGTH] =
+constexpr double DSDFIR1_64_COEFS[DSDFIR1_64_LENGTH] =
 {
     1652, 421, 509, 606, 714, 832,
     960, 1098, 1245, 1402, 1567, 1739,
@@ -405,7 +405,7 @@ const double DSDFIR1_64_COEFS[DSDFIR1_64_LENGTH] =
     714, 606, 509, 421, 1652
 };
 
-const double PCMFIR2_2_COEFS[PCMFIR2_2_LENGTH] =
+constexpr double PCMFIR2_2_COEFS[PCMFIR2_2_LENGTH] =
 {
     349146,
     0,
@@ -436,7 +436,7 @@ const double PCMFIR2_2_COEFS[PCMFIR2_2_LENGTH] =
     349146,
 };
 
-const double PCMFIR3_2_COEFS[PCMFIR3_2_LENGTH] =
+constexpr double PCMFIR3_2_COEFS[PCMFIR3_2_LENGTH] =
 {
     -5412,
     0,
@@ -71,6 +71,7 @@ public:
 
     virtual void init(DSDPCMFilterSetup& flt_setup, int dsd_samples) = 0;
     virtual int convert(uint8_t* dsd_data, double* pcm_data, int dsd_samples) = 0;
+    virtual void reset() = 0;
 
 protected:
 
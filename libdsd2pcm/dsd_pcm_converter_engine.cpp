@@ -63,6 +63,7 @@ DSDPCMConverterEngine::DSDPCMConverterEngine()
     conv_delay = 0.0f;
     convSlots_fp64 = nullptr;
     conv_called = false;
+    conv_planar = false;
 
     for (int i = 0; i < 256; i++)
     {
@@ -107,6 +108,26 @@ int DSDPCMConverterEngine::init(int channels, int framerate, int dsd_samplerate,
     return 0;
 }
 
+// Start over on a new track with the same setup, the converter threads and filter tables are kept
+void DSDPCMConverterEngine::reset()
+{
+    if (convSlots_fp64)
+    {
+        for (int ch = 0; ch < channels; ch++)
+        {
+            convSlots_fp64[ch].converter->reset();
+        }
+    }
+
+    conv_called = false;
+}
+
+// dsd_data passed to convert() holds each channel's bytes contiguously instead of interleaved
+void DSDPCMConverterEngine::set_planar(bool planar)
+{
+    conv_planar = planar;
+}
+
 int DSDPCMConverterEngine::free()
 {
     if (convSlots_fp64)
@@ -246,9 +267,16 @@ int DSDPCMConverterEngine::convert(DSDPCMConverterSlot* convSlots, uint8_t* dsd_
         DSDPCMConverterSlot* slot = &convSlots[ch];
         slot->dsd_samples = dsd_samples / channels;
 
-        for (int sample = 0; sample < slot->dsd_samples; sample++)
+        if (conv_planar)
         {
-            slot->dsd_data[sample] = dsd_data[sample * channels + ch];
+            memcpy(slot->dsd_data, dsd_data + ch * slot->dsd_samples, slot->dsd_samples);
+        }
+        else
+        {
+            for (int sample = 0; sample < slot->dsd_samples; sample++)
+            {
+                slot->dsd_data[sample] = dsd_data[sample * channels + ch];
+            }
         }
 
         // Release worker (decoding) thread on the loaded slot
@@ -291,9 +319,21 @@ int DSDPCMConverterEngine::convertL(DSDPCMConverterSlot* convSlots, uint8_t* dsd
 
         slot->dsd_samples = dsd_samples / channels;
 
-        for (int sample = 0; sample < slot->dsd_samples; sample++)
+        if (conv_planar)
+        {
+            uint8_t* ch_data = dsd_data + ch * slot->dsd_samples;
+
+            for (int sample = 0; sample < slot->dsd_samples; sample++)
+            {
+                slot->dsd_data[sample] = swap_bits[ch_data[slot->dsd_samples - 1 - sample]];
+            }
+        }
+        else
         {
-            slot->dsd_data[sample] = swap_bits[dsd_data[(slot->dsd_samples - 1 - sample) * channels + ch]];
+            for (int sample = 0; sample < slot->dsd_samples; sample++)
+            {
+                slot->dsd_data[sample] = swap_bits[dsd_data[(slot->dsd_samples - 1 - sample) * channels + ch]];
+            }
         }
 
         // Release worker (decoding) thread on the loaded slot
@@ -61,6 +61,8 @@ public:
     float get_delay();
     bool is_convert_called();
     int init(int channels, int framerate, int dsd_samplerate, int pcm_samplerate);
+    void reset();
+    void set_planar(bool planar);
     int free();
     int convert(uint8_t* dsd_data, int dsd_samples, float* pcm_data);
 
@@ -73,6 +75,7 @@ private:
     float conv_delay;
     bool conv_fp64;
     bool conv_called;
+    bool conv_planar;
     DSDPCMFilterSetup fltSetup_fp64;
     DSDPCMConverterSlot* convSlots_fp64;
     uint8_t swap_bits[256];
@@ -20,7 +20,102 @@
 
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 #include "dsd_pcm_converter_hq.h"
+#include "hq_filters.h"
+
+// The filters are the same for every converter with the same rates. One copy per rate pair is shared by all channels
+// of all converters in the process and freed when its last user is gone. The phases of the supported rate pairs are
+// generated at build time (hq_filters.h), anything else is generated here on first use.
+struct hq_filter_entry_t
+{
+    int dsd_samplerate;
+    int pcm_samplerate;
+    int refs;
+    PolyphaseFilter *filter;
+};
+
+static std::vector<hq_filter_entry_t> hq_filters;
+static pthread_mutex_t hq_filters_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const PolyphaseFilter *acquire_filter(int dsd_samplerate, int pcm_samplerate, int upsampling, int taps, int sinc_freq)
+{
+    const PolyphaseFilter *filter = NULL;
+    size_t i;
+
+    pthread_mutex_lock(&hq_filters_mutex);
+
+    for (i = 0; i < hq_filters.size(); i++)
+    {
+        if (hq_filters[i].dsd_samplerate == dsd_samplerate && hq_filters[i].pcm_samplerate == pcm_samplerate)
+        {
+            hq_filters[i].refs++;
+            filter = hq_filters[i].filter;
+            break;
+        }
+    }
+
+    if (!filter)
+    {
+        hq_filter_entry_t entry;
+
+        entry.dsd_samplerate = dsd_samplerate;
+        entry.pcm_samplerate = pcm_samplerate;
+        entry.refs = 1;
+        entry.filter = NULL;
+
+        for (i = 0; i < sizeof(hq_filter_tables) / sizeof(hq_filter_tables[0]); i++)
+        {
+            const hq_filter_table_t &table = hq_filter_tables[i];
+
+            if (table.upsampling == upsampling && table.taps == taps && table.sinc_freq == sinc_freq)
+            {
+                entry.filter = new PolyphaseFilter(upsampling, table.phases, table.phase_size, taps);
+                break;
+            }
+        }
+
+        if (!entry.filter)
+        {
+            double *impulse = new double[taps];
+
+            generateFilter(impulse, taps, sinc_freq);
+            entry.filter = new PolyphaseFilter(upsampling, impulse, taps);
+
+            delete[] impulse;
+        }
+
+        hq_filters.push_back(entry);
+        filter = entry.filter;
+    }
+
+    pthread_mutex_unlock(&hq_filters_mutex);
+
+    return filter;
+}
+
+static void release_filter(const PolyphaseFilter *filter)
+{
+    size_t i;
+
+    pthread_mutex_lock(&hq_filters_mutex);
+
+    for (i = 0; i < hq_filters.size(); i++)
+    {
+        if (hq_filters[i].filter == filter)
+        {
+            if (--hq_filters[i].refs == 0)
+            {
+                delete hq_filters[i].filter;
+                hq_filters.erase(hq_filters.begin() + i);
+            }
+
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&hq_filters_mutex);
+}
 
 dsdpcm_converter_hq::dsdpcm_converter_hq(): m_dither24(24)
 {
@@ -32,8 +127,10 @@ dsdpcm_converter_hq::dsdpcm_converter_hq(): m_dither24(24)
     m_nDsdSamplerate = 0;
     m_nPcmSamplerate = 0;
     conv_called = false;
+    conv_planar = false;
 
     memset(m_resampler, 0, sizeof(m_resampler));
+    m_filter = NULL;
 
     // fill bits_table
     for (i = 0; i < 16; i++)
@@ -61,6 +158,11 @@ dsdpcm_converter_hq::~dsdpcm_converter_hq()
     {
         delete m_resampler[i];
     }
+
+    if (m_filter)
+    {
+        release_filter(m_filter);
+    }
 }
 
 float dsdpcm_converter_hq::get_delay()
@@ -68,6 +170,12 @@ float dsdpcm_converter_hq::get_delay()
     return (m_resampler[0] != NULL) ? (float)(m_resampler[0]->getFirSize() / 2) / (float)m_decimation : 0;
 }
 
+// dsd_data passed to convert() holds each channel's bytes contiguously instead of interleaved
+void dsdpcm_converter_hq::set_planar(bool planar)
+{
+    conv_planar = planar;
+}
+
 bool dsdpcm_converter_hq::is_convert_called()
 {
     return conv_called;
@@ -75,7 +183,6 @@ bool dsdpcm_converter_hq::is_convert_called()
 
 int dsdpcm_converter_hq::init(int channels, int dsd_samplerate, int pcm_samplerate)
 {
-    double *impulse;
     int i, taps, sinc_freq, multiplier, divisor;
 
     this->m_nChannels = channels;
@@ -160,6 +267,12 @@ int dsdpcm_converter_hq::init(int channels, int dsd_samplerate, int pcm_samplera
 
     memset(m_resampler, 0, sizeof(m_resampler));
 
+    if (m_filter)
+    {
+        release_filter(m_filter);
+        m_filter = NULL;
+    }
+
     // default resampling mode DSD64 -> 96 (5/147 resampling)
     // actual resampling mode DSD64 * multiplier -> 96 * divisor (5 * divisor / 147 * multiplier)
     m_upsampling = 5 * divisor;
@@ -168,20 +281,27 @@ int dsdpcm_converter_hq::init(int channels, int dsd_samplerate, int pcm_samplera
     // generate filter
     taps = 2878 * divisor * multiplier + 1;
     sinc_freq = 70 * 5 * divisor * multiplier; // 44.1 * 64 * upsampling / x
-    impulse = new double[taps];
-
-    generateFilter(impulse, taps, sinc_freq);
+    m_filter = acquire_filter(dsd_samplerate, pcm_samplerate, m_upsampling, taps, sinc_freq);
 
     for (i = 0; i < channels; i++)
-        m_resampler[i] = new ResamplerNxMx(m_upsampling, m_decimation, impulse, taps);
-
-    delete[] impulse;
+        m_resampler[i] = new ResamplerNxMx(m_decimation, m_filter);
 
     conv_called = false;
 
     return 0;
 }
 
+// Start over on a new track with the same setup without generating the filter again
+void dsdpcm_converter_hq::reset()
+{
+    for (int i = 0; i < m_nChannels; i++)
+    {
+        m_resampler[i]->reset();
+    }
+
+    conv_called = false;
+}
+
 int dsdpcm_converter_hq::convert(uint8_t* dsd_data, int dsd_samples, float* pcm_data)
 {
     int pcm_samples = 0;
@@ -200,12 +320,26 @@ int dsdpcm_converter_hq::convert(uint8_t* dsd_data, int dsd_samples, float* pcm_
 
     if (!conv_called)
     {
-        for (int sample = 0; sample < dsd_samples; sample++)
+        // prime the filters with the time reversed first frame, keeping every channel in place
+        int ch_samples = dsd_samples / m_nChannels;
+        m_prime_data.resize(dsd_samples);
+
+        for (int ch = 0; ch < m_nChannels; ch++)
         {
-            dsd_data[sample] = swap_bits[dsd_data[dsd_samples - 1 - sample]];
+            for (int sample = 0; sample < ch_samples; sample++)
+            {
+                if (conv_planar)
+                {
+                    m_prime_data[ch * ch_samples + sample] = swap_bits[dsd_data[ch * ch_samples + ch_samples - 1 - sample]];
+                }
+                else
+                {
+                    m_prime_data[sample * m_nChannels + ch] = swap_bits[dsd_data[(ch_samples - 1 - sample) * m_nChannels + ch]];
+                }
+            }
         }
 
-        convertResample(dsd_data, dsd_samples, pcm_data);
+        convertResample(m_prime_data.data(), dsd_samples, pcm_data);
 
         conv_called = true;
     }
@@ -222,7 +356,7 @@ int dsdpcm_converter_hq::convertResample(uint8_t* dsd_data, int dsd_samples, flo
         return -1;
     }
 
-    int i, pcm_samples, ch, offset, dsd_offset, pcm_offset, j;
+    int i, pcm_samples, ch, offset, dsd_offset, pcm_offset, j, ch_stride, sample_stride;
     double dsd_input[DSDPCM_MAX_CHANNELS][MAX_RESAMPLING_IN + 8], x[DSDPCM_MAX_CHANNELS][MAX_RESAMPLING_OUT];
     uint8_t dsd8bits;
     unsigned int x_samples = 1;
@@ -230,7 +364,9 @@ int dsdpcm_converter_hq::convertResample(uint8_t* dsd_data, int dsd_samples, flo
     assert((dsd_samples % m_decimation) == 0);
 
     pcm_samples = (dsd_samples * 8) / m_decimation / m_nChannels * m_upsampling;
-    dsd_offset = 0;
+    ch_stride = conv_planar ? dsd_samples / m_nChannels : 1;
+    sample_stride = conv_planar ? 1 : m_nChannels;
+    dsd_offset = 0; // byte offset in every channel
     pcm_offset = 0;
     offset = 0; // offset in dsd_input
 
@@ -244,12 +380,14 @@ int dsdpcm_converter_hq::convertResample(uint8_t* dsd_data, int dsd_samples, flo
             // all channels
             for (ch = 0; ch < m_nChannels; ch++)
             {
-                dsd8bits = dsd_data[dsd_offset++];
+                dsd8bits = dsd_data[dsd_offset * sample_stride + ch * ch_stride];
 
                 // fastfill doubles from bits
                 memcpy(&dsd_input[ch][offset], m_bits_table[(dsd8bits & 0xf0) >> 4], 4 * sizeof(double));
                 memcpy(&dsd_input[ch][offset + 4], m_bits_table[dsd8bits & 0x0f], 4 * sizeof(double));
             }
+
+            dsd_offset++;
         }
 
         // now fill pcm samples in all channels!!!
@@ -275,7 +413,7 @@ int dsdpcm_converter_hq::convertResample(uint8_t* dsd_data, int dsd_samples, flo
         }
     }
 
-    assert(dsd_offset == dsd_samples);
+    assert(dsd_offset * m_nChannels == dsd_samples);
     assert(pcm_offset == pcm_samples * m_nChannels);
 
     conv_called = true;
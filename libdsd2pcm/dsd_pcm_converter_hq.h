@@ -23,6 +23,7 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <vector>
 #include "upsampler.h"
 
 #define DSDxFs1 (44100 * 1)
@@ -44,7 +45,9 @@ public:
     dsdpcm_converter_hq();
     ~dsdpcm_converter_hq();
     int init(int channels, int dsd_samplerate, int pcm_samplerate);
+    void reset();
     int convert(uint8_t* dsd_data, int dsd_samples, float* pcm_data);
+    void set_planar(bool planar);
     float get_delay();
     bool is_convert_called();
 
@@ -56,13 +59,16 @@ private:
     int m_nDsdSamplerate;
     int m_nPcmSamplerate;
     bool conv_called;
+    bool conv_planar;
     static const int MAX_DECIMATION = 32 * 2; // 64x -> 88.2 (44.1 not supported, 128x not supported)
     static const int MAX_RESAMPLING_IN = 147 * 2; // 64x -> 96  (147 -> 5 for 64x -> 96, 128x not supported)
     static const int MAX_RESAMPLING_OUT = 5 * 2; // 147 -> 5 for 64x -> 96
     ResamplerNxMx *m_resampler[DSDPCM_MAX_CHANNELS];
+    const PolyphaseFilter *m_filter;
     Dither m_dither24;
     double m_bits_table[16][4];
     uint8_t swap_bits[256];
+    std::vector<uint8_t> m_prime_data;
     int convertResample(uint8_t* dsd_data, int dsd_samples, float* pcm_data);
 };
 
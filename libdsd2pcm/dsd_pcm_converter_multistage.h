@@ -50,6 +50,16 @@ public:
         delay = (((dsd_fir1.get_delay() / pcm_fir2a.get_decimation() + pcm_fir2a.get_delay()) / pcm_fir2b.get_decimation() + pcm_fir2b.get_delay()) / pcm_fir2c.get_decimation() + pcm_fir2c.get_delay()) / pcm_fir3.get_decimation() + pcm_fir3.get_delay();
     }
 
+    void reset()
+    {
+        dsd_fir1.reset();
+        pcm_fir2a.reset();
+        pcm_fir2b.reset();
+        pcm_fir2c.reset();
+        pcm_fir2d.reset();
+        pcm_fir3.reset();
+    }
+
     int convert(uint8_t* dsd_data, double* pcm_data, int dsd_samples)
     {
         int pcm_samples;
@@ -86,6 +96,15 @@ public:
         delay = (((dsd_fir1.get_delay() / pcm_fir2a.get_decimation() + pcm_fir2a.get_delay()) / pcm_fir2b.get_decimation() + pcm_fir2b.get_delay()) / pcm_fir2c.get_decimation() + pcm_fir2c.get_delay()) / pcm_fir3.get_decimation() + pcm_fir3.get_delay();
     }
 
+    void reset()
+    {
+        dsd_fir1.reset();
+        pcm_fir2a.reset();
+        pcm_fir2b.reset();
+        pcm_fir2c.reset();
+        pcm_fir3.reset();
+    }
+
     int convert(uint8_t* dsd_data, double* pcm_data, int dsd_samples)
     {
         int pcm_samples;
@@ -119,6 +138,14 @@ public:
         delay = ((dsd_fir1.get_delay() / pcm_fir2a.get_decimation() + pcm_fir2a.get_delay()) / pcm_fir2b.get_decimation() + pcm_fir2b.get_delay()) / pcm_fir3.get_decimation() + pcm_fir3.get_delay();
     }
 
+    void reset()
+    {
+        dsd_fir1.reset();
+        pcm_fir2a.reset();
+        pcm_fir2b.reset();
+        pcm_fir3.reset();
+    }
+
     int convert(uint8_t* dsd_data, double* pcm_data, int dsd_samples)
     {
         int pcm_samples;
@@ -149,6 +176,13 @@ public:
         delay = (dsd_fir1.get_delay() / pcm_fir2a.get_decimation() + pcm_fir2a.get_delay()) / pcm_fir3.get_decimation() + pcm_fir3.get_delay();
     }
 
+    void reset()
+    {
+        dsd_fir1.reset();
+        pcm_fir2a.reset();
+        pcm_fir3.reset();
+    }
+
     int convert(uint8_t* dsd_data, double* pcm_data, int dsd_samples)
     {
         int pcm_samples;
@@ -178,6 +212,13 @@ public:
         delay = (dsd_fir1.get_delay() / pcm_fir2a.get_decimation() + pcm_fir2a.get_delay()) / pcm_fir3.get_decimation() + pcm_fir3.get_delay();
     }
 
+    void reset()
+    {
+        dsd_fir1.reset();
+        pcm_fir2a.reset();
+        pcm_fir3.reset();
+    }
+
     int convert(uint8_t* dsd_data, double* pcm_data, int dsd_samples)
     {
         int pcm_samples;
@@ -204,6 +245,12 @@ public:
         delay = dsd_fir1.get_delay() / pcm_fir3.get_decimation() + pcm_fir3.get_delay();
     }
 
+    void reset()
+    {
+        dsd_fir1.reset();
+        pcm_fir3.reset();
+    }
+
     int convert(uint8_t* dsd_data, double* pcm_data, int dsd_samples)
     {
         int pcm_samples;
@@ -226,6 +273,11 @@ public:
         delay = dsd_fir1.get_delay();
     }
 
+    void reset()
+    {
+        dsd_fir1.reset();
+    }
+
     int convert(uint8_t* dsd_data, double* pcm_data, int dsd_samples)
     {
         int pcm_samples;
@@ -23,47 +23,90 @@
 #include "dsd_pcm_constants.h"
 #include "dsd_pcm_util.h"
 
-class DSDPCMFilterSetup
+// The lookup tables are generated by the compiler from the coefficients in dsd_pcm_constants.h. They end up in
+// read-only data: nothing to build at startup or per track, and every running process maps the same pages.
+
+template <int LENGTH>
+struct dsd_ctables_t
 {
-    using ctable_t = double[256];
-    ctable_t* dsd_fir1_8_ctables;
-    ctable_t* dsd_fir1_16_ctables;
-    ctable_t* dsd_fir1_64_ctables;
-    double* pcm_fir2_2_coefs;
-    double* pcm_fir3_2_coefs;
+    double ctables[CTABLES(LENGTH)][256];
+};
 
-public:
+template <int LENGTH>
+struct pcm_coefs_t
+{
+    double coefs[LENGTH];
+};
 
-    DSDPCMFilterSetup()
-    {
-        dsd_fir1_8_ctables = nullptr;
-        dsd_fir1_16_ctables = nullptr;
-        dsd_fir1_64_ctables = nullptr;
-        pcm_fir2_2_coefs = nullptr;
-        pcm_fir3_2_coefs = nullptr;
-    }
+constexpr double NORM_I(const int scale = 0)
+{
+    return (double)1 / (double)((unsigned int)1 << (31 - scale));
+}
 
-    ~DSDPCMFilterSetup()
+// One table per group of 8 taps, indexed by the 8 DSD bits that are in the group at a time
+template <int LENGTH>
+constexpr dsd_ctables_t<LENGTH> make_ctables(const double (&fir_coefs)[LENGTH], const double fir_gain)
+{
+    dsd_ctables_t<LENGTH> out = {};
+
+    for (int ct = 0; ct < CTABLES(LENGTH); ct++)
     {
+        int k = LENGTH - ct * 8;
+
+        if (k > 8)
+        {
+            k = 8;
+        }
+
+        if (k < 0)
+        {
+            k = 0;
+        }
+
+        for (int i = 0; i < 256; i++)
+        {
+            double cvalue = 0.0;
 
-        DSDPCMUtil::mem_free(pcm_fir2_2_coefs);
-        DSDPCMUtil::mem_free(pcm_fir3_2_coefs);
+            for (int j = 0; j < k; j++)
+            {
+                cvalue += (((i >> (7 - j)) & 1) * 2 - 1) * fir_coefs[LENGTH - 1 - (ct * 8 + j)];
+            }
+
+            out.ctables[ct][i] = (double)(cvalue * fir_gain);
+        }
     }
 
-    static const double NORM_I(const int scale = 0)
+    return out;
+}
+
+template <int LENGTH>
+constexpr pcm_coefs_t<LENGTH> make_coefs(const double (&fir_coefs)[LENGTH], const double fir_gain)
+{
+    pcm_coefs_t<LENGTH> out = {};
+
+    for (int i = 0; i < LENGTH; i++)
     {
-        return (double)1 / (double)((unsigned int)1 << (31 - scale));
+        out.coefs[i] = (double)(fir_coefs[LENGTH - 1 - i] * fir_gain);
     }
 
-    ctable_t* get_fir1_8_ctables()
-    {
-        if (!dsd_fir1_8_ctables)
-        {
-            dsd_fir1_8_ctables = (ctable_t*)DSDPCMUtil::mem_alloc(CTABLES(DSDFIR1_8_LENGTH) * sizeof(ctable_t));
-            set_ctables(DSDFIR1_8_COEFS, DSDFIR1_8_LENGTH, NORM_I(3), dsd_fir1_8_ctables);
-        }
+    return out;
+}
+
+alignas(MEM_ALIGN) constexpr dsd_ctables_t<DSDFIR1_8_LENGTH> DSDFIR1_8_CTABLES = make_ctables(DSDFIR1_8_COEFS, NORM_I(3));
+alignas(MEM_ALIGN) constexpr dsd_ctables_t<DSDFIR1_16_LENGTH> DSDFIR1_16_CTABLES = make_ctables(DSDFIR1_16_COEFS, NORM_I(3));
+alignas(MEM_ALIGN) constexpr dsd_ctables_t<DSDFIR1_64_LENGTH> DSDFIR1_64_CTABLES = make_ctables(DSDFIR1_64_COEFS, NORM_I());
+alignas(MEM_ALIGN) constexpr pcm_coefs_t<PCMFIR2_2_LENGTH> PCMFIR2_2_TABLE = make_coefs(PCMFIR2_2_COEFS, NORM_I());
+alignas(MEM_ALIGN) constexpr pcm_coefs_t<PCMFIR3_2_LENGTH> PCMFIR3_2_TABLE = make_coefs(PCMFIR3_2_COEFS, NORM_I());
 
-        return dsd_fir1_8_ctables;
+class DSDPCMFilterSetup
+{
+    using ctable_t = double[256];
+
+public:
+
+    const ctable_t* get_fir1_8_ctables()
+    {
+        return DSDFIR1_8_CTABLES.ctables;
     }
 
     int get_fir1_8_length()
@@ -71,15 +114,9 @@ public:
         return DSDFIR1_8_LENGTH;
     }
 
-    ctable_t* get_fir1_16_ctables()
+    const ctable_t* get_fir1_16_ctables()
     {
-        if (!dsd_fir1_16_ctables)
-        {
-            dsd_fir1_16_ctables = (ctable_t*)DSDPCMUtil::mem_alloc(CTABLES(DSDFIR1_16_LENGTH) * sizeof(ctable_t));
-            set_ctables(DSDFIR1_16_COEFS, DSDFIR1_16_LENGTH, NORM_I(3), dsd_fir1_16_ctables);
-        }
-
-        return dsd_fir1_16_ctables;
+        return DSDFIR1_16_CTABLES.ctables;
     }
 
     int get_fir1_16_length()
@@ -87,32 +124,19 @@ public:
         return DSDFIR1_16_LENGTH;
     }
 
-    ctable_t* get_fir1_64_ctables()
+    const ctable_t* get_fir1_64_ctables()
     {
-        if (!dsd_fir1_64_ctables)
-        {
-            dsd_fir1_64_ctables = (ctable_t*)DSDPCMUtil::mem_alloc(CTABLES(DSDFIR1_64_LENGTH) * sizeof(ctable_t));
-            set_ctables(DSDFIR1_64_COEFS, DSDFIR1_64_LENGTH, NORM_I(), dsd_fir1_64_ctables);
-        }
-
-        return dsd_fir1_64_ctables;
+        return DSDFIR1_64_CTABLES.ctables;
     }
 
-
     int get_fir1_64_length()
     {
         return DSDFIR1_64_LENGTH;
     }
 
-    double* get_fir2_2_coefs()
+    const double* get_fir2_2_coefs()
     {
-        if (!pcm_fir2_2_coefs)
-        {
-            pcm_fir2_2_coefs = (double*)DSDPCMUtil::mem_alloc(PCMFIR2_2_LENGTH * sizeof(double));
-            set_coefs(PCMFIR2_2_COEFS, PCMFIR2_2_LENGTH, NORM_I(), pcm_fir2_2_coefs);
-        }
-
-        return pcm_fir2_2_coefs;
+        return PCMFIR2_2_TABLE.coefs;
     }
 
     int get_fir2_2_length()
@@ -120,63 +144,13 @@ public:
         return PCMFIR2_2_LENGTH;
     }
 
-    double* get_fir3_2_coefs()
+    const double* get_fir3_2_coefs()
     {
-        if (!pcm_fir3_2_coefs)
-        {
-            pcm_fir3_2_coefs = (double*)DSDPCMUtil::mem_alloc(PCMFIR3_2_LENGTH * sizeof(double));
-            set_coefs(PCMFIR3_2_COEFS, PCMFIR3_2_LENGTH, NORM_I(), pcm_fir3_2_coefs);
-        }
-
-        return pcm_fir3_2_coefs;
+        return PCMFIR3_2_TABLE.coefs;
     }
 
     int get_fir3_2_length()
     {
         return PCMFIR3_2_LENGTH;
     }
-
-private:
-
-    int set_ctables(const double* fir_coefs, const int fir_length, const double fir_gain, ctable_t* out_ctables)
-    {
-        int ctables = CTABLES(fir_length);
-
-        for (int ct = 0; ct < ctables; ct++)
-        {
-            int k = fir_length - ct * 8;
-
-            if (k > 8)
-            {
-                k = 8;
-            }
-
-            if (k < 0)
-            {
-                k = 0;
-            }
-
-            for (int i = 0; i < 256; i++)
-            {
-                double cvalue = 0.0;
-
-                for (int j = 0; j < k; j++)
-                {
-                    cvalue += (((i >> (7 - j)) & 1) * 2 - 1) * fir_coefs[fir_length - 1 - (ct * 8 + j)];
-                }
-
-                out_ctables[ct][i] = (double)(cvalue * fir_gain);
-            }
-        }
-
-        return ctables;
-    }
-
-    void set_coefs(const double* fir_coefs, const int fir_length, const double fir_gain, double* out_coefs)
-    {
-        for (int i = 0; i < fir_length; i++)
-        {
-            out_coefs[i] = (double)(fir_coefs[fir_length - 1 - i] * fir_gain);
-        }
-    }
 };
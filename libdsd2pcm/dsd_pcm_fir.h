@@ -23,7 +23,7 @@
 class DSDPCMFir
 {
     using ctable_t = double[256];
-    ctable_t* fir_ctables;
+    const ctable_t* fir_ctables;
     int fir_order;
     int fir_length;
     int decimation;
@@ -47,7 +47,7 @@ public:
         free();
     }
 
-    void init(ctable_t* fir_ctables, int fir_length, int decimation)
+    void init(const ctable_t* fir_ctables, int fir_length, int decimation)
     {
         this->fir_ctables = fir_ctables;
         this->fir_order = fir_length - 1;
@@ -59,6 +59,13 @@ public:
         fir_index = 0;
     }
 
+    // Back to silence as after init(), the tables stay
+    void reset()
+    {
+        memset(fir_buffer, DSD_SILENCE_BYTE, 2 * fir_length * sizeof(uint8_t));
+        fir_index = 0;
+    }
+
     void free()
     {
         if (fir_buffer)
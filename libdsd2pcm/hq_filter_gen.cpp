@@ -0,0 +1,83 @@
+/*
+    Copyright 2015-2016 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+// Build time helper: prints hq_filters.h, the polyphase filters of every DSD/PCM rate pair dsdpcm_converter_hq::init
+// accepts, already split into aligned phases so the converter does not have to generate them for every track.
+// The parameters must follow the formulas in dsdpcm_converter_hq::init.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "upsampler.h"
+
+int main()
+{
+    int multiplier, divisor, upsampling, taps, sinc_freq, phase_size, i, j, n = 0;
+    double *impulse;
+
+    printf("// Generated by hq_filter_gen, do not edit\n\n");
+    printf("#ifndef _hq_filters_h_\n#define _hq_filters_h_\n\n");
+    printf("struct hq_filter_table_t\n{\n    int upsampling;\n    int taps;\n    int sinc_freq;\n    int phase_size;\n    const double *phases;\n};\n\n");
+
+    for (multiplier = 1; multiplier <= 8; multiplier *= 2)
+    {
+        for (divisor = 1; divisor <= 2; divisor++)
+        {
+            upsampling = 5 * divisor;
+            taps = 2878 * divisor * multiplier + 1;
+            sinc_freq = 350 * divisor * multiplier;
+            phase_size = (taps / upsampling + 1 + 7) / 8 * 8;
+
+            impulse = new double[taps];
+            generateFilter(impulse, taps, sinc_freq);
+
+            printf("alignas(64) static const double hq_filter_%d[%d] =\n{\n", n, upsampling * phase_size);
+
+            for (i = 0; i < upsampling; i++)
+            {
+                for (j = 0; j < phase_size; j++)
+                    printf("%.17g,%s", (i + j * upsampling < taps) ? impulse[i + j * upsampling] : 0.0, ((j % 4) == 3) ? "\n" : " ");
+            }
+
+            printf("};\n\n");
+
+            delete[] impulse;
+            n++;
+        }
+    }
+
+    printf("static const hq_filter_table_t hq_filter_tables[] =\n{\n");
+
+    n = 0;
+
+    for (multiplier = 1; multiplier <= 8; multiplier *= 2)
+    {
+        for (divisor = 1; divisor <= 2; divisor++)
+        {
+            upsampling = 5 * divisor;
+            taps = 2878 * divisor * multiplier + 1;
+
+            printf("    {%d, %d, %d, %d, hq_filter_%d},\n", upsampling, taps, 350 * divisor * multiplier, (taps / upsampling + 1 + 7) / 8 * 8, n);
+            n++;
+        }
+    }
+
+    printf("};\n\n#endif\n");
+
+    return 0;
+}
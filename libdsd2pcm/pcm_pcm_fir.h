@@ -22,7 +22,7 @@
 
 class PCMPCMFir
 {
-    double* fir_coefs;
+    const double* fir_coefs;
     int fir_order;
     int fir_length;
     int decimation;
@@ -46,7 +46,7 @@ public:
         free();
     }
 
-    void init(double* fir_coefs, int fir_length, int decimation)
+    void init(const double* fir_coefs, int fir_length, int decimation)
     {
         this->fir_coefs = fir_coefs;
         this->fir_order = fir_length - 1;
@@ -58,6 +58,12 @@ public:
         fir_index = 0;
     }
 
+    void reset()
+    {
+        memset(fir_buffer, 0, 2 * fir_length * sizeof(double));
+        fir_index = 0;
+    }
+
     void free()
     {
         if (fir_buffer)
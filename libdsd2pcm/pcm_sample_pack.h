@@ -0,0 +1,194 @@
+/*
+    Copyright (c) 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <emmintrin.h>
+#include <tmmintrin.h>
+
+class PCMSamplePack
+{
+
+public:
+
+    // Clamp to [-1.0, 1.0], scale and round to nearest, store as 24-bit little endian (3 * count bytes)
+    static void pack24(const float* in, size_t count, uint8_t* out)
+    {
+        static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+
+        if (has_ssse3)
+        {
+            pack24_ssse3(in, count, out);
+        }
+        else
+        {
+            pack24_sse2(in, count, out);
+        }
+    }
+
+    static inline int32_t to_int24(float sample)
+    {
+        // NaN compares false and ends up at full scale, like the vector min/max
+        sample = sample < 1.0f ? sample : 1.0f;
+        sample = sample > -1.0f ? sample : -1.0f;
+        int32_t value = lrintf(sample * 8388608.0f);
+
+        return value < 8388607 ? value : 8388607;
+    }
+
+    // 1.0 - 2^-23 scales to exactly 8388607, so the integer side needs no clamp
+    static inline __m128i to_int24_x4(__m128 x)
+    {
+        const __m128 hi = _mm_set1_ps(8388607.0f / 8388608.0f);
+        const __m128 lo = _mm_set1_ps(-1.0f);
+        const __m128 scale = _mm_set1_ps(8388608.0f);
+
+        return _mm_cvtps_epi32(_mm_mul_ps(_mm_max_ps(_mm_min_ps(x, hi), lo), scale));
+    }
+
+    static void pack24_sse2(const float* in, size_t count, uint8_t* out)
+    {
+        size_t i = 0;
+
+        for (; i + 4 <= count; i += 4, out += 12)
+        {
+            int32_t v[4];
+            _mm_storeu_si128((__m128i*)v, to_int24_x4(_mm_loadu_ps(in + i)));
+
+            for (int k = 0; k < 4; k++)
+            {
+                out[3 * k + 0] = (uint8_t)(v[k]);
+                out[3 * k + 1] = (uint8_t)(v[k] >> 8);
+                out[3 * k + 2] = (uint8_t)(v[k] >> 16);
+            }
+        }
+
+        pack24_tail(in + i, count - i, out);
+    }
+
+    // pshufb drops the top byte of every lane, byte shifts splice four 12 byte groups into three stores
+    __attribute__((target("ssse3")))
+    static void pack24_ssse3(const float* in, size_t count, uint8_t* out)
+    {
+        const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        size_t i = 0;
+
+        for (; i + 16 <= count; i += 16, out += 48)
+        {
+            __m128i s0 = _mm_shuffle_epi8(to_int24_x4(_mm_loadu_ps(in + i + 0)), pack);
+            __m128i s1 = _mm_shuffle_epi8(to_int24_x4(_mm_loadu_ps(in + i + 4)), pack);
+            __m128i s2 = _mm_shuffle_epi8(to_int24_x4(_mm_loadu_ps(in + i + 8)), pack);
+            __m128i s3 = _mm_shuffle_epi8(to_int24_x4(_mm_loadu_ps(in + i + 12)), pack);
+            _mm_storeu_si128((__m128i*)(out + 0), _mm_or_si128(s0, _mm_slli_si128(s1, 12)));
+            _mm_storeu_si128((__m128i*)(out + 16), _mm_or_si128(_mm_srli_si128(s1, 4), _mm_slli_si128(s2, 8)));
+            _mm_storeu_si128((__m128i*)(out + 32), _mm_or_si128(_mm_srli_si128(s2, 8), _mm_slli_si128(s3, 4)));
+        }
+
+        pack24_tail(in + i, count - i, out);
+    }
+
+    static void pack24_tail(const float* in, size_t count, uint8_t* out)
+    {
+        for (size_t i = 0; i < count; i++, out += 3)
+        {
+            int32_t value = to_int24(in[i]);
+            out[0] = (uint8_t)(value);
+            out[1] = (uint8_t)(value >> 8);
+            out[2] = (uint8_t)(value >> 16);
+        }
+    }
+
+    static inline int16_t to_int16(float sample)
+    {
+        sample = sample < 1.0f ? sample : 1.0f;
+        sample = sample > -1.0f ? sample : -1.0f;
+        int32_t value = lrintf(sample * 32768.0f);
+
+        return (int16_t)(value < 32767 ? value : 32767);
+    }
+
+    // Same clamp and rounding as pack24, packssdw saturates the top code
+    static void pack16(const float* in, size_t count, int16_t* out)
+    {
+        const __m128 hi = _mm_set1_ps(1.0f);
+        const __m128 lo = _mm_set1_ps(-1.0f);
+        const __m128 scale = _mm_set1_ps(32768.0f);
+        size_t i = 0;
+
+        for (; i + 8 <= count; i += 8)
+        {
+            __m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_max_ps(_mm_min_ps(_mm_loadu_ps(in + i + 0), hi), lo), scale));
+            __m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_max_ps(_mm_min_ps(_mm_loadu_ps(in + i + 4), hi), lo), scale));
+            _mm_storeu_si128((__m128i*)(out + i), _mm_packs_epi32(a, b));
+        }
+
+        for (; i < count; i++)
+        {
+            out[i] = to_int16(in[i]);
+        }
+    }
+
+    static inline int32_t to_int32(float sample)
+    {
+        // The largest float below 1.0 is 1 - 2^-24, which still fits after scaling by 2^31
+        sample = sample < 0.99999994f ? sample : 0.99999994f;
+        sample = sample > -1.0f ? sample : -1.0f;
+
+        return (int32_t)lrintf(sample * 2147483648.0f);
+    }
+
+    static void pack32(const float* in, size_t count, int32_t* out)
+    {
+        const __m128 hi = _mm_set1_ps(0.99999994f);
+        const __m128 lo = _mm_set1_ps(-1.0f);
+        const __m128 scale = _mm_set1_ps(2147483648.0f);
+        size_t i = 0;
+
+        for (; i + 4 <= count; i += 4)
+        {
+            _mm_storeu_si128((__m128i*)(out + i), _mm_cvtps_epi32(_mm_mul_ps(_mm_max_ps(_mm_min_ps(_mm_loadu_ps(in + i), hi), lo), scale)));
+        }
+
+        for (; i < count; i++)
+        {
+            out[i] = to_int32(in[i]);
+        }
+    }
+
+    // Float output keeps everything the converters produce, overs included, so there is no clamp
+    static void widen64(const float* in, size_t count, double* out)
+    {
+        size_t i = 0;
+
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(in + i);
+            _mm_storeu_pd(out + i, _mm_cvtps_pd(x));
+            _mm_storeu_pd(out + i + 2, _mm_cvtps_pd(_mm_movehl_ps(x, x)));
+        }
+
+        for (; i < count; i++)
+        {
+            out[i] = in[i];
+        }
+    }
+};
@@ -175,7 +175,7 @@ void FirFilter::pushSample(double x)
 }
 
 // fir must be aligned! fir_size must be %8!
-double FirFilter::fast_convolve(double *x)
+double FirFilter::fast_convolve(double *x) const
 {
     unsigned int i;
     double y;
@@ -212,43 +212,88 @@ void FirFilter::reset(bool reset_to_1)
     m_x.reset(reset_to_1);
 }
 
-// ResamplerNxMx
-ResamplerNxMx::ResamplerNxMx(unsigned int nX, unsigned int mX, const double *fir, unsigned int fir_size) : m_x((fir_size % nX) == 0 ? fir_size / nX : fir_size / nX + 1)
+// PolyphaseFilter
+PolyphaseFilter::PolyphaseFilter(unsigned int nX, const double *fir, unsigned int fir_size)
 {
-    unsigned int *xfir_size, i, j;
-    double *xfir;
+    unsigned int i, j;
+    double *phases;
 
     m_fir_size = fir_size;
     m_xN = nX;
-    m_xM = mX;
-    xfir_size = new unsigned int[nX];
-    m_flt = new FirFilter[nX];
+
+    // every phase padded with zeros to the size of the longest one, aligned
+    m_phase_size = (fir_size / nX + 1 + 7) / 8 * 8;
+    m_alloc = new double[m_xN * m_phase_size + 2]; // reserve some space for pointer align
+
+    // align pointer!
+    phases = (((size_t)m_alloc & 0x0f) == 0) ? m_alloc : (double *)(((size_t)m_alloc & ~0x0f) + 0x10);
 
     for (i = 0; i < nX; i++)
     {
-        xfir_size[i] = (i < (fir_size % nX)) ? (fir_size / nX + 1) : (fir_size / nX);
+        for (j = 0; j < m_phase_size; j++)
+            phases[i * m_phase_size + j] = (i + j * nX < fir_size) ? fir[i + j * nX] : 0;
+    }
+
+    m_phases = phases;
+}
+
+PolyphaseFilter::PolyphaseFilter(unsigned int nX, const double *phases, unsigned int phase_size, unsigned int fir_size)
+{
+    assert(((size_t)phases & 0x0f) == 0 && (phase_size % 8) == 0);
 
-        // use max size for alloc
-        xfir = new double[xfir_size[0]];
+    m_fir_size = fir_size;
+    m_xN = nX;
+    m_phase_size = phase_size;
+    m_phases = phases;
+    m_alloc = NULL;
+}
+
+PolyphaseFilter::~PolyphaseFilter()
+{
+    delete[] m_alloc;
+}
+
+// same as FirFilter::fast_convolve
+double PolyphaseFilter::convolve(unsigned int phase, const double *x) const
+{
+    const double *fir = m_phases + phase * m_phase_size;
+    unsigned int i;
 
-        // fill and pad with zeros
-        for (j = 0; j < xfir_size[0]; j++)
-            xfir[j] = j < xfir_size[i] ? fir[i + j * nX] : 0;
+    __m128d xy1, xy2, xy3, xy4;
 
-        // got filter
-        m_flt[i] = FirFilter(xfir, xfir_size[i], true);
+    xy1 = _mm_setzero_pd();
+    xy2 = _mm_setzero_pd();
+    xy3 = _mm_setzero_pd();
+    xy4 = _mm_setzero_pd();
 
-        delete[] xfir;
+    for (i = 0; i < m_phase_size; i += 8)
+    {
+        xy1 = _mm_add_pd(xy1, _mm_mul_pd(_mm_loadu_pd(x + i), _mm_load_pd(fir + i)));
+        xy2 = _mm_add_pd(xy2, _mm_mul_pd(_mm_loadu_pd(x + i + 2), _mm_load_pd(fir + i + 2)));
+        xy3 = _mm_add_pd(xy3, _mm_mul_pd(_mm_loadu_pd(x + i + 4), _mm_load_pd(fir + i + 4)));
+        xy4 = _mm_add_pd(xy4, _mm_mul_pd(_mm_loadu_pd(x + i + 6), _mm_load_pd(fir + i + 6)));
     }
 
-    delete[] xfir_size;
+    xy1 = _mm_add_pd(_mm_add_pd(xy1, xy2), _mm_add_pd(xy3, xy4));
 
+    double xy_flt[2];
+
+    _mm_storeu_pd(xy_flt, xy1);
+
+    return xy_flt[0] + xy_flt[1];
+}
+
+// ResamplerNxMx
+ResamplerNxMx::ResamplerNxMx(unsigned int mX, const PolyphaseFilter *flt) : m_x(flt->getPhaseSize())
+{
+    m_xN = flt->getPhaseCount();
+    m_xM = mX;
+    m_flt = flt;
     m_xN_counter = 0;
 }
 
 ResamplerNxMx::~ResamplerNxMx()
 {
-    delete[] m_flt;
 }
 
 void ResamplerNxMx::processSample(const double *x, unsigned int x_n, double *y, unsigned int *y_n)
@@ -275,7 +320,7 @@ void ResamplerNxMx::processSample(const double *x, unsigned int x_n, double *y,
             // apply phase shift (0 -> 0000x -> (N-1); 1 -> x0000 -> 0; 2 -> 0x000 -> 1)
             x_phase = (x_phase + (m_xN - 1)) % m_xN;
 
-            y[offset++] = m_flt[x_phase].fast_convolve(m_x.getBuffer()) * (double)m_xN;
+            y[offset++] = m_flt->convolve(x_phase, m_x.getBuffer()) * (double)m_xN;
 
             // leave some zero virtual samples in buffer
             m_xN_counter -= m_xM;
@@ -289,11 +334,6 @@ void ResamplerNxMx::processSample(const double *x, unsigned int x_n, double *y,
 
 void ResamplerNxMx::reset(bool reset_to_1)
 {
-    unsigned int i;
-
-    for (i = 0; i < m_xN; i++)
-        m_flt[i].reset();
-
     m_x.reset(reset_to_1);
 
     m_xN_counter = 0;
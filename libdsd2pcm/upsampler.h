@@ -52,7 +52,7 @@ public:
     double processSample(double x);
     void reset(bool reset_to_1 = false);
     void pushSample(double x);
-    double fast_convolve(double *x);
+    double fast_convolve(double *x) const;
     const double *getFir() const { return m_fir; }
     unsigned int getFirSize() const { return m_org_fir_size; }
 
@@ -64,21 +64,42 @@ private:
     unsigned int m_org_fir_size;
 };
 
+// the nX phases of a resampling filter, immutable once built so any number of resamplers can share them
+class PolyphaseFilter
+{
+public:
+    // split fir into phases
+    PolyphaseFilter(unsigned int nX, const double *fir, unsigned int fir_size);
+    // use phases that are already split: phase i at phases + i * phase_size, aligned, phase_size % 8 == 0, not copied
+    PolyphaseFilter(unsigned int nX, const double *phases, unsigned int phase_size, unsigned int fir_size);
+    ~PolyphaseFilter();
+    double convolve(unsigned int phase, const double *x) const;
+    unsigned int getPhaseCount() const { return m_xN; }
+    unsigned int getPhaseSize() const { return m_phase_size; }
+    unsigned int getFirSize() const { return m_fir_size; }
+
+private:
+    unsigned int m_xN;
+    unsigned int m_fir_size;
+    unsigned int m_phase_size; // aligned
+    const double *m_phases; // [m_xN * m_phase_size]
+    double *m_alloc;
+};
+
 // Nx/Mx resampler
 class ResamplerNxMx
 {
 public:
-    ResamplerNxMx(unsigned int nX, unsigned int mX, const double *fir, unsigned int fir_size);
+    ResamplerNxMx(unsigned int mX, const PolyphaseFilter *flt);
     ~ResamplerNxMx();
     void processSample(const double *x, unsigned int x_n, double *y, unsigned int *y_n);
     void reset(bool reset_to_1 = false);
-    unsigned int getFirSize() const { return m_fir_size; }
+    unsigned int getFirSize() const { return m_flt->getFirSize(); }
 
 private:
     unsigned int m_xN; // up^
     unsigned int m_xM; // down_
-    unsigned int m_fir_size;
-    FirFilter *m_flt; // [m_xN]
+    const PolyphaseFilter *m_flt; // not owned
     FirHistory m_x;
     unsigned int m_xN_counter; // how many virtually upsampled samples we have in FirHistory?
 };
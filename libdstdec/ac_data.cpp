@@ -241,3 +241,99 @@ void CACData::decodeBit_Flush(uint8_t* b, int p, ADataByte* cb, int fs)
         }
     }
 }
+
+// Encoder counterpart of decodeBit_Init(): C holds the lower end of the interval, cbptr the next code bit to write.
+// Bit 0 of the code is never written, it stays 0 and takes the (impossible) carry out of the first interval.
+void CACData::encodeBit_Init(ADataByte* cb, int fs)
+{
+    Init = 0;
+    A = ONE - 1;
+    C = 0;
+    cbptr = 1;
+    dst_memset(cb, 0, (fs + 7) / 8);
+}
+
+// Splits the interval exactly like decodeBit_Decode(). Bits beyond fs are counted but not stored.
+void CACData::encodeBit_Encode(uint8_t b, int p, ADataByte* cb, int fs)
+{
+    unsigned int ap;
+    unsigned int h;
+
+    // approximate (A * p) with "partial rounding".
+    ap = ((A >> PBITS) | ((A >> (PBITS - 1)) & 1)) * p;
+    h = A - ap;
+
+    if (b == 0)
+    {
+        C += h;
+        A = ap;
+    }
+    else
+    {
+        A = h;
+    }
+
+    // Propagate the carry into the bits already written
+    if (C >= ONE)
+    {
+        C -= ONE;
+
+        for (int i = cbptr - 1; i > 0 && i < fs; i--)
+        {
+            cb[i >> 3] ^= (ADataByte)(0x80 >> (i & 7));
+
+            if (GET_BIT(cb, i) != 0)
+            {
+                break;
+            }
+        }
+    }
+
+    while (A < HALF)
+    {
+        A <<= 1;
+
+        if (cbptr < fs && ((C >> (ABITS - 1)) & 1))
+        {
+            cb[cbptr >> 3] |= (ADataByte)(0x80 >> (cbptr & 7));
+        }
+
+        C = (C << 1) & (ONE - 1);
+        cbptr++;
+    }
+}
+
+// Writes the lower end of the final interval. The decoder reads zeros past the end of the code, so trailing zeros are
+// left out. Returns the length of the code in bits, more than fs if it did not fit.
+int CACData::encodeBit_Flush(ADataByte* cb, int fs)
+{
+    int len = 1;
+
+    Init = 1;
+
+    for (int i = ABITS - 1; i >= 0; i--)
+    {
+        if (cbptr < fs && ((C >> i) & 1))
+        {
+            cb[cbptr >> 3] |= (ADataByte)(0x80 >> (cbptr & 7));
+        }
+
+        cbptr++;
+    }
+
+    if (cbptr > fs)
+    {
+        return cbptr;
+    }
+
+    for (int i = cbptr - 1; i > 0; i--)
+    {
+        if (GET_BIT(cb, i) != 0)
+        {
+            len = i + 1;
+            break;
+        }
+    }
+
+    return len;
+}
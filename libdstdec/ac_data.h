@@ -81,6 +81,9 @@ public:
     void decodeBit_Init(ADataByte* cb, int fs);
     void decodeBit_Decode(uint8_t* b, int p, ADataByte* cb, int fs);
     void decodeBit_Flush(uint8_t* b, int p, ADataByte* cb, int fs);
+    void encodeBit_Init(ADataByte* cb, int fs);
+    void encodeBit_Encode(uint8_t b, int p, ADataByte* cb, int fs);
+    int encodeBit_Flush(ADataByte* cb, int fs);
 };
 
 #endif
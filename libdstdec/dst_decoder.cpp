@@ -70,14 +70,16 @@
 
 CDSTDecoder::CDSTDecoder()
 {
+    Planar = false;
 }
 
 CDSTDecoder::~CDSTDecoder()
 {
 }
 
-int CDSTDecoder::init(int channels, int fs44)
+int CDSTDecoder::init(int channels, int fs44, bool planar)
 {
+    Planar = planar;
     FrameHdr.NrOfChannels = channels;
     FrameHdr.MaxFrameLen = (588 * fs44 / 8);
     FrameHdr.ByteStreamLen = FrameHdr.MaxFrameLen * FrameHdr.NrOfChannels;
@@ -122,6 +124,8 @@ int CDSTDecoder::decode(uint8_t* DSTFrame, int frameSize, uint8_t* DSDFrame)
     uint8_t ACError;
     int NrOfBitsPerCh = FrameHdr.NrOfBitsPerCh;
     int NrOfChannels = FrameHdr.NrOfChannels;
+    int ByteStride = Planar ? 1 : NrOfChannels;
+    int ChStride = Planar ? FrameHdr.MaxFrameLen : 1;
 
     FrameHdr.FrameNr++;
     FrameHdr.CalcNrOfBytes = frameSize / 8;
@@ -177,7 +181,7 @@ int CDSTDecoder::decode(uint8_t* DSTFrame, int frameSize, uint8_t* DSDFrame)
                 BitVal = ((((uint16_t)Predict) >> 15) ^ Residual) & 1;
 
                 // Shift the result into the correct bit position
-                DSDFrame[(BitNr >> 3) * NrOfChannels + ChNr] |= (uint8_t)(BitVal << (7 - (BitNr & 7)));
+                DSDFrame[(BitNr >> 3) * ByteStride + ChNr * ChStride] |= (uint8_t)(BitVal << (7 - (BitNr & 7)));
 
                 // Update filter
                 uint32_t* const st = (uint32_t*)LT_Status[ChNr];
@@ -226,7 +230,7 @@ int CDSTDecoder::unpack(uint8_t* DSTFrame, uint8_t* DSDFrame)
         }
 
         // Read DSD data and put in output stream
-        CFrameReader::readDSDFrame(SD, FrameHdr.MaxFrameLen, FrameHdr.NrOfChannels, DSDFrame);
+        CFrameReader::readDSDFrame(SD, FrameHdr.MaxFrameLen, FrameHdr.NrOfChannels, Planar, DSDFrame);
     }
     else
     {
@@ -84,13 +84,15 @@ public:
 
     CDSTDecoder();
     ~CDSTDecoder();
-    int init(int channels, int fs44);
+    int init(int channels, int fs44, bool planar = false);
     int close();
     int decode(uint8_t* DSTFrame, int frameSize, uint8_t* DSDFrame);
     int unpack(uint8_t* DSTFrame, uint8_t* DSDFrame);
 
 private:
 
+    bool Planar; // Output channel after channel (MaxFrameLen bytes each) instead of byte interleaved
+
     int16_t reverse7LSBs(int16_t c);
     void fillTable4Bit(CSegment& S, uint8_t Table4Bit[MAX_CHANNELS][MAX_DSDBITS_INFRAME / 2]);
     void LT_InitCoefTablesI(int16_t ICoefI[2 * MAX_CHANNELS][16][256]);
@@ -56,7 +56,7 @@ void* DSTDecoderThread(void* threadarg)
         {
             bError = true;
             frame_slot->D.close();
-            frame_slot->D.init(frame_slot->channel_count, frame_slot->samplerate / 44100);
+            frame_slot->D.init(frame_slot->channel_count, frame_slot->samplerate / 44100, frame_slot->planar);
         }
 
         pthread_mutex_lock(&frame_slot->hMutex);
@@ -108,17 +108,18 @@ dst_decoder_t::~dst_decoder_t()
     delete[] frame_slots;
 }
 
-int dst_decoder_t::init(int channel_count, int samplerate, int framerate)
+int dst_decoder_t::init(int channel_count, int samplerate, int framerate, bool planar)
 {
     for (int i = 0; i < thread_count; i++)
     {
         frame_slot_t* frame_slot = &frame_slots[i];
 
-        if (frame_slot->D.init(channel_count, (samplerate / 44100) / (framerate / 75)) == 0)
+        if (frame_slot->D.init(channel_count, (samplerate / 44100) / (framerate / 75), planar) == 0)
         {
             frame_slot->channel_count = channel_count;
             frame_slot->samplerate = samplerate;
             frame_slot->framerate = framerate;
+            frame_slot->planar = planar;
             frame_slot->dsd_size = (size_t)(samplerate / 8 / framerate * channel_count);
             pthread_mutex_init(&frame_slot->hMutex, NULL);
             pthread_cond_init(&frame_slot->hEventGet, NULL);
@@ -39,6 +39,7 @@ class frame_slot_t
         int channel_count;
         int samplerate;
         int framerate;
+        bool planar;
         pthread_t hThread;
         pthread_cond_t hEventGet;
         pthread_cond_t hEventPut;
@@ -55,6 +56,7 @@ class frame_slot_t
             channel_count = 0;
             samplerate = 0;
             framerate = 0;
+            planar = false;
             frame_nr = 0;
         }
 };
@@ -74,7 +76,7 @@ public:
 
     dst_decoder_t(int threads);
     ~dst_decoder_t();
-    int init(int channel_count, int samplerate, int framerate);
+    int init(int channel_count, int samplerate, int framerate, bool planar = false);
     int decode(uint8_t* dst_data, size_t dst_size, uint8_t** dsd_data, size_t* dsd_size);
 };
 
@@ -0,0 +1,545 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#include <math.h>
+#include "ac_data.h"
+#include "frame_writer.h"
+#include "dst_encoder.h"
+
+// Prediction orders tried for every channel, per effort level (0 terminated)
+static const int EffortOrders[DST_EFFORT_MAX + 1][9] =
+{
+    {32, 0},
+    {128, 0},
+    {64, 96, 128, 0},
+    {16, 32, 48, 64, 80, 96, 112, 128, 0}
+};
+
+// Weight of a filter coefficient of 1, filters with larger coefficients are scaled down to fit SIZE_PREDCOEF bits
+#define COEF_SCALE 128.0
+
+CDSTEncoder::CDSTEncoder()
+{
+    Effort = DST_EFFORT_DEFAULT;
+    ADataLen = 0;
+}
+
+CDSTEncoder::~CDSTEncoder()
+{
+}
+
+int CDSTEncoder::init(int channels, int fs44, int effort)
+{
+    if (channels < 1 || channels > MAX_CHANNELS || fs44 < 1 || 588 * fs44 / 8 > MAX_DSDBYTES_INFRAME)
+    {
+        return -1;
+    }
+
+    Effort = MIN(MAX(effort, DST_EFFORT_MIN), DST_EFFORT_MAX);
+    FrameHdr.NrOfChannels = channels;
+    FrameHdr.MaxFrameLen = (588 * fs44 / 8);
+    FrameHdr.ByteStreamLen = FrameHdr.MaxFrameLen * FrameHdr.NrOfChannels;
+    FrameHdr.BitStreamLen = FrameHdr.ByteStreamLen * 8;
+    FrameHdr.NrOfBitsPerCh = FrameHdr.MaxFrameLen * 8;
+    FrameHdr.MaxNrOfFilters = 2 * FrameHdr.NrOfChannels;
+    FrameHdr.MaxNrOfPtables = 2 * FrameHdr.NrOfChannels;
+    FrameHdr.FrameNr = 0;
+
+    BitCost[0] = 0;
+
+    for (int p = 1; p <= AC_PROBS; p++)
+    {
+        BitCost[p] = -log2((double)p / AC_PROBS);
+    }
+
+    return 0;
+}
+
+int CDSTEncoder::close()
+{
+    return 0;
+}
+
+// Inverse of CDSTDecoder::reverse7LSBs(), the probability of the bit that starts the arithmetic code
+static int reverse7LSBs(int16_t c)
+{
+    int v = (c + (1 << SIZE_PREDCOEF)) & 127;
+    int r = 0;
+
+    for (int i = 0; i < 7; i++)
+    {
+        r |= ((v >> i) & 1) << (6 - i);
+    }
+
+    return r + 1;
+}
+
+// DST encode a complete frame (all channels), returns the size of the DST frame in bytes (at most 1 + all DSD bytes)
+int CDSTEncoder::encode(uint8_t* DSDFrame, uint8_t* DSTFrame)
+{
+    FrameHdr.FrameNr++;
+
+    for (int ChNr = 0; ChNr < FrameHdr.NrOfChannels; ChNr++)
+    {
+        designChannel(DSDFrame, ChNr);
+    }
+
+    assignTables();
+    ADataLen = encodeAData(DSDFrame);
+
+    if (ADataLen < FrameHdr.BitStreamLen)
+    {
+        SD.resetWritingIndex();
+        SD.putIntUnsigned(1, 1);
+        CFrameWriter::writeSegmentData(SD, FrameHdr);
+        CFrameWriter::writeMappingData(SD, FrameHdr);
+        CFrameWriter::writeFilterCoefSets(SD, FrameHdr, StrFilter);
+        CFrameWriter::writeProbabilityTables(SD, FrameHdr, StrPtable, P_one);
+        CFrameWriter::writeArithmeticCodedData(SD, ADataLen, AData);
+
+        int Size = (SD.get_out_bitcount() + 7) / 8;
+
+        if (Size <= FrameHdr.ByteStreamLen)
+        {
+            uint8_t* pBuffer;
+
+            SD.getDSTDataPointer(&pBuffer);
+            dst_memcpy(DSTFrame, pBuffer, Size);
+
+            return Size;
+        }
+    }
+
+    // Not compressible: DSTCoded = 0, a dummy bit and 6 stuffing bits, then the DSD as it is
+    DSTFrame[0] = 0;
+    dst_memcpy(DSTFrame + 1, DSDFrame, FrameHdr.ByteStreamLen);
+
+    return 1 + FrameHdr.ByteStreamLen;
+}
+
+// Autocorrelation of one channel as a +1/-1 signal: x[n] * x[n + k] = 1 - 2 * (b[n] ^ b[n + k]), counted 64 bits at once
+void CDSTEncoder::calcAutocorr(uint8_t* DSDFrame, int ChNr, int MaxOrder, double* Autocorr)
+{
+    int NrOfChannels = FrameHdr.NrOfChannels;
+    int NrOfBits = FrameHdr.NrOfBitsPerCh;
+    int NrOfWords = (NrOfBits + 63) / 64;
+
+    dst_memset(ChBits, 0, (NrOfWords + 2) * sizeof(uint64_t));
+
+    for (int ByteNr = 0; ByteNr < FrameHdr.MaxFrameLen; ByteNr++)
+    {
+        ChBits[ByteNr >> 3] |= (uint64_t)DSDFrame[ByteNr * NrOfChannels + ChNr] << (56 - 8 * (ByteNr & 7));
+    }
+
+    for (int k = 0; k <= MaxOrder; k++)
+    {
+        int WordOffset = k >> 6;
+        int Shift = k & 63;
+        int Valid = NrOfBits - k;
+        long Diff = 0;
+
+        for (int WordNr = 0; WordNr * 64 < Valid; WordNr++)
+        {
+            uint64_t Ahead = ChBits[WordNr + WordOffset];
+
+            if (Shift)
+            {
+                Ahead = (Ahead << Shift) | (ChBits[WordNr + WordOffset + 1] >> (64 - Shift));
+            }
+
+            uint64_t Differ = ChBits[WordNr] ^ Ahead;
+
+            if ((WordNr + 1) * 64 > Valid)
+            {
+                Differ &= ~0ULL << (64 - (Valid - WordNr * 64));
+            }
+
+            Diff += __builtin_popcountll(Differ);
+        }
+
+        Autocorr[k] = (double)(Valid - 2 * Diff);
+    }
+}
+
+// Prediction filter of at most Order taps (Levinson-Durbin), scaled to SIZE_PREDCOEF bits. Returns the order reached
+int CDSTEncoder::calcFilter(double* Autocorr, int Order, int16_t* ICoef)
+{
+    double Coef[MAXPREDORDER + 1];
+    double Prev[MAXPREDORDER + 1];
+    double Err = Autocorr[0];
+    double MaxCoef = 0;
+    int PredOrder = 0;
+
+    for (int i = 0; i <= Order; i++)
+    {
+        Coef[i] = 0;
+    }
+
+    for (int i = 1; i <= Order && Err > 0; i++)
+    {
+        double Acc = Autocorr[i];
+
+        for (int j = 1; j < i; j++)
+        {
+            Acc -= Coef[j] * Autocorr[i - j];
+        }
+
+        double K = Acc / Err;
+
+        if (K >= 1 || K <= -1)
+        {
+            break;
+        }
+
+        for (int j = 1; j < i; j++)
+        {
+            Prev[j] = Coef[j];
+        }
+
+        for (int j = 1; j < i; j++)
+        {
+            Coef[j] = Prev[j] - K * Prev[i - j];
+        }
+
+        Coef[i] = K;
+        Err *= 1 - K * K;
+        PredOrder = i;
+    }
+
+    PredOrder = MAX(PredOrder, 1);
+
+    for (int i = 1; i <= PredOrder; i++)
+    {
+        MaxCoef = MAX(MaxCoef, fabs(Coef[i]));
+    }
+
+    // Only the sign of the prediction and its size relative to the Ptable matter, so large filters are just scaled down
+    double Scale = MaxCoef * COEF_SCALE > PFCOEFSCALER ? PFCOEFSCALER / MaxCoef : COEF_SCALE;
+
+    for (int i = 0; i < PredOrder; i++)
+    {
+        ICoef[i] = (int16_t)lrint(Coef[i + 1] * Scale);
+    }
+
+    return PredOrder;
+}
+
+// Runs the filter over one channel and counts per Ptable index how often the prediction was right or wrong
+void CDSTEncoder::calcHistogram(uint8_t* DSDFrame, int ChNr, int16_t* ICoef, int PredOrder, int Count[AC_HISMAX], int Wrong[AC_HISMAX])
+{
+    int NrOfChannels = FrameHdr.NrOfChannels;
+    int NrOfTables = (PredOrder + 7) / 8;
+    int16_t (*ICoefI)[256] = LT_ICoefI[2 * MAX_CHANNELS - 1];
+    uint8_t* Status = LT_Status[ChNr];
+
+    LT_InitCoefTablesI(ICoefI, ICoef, PredOrder);
+    LT_InitStatus(Status);
+
+    for (int i = 0; i < AC_HISMAX; i++)
+    {
+        Count[i] = 0;
+        Wrong[i] = 0;
+    }
+
+    for (int BitNr = 0; BitNr < FrameHdr.NrOfBitsPerCh; BitNr++)
+    {
+        int Sum = 0;
+
+        for (int TableNr = 0; TableNr < NrOfTables; TableNr++)
+        {
+            Sum += ICoefI[TableNr][Status[TableNr]];
+        }
+
+        int16_t Predict = (int16_t)Sum;
+        int BitVal = (DSDFrame[(BitNr >> 3) * NrOfChannels + ChNr] >> (7 - (BitNr & 7))) & 1;
+        int Residual = BitVal ^ ((((uint16_t)Predict) >> 15) & 1);
+        int Index = MIN((Predict > 0 ? Predict : -Predict) >> AC_QSTEP, AC_HISMAX - 1);
+
+        Count[Index]++;
+        Wrong[Index] += 1 - Residual;
+
+        uint32_t* const st = (uint32_t*)Status;
+        st[3] = (st[3] << 1) | ((st[2] >> 31) & 1);
+        st[2] = (st[2] << 1) | ((st[1] >> 31) & 1);
+        st[1] = (st[1] << 1) | ((st[0] >> 31) & 1);
+        st[0] = (st[0] << 1) | BitVal;
+    }
+}
+
+// Ptable with the fewest bits for the table plus the (estimated) arithmetic code, the last entry is used for all
+// larger indices. Returns that number of bits
+double CDSTEncoder::calcPtable(int Count[AC_HISMAX], int Wrong[AC_HISMAX], int* Ptable, int& PtableLen)
+{
+    double BestBits = HUGE_VAL;
+    long CountAbove[AC_HISMAX + 1];
+    long WrongAbove[AC_HISMAX + 1];
+    int P[AC_HISMAX];
+
+    CountAbove[AC_HISMAX] = 0;
+    WrongAbove[AC_HISMAX] = 0;
+
+    for (int i = AC_HISMAX - 1; i >= 0; i--)
+    {
+        CountAbove[i] = CountAbove[i + 1] + Count[i];
+        WrongAbove[i] = WrongAbove[i + 1] + Wrong[i];
+    }
+
+    for (int Len = 1; Len <= AC_HISMAX; Len++)
+    {
+        double Bits = AC_HISBITS;
+        int Prev = AC_PROBS / 2;
+
+        for (int EntryNr = 0; EntryNr < Len; EntryNr++)
+        {
+            long n = EntryNr == Len - 1 ? CountAbove[EntryNr] : Count[EntryNr];
+            long z = EntryNr == Len - 1 ? WrongAbove[EntryNr] : Wrong[EntryNr];
+            int p = Prev;
+
+            if (Len == 1)
+            {
+                p = AC_PROBS / 2;
+            }
+            else if (n > 0)
+            {
+                p = MIN(MAX((int)((z * AC_PROBS + n / 2) / n), 1), AC_PROBS / 2);
+            }
+
+            P[EntryNr] = Prev = p;
+            Bits += z * BitCost[p] + (n - z) * BitCost[AC_PROBS - p];
+        }
+
+        if (Len > 1)
+        {
+            Bits += CFrameWriter::chooseTableCoding(P, Len, AC_BITS - 1, MAX_RICE_M_P, StrPtable, 0);
+        }
+
+        if (Bits < BestBits)
+        {
+            BestBits = Bits;
+            PtableLen = Len;
+
+            for (int EntryNr = 0; EntryNr < Len; EntryNr++)
+            {
+                Ptable[EntryNr] = P[EntryNr];
+            }
+        }
+    }
+
+    return BestBits;
+}
+
+// Tries the prediction orders of the effort level and keeps the filter and Ptable giving the fewest bits
+void CDSTEncoder::designChannel(uint8_t* DSDFrame, int ChNr)
+{
+    const int* Orders = EffortOrders[Effort];
+    double Autocorr[MAXPREDORDER + 1];
+    double BestBits = HUGE_VAL;
+    int LastOrder = 0;
+    int MaxOrder = 0;
+
+    for (int i = 0; Orders[i] != 0; i++)
+    {
+        MaxOrder = MAX(MaxOrder, Orders[i]);
+    }
+
+    calcAutocorr(DSDFrame, ChNr, MaxOrder, Autocorr);
+
+    for (int i = 0; Orders[i] != 0; i++)
+    {
+        int16_t ICoef[MAXPREDORDER];
+        int Values[MAXPREDORDER];
+        int Count[AC_HISMAX];
+        int Wrong[AC_HISMAX];
+        int Ptable[AC_HISMAX];
+        int PtableLen;
+        int PredOrder = calcFilter(Autocorr, Orders[i], ICoef);
+
+        // Levinson-Durbin stopped early, a higher order gives the same filter
+        if (PredOrder == LastOrder)
+        {
+            break;
+        }
+
+        LastOrder = PredOrder;
+        calcHistogram(DSDFrame, ChNr, ICoef, PredOrder, Count, Wrong);
+
+        for (int CoefNr = 0; CoefNr < PredOrder; CoefNr++)
+        {
+            Values[CoefNr] = ICoef[CoefNr];
+        }
+
+        double Bits = SIZE_CODEDPREDORDER + CFrameWriter::chooseTableCoding(Values, PredOrder, SIZE_PREDCOEF, MAX_RICE_M_F, StrFilter, 0);
+        Bits += calcPtable(Count, Wrong, Ptable, PtableLen);
+
+        if (Bits < BestBits)
+        {
+            BestBits = Bits;
+            ChPredOrder[ChNr] = PredOrder;
+            ChPtableLen[ChNr] = PtableLen;
+            dst_memcpy(ChCoef[ChNr], ICoef, PredOrder * sizeof(int16_t));
+            dst_memcpy(ChPtable[ChNr], Ptable, PtableLen * sizeof(int));
+        }
+    }
+}
+
+// One segment per channel, channels with the same filter and Ptable share them
+void CDSTEncoder::assignTables()
+{
+    CSegment& S = FrameHdr.FSeg;
+
+    FrameHdr.NrOfFilters = 0;
+
+    for (int ChNr = 0; ChNr < FrameHdr.NrOfChannels; ChNr++)
+    {
+        int TableNr = FrameHdr.NrOfFilters;
+
+        for (int PrevNr = 0; PrevNr < ChNr; PrevNr++)
+        {
+            if (ChPredOrder[PrevNr] == ChPredOrder[ChNr] && ChPtableLen[PrevNr] == ChPtableLen[ChNr] &&
+                memcmp(ChCoef[PrevNr], ChCoef[ChNr], ChPredOrder[ChNr] * sizeof(int16_t)) == 0 &&
+                memcmp(ChPtable[PrevNr], ChPtable[ChNr], ChPtableLen[ChNr] * sizeof(int)) == 0)
+            {
+                TableNr = S.Table4Segment[PrevNr][0];
+                break;
+            }
+        }
+
+        if (TableNr == FrameHdr.NrOfFilters)
+        {
+            int Values[MAXPREDORDER];
+
+            FrameHdr.PredOrder[TableNr] = ChPredOrder[ChNr];
+            FrameHdr.PtableLen[TableNr] = ChPtableLen[ChNr];
+
+            for (int CoefNr = 0; CoefNr < ChPredOrder[ChNr]; CoefNr++)
+            {
+                Values[CoefNr] = FrameHdr.ICoefA[TableNr][CoefNr] = ChCoef[ChNr][CoefNr];
+            }
+
+            for (int EntryNr = 0; EntryNr < ChPtableLen[ChNr]; EntryNr++)
+            {
+                P_one[TableNr][EntryNr] = ChPtable[ChNr][EntryNr];
+            }
+
+            CFrameWriter::chooseTableCoding(Values, ChPredOrder[ChNr], SIZE_PREDCOEF, MAX_RICE_M_F, StrFilter, TableNr);
+
+            if (ChPtableLen[ChNr] > 1)
+            {
+                CFrameWriter::chooseTableCoding(P_one[TableNr], ChPtableLen[ChNr], AC_BITS - 1, MAX_RICE_M_P, StrPtable, TableNr);
+            }
+
+            FrameHdr.NrOfFilters++;
+        }
+
+        S.NrOfSegments[ChNr] = 1;
+        S.SegmentLen[ChNr][0] = 0;
+        S.Table4Segment[ChNr][0] = TableNr;
+        FrameHdr.HalfProb[ChNr] = 0;
+        FrameHdr.NrOfHalfBits[ChNr] = 0;
+    }
+
+    S.Resolution = 1;
+    FrameHdr.PSeg = S;
+    FrameHdr.NrOfPtables = FrameHdr.NrOfFilters;
+    FrameHdr.PSameSegAsF = 1;
+    FrameHdr.PSameMapAsF = 1;
+    FrameHdr.FSameSegAllCh = 1;
+    FrameHdr.PSameSegAllCh = 1;
+    FrameHdr.FSameMapAllCh = FrameHdr.NrOfFilters == 1 ? 1 : 0;
+    FrameHdr.PSameMapAllCh = FrameHdr.FSameMapAllCh;
+}
+
+// Arithmetic code of the prediction residuals, in the order CDSTDecoder::decode() reads them. Returns its length in bits
+int CDSTEncoder::encodeAData(uint8_t* DSDFrame)
+{
+    CACData AC;
+    int NrOfChannels = FrameHdr.NrOfChannels;
+    int Capacity = FrameHdr.BitStreamLen;
+
+    for (int FilterNr = 0; FilterNr < FrameHdr.NrOfFilters; FilterNr++)
+    {
+        LT_InitCoefTablesI(LT_ICoefI[FilterNr], FrameHdr.ICoefA[FilterNr], FrameHdr.PredOrder[FilterNr]);
+    }
+
+    for (int ChNr = 0; ChNr < NrOfChannels; ChNr++)
+    {
+        LT_InitStatus(LT_Status[ChNr]);
+    }
+
+    AC.encodeBit_Init(AData, Capacity);
+    AC.encodeBit_Encode(1, reverse7LSBs(FrameHdr.ICoefA[0][0]), AData, Capacity);
+
+    for (int BitNr = 0; BitNr < FrameHdr.NrOfBitsPerCh; BitNr++)
+    {
+        for (int ChNr = 0; ChNr < NrOfChannels; ChNr++)
+        {
+            const int TableNr = FrameHdr.FSeg.Table4Segment[ChNr][0];
+            const int NrOfTables = (FrameHdr.PredOrder[TableNr] + 7) / 8;
+            int Sum = 0;
+
+            for (int i = 0; i < NrOfTables; i++)
+            {
+                Sum += LT_ICoefI[TableNr][i][LT_Status[ChNr][i]];
+            }
+
+            int16_t Predict = (int16_t)Sum;
+            int BitVal = (DSDFrame[(BitNr >> 3) * NrOfChannels + ChNr] >> (7 - (BitNr & 7))) & 1;
+            uint8_t Residual = (uint8_t)(BitVal ^ ((((uint16_t)Predict) >> 15) & 1));
+            int PtableIndex = AC.getPtableIndex(Predict, FrameHdr.PtableLen[TableNr]);
+
+            AC.encodeBit_Encode(Residual, P_one[TableNr][PtableIndex], AData, Capacity);
+
+            uint32_t* const st = (uint32_t*)LT_Status[ChNr];
+            st[3] = (st[3] << 1) | ((st[2] >> 31) & 1);
+            st[2] = (st[2] << 1) | ((st[1] >> 31) & 1);
+            st[1] = (st[1] << 1) | ((st[0] >> 31) & 1);
+            st[0] = (st[0] << 1) | BitVal;
+        }
+    }
+
+    return AC.encodeBit_Flush(AData, Capacity);
+}
+
+void CDSTEncoder::LT_InitCoefTablesI(int16_t ICoefI[16][256], int16_t* ICoef, int PredOrder)
+{
+    for (int TableNr = 0; TableNr < 16; TableNr++)
+    {
+        int k = MIN(MAX(PredOrder - TableNr * 8, 0), 8);
+
+        for (int i = 0; i < 256; i++)
+        {
+            int cvalue = 0;
+
+            for (int j = 0; j < k; j++)
+            {
+                cvalue += (((i >> j) & 1) * 2 - 1) * ICoef[TableNr * 8 + j];
+            }
+
+            ICoefI[TableNr][i] = (int16_t)cvalue;
+        }
+    }
+}
+
+void CDSTEncoder::LT_InitStatus(uint8_t Status[16])
+{
+    for (int TableNr = 0; TableNr < 16; TableNr++)
+    {
+        Status[TableNr] = 0xaa;
+    }
+}
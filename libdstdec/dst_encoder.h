@@ -0,0 +1,75 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#ifndef DSTENCODER_H
+#define DSTENCODER_H
+
+#include "coded_table.h"
+#include "str_data.h"
+
+#define DST_EFFORT_MIN 0
+#define DST_EFFORT_MAX 3
+#define DST_EFFORT_DEFAULT 1
+
+// Encoder counterpart of CDSTDecoder: a frame of byte interleaved DSD in, a DST frame out. Every channel gets a
+// prediction filter (Levinson-Durbin on the autocorrelation of its bitstream) and a Ptable for the whole frame, channels
+// that end up with the same ones share them. The effort selects how many filter orders are tried per channel.
+// A frame that would not get smaller is stored as plain DSD.
+class CDSTEncoder
+{
+public:
+
+    CFrameHeader FrameHdr; // Contains frame based header information
+    CCodedTableF StrFilter; // Contains FIR-coef. compression data
+    CCodedTableP StrPtable; // Contains Ptable-entry compression data
+    int P_one[2 * MAX_CHANNELS][AC_HISMAX]; // Probability table for arithmetic coder
+    ADataByte AData[MAX_DSDBYTES_INFRAME * MAX_CHANNELS]; // Contains the arithmetic coded bit stream of a complete frame
+    int ADataLen; // Number of code bits contained in AData[]
+    CStrData SD; // DST data stream
+
+    CDSTEncoder();
+    ~CDSTEncoder();
+    int init(int channels, int fs44, int effort = DST_EFFORT_DEFAULT);
+    int close();
+    int encode(uint8_t* DSDFrame, uint8_t* DSTFrame);
+
+private:
+
+    int Effort;
+    int16_t ChCoef[MAX_CHANNELS][MAXPREDORDER]; // Filter designed for each channel
+    int ChPredOrder[MAX_CHANNELS];
+    int ChPtable[MAX_CHANNELS][AC_HISMAX]; // Ptable designed for each channel
+    int ChPtableLen[MAX_CHANNELS];
+    int16_t LT_ICoefI[2 * MAX_CHANNELS][16][256];
+    alignas(16) uint8_t LT_Status[MAX_CHANNELS][16];
+    uint64_t ChBits[MAX_DSDBITS_INFRAME / 64 + 2]; // Bitstream of one channel, MSB first
+    double BitCost[AC_PROBS + 1]; // -log2(p / AC_PROBS)
+
+    void calcAutocorr(uint8_t* DSDFrame, int ChNr, int MaxOrder, double* Autocorr);
+    int calcFilter(double* Autocorr, int Order, int16_t* ICoef);
+    void calcHistogram(uint8_t* DSDFrame, int ChNr, int16_t* ICoef, int PredOrder, int Count[AC_HISMAX], int Wrong[AC_HISMAX]);
+    double calcPtable(int Count[AC_HISMAX], int Wrong[AC_HISMAX], int* Ptable, int& PtableLen);
+    void designChannel(uint8_t* DSDFrame, int ChNr);
+    void assignTables();
+    int encodeAData(uint8_t* DSDFrame);
+    void LT_InitCoefTablesI(int16_t ICoefI[16][256], int16_t* ICoef, int PredOrder);
+    void LT_InitStatus(uint8_t Status[16]);
+};
+
+#endif
@@ -0,0 +1,197 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#include "dst_encoder_mt.h"
+
+#define DSD_SILENCE_BYTE 0x69
+
+void* DSTEncoderThread(void* threadarg)
+{
+    encoder_slot_t* encoder_slot = (encoder_slot_t*)threadarg;
+
+    while (1)
+    {
+        pthread_mutex_lock(&encoder_slot->hMutex);
+
+        while (encoder_slot->state != ENC_SLOT_LOADED && encoder_slot->state != ENC_SLOT_TERMINATING)
+        {
+            pthread_cond_wait(&encoder_slot->hEventPut, &encoder_slot->hMutex);
+        }
+
+        if (encoder_slot->state == ENC_SLOT_TERMINATING)
+        {
+            encoder_slot->dst_size = 0;
+            pthread_mutex_unlock(&encoder_slot->hMutex);
+            return 0;
+        }
+
+        encoder_slot->state = ENC_SLOT_RUNNING;
+        pthread_mutex_unlock(&encoder_slot->hMutex);
+
+        encoder_slot->dst_size = encoder_slot->E.encode(encoder_slot->dsd_data.data(), encoder_slot->dst_data.data());
+
+        pthread_mutex_lock(&encoder_slot->hMutex);
+        encoder_slot->state = ENC_SLOT_READY;
+        pthread_cond_signal(&encoder_slot->hEventGet);
+        pthread_mutex_unlock(&encoder_slot->hMutex);
+    }
+
+    return 0;
+}
+
+dst_encoder_t::dst_encoder_t(int threads)
+{
+    thread_count = threads > 0 ? threads : 1;
+
+    encoder_slots = new encoder_slot_t[thread_count];
+
+    started = 0;
+    channel_count = 0;
+    samplerate = 0;
+    framerate = 0;
+    frame_nr = 0;
+    slot_nr = 0;
+}
+
+dst_encoder_t::~dst_encoder_t()
+{
+    for (int i = 0; i < started; i++)
+    {
+        encoder_slot_t* encoder_slot = &encoder_slots[i];
+
+        // Release worker (encoding) thread for exit
+        pthread_mutex_lock(&encoder_slot->hMutex);
+
+        while (encoder_slot->state == ENC_SLOT_LOADED || encoder_slot->state == ENC_SLOT_RUNNING)
+        {
+            pthread_cond_wait(&encoder_slot->hEventGet, &encoder_slot->hMutex);
+        }
+
+        encoder_slot->state = ENC_SLOT_TERMINATING;
+        encoder_slot->E.close();
+        pthread_cond_signal(&encoder_slot->hEventPut);
+        pthread_mutex_unlock(&encoder_slot->hMutex);
+
+        // Wait until worker (encoding) thread exit
+        pthread_join(encoder_slot->hThread, NULL);
+        pthread_cond_destroy(&encoder_slot->hEventGet);
+        pthread_cond_destroy(&encoder_slot->hEventPut);
+        pthread_mutex_destroy(&encoder_slot->hMutex);
+    }
+
+    delete[] encoder_slots;
+}
+
+int dst_encoder_t::init(int channel_count, int samplerate, int framerate, int effort)
+{
+    if (started > 0 || framerate <= 0)
+    {
+        return -1;
+    }
+
+    size_t frame_size = (size_t)(samplerate / 8 / framerate * channel_count);
+
+    for (int i = 0; i < thread_count; i++)
+    {
+        encoder_slot_t* encoder_slot = &encoder_slots[i];
+
+        if (encoder_slot->E.init(channel_count, (samplerate / 44100) / (framerate / 75), effort) != 0)
+        {
+            return -1;
+        }
+
+        encoder_slot->dsd_data.resize(frame_size);
+        encoder_slot->dst_data.resize(frame_size + 1);
+        pthread_mutex_init(&encoder_slot->hMutex, NULL);
+        pthread_cond_init(&encoder_slot->hEventGet, NULL);
+        pthread_cond_init(&encoder_slot->hEventPut, NULL);
+        pthread_create(&encoder_slot->hThread, NULL, DSTEncoderThread, encoder_slot);
+        started++;
+    }
+
+    this->channel_count = channel_count;
+    this->samplerate = samplerate;
+    this->framerate = framerate;
+    this->frame_nr = 0;
+
+    return 0;
+}
+
+int dst_encoder_t::encode(const uint8_t* dsd_data, size_t dsd_size, uint8_t** dst_data, size_t* dst_size)
+{
+    if (started == 0)
+    {
+        return -1;
+    }
+
+    // Get current slot
+    encoder_slot_t* encoder_slot = &encoder_slots[slot_nr];
+
+    // Release worker (encoding) thread on the loaded slot, a short last frame is padded with silence
+    if (dsd_size > 0)
+    {
+        size_t frame_size = encoder_slot->dsd_data.size();
+
+        memcpy(encoder_slot->dsd_data.data(), dsd_data, dsd_size < frame_size ? dsd_size : frame_size);
+
+        if (dsd_size < frame_size)
+        {
+            memset(encoder_slot->dsd_data.data() + dsd_size, DSD_SILENCE_BYTE, frame_size - dsd_size);
+        }
+
+        encoder_slot->frame_nr = frame_nr;
+        pthread_mutex_lock(&encoder_slot->hMutex);
+        encoder_slot->state = ENC_SLOT_LOADED;
+        pthread_cond_signal(&encoder_slot->hEventPut);
+        pthread_mutex_unlock(&encoder_slot->hMutex);
+        frame_nr++;
+    }
+    else
+    {
+        encoder_slot->state = ENC_SLOT_EMPTY;
+    }
+
+    // Advance to the next slot
+    slot_nr = (slot_nr + 1) % thread_count;
+    encoder_slot = &encoder_slots[slot_nr];
+
+    // Dump encoded frame
+    if (encoder_slot->state != ENC_SLOT_EMPTY)
+    {
+        pthread_mutex_lock(&encoder_slot->hMutex);
+
+        while (encoder_slot->state != ENC_SLOT_READY)
+        {
+            pthread_cond_wait(&encoder_slot->hEventGet, &encoder_slot->hMutex);
+        }
+
+        pthread_mutex_unlock(&encoder_slot->hMutex);
+
+        *dst_data = encoder_slot->dst_data.data();
+        *dst_size = (size_t)encoder_slot->dst_size;
+        encoder_slot->state = ENC_SLOT_EMPTY;
+    }
+    else
+    {
+        *dst_data = nullptr;
+        *dst_size = 0;
+    }
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#ifndef _DST_ENCODER_H_INCLUDED
+#define _DST_ENCODER_H_INCLUDED
+
+#include <pthread.h>
+#include <vector>
+#include "dst_encoder.h"
+
+enum encoder_slot_state_t {ENC_SLOT_EMPTY, ENC_SLOT_LOADED, ENC_SLOT_RUNNING, ENC_SLOT_READY, ENC_SLOT_TERMINATING};
+
+class encoder_slot_t
+{
+    public:
+
+        volatile int state;
+        int frame_nr;
+        std::vector<uint8_t> dsd_data;
+        std::vector<uint8_t> dst_data;
+        int dst_size;
+        pthread_t hThread;
+        pthread_cond_t hEventGet;
+        pthread_cond_t hEventPut;
+        pthread_mutex_t hMutex;
+        CDSTEncoder E;
+
+        encoder_slot_t()
+        {
+            state = ENC_SLOT_EMPTY;
+            dst_size = 0;
+            frame_nr = 0;
+        }
+};
+
+// Frame parallel DST encoding: every frame goes round robin to one of a ring of encoder threads, the frames come back
+// in order, thread_count frames later
+class dst_encoder_t
+{
+    encoder_slot_t* encoder_slots;
+    int thread_count;
+    int started;
+    int channel_count;
+    int samplerate;
+    int framerate;
+    uint32_t frame_nr;
+
+public:
+
+    int slot_nr;
+
+    dst_encoder_t(int threads);
+    ~dst_encoder_t();
+    int init(int channel_count, int samplerate, int framerate, int effort = DST_EFFORT_DEFAULT);
+    int get_thread_count() { return thread_count; }
+
+    // Hands a frame of byte interleaved DSD (MSB first) to the next thread and returns the frame handed over
+    // thread_count - 1 calls before, valid until the next call (dst_size 0 if there is none). After the last frame
+    // thread_count calls with dsd_size 0 collect the rest.
+    int encode(const uint8_t* dsd_data, size_t dsd_size, uint8_t** dst_data, size_t* dst_size);
+};
+
+#endif
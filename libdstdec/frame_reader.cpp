@@ -114,10 +114,20 @@ int CFrameReader::RiceDecode(CStrData& SD, int m)
 }
 
 // Read DSD signal of this frame from the DST input file
-void CFrameReader::readDSDFrame(CStrData& SD, long MaxFrameLen, int NrOfChannels, uint8_t* DSDFrame)
+void CFrameReader::readDSDFrame(CStrData& SD, long MaxFrameLen, int NrOfChannels, bool Planar, uint8_t* DSDFrame)
 {
     int ByteMax = MaxFrameLen * NrOfChannels;
 
+    if (Planar)
+    {
+        for (int ByteNr = 0; ByteNr < ByteMax; ByteNr++)
+        {
+            SD.getChrUnsigned(8, DSDFrame[(ByteNr % NrOfChannels) * MaxFrameLen + ByteNr / NrOfChannels]);
+        }
+
+        return;
+    }
+
     for (int ByteNr = 0; ByteNr < ByteMax; ByteNr++)
     {
         SD.getChrUnsigned(8, DSDFrame[ByteNr]);
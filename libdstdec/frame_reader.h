@@ -74,7 +74,7 @@ public:
 
     static int log2RoundUp(long x);
     static int RiceDecode(CStrData& SD, int m);
-    static void readDSDFrame(CStrData& SD, long MaxFrameLen, int NrOfChannels, uint8_t* DSDFrame);
+    static void readDSDFrame(CStrData& SD, long MaxFrameLen, int NrOfChannels, bool Planar, uint8_t* DSDFrame);
     static void readTableSegmentData(CStrData& SD, int NrOfChannels, int FrameLen, int MaxNrOfSegs, int MinSegLen, CSegment& S, int& SameSegAllCh);
     static void copySegmentData(CFrameHeader& FH);
     static void readSegmentData(CStrData& SD, CFrameHeader& FH);
@@ -0,0 +1,279 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#include "frame_reader.h"
+#include "frame_writer.h"
+
+// Value RiceDecode() has to return for entry Nr of a Rice coded table, given the values before it
+static int riceValue(const int* Values, int Nr, CCodedTable& CT, int Method)
+{
+    int x = 0;
+
+    for (int TapNr = 0; TapNr < CT.CPredOrder[Method]; TapNr++)
+    {
+        x += CT.CPredCoef[Method][TapNr] * Values[Nr - TapNr - 1];
+    }
+
+    return x >= 0 ? Values[Nr] + (x + 4) / 8 : Values[Nr] - (-x + 3) / 8;
+}
+
+// Number of bits of a Rice code
+int CFrameWriter::RiceBits(int Nr, int m)
+{
+    int Abs = Nr < 0 ? -Nr : Nr;
+
+    return (Abs >> m) + 1 + m + (Abs != 0 ? 1 : 0);
+}
+
+// Write a Rice code to the DST stream, see CFrameReader::RiceDecode()
+void CFrameWriter::RiceEncode(CStrData& SD, int Nr, int m)
+{
+    int Abs = Nr < 0 ? -Nr : Nr;
+
+    for (int RunLength = Abs >> m; RunLength > 0; RunLength--)
+    {
+        SD.putIntUnsigned(1, 0);
+    }
+
+    SD.putIntUnsigned(1, 1);
+    SD.putIntUnsigned(m, Abs & ((1 << m) - 1));
+
+    if (Abs != 0)
+    {
+        SD.putIntUnsigned(1, Nr < 0 ? 1 : 0);
+    }
+}
+
+// Find the cheapest way to store a filter or Ptable: plain values of ValueBits bits, or one of the Rice coding methods.
+// The choice goes into CT.Coded, CT.BestMethod and CT.m of TableNr, returns the number of bits including the Coded flag
+int CFrameWriter::chooseTableCoding(const int* Values, int Len, int ValueBits, int MaxM, CCodedTable& CT, int TableNr)
+{
+    int BestBits = Len * ValueBits;
+
+    CT.Coded[TableNr] = 0;
+    CT.BestMethod[TableNr] = -1;
+
+    for (int Method = 0; Method < NROFFRICEMETHODS; Method++)
+    {
+        if (CT.CPredOrder[Method] >= Len)
+        {
+            continue;
+        }
+
+        for (int m = 0; m <= MaxM; m++)
+        {
+            int Bits = SIZE_RICEMETHOD + CT.CPredOrder[Method] * ValueBits + SIZE_RICEM;
+
+            for (int Nr = CT.CPredOrder[Method]; Nr < Len && Bits < BestBits; Nr++)
+            {
+                Bits += RiceBits(riceValue(Values, Nr, CT, Method), m);
+            }
+
+            if (Bits < BestBits)
+            {
+                BestBits = Bits;
+                CT.Coded[TableNr] = 1;
+                CT.BestMethod[TableNr] = Method;
+                CT.m[TableNr][Method] = m;
+            }
+        }
+    }
+
+    return BestBits + 1;
+}
+
+// Write segmentation data for filters or Ptables
+void CFrameWriter::writeTableSegmentData(CStrData& SD, int NrOfChannels, int FrameLen, int MinSegLen, CSegment& S, int SameSegAllCh)
+{
+    bool ResolWritten = false;
+    int MaxSegSize;
+
+    SD.putIntUnsigned(1, SameSegAllCh);
+
+    for (int ChNr = 0; ChNr < (SameSegAllCh ? 1 : NrOfChannels); ChNr++)
+    {
+        MaxSegSize = FrameLen - MinSegLen / 8;
+
+        for (int SegNr = 0; SegNr < S.NrOfSegments[ChNr] - 1; SegNr++)
+        {
+            // EndOfChannel
+            SD.putIntUnsigned(1, 0);
+
+            if (!ResolWritten)
+            {
+                SD.putIntUnsigned(CFrameReader::log2RoundUp(FrameLen - MinSegLen / 8), S.Resolution);
+                ResolWritten = true;
+            }
+
+            SD.putIntUnsigned(CFrameReader::log2RoundUp(MaxSegSize / S.Resolution), S.SegmentLen[ChNr][SegNr]);
+            MaxSegSize -= S.Resolution * S.SegmentLen[ChNr][SegNr];
+        }
+
+        SD.putIntUnsigned(1, 1);
+    }
+}
+
+// Write segmentation data for filters and Ptables
+void CFrameWriter::writeSegmentData(CStrData& SD, CFrameHeader& FH)
+{
+    SD.putIntUnsigned(1, FH.PSameSegAsF);
+    writeTableSegmentData(SD, FH.NrOfChannels, FH.MaxFrameLen, MIN_FSEG_LEN, FH.FSeg, FH.FSameSegAllCh);
+
+    if (FH.PSameSegAsF == 0)
+    {
+        writeTableSegmentData(SD, FH.NrOfChannels, FH.MaxFrameLen, MIN_PSEG_LEN, FH.PSeg, FH.PSameSegAllCh);
+    }
+}
+
+// Write mapping data for filters or Ptables, new tables have to be numbered in the order they first appear
+void CFrameWriter::writeTableMappingData(CStrData& SD, int NrOfChannels, CSegment& S, int SameMapAllCh)
+{
+    int CountTables = 1;
+
+    SD.putIntUnsigned(1, SameMapAllCh);
+
+    for (int ChNr = 0; ChNr < (SameMapAllCh ? 1 : NrOfChannels); ChNr++)
+    {
+        for (int SegNr = 0; SegNr < S.NrOfSegments[ChNr]; SegNr++)
+        {
+            if ((ChNr != 0) || (SegNr != 0))
+            {
+                SD.putIntUnsigned(CFrameReader::log2RoundUp(CountTables), S.Table4Segment[ChNr][SegNr]);
+
+                if (S.Table4Segment[ChNr][SegNr] == CountTables)
+                {
+                    CountTables++;
+                }
+            }
+        }
+    }
+}
+
+// Write mapping data (which channel uses which filter/Ptable)
+void CFrameWriter::writeMappingData(CStrData& SD, CFrameHeader& FH)
+{
+    SD.putIntUnsigned(1, FH.PSameMapAsF);
+    writeTableMappingData(SD, FH.NrOfChannels, FH.FSeg, FH.FSameMapAllCh);
+
+    if (FH.PSameMapAsF == 0)
+    {
+        writeTableMappingData(SD, FH.NrOfChannels, FH.PSeg, FH.PSameMapAllCh);
+    }
+
+    for (int i = 0; i < FH.NrOfChannels; i++)
+    {
+        SD.putIntUnsigned(1, FH.HalfProb[i]);
+    }
+}
+
+// Write all filters: prediction order and the coefficients, plain or Rice coded as chosen in CF
+void CFrameWriter::writeFilterCoefSets(CStrData& SD, CFrameHeader& FH, CCodedTableF& CF)
+{
+    for (int FilterNr = 0; FilterNr < FH.NrOfFilters; FilterNr++)
+    {
+        SD.putIntUnsigned(SIZE_CODEDPREDORDER, FH.PredOrder[FilterNr] - 1);
+        SD.putIntUnsigned(1, CF.Coded[FilterNr]);
+
+        if (!CF.Coded[FilterNr])
+        {
+            for (int CoefNr = 0; CoefNr < FH.PredOrder[FilterNr]; CoefNr++)
+            {
+                SD.putIntSigned(SIZE_PREDCOEF, FH.ICoefA[FilterNr][CoefNr]);
+            }
+        }
+        else
+        {
+            int bestmethod = CF.BestMethod[FilterNr];
+            int Values[1 << SIZE_CODEDPREDORDER];
+
+            SD.putIntUnsigned(SIZE_RICEMETHOD, bestmethod);
+
+            for (int CoefNr = 0; CoefNr < FH.PredOrder[FilterNr]; CoefNr++)
+            {
+                Values[CoefNr] = FH.ICoefA[FilterNr][CoefNr];
+            }
+
+            for (int CoefNr = 0; CoefNr < CF.CPredOrder[bestmethod]; CoefNr++)
+            {
+                SD.putIntSigned(SIZE_PREDCOEF, Values[CoefNr]);
+            }
+
+            SD.putIntUnsigned(SIZE_RICEM, CF.m[FilterNr][bestmethod]);
+
+            for (int CoefNr = CF.CPredOrder[bestmethod]; CoefNr < FH.PredOrder[FilterNr]; CoefNr++)
+            {
+                RiceEncode(SD, riceValue(Values, CoefNr, CF, bestmethod), CF.m[FilterNr][bestmethod]);
+            }
+        }
+    }
+}
+
+// Write all Ptables: length and the entries, plain or Rice coded as chosen in CP
+void CFrameWriter::writeProbabilityTables(CStrData& SD, CFrameHeader& FH, CCodedTableP& CP, int P_one[2 * MAX_CHANNELS][AC_HISMAX])
+{
+    for (int PtableNr = 0; PtableNr < FH.NrOfPtables; PtableNr++)
+    {
+        SD.putIntUnsigned(AC_HISBITS, FH.PtableLen[PtableNr] - 1);
+
+        if (FH.PtableLen[PtableNr] > 1)
+        {
+            SD.putIntUnsigned(1, CP.Coded[PtableNr]);
+
+            if (!CP.Coded[PtableNr])
+            {
+                for (int EntryNr = 0; EntryNr < FH.PtableLen[PtableNr]; EntryNr++)
+                {
+                    SD.putIntUnsigned(AC_BITS - 1, P_one[PtableNr][EntryNr] - 1);
+                }
+            }
+            else
+            {
+                int bestmethod = CP.BestMethod[PtableNr];
+
+                SD.putIntUnsigned(SIZE_RICEMETHOD, bestmethod);
+
+                for (int EntryNr = 0; EntryNr < CP.CPredOrder[bestmethod]; EntryNr++)
+                {
+                    SD.putIntUnsigned(AC_BITS - 1, P_one[PtableNr][EntryNr] - 1);
+                }
+
+                SD.putIntUnsigned(SIZE_RICEM, CP.m[PtableNr][bestmethod]);
+
+                for (int EntryNr = CP.CPredOrder[bestmethod]; EntryNr < FH.PtableLen[PtableNr]; EntryNr++)
+                {
+                    RiceEncode(SD, riceValue(P_one[PtableNr], EntryNr, CP, bestmethod), CP.m[PtableNr][bestmethod]);
+                }
+            }
+        }
+    }
+}
+
+// Append the arithmetic code, the rest of the last byte stays 0
+void CFrameWriter::writeArithmeticCodedData(CStrData& SD, int ADataLen, ADataByte* AData)
+{
+    for (int j = 0; j < (ADataLen >> 3); j++)
+    {
+        SD.putIntUnsigned(8, AData[j]);
+    }
+
+    for (int j = ADataLen & ~7; j < ADataLen; j++)
+    {
+        SD.putIntUnsigned(1, GET_BIT(AData, j));
+    }
+}
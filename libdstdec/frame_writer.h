@@ -0,0 +1,43 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#ifndef FRAMEWRITER_H
+#define FRAMEWRITER_H
+
+#include "coded_table.h"
+#include "str_data.h"
+
+// Writes the fields of a DST frame in exactly the syntax CFrameReader reads them
+class CFrameWriter
+{
+public:
+
+    static int RiceBits(int Nr, int m);
+    static void RiceEncode(CStrData& SD, int Nr, int m);
+    static int chooseTableCoding(const int* Values, int Len, int ValueBits, int MaxM, CCodedTable& CT, int TableNr);
+    static void writeTableSegmentData(CStrData& SD, int NrOfChannels, int FrameLen, int MinSegLen, CSegment& S, int SameSegAllCh);
+    static void writeSegmentData(CStrData& SD, CFrameHeader& FH);
+    static void writeTableMappingData(CStrData& SD, int NrOfChannels, CSegment& S, int SameMapAllCh);
+    static void writeMappingData(CStrData& SD, CFrameHeader& FH);
+    static void writeFilterCoefSets(CStrData& SD, CFrameHeader& FH, CCodedTableF& CF);
+    static void writeProbabilityTables(CStrData& SD, CFrameHeader& FH, CCodedTableP& CP, int P_one[2 * MAX_CHANNELS][AC_HISMAX]);
+    static void writeArithmeticCodedData(CStrData& SD, int ADataLen, ADataByte* AData);
+};
+
+#endif
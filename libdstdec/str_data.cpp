@@ -279,3 +279,76 @@ int CStrData::getbits(long& outword, int out_bitptr)
 
     return 0;
 }
+
+// function : Start writing a new stream into the (cleared) buffer.
+// pre: None
+// post: The buffer is empty, get_out_bitcount() returns 0.
+void CStrData::resetWritingIndex()
+{
+    dst_memset(DSTdata, 0, sizeof(DSTdata));
+    OutBitCount = 0;
+}
+
+// function : Write an integer as an unsigned number to the stream with a given number of bits.
+// pre: resetWritingIndex() has been called
+// post: The length LSBs of x are appended to the stream, most significant bit first
+void CStrData::putIntUnsigned(int length, int x)
+{
+    if (length > 0)
+    {
+        putbits(x, length);
+    }
+    else if (length < 0)
+    {
+        printf("ERROR: a negative number of bits allocated");
+    }
+}
+
+// function : Write an integer as a signed number to the stream with a given number of bits.
+// pre: resetWritingIndex() has been called
+// post: x is appended to the stream in 2's complement
+void CStrData::putIntSigned(int length, int x)
+{
+    if (length > 0)
+    {
+        putbits(x & ((1L << length) - 1), length);
+    }
+    else if (length < 0)
+    {
+        printf("ERROR: a negative number of bits allocated");
+    }
+}
+
+// function : Number of bits written since resetWritingIndex().
+// pre: None
+// post: Also counts the bits that did not fit into the buffer anymore.
+int CStrData::get_out_bitcount()
+{
+    return OutBitCount;
+}
+
+// function : Write bits to the bitstream and increment the counter.
+// pre: in_bitptr <= 31
+// post: OutBitCount, returns -1 if the buffer is full or 0 otherwise.
+int CStrData::putbits(long inword, int in_bitptr)
+{
+    int rv = 0;
+
+    while (in_bitptr > 0)
+    {
+        in_bitptr--;
+
+        if (OutBitCount < (int)sizeof(DSTdata) * 8)
+        {
+            DSTdata[OutBitCount >> 3] |= (uint8_t)(((inword >> in_bitptr) & 1) << (7 - (OutBitCount & 7)));
+        }
+        else
+        {
+            rv = -1;
+        }
+
+        OutBitCount++;
+    }
+
+    return rv;
+}
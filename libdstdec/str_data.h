@@ -75,6 +75,7 @@ class CStrData
     int ByteCounter;
     int BitPosition;
     uint8_t DataByte;
+    int OutBitCount;
 
 public:
 
@@ -88,10 +89,15 @@ public:
     void getIntSigned(int length, int& x);
     void getShortSigned(int length, short& x);
     int get_in_bitcount();
+    void resetWritingIndex();
+    void putIntUnsigned(int length, int x);
+    void putIntSigned(int length, int x);
+    int get_out_bitcount();
 
 private:
 
     int getbits(long& outword, int out_bitptr);
+    int putbits(long inword, int in_bitptr);
 };
 
 #endif
@@ -0,0 +1,232 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#include <string.h>
+#include <emmintrin.h>  // SSE2
+#include <tmmintrin.h>  // SSSE3 (pshufb), runtime dispatched
+#include "dsd_transpose.h"
+
+const uint8_t dsd_bit_reverse_table[256] =
+{
+    0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0, 0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0,
+    0x08, 0x88, 0x48, 0xc8, 0x28, 0xa8, 0x68, 0xe8, 0x18, 0x98, 0x58, 0xd8, 0x38, 0xb8, 0x78, 0xf8,
+    0x04, 0x84, 0x44, 0xc4, 0x24, 0xa4, 0x64, 0xe4, 0x14, 0x94, 0x54, 0xd4, 0x34, 0xb4, 0x74, 0xf4,
+    0x0c, 0x8c, 0x4c, 0xcc, 0x2c, 0xac, 0x6c, 0xec, 0x1c, 0x9c, 0x5c, 0xdc, 0x3c, 0xbc, 0x7c, 0xfc,
+    0x02, 0x82, 0x42, 0xc2, 0x22, 0xa2, 0x62, 0xe2, 0x12, 0x92, 0x52, 0xd2, 0x32, 0xb2, 0x72, 0xf2,
+    0x0a, 0x8a, 0x4a, 0xca, 0x2a, 0xaa, 0x6a, 0xea, 0x1a, 0x9a, 0x5a, 0xda, 0x3a, 0xba, 0x7a, 0xfa,
+    0x06, 0x86, 0x46, 0xc6, 0x26, 0xa6, 0x66, 0xe6, 0x16, 0x96, 0x56, 0xd6, 0x36, 0xb6, 0x76, 0xf6,
+    0x0e, 0x8e, 0x4e, 0xce, 0x2e, 0xae, 0x6e, 0xee, 0x1e, 0x9e, 0x5e, 0xde, 0x3e, 0xbe, 0x7e, 0xfe,
+    0x01, 0x81, 0x41, 0xc1, 0x21, 0xa1, 0x61, 0xe1, 0x11, 0x91, 0x51, 0xd1, 0x31, 0xb1, 0x71, 0xf1,
+    0x09, 0x89, 0x49, 0xc9, 0x29, 0xa9, 0x69, 0xe9, 0x19, 0x99, 0x59, 0xd9, 0x39, 0xb9, 0x79, 0xf9,
+    0x05, 0x85, 0x45, 0xc5, 0x25, 0xa5, 0x65, 0xe5, 0x15, 0x95, 0x55, 0xd5, 0x35, 0xb5, 0x75, 0xf5,
+    0x0d, 0x8d, 0x4d, 0xcd, 0x2d, 0xad, 0x6d, 0xed, 0x1d, 0x9d, 0x5d, 0xdd, 0x3d, 0xbd, 0x7d, 0xfd,
+    0x03, 0x83, 0x43, 0xc3, 0x23, 0xa3, 0x63, 0xe3, 0x13, 0x93, 0x53, 0xd3, 0x33, 0xb3, 0x73, 0xf3,
+    0x0b, 0x8b, 0x4b, 0xcb, 0x2b, 0xab, 0x6b, 0xeb, 0x1b, 0x9b, 0x5b, 0xdb, 0x3b, 0xbb, 0x7b, 0xfb,
+    0x07, 0x87, 0x47, 0xc7, 0x27, 0xa7, 0x67, 0xe7, 0x17, 0x97, 0x57, 0xd7, 0x37, 0xb7, 0x77, 0xf7,
+    0x0f, 0x8f, 0x4f, 0xcf, 0x2f, 0xaf, 0x6f, 0xef, 0x1f, 0x9f, 0x5f, 0xdf, 0x3f, 0xbf, 0x7f, 0xff
+};
+
+// swap bits, bit pairs and nibbles with shifts and masks
+static inline __m128i bit_reverse_sse2(__m128i x)
+{
+    const __m128i m1 = _mm_set1_epi8(0x55);
+    const __m128i m2 = _mm_set1_epi8(0x33);
+    const __m128i m4 = _mm_set1_epi8(0x0f);
+
+    x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 1), m1), _mm_slli_epi16(_mm_and_si128(x, m1), 1));
+    x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 2), m2), _mm_slli_epi16(_mm_and_si128(x, m2), 2));
+    x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 4), m4), _mm_slli_epi16(_mm_and_si128(x, m4), 4));
+
+    return x;
+}
+
+static void bit_reverse_sse2(const uint8_t* src, uint8_t* dst, size_t size)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= size; i += 16)
+    {
+        _mm_storeu_si128((__m128i*)(dst + i), bit_reverse_sse2(_mm_loadu_si128((const __m128i*)(src + i))));
+    }
+
+    for (; i < size; i++)
+    {
+        dst[i] = dsd_bit_reverse_table[src[i]];
+    }
+}
+
+// two pshufb lookups in nibble tables: reversed low nibble goes high and vice versa
+__attribute__((target("ssse3")))
+static void bit_reverse_ssse3(const uint8_t* src, uint8_t* dst, size_t size)
+{
+    const __m128i rev_lo = _mm_setr_epi8(0x00, 0x08, 0x04, 0x0c, 0x02, 0x0a, 0x06, 0x0e, 0x01, 0x09, 0x05, 0x0d, 0x03, 0x0b, 0x07, 0x0f);
+    const __m128i rev_hi = _mm_slli_epi16(rev_lo, 4);
+    const __m128i m4 = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 32 <= size; i += 32)
+    {
+        __m128i x0 = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i x1 = _mm_loadu_si128((const __m128i*)(src + i + 16));
+        x0 = _mm_or_si128(_mm_shuffle_epi8(rev_hi, _mm_and_si128(x0, m4)), _mm_shuffle_epi8(rev_lo, _mm_and_si128(_mm_srli_epi16(x0, 4), m4)));
+        x1 = _mm_or_si128(_mm_shuffle_epi8(rev_hi, _mm_and_si128(x1, m4)), _mm_shuffle_epi8(rev_lo, _mm_and_si128(_mm_srli_epi16(x1, 4), m4)));
+        _mm_storeu_si128((__m128i*)(dst + i), x0);
+        _mm_storeu_si128((__m128i*)(dst + i + 16), x1);
+    }
+
+    for (; i < size; i++)
+    {
+        dst[i] = dsd_bit_reverse_table[src[i]];
+    }
+}
+
+void dsd_bit_reverse(const uint8_t* src, uint8_t* dst, size_t size)
+{
+    static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+
+    if (has_ssse3)
+    {
+        bit_reverse_ssse3(src, dst, size);
+    }
+    else
+    {
+        bit_reverse_sse2(src, dst, size);
+    }
+}
+
+static void interleave2(const uint8_t* a, const uint8_t* b, size_t samples, uint8_t* out)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= samples; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+        _mm_storeu_si128((__m128i*)(out + 2 * i), _mm_unpacklo_epi8(x, y));
+        _mm_storeu_si128((__m128i*)(out + 2 * i + 16), _mm_unpackhi_epi8(x, y));
+    }
+
+    for (; i < samples; i++)
+    {
+        out[2 * i + 0] = a[i];
+        out[2 * i + 1] = b[i];
+    }
+}
+
+static void interleave4(const uint8_t* a, const uint8_t* b, const uint8_t* c, const uint8_t* d, size_t samples, uint8_t* out)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= samples; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+        __m128i z = _mm_loadu_si128((const __m128i*)(c + i));
+        __m128i w = _mm_loadu_si128((const __m128i*)(d + i));
+        __m128i xy_lo = _mm_unpacklo_epi8(x, y);
+        __m128i xy_hi = _mm_unpackhi_epi8(x, y);
+        __m128i zw_lo = _mm_unpacklo_epi8(z, w);
+        __m128i zw_hi = _mm_unpackhi_epi8(z, w);
+        _mm_storeu_si128((__m128i*)(out + 4 * i), _mm_unpacklo_epi16(xy_lo, zw_lo));
+        _mm_storeu_si128((__m128i*)(out + 4 * i + 16), _mm_unpackhi_epi16(xy_lo, zw_lo));
+        _mm_storeu_si128((__m128i*)(out + 4 * i + 32), _mm_unpacklo_epi16(xy_hi, zw_hi));
+        _mm_storeu_si128((__m128i*)(out + 4 * i + 48), _mm_unpackhi_epi16(xy_hi, zw_hi));
+    }
+
+    for (; i < samples; i++)
+    {
+        out[4 * i + 0] = a[i];
+        out[4 * i + 1] = b[i];
+        out[4 * i + 2] = c[i];
+        out[4 * i + 3] = d[i];
+    }
+}
+
+void dsd_interleave(const uint8_t* planar, size_t stride, int channels, size_t samples, uint8_t* out)
+{
+    switch (channels)
+    {
+        case 1:
+            memcpy(out, planar, samples);
+            break;
+        case 2:
+            interleave2(planar, planar + stride, samples, out);
+            break;
+        case 4:
+            interleave4(planar, planar + stride, planar + 2 * stride, planar + 3 * stride, samples, out);
+            break;
+        default:
+            for (int ch = 0; ch < channels; ch++)
+            {
+                const uint8_t* src = planar + ch * stride;
+                uint8_t* dst = out + ch;
+
+                for (size_t i = 0; i < samples; i++, dst += channels)
+                {
+                    *dst = src[i];
+                }
+            }
+            break;
+    }
+}
+
+static void deinterleave2(const uint8_t* in, size_t samples, uint8_t* a, uint8_t* b)
+{
+    const __m128i lo = _mm_set1_epi16(0x00ff);
+    size_t i = 0;
+
+    for (; i + 16 <= samples; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*)(in + 2 * i));
+        __m128i y = _mm_loadu_si128((const __m128i*)(in + 2 * i + 16));
+        _mm_storeu_si128((__m128i*)(a + i), _mm_packus_epi16(_mm_and_si128(x, lo), _mm_and_si128(y, lo)));
+        _mm_storeu_si128((__m128i*)(b + i), _mm_packus_epi16(_mm_srli_epi16(x, 8), _mm_srli_epi16(y, 8)));
+    }
+
+    for (; i < samples; i++)
+    {
+        a[i] = in[2 * i + 0];
+        b[i] = in[2 * i + 1];
+    }
+}
+
+void dsd_deinterleave(const uint8_t* in, int channels, size_t samples, uint8_t* planar, size_t stride)
+{
+    switch (channels)
+    {
+        case 1:
+            memcpy(planar, in, samples);
+            break;
+        case 2:
+            deinterleave2(in, samples, planar, planar + stride);
+            break;
+        default:
+            for (int ch = 0; ch < channels; ch++)
+            {
+                const uint8_t* src = in + ch;
+                uint8_t* dst = planar + ch * stride;
+
+                for (size_t i = 0; i < samples; i++, src += channels)
+                {
+                    dst[i] = *src;
+                }
+            }
+            break;
+    }
+}
@@ -0,0 +1,38 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#ifndef _DSD_TRANSPOSE_H_INCLUDED
+#define _DSD_TRANSPOSE_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+// LSB first <-> MSB first bit order of a DSD byte
+extern const uint8_t dsd_bit_reverse_table[256];
+
+// Reverse the bit order of every byte in src and store the result in dst (src == dst is allowed)
+void dsd_bit_reverse(const uint8_t* src, uint8_t* dst, size_t size);
+
+// Interleave 'samples' bytes of each channel, channel ch starting at planar + ch * stride, into out (out[i * channels + ch])
+void dsd_interleave(const uint8_t* planar, size_t stride, int channels, size_t samples, uint8_t* out);
+
+// Split 'samples' interleaved sample frames of in into per-channel runs, channel ch starting at planar + ch * stride
+void dsd_deinterleave(const uint8_t* in, int channels, size_t samples, uint8_t* planar, size_t stride);
+
+#endif
@@ -0,0 +1,454 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "dsd_writer.h"
+#include "dsd_transpose.h"
+
+static void put_id(vector<uint8_t>& out, const char* id)
+{
+    out.insert(out.end(), id, id + 4);
+}
+
+static void put_le(vector<uint8_t>& out, uint64_t value, int size)
+{
+    uint8_t buf[8];
+
+    for (int i = 0; i < size; i++)
+    {
+        buf[i] = (uint8_t)(value >> (8 * i));
+    }
+
+    out.insert(out.end(), buf, buf + size);
+}
+
+static void put_be(vector<uint8_t>& out, uint64_t value, int size)
+{
+    uint8_t buf[8];
+
+    for (int i = 0; i < size; i++)
+    {
+        buf[i] = (uint8_t)(value >> (8 * (size - 1 - i)));
+    }
+
+    out.insert(out.end(), buf, buf + size);
+}
+
+dsd_writer_t::dsd_writer_t(dsd_container_t container)
+{
+    m_fd = -1;
+    m_container = container;
+    m_channels = 0;
+    m_samplerate = 0;
+    m_channel_map = 0;
+    m_sample_count = 0;
+    m_data_size = 0;
+    m_block_fill = 0;
+    m_file_pos = 0;
+    m_error = false;
+}
+
+dsd_writer_t::~dsd_writer_t()
+{
+    close();
+}
+
+string dsd_writer_t::get_extension()
+{
+    return m_container == DSD_CONTAINER_DSF ? ".dsf" : ".dff";
+}
+
+bool dsd_writer_t::open(const string& path, int channels, int samplerate, unsigned int channel_map)
+{
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (m_fd < 0)
+    {
+        return false;
+    }
+
+    m_channels = channels;
+    m_samplerate = samplerate;
+    m_channel_map = channel_map;
+    m_sample_count = 0;
+    m_data_size = 0;
+    m_block_fill = 0;
+    m_file_pos = 0;
+    m_frame_offsets.clear();
+    m_frame_sizes.clear();
+    m_markers.clear();
+    m_error = false;
+    m_buffer.reserve(DSD_WRITER_BUFFER_SIZE);
+
+    if (m_container == DSD_CONTAINER_DSF)
+    {
+        m_block.assign(DSF_BLOCK_SIZE * channels, 0);
+    }
+
+    // Placeholder, the sizes are known on close()
+    write_header(false);
+
+    return !m_error;
+}
+
+bool dsd_writer_t::append(const uint8_t* data, size_t size)
+{
+    if (m_buffer.size() + size > DSD_WRITER_BUFFER_SIZE && !flush())
+    {
+        return false;
+    }
+
+    m_buffer.insert(m_buffer.end(), data, data + size);
+    m_file_pos += size;
+
+    return true;
+}
+
+bool dsd_writer_t::flush()
+{
+    size_t done = 0;
+
+    while (!m_error && done < m_buffer.size())
+    {
+        ssize_t written = ::write(m_fd, m_buffer.data() + done, m_buffer.size() - done);
+
+        if (written <= 0)
+        {
+            m_error = true;
+        }
+        else
+        {
+            done += written;
+        }
+    }
+
+    m_buffer.clear();
+
+    return !m_error;
+}
+
+bool dsd_writer_t::write(const uint8_t* dsd_data, int samples)
+{
+    if (m_fd < 0 || m_error)
+    {
+        return false;
+    }
+
+    if (m_container == DSD_CONTAINER_DST)
+    {
+        return write_dsd_frame(dsd_data, (size_t)samples * m_channels);
+    }
+
+    m_sample_count += samples;
+
+    if (m_container == DSD_CONTAINER_DFF)
+    {
+        m_data_size += (uint64_t)samples * m_channels;
+
+        return append(dsd_data, (size_t)samples * m_channels);
+    }
+
+    while (samples > 0)
+    {
+        size_t count = (size_t)samples < DSF_BLOCK_SIZE - m_block_fill ? (size_t)samples : DSF_BLOCK_SIZE - m_block_fill;
+
+        dsd_deinterleave(dsd_data, m_channels, count, m_block.data() + m_block_fill, DSF_BLOCK_SIZE);
+        dsd_data += count * m_channels;
+        samples -= count;
+        m_block_fill += count;
+
+        if (m_block_fill == DSF_BLOCK_SIZE)
+        {
+            dsd_bit_reverse(m_block.data(), m_block.data(), m_block.size());
+            m_data_size += m_block.size();
+            m_block_fill = 0;
+
+            if (!append(m_block.data(), m_block.size()))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// One DST frame as a DSTF chunk, DSD_CONTAINER_DST only
+bool dsd_writer_t::write_frame(const uint8_t* dst_data, size_t size)
+{
+    vector<uint8_t> ck;
+    uint8_t pad = 0;
+
+    if (m_fd < 0 || m_error || m_container != DSD_CONTAINER_DST)
+    {
+        return false;
+    }
+
+    put_id(ck, "DSTF");
+    put_be(ck, size, 8);
+
+    m_frame_offsets.push_back(m_file_pos + ck.size());
+    m_frame_sizes.push_back((uint32_t)size);
+    m_data_size += ck.size() + size + (size & 1);
+    m_sample_count += (uint64_t)m_samplerate / 8 / 75;
+
+    return append(ck.data(), ck.size()) && append(dst_data, size) && ((size & 1) == 0 || append(&pad, 1));
+}
+
+// A DSD frame stored in the DST stream without compression: a header byte with the DST coded bit cleared, then the
+// interleaved DSD bytes
+bool dsd_writer_t::write_dsd_frame(const uint8_t* dsd_data, size_t size)
+{
+    vector<uint8_t> frame(1, 0);
+
+    frame.insert(frame.end(), dsd_data, dsd_data + size);
+
+    return write_frame(frame.data(), frame.size());
+}
+
+// Track start at a DSD sample (bit) position, DSDIFF only
+void dsd_writer_t::add_marker(uint64_t sample)
+{
+    m_markers.push_back(sample);
+}
+
+void dsd_writer_t::write_header(bool final)
+{
+    vector<uint8_t> header;
+
+    if (m_container == DSD_CONTAINER_DSF)
+    {
+        // Channel type by layout: mono, stereo, 3 channels, quad, 4 channels, 5 channels, 5.1
+        int channel_type = m_channels;
+
+        switch (m_channel_map)
+        {
+            case 1<<0 | 1<<1 | 1<<4 | 1<<5:
+                channel_type = 4;
+                break;
+            case 1<<0 | 1<<1 | 1<<2 | 1<<3:
+                channel_type = 5;
+                break;
+            case 1<<0 | 1<<1 | 1<<2 | 1<<4 | 1<<5:
+                channel_type = 6;
+                break;
+            case 1<<0 | 1<<1 | 1<<2 | 1<<3 | 1<<4 | 1<<5:
+                channel_type = 7;
+                break;
+        }
+
+        put_id(header, "DSD ");
+        put_le(header, 28, 8);
+        put_le(header, 28 + 52 + 12 + m_data_size, 8);
+        put_le(header, 0, 8); // no metadata
+        put_id(header, "fmt ");
+        put_le(header, 52, 8);
+        put_le(header, 1, 4); // version
+        put_le(header, 0, 4); // DSD raw
+        put_le(header, channel_type, 4);
+        put_le(header, m_channels, 4);
+        put_le(header, m_samplerate, 4);
+        put_le(header, 1, 4); // bits per sample
+        put_le(header, m_sample_count * 8, 8);
+        put_le(header, DSF_BLOCK_SIZE, 4);
+        put_le(header, 0, 4);
+        put_id(header, "data");
+        put_le(header, 12 + m_data_size, 8);
+    }
+    else
+    {
+        // Speaker ids of the channels in scarletbook order, the 2-channel area is stereo
+        static const char* speakers[] = {"MLFT", "MRGT", "C   ", "LFE ", "LS  ", "RS  "};
+        bool dst = m_container == DSD_CONTAINER_DST;
+        vector<uint8_t> prop;
+
+        put_id(prop, "SND ");
+        put_id(prop, "FS  ");
+        put_be(prop, 4, 8);
+        put_be(prop, m_samplerate, 4);
+        put_id(prop, "CHNL");
+        put_be(prop, 2 + 4 * m_channels, 8);
+        put_be(prop, m_channels, 2);
+
+        for (int ch = 0, bit = 0; ch < m_channels; ch++, bit++)
+        {
+            if (m_channels == 2)
+            {
+                put_id(prop, ch == 0 ? "SLFT" : "SRGT");
+                continue;
+            }
+
+            while (bit < 6 && !(m_channel_map & (1 << bit)))
+            {
+                bit++;
+            }
+
+            if (bit < 6)
+            {
+                put_id(prop, speakers[bit]);
+            }
+            else
+            {
+                char id[16];
+
+                snprintf(id, sizeof(id), "C%03d", ch % 1000);
+                put_id(prop, id);
+            }
+        }
+
+        // Compression name as a pascal string padded to an even length
+        const char* name = dst ? "DST Encoded" : "not compressed";
+        size_t name_size = strlen(name);
+
+        put_id(prop, "CMPR");
+        put_be(prop, 4 + ((1 + name_size + 1) & ~1), 8);
+        put_id(prop, dst ? "DST " : "DSD ");
+        put_be(prop, name_size, 1);
+        prop.insert(prop.end(), name, name + name_size);
+
+        if (((1 + name_size) & 1) != 0)
+        {
+            put_be(prop, 0, 1);
+        }
+
+        // Chunks behind the sound data: the DST frame index and the markers
+        uint64_t trailer_size = (dst ? 12 + 12 * m_frame_offsets.size() : 0) + (m_markers.empty() ? 0 : 12 + (12 + 22) * m_markers.size());
+        uint64_t sound_size = dst ? 12 + 6 + m_data_size : m_data_size;
+
+        put_id(header, "FRM8");
+        put_be(header, 4 + 12 + 4 + 12 + prop.size() + 12 + sound_size + (sound_size & 1) + trailer_size, 8);
+        put_id(header, "DSD ");
+        put_id(header, "FVER");
+        put_be(header, 4, 8);
+        put_be(header, 0x01050000, 4);
+        put_id(header, "PROP");
+        put_be(header, prop.size(), 8);
+        header.insert(header.end(), prop.begin(), prop.end());
+        put_id(header, dst ? "DST " : "DSD ");
+        put_be(header, sound_size, 8);
+
+        if (dst)
+        {
+            put_id(header, "FRTE");
+            put_be(header, 6, 8);
+            put_be(header, m_frame_offsets.size(), 4);
+            put_be(header, 75, 2);
+        }
+    }
+
+    if (!final)
+    {
+        m_error = !append(header.data(), header.size());
+    }
+    else if (pwrite(m_fd, header.data(), header.size(), 0) != (ssize_t)header.size())
+    {
+        m_error = true;
+    }
+}
+
+void dsd_writer_t::write_trailer()
+{
+    vector<uint8_t> trailer;
+
+    if (m_container == DSD_CONTAINER_DST)
+    {
+        put_id(trailer, "DSTI");
+        put_be(trailer, 12 * m_frame_offsets.size(), 8);
+
+        for (size_t i = 0; i < m_frame_offsets.size(); i++)
+        {
+            put_be(trailer, m_frame_offsets[i], 8);
+            put_be(trailer, m_frame_sizes[i], 4);
+        }
+    }
+
+    if (!m_markers.empty())
+    {
+        put_id(trailer, "DIIN");
+        put_be(trailer, (12 + 22) * m_markers.size(), 8);
+
+        for (size_t i = 0; i < m_markers.size(); i++)
+        {
+            uint64_t seconds = m_markers[i] / m_samplerate;
+
+            put_id(trailer, "MARK");
+            put_be(trailer, 22, 8);
+            put_be(trailer, seconds / 3600, 2);
+            put_be(trailer, seconds / 60 % 60, 1);
+            put_be(trailer, seconds % 60, 1);
+            put_be(trailer, m_markers[i] % m_samplerate, 4);
+            put_be(trailer, 0, 4); // offset
+            put_be(trailer, 0, 2); // TrackStart
+            put_be(trailer, 0, 2); // all channels
+            put_be(trailer, 0, 2); // flags
+            put_be(trailer, 0, 4); // no text
+        }
+    }
+
+    append(trailer.data(), trailer.size());
+}
+
+bool dsd_writer_t::close()
+{
+    if (m_fd < 0)
+    {
+        return !m_error;
+    }
+
+    if (!m_error)
+    {
+        if (m_container == DSD_CONTAINER_DSF && m_block_fill > 0)
+        {
+            // Silence after the end of every channel
+            for (int ch = 0; ch < m_channels; ch++)
+            {
+                memset(m_block.data() + ch * DSF_BLOCK_SIZE + m_block_fill, 0, DSF_BLOCK_SIZE - m_block_fill);
+            }
+
+            dsd_bit_reverse(m_block.data(), m_block.data(), m_block.size());
+            m_data_size += m_block.size();
+            m_block_fill = 0;
+            append(m_block.data(), m_block.size());
+        }
+
+        if (m_container == DSD_CONTAINER_DFF && (m_data_size & 1))
+        {
+            uint8_t pad = 0;
+
+            append(&pad, 1);
+        }
+
+        if (m_container != DSD_CONTAINER_DSF)
+        {
+            write_trailer();
+        }
+
+        flush();
+        write_header(true);
+    }
+
+    bool ok = !m_error && ::close(m_fd) == 0;
+
+    m_fd = -1;
+
+    return ok;
+}
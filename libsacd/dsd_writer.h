@@ -0,0 +1,72 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#ifndef _DSD_WRITER_H_INCLUDED
+#define _DSD_WRITER_H_INCLUDED
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+enum dsd_container_t {DSD_CONTAINER_DSF = 0, DSD_CONTAINER_DFF = 1, DSD_CONTAINER_DST = 2};
+
+constexpr size_t DSF_BLOCK_SIZE = 4096;
+constexpr size_t DSD_WRITER_BUFFER_SIZE = 4 * 1024 * 1024;
+
+// Stores the DSD stream of a session (interleaved bytes, MSB first) without conversion. DSDIFF takes it as it is, DSF
+// wants blocks of DSF_BLOCK_SIZE bytes per channel, LSB first, the last one padded with silence. DSD_CONTAINER_DST is
+// DSDIFF with DST frames copied as they are (write_frame()) and a DSTI index of them. DSDIFF files get a DIIN chunk
+// with the track markers. The chunk sizes are written when the file is closed, so the output has to be a regular file.
+class dsd_writer_t
+{
+    int m_fd;
+    dsd_container_t m_container;
+    int m_channels;
+    int m_samplerate;
+    unsigned int m_channel_map;
+    uint64_t m_sample_count; // bytes per channel
+    uint64_t m_data_size;
+    vector<uint8_t> m_block; // DSF: one block of every channel
+    size_t m_block_fill;
+    vector<uint8_t> m_buffer;
+    uint64_t m_file_pos;
+    vector<uint64_t> m_frame_offsets; // DST: file position of every DSTF chunk's data
+    vector<uint32_t> m_frame_sizes;
+    vector<uint64_t> m_markers;
+    bool m_error;
+    bool append(const uint8_t* data, size_t size);
+    bool flush();
+    void write_header(bool final);
+    void write_trailer();
+public:
+    dsd_writer_t(dsd_container_t container);
+    ~dsd_writer_t();
+    bool open(const string& path, int channels, int samplerate, unsigned int channel_map);
+    bool write(const uint8_t* dsd_data, int samples);
+    bool write_frame(const uint8_t* dst_data, size_t size);
+    bool write_dsd_frame(const uint8_t* dsd_data, size_t size);
+    void add_marker(uint64_t sample);
+    bool close();
+    bool failed() { return m_error; }
+    string get_extension();
+};
+
+#endif
@@ -0,0 +1,1179 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include "pcm_sample_pack.h"
+#include "version.h"
+#include "flac_writer.h"
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+
+class flac_crc_t
+{
+public:
+    uint8_t crc8[256];
+    uint16_t crc16[256];
+
+    flac_crc_t()
+    {
+        for (int i = 0; i < 256; i++)
+        {
+            uint8_t c8 = (uint8_t)i;
+            uint16_t c16 = (uint16_t)(i << 8);
+
+            for (int j = 0; j < 8; j++)
+            {
+                c8 = (c8 & 0x80) ? (uint8_t)((c8 << 1) ^ 0x07) : (uint8_t)(c8 << 1);
+                c16 = (c16 & 0x8000) ? (uint16_t)((c16 << 1) ^ 0x8005) : (uint16_t)(c16 << 1);
+            }
+
+            crc8[i] = c8;
+            crc16[i] = c16;
+        }
+    }
+};
+
+static const flac_crc_t g_cFlacCrc;
+
+static uint8_t flac_crc8(const uint8_t* data, size_t size)
+{
+    uint8_t crc = 0;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        crc = g_cFlacCrc.crc8[crc ^ data[i]];
+    }
+
+    return crc;
+}
+
+static uint16_t flac_crc16(const uint8_t* data, size_t size)
+{
+    uint16_t crc = 0;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        crc = (uint16_t)(crc << 8) ^ g_cFlacCrc.crc16[(crc >> 8) ^ data[i]];
+    }
+
+    return crc;
+}
+
+// RFC 1321, STREAMINFO carries the MD5 of the interleaved little endian samples
+
+#define MD5_F(x, y, z) (((x) & (y)) | (~(x) & (z)))
+#define MD5_G(x, y, z) (((x) & (z)) | ((y) & ~(z)))
+#define MD5_H(x, y, z) ((x) ^ (y) ^ (z))
+#define MD5_I(x, y, z) ((y) ^ ((x) | ~(z)))
+#define MD5_STEP(f, a, b, c, d, x, t, s) (a) += f((b), (c), (d)) + (x) + (t); (a) = ((a) << (s)) | ((a) >> (32 - (s))); (a) += (b)
+
+static void md5_transform(uint32_t* state, const uint8_t* block)
+{
+    uint32_t x[16];
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+
+    for (int i = 0; i < 16; i++)
+    {
+        x[i] = block[4 * i] | (block[4 * i + 1] << 8) | (block[4 * i + 2] << 16) | ((uint32_t)block[4 * i + 3] << 24);
+    }
+
+    MD5_STEP(MD5_F, a, b, c, d, x[0], 0xd76aa478, 7);
+    MD5_STEP(MD5_F, d, a, b, c, x[1], 0xe8c7b756, 12);
+    MD5_STEP(MD5_F, c, d, a, b, x[2], 0x242070db, 17);
+    MD5_STEP(MD5_F, b, c, d, a, x[3], 0xc1bdceee, 22);
+    MD5_STEP(MD5_F, a, b, c, d, x[4], 0xf57c0faf, 7);
+    MD5_STEP(MD5_F, d, a, b, c, x[5], 0x4787c62a, 12);
+    MD5_STEP(MD5_F, c, d, a, b, x[6], 0xa8304613, 17);
+    MD5_STEP(MD5_F, b, c, d, a, x[7], 0xfd469501, 22);
+    MD5_STEP(MD5_F, a, b, c, d, x[8], 0x698098d8, 7);
+    MD5_STEP(MD5_F, d, a, b, c, x[9], 0x8b44f7af, 12);
+    MD5_STEP(MD5_F, c, d, a, b, x[10], 0xffff5bb1, 17);
+    MD5_STEP(MD5_F, b, c, d, a, x[11], 0x895cd7be, 22);
+    MD5_STEP(MD5_F, a, b, c, d, x[12], 0x6b901122, 7);
+    MD5_STEP(MD5_F, d, a, b, c, x[13], 0xfd987193, 12);
+    MD5_STEP(MD5_F, c, d, a, b, x[14], 0xa679438e, 17);
+    MD5_STEP(MD5_F, b, c, d, a, x[15], 0x49b40821, 22);
+
+    MD5_STEP(MD5_G, a, b, c, d, x[1], 0xf61e2562, 5);
+    MD5_STEP(MD5_G, d, a, b, c, x[6], 0xc040b340, 9);
+    MD5_STEP(MD5_G, c, d, a, b, x[11], 0x265e5a51, 14);
+    MD5_STEP(MD5_G, b, c, d, a, x[0], 0xe9b6c7aa, 20);
+    MD5_STEP(MD5_G, a, b, c, d, x[5], 0xd62f105d, 5);
+    MD5_STEP(MD5_G, d, a, b, c, x[10], 0x02441453, 9);
+    MD5_STEP(MD5_G, c, d, a, b, x[15], 0xd8a1e681, 14);
+    MD5_STEP(MD5_G, b, c, d, a, x[4], 0xe7d3fbc8, 20);
+    MD5_STEP(MD5_G, a, b, c, d, x[9], 0x21e1cde6, 5);
+    MD5_STEP(MD5_G, d, a, b, c, x[14], 0xc33707d6, 9);
+    MD5_STEP(MD5_G, c, d, a, b, x[3], 0xf4d50d87, 14);
+    MD5_STEP(MD5_G, b, c, d, a, x[8], 0x455a14ed, 20);
+    MD5_STEP(MD5_G, a, b, c, d, x[13], 0xa9e3e905, 5);
+    MD5_STEP(MD5_G, d, a, b, c, x[2], 0xfcefa3f8, 9);
+    MD5_STEP(MD5_G, c, d, a, b, x[7], 0x676f02d9, 14);
+    MD5_STEP(MD5_G, b, c, d, a, x[12], 0x8d2a4c8a, 20);
+
+    MD5_STEP(MD5_H, a, b, c, d, x[5], 0xfffa3942, 4);
+    MD5_STEP(MD5_H, d, a, b, c, x[8], 0x8771f681, 11);
+    MD5_STEP(MD5_H, c, d, a, b, x[11], 0x6d9d6122, 16);
+    MD5_STEP(MD5_H, b, c, d, a, x[14], 0xfde5380c, 23);
+    MD5_STEP(MD5_H, a, b, c, d, x[1], 0xa4beea44, 4);
+    MD5_STEP(MD5_H, d, a, b, c, x[4], 0x4bdecfa9, 11);
+    MD5_STEP(MD5_H, c, d, a, b, x[7], 0xf6bb4b60, 16);
+    MD5_STEP(MD5_H, b, c, d, a, x[10], 0xbebfbc70, 23);
+    MD5_STEP(MD5_H, a, b, c, d, x[13], 0x289b7ec6, 4);
+    MD5_STEP(MD5_H, d, a, b, c, x[0], 0xeaa127fa, 11);
+    MD5_STEP(MD5_H, c, d, a, b, x[3], 0xd4ef3085, 16);
+    MD5_STEP(MD5_H, b, c, d, a, x[6], 0x04881d05, 23);
+    MD5_STEP(MD5_H, a, b, c, d, x[9], 0xd9d4d039, 4);
+    MD5_STEP(MD5_H, d, a, b, c, x[12], 0xe6db99e5, 11);
+    MD5_STEP(MD5_H, c, d, a, b, x[15], 0x1fa27cf8, 16);
+    MD5_STEP(MD5_H, b, c, d, a, x[2], 0xc4ac5665, 23);
+
+    MD5_STEP(MD5_I, a, b, c, d, x[0], 0xf4292244, 6);
+    MD5_STEP(MD5_I, d, a, b, c, x[7], 0x432aff97, 10);
+    MD5_STEP(MD5_I, c, d, a, b, x[14], 0xab9423a7, 15);
+    MD5_STEP(MD5_I, b, c, d, a, x[5], 0xfc93a039, 21);
+    MD5_STEP(MD5_I, a, b, c, d, x[12], 0x655b59c3, 6);
+    MD5_STEP(MD5_I, d, a, b, c, x[3], 0x8f0ccc92, 10);
+    MD5_STEP(MD5_I, c, d, a, b, x[10], 0xffeff47d, 15);
+    MD5_STEP(MD5_I, b, c, d, a, x[1], 0x85845dd1, 21);
+    MD5_STEP(MD5_I, a, b, c, d, x[8], 0x6fa87e4f, 6);
+    MD5_STEP(MD5_I, d, a, b, c, x[15], 0xfe2ce6e0, 10);
+    MD5_STEP(MD5_I, c, d, a, b, x[6], 0xa3014314, 15);
+    MD5_STEP(MD5_I, b, c, d, a, x[13], 0x4e0811a1, 21);
+    MD5_STEP(MD5_I, a, b, c, d, x[4], 0xf7537e82, 6);
+    MD5_STEP(MD5_I, d, a, b, c, x[11], 0xbd3af235, 10);
+    MD5_STEP(MD5_I, c, d, a, b, x[2], 0x2ad7d2bb, 15);
+    MD5_STEP(MD5_I, b, c, d, a, x[9], 0xeb86d391, 21);
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+}
+
+static void md5_init(flac_md5_t* md5)
+{
+    md5->state[0] = 0x67452301;
+    md5->state[1] = 0xefcdab89;
+    md5->state[2] = 0x98badcfe;
+    md5->state[3] = 0x10325476;
+    md5->length = 0;
+}
+
+static void md5_update(flac_md5_t* md5, const uint8_t* data, size_t size)
+{
+    size_t nFill = md5->length & 63;
+
+    md5->length += size;
+
+    if (nFill > 0)
+    {
+        size_t nCopy = MIN(size, 64 - nFill);
+        memcpy(md5->buffer + nFill, data, nCopy);
+        data += nCopy;
+        size -= nCopy;
+
+        if (nFill + nCopy < 64)
+        {
+            return;
+        }
+
+        md5_transform(md5->state, md5->buffer);
+    }
+
+    for (; size >= 64; data += 64, size -= 64)
+    {
+        md5_transform(md5->state, data);
+    }
+
+    memcpy(md5->buffer, data, size);
+}
+
+static void md5_final(flac_md5_t* md5, uint8_t* digest)
+{
+    uint8_t arrPad[72] = {0x80};
+    uint8_t arrLength[8];
+    uint64_t nBits = md5->length * 8;
+
+    for (int i = 0; i < 8; i++)
+    {
+        arrLength[i] = (uint8_t)(nBits >> (8 * i));
+    }
+
+    md5_update(md5, arrPad, 1 + ((119 - (md5->length & 63)) & 63));
+    md5_update(md5, arrLength, 8);
+
+    for (int i = 0; i < 16; i++)
+    {
+        digest[i] = (uint8_t)(md5->state[i / 4] >> (8 * (i % 4)));
+    }
+}
+
+// Predictor coefficients of the fixed FLAC predictors, applied like quantized LPC with a zero shift
+static const int32_t g_arrFixedCoefs[FLAC_MAX_FIXED_ORDER + 1][FLAC_MAX_FIXED_ORDER] =
+{
+    {0, 0, 0, 0},
+    {1, 0, 0, 0},
+    {2, -1, 0, 0},
+    {3, -3, 1, 0},
+    {4, -6, 4, -1}
+};
+
+static inline uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int bit_length(uint32_t value)
+{
+    return value ? 32 - __builtin_clz(value) : 0;
+}
+
+// Rice parameter that minimizes the estimated size of a partition holding 'count' values summing (zigzagged) to 'sum'
+static int rice_parameter(uint64_t count, uint64_t sum, int max_param, uint64_t* bits)
+{
+    int k = 0;
+
+    while (k < max_param && (count << (k + 1)) < sum)
+    {
+        k++;
+    }
+
+    *bits = count * (k + 1) + (sum >> k);
+
+    if (k > 0 && count * k + (sum >> (k - 1)) < *bits)
+    {
+        k--;
+        *bits = count * (k + 1) + (sum >> k);
+    }
+
+    return k;
+}
+
+flac_frame_encoder_t::flac_frame_encoder_t()
+{
+    m_channels = 0;
+    m_bits = 0;
+    m_samplerate = 0;
+    m_out = nullptr;
+    m_acc = 0;
+    m_acc_bits = 0;
+}
+
+void flac_frame_encoder_t::init(int channels, int bits, int samplerate)
+{
+    m_channels = channels;
+    m_bits = bits;
+    m_samplerate = samplerate;
+    m_mid.resize(FLAC_BLOCK_SIZE);
+    m_side.resize(FLAC_BLOCK_SIZE);
+    m_residual.resize(FLAC_BLOCK_SIZE);
+    m_windowed.resize(FLAC_BLOCK_SIZE);
+    m_window.clear();
+}
+
+void flac_frame_encoder_t::put(uint32_t value, int bits)
+{
+    if (bits == 0)
+    {
+        return;
+    }
+
+    m_acc = (m_acc << bits) | (value & (0xffffffffULL >> (32 - bits)));
+    m_acc_bits += bits;
+
+    while (m_acc_bits >= 8)
+    {
+        m_acc_bits -= 8;
+        m_out->push_back((uint8_t)(m_acc >> m_acc_bits));
+    }
+}
+
+void flac_frame_encoder_t::put_signed(int32_t value, int bits)
+{
+    put((uint32_t)value, bits);
+}
+
+void flac_frame_encoder_t::put_rice(uint32_t value, int k)
+{
+    uint32_t q = value >> k;
+    uint32_t r = value & ((1U << k) - 1);
+
+    if (q + 1 + k <= 32)
+    {
+        put((1U << k) | r, q + 1 + k);
+        return;
+    }
+
+    for (; q >= 32; q -= 32)
+    {
+        put(0, 32);
+    }
+
+    put(1, q + 1);
+    put(r, k);
+}
+
+void flac_frame_encoder_t::put_utf8(uint32_t value)
+{
+    if (value < 0x80)
+    {
+        put(value, 8);
+        return;
+    }
+
+    int nBytes = value < 0x800 ? 2 : value < 0x10000 ? 3 : value < 0x200000 ? 4 : value < 0x4000000 ? 5 : 6;
+
+    put(((0xff00 >> nBytes) & 0xff) | (value >> (6 * (nBytes - 1))), 8);
+
+    for (int i = nBytes - 2; i >= 0; i--)
+    {
+        put(0x80 | ((value >> (6 * i)) & 0x3f), 8);
+    }
+}
+
+void flac_frame_encoder_t::align()
+{
+    if (m_acc_bits > 0)
+    {
+        put(0, 8 - m_acc_bits);
+    }
+}
+
+// Residual of the prediction for samples [order, count), false if it does not fit the 32-bit residual coding
+bool flac_frame_encoder_t::predict(const int32_t* samples, int count, const flac_subframe_plan_t* plan, int32_t* residual)
+{
+    for (int i = plan->order; i < count; i++)
+    {
+        int64_t nSum = 0;
+
+        for (int j = 0; j < plan->order; j++)
+        {
+            nSum += (int64_t)plan->qlp[j] * samples[i - j - 1];
+        }
+
+        int64_t nResidual = samples[i] - (nSum >> plan->shift);
+
+        if (nResidual > INT32_MAX || nResidual < -INT32_MAX)
+        {
+            return false;
+        }
+
+        residual[i - plan->order] = (int32_t)nResidual;
+    }
+
+    return true;
+}
+
+// Picks the partition order and per partition Rice parameter (or escape to raw bits) and returns the size in bits
+uint64_t flac_frame_encoder_t::plan_residual(const int32_t* residual, int count, int order, flac_residual_plan_t* plan)
+{
+    uint64_t arrSum[1 << FLAC_MAX_PARTITION_ORDER];
+    uint32_t arrMax[1 << FLAC_MAX_PARTITION_ORDER];
+    int nMaxOrder = 0;
+
+    while (nMaxOrder < FLAC_MAX_PARTITION_ORDER && (count & ((1 << (nMaxOrder + 1)) - 1)) == 0 && (count >> (nMaxOrder + 1)) > order)
+    {
+        nMaxOrder++;
+    }
+
+    int nPartitionSize = count >> nMaxOrder;
+
+    for (int p = 0; p < (1 << nMaxOrder); p++)
+    {
+        int nStart = p == 0 ? 0 : p * nPartitionSize - order;
+        int nEnd = (p + 1) * nPartitionSize - order;
+        uint64_t nSum = 0;
+        uint32_t nMax = 0;
+
+        for (int i = nStart; i < nEnd; i++)
+        {
+            uint32_t u = zigzag(residual[i]);
+            nSum += u;
+            nMax = u > nMax ? u : nMax;
+        }
+
+        arrSum[p] = nSum;
+        arrMax[p] = nMax;
+    }
+
+    uint64_t nBest = UINT64_MAX;
+
+    for (int nOrder = nMaxOrder; nOrder >= 0; nOrder--)
+    {
+        if (nOrder < nMaxOrder)
+        {
+            for (int p = 0; p < (1 << nOrder); p++)
+            {
+                arrSum[p] = arrSum[2 * p] + arrSum[2 * p + 1];
+                arrMax[p] = arrMax[2 * p] > arrMax[2 * p + 1] ? arrMax[2 * p] : arrMax[2 * p + 1];
+            }
+        }
+
+        // Both Rice coding methods, 4-bit parameters up to 14 and 5-bit parameters up to 30, the top value escapes
+        for (int nRice2 = 0; nRice2 <= 1; nRice2++)
+        {
+            int nParamBits = nRice2 ? 5 : 4;
+            int nEscape = (1 << nParamBits) - 1;
+            uint64_t nBits = 2 + 4;
+            flac_residual_plan_t cPlan;
+
+            cPlan.rice2 = nRice2;
+            cPlan.partition_order = nOrder;
+
+            for (int p = 0; p < (1 << nOrder); p++)
+            {
+                uint64_t nCount = (count >> nOrder) - (p == 0 ? order : 0);
+                uint64_t nRiceBits;
+                int k = rice_parameter(nCount, arrSum[p], nEscape - 1, &nRiceBits);
+                int nRawBits = bit_length(arrMax[p]);
+                uint64_t nEscapeBits = 5 + nCount * nRawBits;
+
+                if (nEscapeBits < nRiceBits)
+                {
+                    cPlan.params[p] = nEscape;
+                    cPlan.raw_bits[p] = nRawBits;
+                    nBits += nParamBits + nEscapeBits;
+                }
+                else
+                {
+                    cPlan.params[p] = k;
+                    cPlan.raw_bits[p] = 0;
+                    nBits += nParamBits + nRiceBits;
+                }
+            }
+
+            if (nBits < nBest)
+            {
+                nBest = nBits;
+                *plan = cPlan;
+            }
+        }
+    }
+
+    return nBest;
+}
+
+uint64_t flac_frame_encoder_t::plan_subframe(const int32_t* samples, int count, int bits, flac_subframe_plan_t* plan)
+{
+    bool bConstant = true;
+
+    for (int i = 1; i < count && bConstant; i++)
+    {
+        bConstant = samples[i] == samples[0];
+    }
+
+    if (bConstant)
+    {
+        plan->type = FLAC_SUBFRAME_CONSTANT;
+        plan->order = 0;
+        return 8 + bits;
+    }
+
+    uint64_t nBest = 8 + (uint64_t)count * bits;
+    flac_subframe_plan_t cPlan;
+
+    plan->type = FLAC_SUBFRAME_VERBATIM;
+    plan->order = 0;
+
+    if (count <= FLAC_MAX_LPC_ORDER * 4)
+    {
+        return nBest;
+    }
+
+    // Fixed predictor: the order with the smallest sum of absolute residuals
+    {
+        uint64_t arrError[FLAC_MAX_FIXED_ORDER + 1] = {0, 0, 0, 0, 0};
+
+        for (int i = FLAC_MAX_FIXED_ORDER; i < count; i++)
+        {
+            int64_t e0 = samples[i];
+            int64_t e1 = e0 - samples[i - 1];
+            int64_t e2 = e1 - (samples[i - 1] - samples[i - 2]);
+            int64_t e3 = e2 - (samples[i - 1] - 2 * (int64_t)samples[i - 2] + samples[i - 3]);
+            int64_t e4 = e3 - (samples[i - 1] - 3 * (int64_t)samples[i - 2] + 3 * (int64_t)samples[i - 3] - samples[i - 4]);
+            arrError[0] += e0 < 0 ? -e0 : e0;
+            arrError[1] += e1 < 0 ? -e1 : e1;
+            arrError[2] += e2 < 0 ? -e2 : e2;
+            arrError[3] += e3 < 0 ? -e3 : e3;
+            arrError[4] += e4 < 0 ? -e4 : e4;
+        }
+
+        int nOrder = 0;
+
+        for (int o = 1; o <= FLAC_MAX_FIXED_ORDER; o++)
+        {
+            nOrder = arrError[o] < arrError[nOrder] ? o : nOrder;
+        }
+
+        cPlan.type = FLAC_SUBFRAME_FIXED;
+        cPlan.order = nOrder;
+        cPlan.shift = 0;
+        memcpy(cPlan.qlp, g_arrFixedCoefs[nOrder], sizeof(g_arrFixedCoefs[nOrder]));
+
+        if (predict(samples, count, &cPlan, m_residual.data()))
+        {
+            uint64_t nBits = 8 + (uint64_t)nOrder * bits + plan_residual(m_residual.data(), count, nOrder, &cPlan.residual);
+
+            if (nBits < nBest)
+            {
+                nBest = nBits;
+                *plan = cPlan;
+            }
+        }
+    }
+
+    // LPC: Tukey(0.5) windowed autocorrelation, Levinson-Durbin, then every order is quantized and sized exactly
+    if ((int)m_window.size() != count)
+    {
+        int nTaper = count / 4;
+
+        m_window.resize(count);
+
+        for (int i = 0; i < count; i++)
+        {
+            int n = MIN(i, count - 1 - i);
+            m_window[i] = n < nTaper ? 0.5 - 0.5 * cos(M_PI * n / nTaper) : 1.0;
+        }
+    }
+
+    double arrAutoc[FLAC_MAX_LPC_ORDER + 1];
+
+    for (int i = 0; i < count; i++)
+    {
+        m_windowed[i] = samples[i] * m_window[i];
+    }
+
+    for (int lag = 0; lag <= FLAC_MAX_LPC_ORDER; lag++)
+    {
+        double fSum = 0;
+
+        for (int i = lag; i < count; i++)
+        {
+            fSum += m_windowed[i] * m_windowed[i - lag];
+        }
+
+        arrAutoc[lag] = fSum;
+    }
+
+    if (arrAutoc[0] <= 0)
+    {
+        return nBest;
+    }
+
+    double arrLpc[FLAC_MAX_LPC_ORDER];
+    double fError = arrAutoc[0];
+
+    for (int i = 0; i < FLAC_MAX_LPC_ORDER; i++)
+    {
+        double r = -arrAutoc[i + 1];
+
+        for (int j = 0; j < i; j++)
+        {
+            r -= arrLpc[j] * arrAutoc[i - j];
+        }
+
+        r /= fError;
+        arrLpc[i] = r;
+
+        for (int j = 0; j < i / 2; j++)
+        {
+            double fTmp = arrLpc[j];
+            arrLpc[j] += r * arrLpc[i - 1 - j];
+            arrLpc[i - 1 - j] += r * fTmp;
+        }
+
+        if (i & 1)
+        {
+            arrLpc[i / 2] += arrLpc[i / 2] * r;
+        }
+
+        fError *= 1.0 - r * r;
+
+        if (fError <= 0)
+        {
+            break;
+        }
+
+        int nOrder = i + 1;
+        double fMax = 0;
+
+        for (int j = 0; j < nOrder; j++)
+        {
+            fMax = fabs(arrLpc[j]) > fMax ? fabs(arrLpc[j]) : fMax;
+        }
+
+        int nLog2Max;
+        frexp(fMax, &nLog2Max);
+        int nShift = FLAC_QLP_PRECISION - 1 - nLog2Max;
+
+        if (fMax <= 0 || nShift < 0)
+        {
+            continue;
+        }
+
+        nShift = MIN(nShift, 15);
+
+        // Quantize with error feedback so the rounding errors do not add up
+        const int32_t nQMax = (1 << (FLAC_QLP_PRECISION - 1)) - 1;
+        const int32_t nQMin = -(1 << (FLAC_QLP_PRECISION - 1));
+        double fCarry = 0;
+
+        cPlan.type = FLAC_SUBFRAME_LPC;
+        cPlan.order = nOrder;
+        cPlan.shift = nShift;
+
+        for (int j = 0; j < nOrder; j++)
+        {
+            fCarry += -arrLpc[j] * (1 << nShift);
+            int32_t q = (int32_t)lround(fCarry);
+            q = q > nQMax ? nQMax : q < nQMin ? nQMin : q;
+            fCarry -= q;
+            cPlan.qlp[j] = q;
+        }
+
+        if (!predict(samples, count, &cPlan, m_residual.data()))
+        {
+            continue;
+        }
+
+        uint64_t nBits = 8 + (uint64_t)nOrder * bits + 4 + 5 + nOrder * FLAC_QLP_PRECISION + plan_residual(m_residual.data(), count, nOrder, &cPlan.residual);
+
+        if (nBits < nBest)
+        {
+            nBest = nBits;
+            *plan = cPlan;
+        }
+    }
+
+    return nBest;
+}
+
+void flac_frame_encoder_t::write_residual(const int32_t* residual, int count, int order, const flac_residual_plan_t* plan)
+{
+    int nParamBits = plan->rice2 ? 5 : 4;
+    int nEscape = (1 << nParamBits) - 1;
+    int nPartitionSize = count >> plan->partition_order;
+
+    put(plan->rice2, 2);
+    put(plan->partition_order, 4);
+
+    for (int p = 0, i = 0; p < (1 << plan->partition_order); p++)
+    {
+        int nEnd = (p + 1) * nPartitionSize - order;
+        int k = plan->params[p];
+
+        put(k, nParamBits);
+
+        if (k == nEscape)
+        {
+            put(plan->raw_bits[p], 5);
+
+            for (; i < nEnd; i++)
+            {
+                put_signed(residual[i], plan->raw_bits[p]);
+            }
+        }
+        else
+        {
+            for (; i < nEnd; i++)
+            {
+                put_rice(zigzag(residual[i]), k);
+            }
+        }
+    }
+}
+
+void flac_frame_encoder_t::write_subframe(const int32_t* samples, int count, int bits, const flac_subframe_plan_t* plan)
+{
+    switch (plan->type)
+    {
+        case FLAC_SUBFRAME_CONSTANT:
+            put(0x00, 8);
+            put_signed(samples[0], bits);
+            break;
+        case FLAC_SUBFRAME_VERBATIM:
+            put(0x02, 8);
+
+            for (int i = 0; i < count; i++)
+            {
+                put_signed(samples[i], bits);
+            }
+            break;
+        case FLAC_SUBFRAME_FIXED:
+        case FLAC_SUBFRAME_LPC:
+            put(plan->type == FLAC_SUBFRAME_FIXED ? (0x08 | plan->order) << 1 : (0x20 | (plan->order - 1)) << 1, 8);
+
+            for (int i = 0; i < plan->order; i++)
+            {
+                put_signed(samples[i], bits);
+            }
+
+            if (plan->type == FLAC_SUBFRAME_LPC)
+            {
+                put(FLAC_QLP_PRECISION - 1, 4);
+                put_signed(plan->shift, 5);
+
+                for (int j = 0; j < plan->order; j++)
+                {
+                    put_signed(plan->qlp[j], FLAC_QLP_PRECISION);
+                }
+            }
+
+            predict(samples, count, plan, m_residual.data());
+            write_residual(m_residual.data(), count, plan->order, &plan->residual);
+            break;
+    }
+}
+
+void flac_frame_encoder_t::encode(int32_t* const* samples, int count, uint32_t frame_nr, vector<uint8_t>& out)
+{
+    const int32_t* arrSource[8];
+    int arrBits[8];
+    flac_subframe_plan_t arrPlan[8];
+    int nAssignment = m_channels - 1;
+
+    for (int ch = 0; ch < m_channels; ch++)
+    {
+        arrSource[ch] = samples[ch];
+        arrBits[ch] = m_bits;
+
+        if (m_channels != 2)
+        {
+            plan_subframe(samples[ch], count, m_bits, &arrPlan[ch]);
+        }
+    }
+
+    // Stereo: left/side, side/right or mid/side instead of left/right when that is smaller
+    if (m_channels == 2)
+    {
+        flac_subframe_plan_t cMidPlan;
+        flac_subframe_plan_t cSidePlan;
+        flac_subframe_plan_t& cLeftPlan = arrPlan[0];
+        flac_subframe_plan_t cRightPlan;
+
+        for (int i = 0; i < count; i++)
+        {
+            m_side[i] = samples[0][i] - samples[1][i];
+            m_mid[i] = (samples[0][i] + samples[1][i]) >> 1;
+        }
+
+        uint64_t nLeft = plan_subframe(samples[0], count, m_bits, &cLeftPlan);
+        uint64_t nRight = plan_subframe(samples[1], count, m_bits, &cRightPlan);
+        uint64_t nSide = plan_subframe(m_side.data(), count, m_bits + 1, &cSidePlan);
+        uint64_t nMid = plan_subframe(m_mid.data(), count, m_bits, &cMidPlan);
+        uint64_t nBest = nLeft + nRight;
+
+        arrPlan[1] = cRightPlan;
+
+        if (nLeft + nSide < nBest)
+        {
+            nBest = nLeft + nSide;
+            nAssignment = 8;
+            arrSource[1] = m_side.data();
+            arrBits[1] = m_bits + 1;
+            arrPlan[1] = cSidePlan;
+        }
+
+        if (nSide + nRight < nBest)
+        {
+            nBest = nSide + nRight;
+            nAssignment = 9;
+            arrSource[0] = m_side.data();
+            arrBits[0] = m_bits + 1;
+            arrPlan[0] = cSidePlan;
+            arrSource[1] = samples[1];
+            arrBits[1] = m_bits;
+            arrPlan[1] = cRightPlan;
+        }
+
+        if (nMid + nSide < nBest)
+        {
+            nBest = nMid + nSide;
+            nAssignment = 10;
+            arrSource[0] = m_mid.data();
+            arrBits[0] = m_bits;
+            arrPlan[0] = cMidPlan;
+            arrSource[1] = m_side.data();
+            arrBits[1] = m_bits + 1;
+            arrPlan[1] = cSidePlan;
+        }
+    }
+
+    int nRateCode = 0;
+
+    switch (m_samplerate)
+    {
+        case 88200:
+            nRateCode = 1;
+            break;
+        case 176400:
+            nRateCode = 2;
+            break;
+        case 192000:
+            nRateCode = 3;
+            break;
+        case 96000:
+            nRateCode = 10;
+            break;
+    }
+
+    out.clear();
+    m_out = &out;
+    m_acc = 0;
+    m_acc_bits = 0;
+
+    put(0xfff8, 16);
+    put(count == FLAC_BLOCK_SIZE ? 12 : 7, 4);
+    put(nRateCode, 4);
+    put(nAssignment, 4);
+    put(m_bits == 16 ? 4 : 6, 3);
+    put(0, 1);
+    put_utf8(frame_nr);
+
+    if (count != FLAC_BLOCK_SIZE)
+    {
+        put(count - 1, 16);
+    }
+
+    put(flac_crc8(out.data(), out.size()), 8);
+
+    for (int ch = 0; ch < m_channels; ch++)
+    {
+        write_subframe(arrSource[ch], count, arrBits[ch], &arrPlan[ch]);
+    }
+
+    align();
+    put(flac_crc16(out.data(), out.size()), 16);
+}
+
+static void* flac_encoder_thread(void* threadarg)
+{
+    flac_frame_slot_t* frame_slot = (flac_frame_slot_t*)threadarg;
+    int32_t* arrChannels[8];
+
+    while (1)
+    {
+        pthread_mutex_lock(&frame_slot->hMutex);
+
+        while (frame_slot->state != FLAC_SLOT_LOADED && frame_slot->state != FLAC_SLOT_TERMINATING)
+        {
+            pthread_cond_wait(&frame_slot->hEventPut, &frame_slot->hMutex);
+        }
+
+        if (frame_slot->state == FLAC_SLOT_TERMINATING)
+        {
+            pthread_mutex_unlock(&frame_slot->hMutex);
+            return 0;
+        }
+
+        frame_slot->state = FLAC_SLOT_RUNNING;
+        pthread_mutex_unlock(&frame_slot->hMutex);
+
+        int nChannels = (int)frame_slot->samples.size() / FLAC_BLOCK_SIZE;
+
+        for (int ch = 0; ch < nChannels; ch++)
+        {
+            arrChannels[ch] = frame_slot->samples.data() + ch * FLAC_BLOCK_SIZE;
+        }
+
+        frame_slot->E.encode(arrChannels, frame_slot->sample_count, frame_slot->frame_nr, frame_slot->frame);
+
+        pthread_mutex_lock(&frame_slot->hMutex);
+        frame_slot->state = FLAC_SLOT_READY;
+        pthread_cond_signal(&frame_slot->hEventGet);
+        pthread_mutex_unlock(&frame_slot->hMutex);
+    }
+
+    return 0;
+}
+
+flac_writer_t::flac_writer_t(pcm_format_t format, bool async, int threads) : pcm_writer_t(format, CONTAINER_FLAC, async)
+{
+    m_thread_count = threads > 0 ? threads : 1;
+    m_slots = new flac_frame_slot_t[m_thread_count];
+    m_slot_nr = 0;
+    m_frame_nr = 0;
+    m_sample_count = 0;
+    m_min_frame_size = 0;
+    m_max_frame_size = 0;
+}
+
+flac_writer_t::~flac_writer_t()
+{
+    close();
+    delete[] m_slots;
+}
+
+string flac_writer_t::get_extension()
+{
+    return ".flac";
+}
+
+int flac_writer_t::get_bits()
+{
+    return get_sample_size() * 8;
+}
+
+bool flac_writer_t::attach(int fd, bool owns_fd, int channels, int samplerate, unsigned int channel_map, uint64_t expected_samples)
+{
+    if ((m_format != PCM_S16 && m_format != PCM_S24) || channels < 1 || channels > 8)
+    {
+        if (owns_fd)
+        {
+            ::close(fd);
+        }
+
+        return false;
+    }
+
+    m_slot_nr = 0;
+    m_frame_nr = 0;
+    m_sample_count = 0;
+    m_min_frame_size = 0;
+    m_max_frame_size = 0;
+    md5_init(&m_md5);
+
+    if (!pcm_writer_t::attach(fd, owns_fd, channels, samplerate, channel_map, expected_samples))
+    {
+        return false;
+    }
+
+    for (int i = 0; i < m_thread_count; i++)
+    {
+        flac_frame_slot_t* frame_slot = &m_slots[i];
+
+        frame_slot->state = FLAC_SLOT_EMPTY;
+        frame_slot->sample_count = 0;
+        frame_slot->samples.resize(channels * FLAC_BLOCK_SIZE);
+        frame_slot->E.init(channels, get_bits(), samplerate);
+        pthread_mutex_init(&frame_slot->hMutex, NULL);
+        pthread_cond_init(&frame_slot->hEventGet, NULL);
+        pthread_cond_init(&frame_slot->hEventPut, NULL);
+        pthread_create(&frame_slot->hThread, NULL, flac_encoder_thread, frame_slot);
+    }
+
+    return true;
+}
+
+// "fLaC", STREAMINFO and a VORBIS_COMMENT with the vendor and, for unusual layouts, the channel mask.
+// The final pass only patches STREAMINFO now that the sample count, frame sizes and MD5 are known.
+void flac_writer_t::write_header(bool final)
+{
+    uint8_t arrInfo[FLAC_STREAMINFO_SIZE];
+    uint64_t nPacked = ((uint64_t)m_samplerate << 44) | ((uint64_t)(m_channels - 1) << 41) | ((uint64_t)(get_bits() - 1) << 36) | (m_sample_count & 0xfffffffffULL);
+
+    memset(arrInfo, 0, sizeof(arrInfo));
+    arrInfo[0] = FLAC_BLOCK_SIZE >> 8;
+    arrInfo[1] = FLAC_BLOCK_SIZE & 0xff;
+    arrInfo[2] = FLAC_BLOCK_SIZE >> 8;
+    arrInfo[3] = FLAC_BLOCK_SIZE & 0xff;
+
+    for (int i = 0; i < 3; i++)
+    {
+        arrInfo[4 + i] = (uint8_t)(m_min_frame_size >> (16 - 8 * i));
+        arrInfo[7 + i] = (uint8_t)(m_max_frame_size >> (16 - 8 * i));
+    }
+
+    for (int i = 0; i < 8; i++)
+    {
+        arrInfo[10 + i] = (uint8_t)(nPacked >> (56 - 8 * i));
+    }
+
+    if (final)
+    {
+        md5_final(&m_md5, arrInfo + 18);
+        if (pwrite(m_fd, arrInfo, FLAC_STREAMINFO_SIZE, m_start_offset + 8) != FLAC_STREAMINFO_SIZE)
+        {
+            m_error = true;
+        }
+
+        return;
+    }
+
+    const unsigned int arrDefaultMap[9] = {0, 0x4, 0x3, 0x7, 0x33, 0x37, 0x3f, 0x70f, 0x63f};
+    string strVendor = string("sacd ") + APPVERSION;
+    vector<string> arrComments;
+    vector<uint8_t> arrHeader;
+
+    if (m_channel_map && m_channel_map != arrDefaultMap[m_channels])
+    {
+        char strMask[64];
+        snprintf(strMask, sizeof(strMask), "WAVEFORMATEXTENSIBLE_CHANNEL_MASK=0x%04X", m_channel_map);
+        arrComments.push_back(strMask);
+    }
+
+    size_t nCommentSize = 4 + strVendor.size() + 4;
+
+    for (size_t i = 0; i < arrComments.size(); i++)
+    {
+        nCommentSize += 4 + arrComments[i].size();
+    }
+
+    auto put_le32 = [&arrHeader](uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            arrHeader.push_back((uint8_t)(value >> (8 * i)));
+        }
+    };
+
+    arrHeader.insert(arrHeader.end(), {'f', 'L', 'a', 'C', 0x00, 0x00, 0x00, FLAC_STREAMINFO_SIZE});
+    arrHeader.insert(arrHeader.end(), arrInfo, arrInfo + FLAC_STREAMINFO_SIZE);
+    arrHeader.insert(arrHeader.end(), {0x84, (uint8_t)(nCommentSize >> 16), (uint8_t)(nCommentSize >> 8), (uint8_t)nCommentSize});
+    put_le32(strVendor.size());
+    arrHeader.insert(arrHeader.end(), strVendor.begin(), strVendor.end());
+    put_le32(arrComments.size());
+
+    for (size_t i = 0; i < arrComments.size(); i++)
+    {
+        put_le32(arrComments[i].size());
+        arrHeader.insert(arrHeader.end(), arrComments[i].begin(), arrComments[i].end());
+    }
+
+    append(arrHeader.data(), arrHeader.size());
+}
+
+bool flac_writer_t::write(const float* pcm_data, int samples)
+{
+    int nBytes = get_sample_size();
+    uint8_t* pMd5;
+
+    m_md5_buffer.resize((size_t)samples * m_channels * nBytes);
+    pMd5 = m_md5_buffer.data();
+
+    while (samples > 0)
+    {
+        flac_frame_slot_t* frame_slot = &m_slots[m_slot_nr];
+        int nCount = MIN(samples, FLAC_BLOCK_SIZE - frame_slot->sample_count);
+        int32_t* pOut = frame_slot->samples.data() + frame_slot->sample_count;
+
+        for (int i = 0; i < nCount; i++)
+        {
+            for (int ch = 0; ch < m_channels; ch++)
+            {
+                int32_t nValue = m_format == PCM_S16 ? PCMSamplePack::to_int16(*pcm_data++) : PCMSamplePack::to_int24(*pcm_data++);
+                pOut[ch * FLAC_BLOCK_SIZE + i] = nValue;
+
+                for (int b = 0; b < nBytes; b++)
+                {
+                    *pMd5++ = (uint8_t)(nValue >> (8 * b));
+                }
+            }
+        }
+
+        frame_slot->sample_count += nCount;
+        samples -= nCount;
+
+        if (frame_slot->sample_count == FLAC_BLOCK_SIZE)
+        {
+            dispatch();
+        }
+    }
+
+    md5_update(&m_md5, m_md5_buffer.data(), m_md5_buffer.size());
+    m_data_size += m_md5_buffer.size();
+    flush_stream();
+
+    return !m_error;
+}
+
+// Hands the filled slot to its encoder thread and frees the next one, which holds the oldest frame in flight
+void flac_writer_t::dispatch()
+{
+    flac_frame_slot_t* frame_slot = &m_slots[m_slot_nr];
+
+    frame_slot->frame_nr = m_frame_nr++;
+
+    pthread_mutex_lock(&frame_slot->hMutex);
+    frame_slot->state = FLAC_SLOT_LOADED;
+    pthread_cond_signal(&frame_slot->hEventPut);
+    pthread_mutex_unlock(&frame_slot->hMutex);
+
+    m_slot_nr = (m_slot_nr + 1) % m_thread_count;
+    flush_slot(&m_slots[m_slot_nr]);
+}
+
+void flac_writer_t::flush_slot(flac_frame_slot_t* frame_slot)
+{
+    if (frame_slot->state == FLAC_SLOT_EMPTY)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&frame_slot->hMutex);
+
+    while (frame_slot->state != FLAC_SLOT_READY)
+    {
+        pthread_cond_wait(&frame_slot->hEventGet, &frame_slot->hMutex);
+    }
+
+    pthread_mutex_unlock(&frame_slot->hMutex);
+
+    uint32_t nSize = (uint32_t)frame_slot->frame.size();
+
+    append(frame_slot->frame.data(), nSize);
+    m_min_frame_size = m_min_frame_size == 0 || nSize < m_min_frame_size ? nSize : m_min_frame_size;
+    m_max_frame_size = nSize > m_max_frame_size ? nSize : m_max_frame_size;
+    m_sample_count += frame_slot->sample_count;
+
+    frame_slot->state = FLAC_SLOT_EMPTY;
+    frame_slot->sample_count = 0;
+}
+
+bool flac_writer_t::close()
+{
+    if (m_fd < 0)
+    {
+        return true;
+    }
+
+    if (m_slots[m_slot_nr].sample_count > 0)
+    {
+        dispatch();
+    }
+
+    // m_slot_nr is now the oldest slot, drain them all in frame order
+    for (int i = 0; i < m_thread_count; i++)
+    {
+        flush_slot(&m_slots[(m_slot_nr + i) % m_thread_count]);
+    }
+
+    for (int i = 0; i < m_thread_count; i++)
+    {
+        flac_frame_slot_t* frame_slot = &m_slots[i];
+
+        pthread_mutex_lock(&frame_slot->hMutex);
+        frame_slot->state = FLAC_SLOT_TERMINATING;
+        pthread_cond_signal(&frame_slot->hEventPut);
+        pthread_mutex_unlock(&frame_slot->hMutex);
+
+        pthread_join(frame_slot->hThread, NULL);
+        pthread_cond_destroy(&frame_slot->hEventGet);
+        pthread_cond_destroy(&frame_slot->hEventPut);
+        pthread_mutex_destroy(&frame_slot->hMutex);
+    }
+
+    return pcm_writer_t::close();
+}
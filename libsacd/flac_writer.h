@@ -0,0 +1,145 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#ifndef _FLAC_WRITER_H_INCLUDED
+#define _FLAC_WRITER_H_INCLUDED
+
+#include <stdint.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include "pcm_writer.h"
+
+using namespace std;
+
+constexpr int FLAC_BLOCK_SIZE = 4096;
+constexpr int FLAC_MAX_LPC_ORDER = 8;
+constexpr int FLAC_MAX_FIXED_ORDER = 4;
+constexpr int FLAC_MAX_PARTITION_ORDER = 8;
+constexpr int FLAC_QLP_PRECISION = 15;
+constexpr int FLAC_STREAMINFO_SIZE = 34;
+
+enum flac_subframe_type_t {FLAC_SUBFRAME_CONSTANT, FLAC_SUBFRAME_VERBATIM, FLAC_SUBFRAME_FIXED, FLAC_SUBFRAME_LPC};
+
+struct flac_residual_plan_t
+{
+    int rice2;
+    int partition_order;
+    uint8_t params[1 << FLAC_MAX_PARTITION_ORDER];
+    uint8_t raw_bits[1 << FLAC_MAX_PARTITION_ORDER];
+};
+
+struct flac_subframe_plan_t
+{
+    flac_subframe_type_t type;
+    int order;
+    int shift;
+    int32_t qlp[FLAC_MAX_LPC_ORDER];
+    flac_residual_plan_t residual;
+};
+
+// Encodes one block of integer samples into a complete FLAC frame: constant, verbatim, fixed or LPC subframes,
+// partitioned Rice residual and, for stereo, the cheapest of the four channel decorrelation modes
+class flac_frame_encoder_t
+{
+    int m_channels;
+    int m_bits;
+    int m_samplerate;
+    vector<int32_t> m_mid;
+    vector<int32_t> m_side;
+    vector<int32_t> m_residual;
+    vector<double> m_window;
+    vector<double> m_windowed;
+    vector<uint8_t>* m_out;
+    uint64_t m_acc;
+    int m_acc_bits;
+    void put(uint32_t value, int bits);
+    void put_signed(int32_t value, int bits);
+    void put_rice(uint32_t value, int k);
+    void put_utf8(uint32_t value);
+    void align();
+    uint64_t plan_subframe(const int32_t* samples, int count, int bits, flac_subframe_plan_t* plan);
+    uint64_t plan_residual(const int32_t* residual, int count, int order, flac_residual_plan_t* plan);
+    bool predict(const int32_t* samples, int count, const flac_subframe_plan_t* plan, int32_t* residual);
+    void write_subframe(const int32_t* samples, int count, int bits, const flac_subframe_plan_t* plan);
+    void write_residual(const int32_t* residual, int count, int order, const flac_residual_plan_t* plan);
+public:
+    flac_frame_encoder_t();
+    void init(int channels, int bits, int samplerate);
+    void encode(int32_t* const* samples, int count, uint32_t frame_nr, vector<uint8_t>& out);
+};
+
+enum flac_slot_state_t {FLAC_SLOT_EMPTY, FLAC_SLOT_LOADED, FLAC_SLOT_RUNNING, FLAC_SLOT_READY, FLAC_SLOT_TERMINATING};
+
+class flac_frame_slot_t
+{
+public:
+    volatile int state;
+    uint32_t frame_nr;
+    int sample_count;
+    vector<int32_t> samples;
+    vector<uint8_t> frame;
+    pthread_t hThread;
+    pthread_cond_t hEventGet;
+    pthread_cond_t hEventPut;
+    pthread_mutex_t hMutex;
+    flac_frame_encoder_t E;
+
+    flac_frame_slot_t()
+    {
+        state = FLAC_SLOT_EMPTY;
+        frame_nr = 0;
+        sample_count = 0;
+    }
+};
+
+struct flac_md5_t
+{
+    uint32_t state[4];
+    uint64_t length;
+    uint8_t buffer[64];
+};
+
+// FLAC output stage. Blocks of FLAC_BLOCK_SIZE samples are collected on the decoding thread and handed round robin to
+// a ring of encoder threads, finished frames are appended to the output in order. Only s16 and s24 can be stored.
+class flac_writer_t : public pcm_writer_t
+{
+    int m_thread_count;
+    flac_frame_slot_t* m_slots;
+    int m_slot_nr;
+    uint32_t m_frame_nr;
+    uint64_t m_sample_count;
+    uint32_t m_min_frame_size;
+    uint32_t m_max_frame_size;
+    flac_md5_t m_md5;
+    vector<uint8_t> m_md5_buffer;
+    int get_bits();
+    bool attach(int fd, bool owns_fd, int channels, int samplerate, unsigned int channel_map, uint64_t expected_samples);
+    void write_header(bool final);
+    void dispatch();
+    void flush_slot(flac_frame_slot_t* slot);
+public:
+    flac_writer_t(pcm_format_t format, bool async = false, int threads = 1);
+    ~flac_writer_t();
+    bool write(const float* pcm_data, int samples);
+    bool close();
+    string get_extension();
+};
+
+#endif
@@ -0,0 +1,488 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "pcm_sample_pack.h"
+#include "pcm_writer.h"
+#include "flac_writer.h"
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+
+constexpr uint64_t WAV_DS64_SIZE = 28;
+constexpr uint64_t WAV_HEADER_SIZE = 12 + 8 + WAV_DS64_SIZE + 8 + 40 + 8;
+
+static void put_le(uint8_t* buf, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        buf[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+pcm_writer_t* pcm_writer_t::create(pcm_format_t format, pcm_container_t container, bool async, int threads)
+{
+    if (container == CONTAINER_FLAC)
+    {
+        return new flac_writer_t(format, async, threads);
+    }
+
+    return new pcm_writer_t(format, container, async);
+}
+
+pcm_writer_t::pcm_writer_t(pcm_format_t format, pcm_container_t container, bool async)
+{
+    m_fd = -1;
+    m_format = format;
+    m_container = container;
+    m_channels = 0;
+    m_samplerate = 0;
+    m_channel_map = 0;
+    m_data_size = 0;
+    m_async = async;
+    m_blocks[0] = nullptr;
+    m_blocks[1] = nullptr;
+    m_block_nr = 0;
+    m_block_fill = 0;
+    m_pending_size = 0;
+    m_terminate = false;
+    m_error = false;
+    m_preallocated = false;
+    m_owns_fd = false;
+    m_seekable = false;
+    m_start_offset = 0;
+}
+
+pcm_writer_t::~pcm_writer_t()
+{
+    close();
+}
+
+int pcm_writer_t::get_sample_size()
+{
+    switch (m_format)
+    {
+        case PCM_S16:
+            return 2;
+        case PCM_S24:
+            return 3;
+        case PCM_F64:
+            return 8;
+        default:
+            return 4;
+    }
+}
+
+string pcm_writer_t::get_extension()
+{
+    return m_container == CONTAINER_RAW ? ".raw" : ".wav";
+}
+
+bool pcm_writer_t::open(const string& path, int channels, int samplerate, unsigned int channel_map, uint64_t expected_samples)
+{
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    return attach(fd, true, channels, samplerate, channel_map, expected_samples);
+}
+
+// Writes to an already open descriptor (stdout, a pipe or socket from the caller), which is left open on close()
+bool pcm_writer_t::open_fd(int fd, int channels, int samplerate, unsigned int channel_map)
+{
+    return attach(fd, false, channels, samplerate, channel_map, 0);
+}
+
+bool pcm_writer_t::attach(int fd, bool owns_fd, int channels, int samplerate, unsigned int channel_map, uint64_t expected_samples)
+{
+    struct stat tStat;
+
+    m_channels = channels;
+    m_samplerate = samplerate;
+    m_channel_map = channel_map;
+    m_data_size = 0;
+    m_block_nr = 0;
+    m_block_fill = 0;
+    m_pending_size = 0;
+    m_terminate = false;
+    m_error = false;
+    m_preallocated = false;
+    m_fd = fd;
+    m_owns_fd = owns_fd;
+    m_start_offset = lseek(fd, 0, SEEK_CUR);
+    m_seekable = fstat(fd, &tStat) == 0 && S_ISREG(tStat.st_mode) && m_start_offset >= 0;
+
+    if (posix_memalign((void**)&m_blocks[0], PCM_WRITER_BLOCK_ALIGN, PCM_WRITER_BLOCK_SIZE) != 0 || posix_memalign((void**)&m_blocks[1], PCM_WRITER_BLOCK_ALIGN, PCM_WRITER_BLOCK_SIZE) != 0)
+    {
+        free(m_blocks[0]);
+        free(m_blocks[1]);
+        m_blocks[0] = nullptr;
+        m_blocks[1] = nullptr;
+        m_fd = -1;
+
+        if (owns_fd)
+        {
+            ::close(fd);
+        }
+
+        return false;
+    }
+
+    // Reserve the blocks for the whole track up front so the file does not fragment, close() trims it to what was written
+    if (expected_samples > 0 && m_seekable)
+    {
+        m_preallocated = fallocate(m_fd, 0, m_start_offset, WAV_HEADER_SIZE + expected_samples * channels * get_sample_size()) == 0;
+    }
+
+    if (m_async)
+    {
+        pthread_mutex_init(&m_mutex, NULL);
+        pthread_cond_init(&m_cond, NULL);
+        pthread_create(&m_thread, NULL, flush_thread, this);
+    }
+
+    if (m_container != CONTAINER_RAW)
+    {
+        write_header(false);
+    }
+
+    return true;
+}
+
+// WAVE_FORMAT_EXTENSIBLE header with a JUNK chunk reserving room for ds64, the sizes are placeholders until close() rewrites it.
+// Files that end up over 4 GB turn into RF64: the JUNK chunk becomes ds64 and the 32-bit sizes are set to 0xFFFFFFFF.
+// Pipes cannot be rewritten, they get 0xFFFFFFFF (unknown length) right away.
+void pcm_writer_t::write_header(bool final)
+{
+    const uint8_t arrSubtypePcm[16] = {0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+    const uint8_t arrSubtypeFloat[16] = {0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
+    bool bFloat = m_format == PCM_F32 || m_format == PCM_F64;
+    int nSampleSize = get_sample_size();
+    uint64_t nRiffSize = m_seekable ? 0x7fffffff - 8 : 0xffffffff;
+    uint64_t nDataSize = m_seekable ? 0x7fffffff - WAV_HEADER_SIZE : 0xffffffff;
+    bool bRF64 = false;
+    uint8_t arrHeader[WAV_HEADER_SIZE];
+
+    if (final)
+    {
+        nRiffSize = WAV_HEADER_SIZE - 8 + m_data_size + (m_data_size & 1);
+        nDataSize = m_data_size;
+        bRF64 = nRiffSize > 0xffffffffULL;
+    }
+
+    memset(arrHeader, 0, WAV_HEADER_SIZE);
+    memcpy(arrHeader, bRF64 ? "RF64" : "RIFF", 4);
+    put_le(arrHeader + 4, bRF64 ? 0xffffffffULL : nRiffSize, 4);
+    memcpy(arrHeader + 8, "WAVE", 4);
+    memcpy(arrHeader + 12, bRF64 ? "ds64" : "JUNK", 4);
+    put_le(arrHeader + 16, WAV_DS64_SIZE, 4);
+
+    if (bRF64)
+    {
+        put_le(arrHeader + 20, nRiffSize, 8);
+        put_le(arrHeader + 28, nDataSize, 8);
+        put_le(arrHeader + 36, m_data_size / (nSampleSize * m_channels), 8);
+        put_le(arrHeader + 44, 0, 4);
+    }
+
+    uint8_t* pFmt = arrHeader + 20 + WAV_DS64_SIZE;
+    memcpy(pFmt, "fmt ", 4);
+    put_le(pFmt + 4, 40, 4);
+    put_le(pFmt + 8, 0xFFFE, 2);
+    put_le(pFmt + 10, m_channels, 2);
+    put_le(pFmt + 12, m_samplerate, 4);
+    put_le(pFmt + 16, m_samplerate * nSampleSize * m_channels, 4);
+    put_le(pFmt + 20, m_channels * nSampleSize, 2);
+    put_le(pFmt + 22, nSampleSize * 8, 2);
+    put_le(pFmt + 24, 22, 2);
+    put_le(pFmt + 26, nSampleSize * 8, 2);
+    put_le(pFmt + 28, m_channel_map, 4);
+    memcpy(pFmt + 32, bFloat ? arrSubtypeFloat : arrSubtypePcm, 16);
+    memcpy(pFmt + 48, "data", 4);
+    put_le(pFmt + 52, bRF64 ? 0xffffffffULL : nDataSize, 4);
+
+    if (final)
+    {
+        if (pwrite(m_fd, arrHeader, WAV_HEADER_SIZE, m_start_offset) != (ssize_t)WAV_HEADER_SIZE)
+        {
+            m_error = true;
+        }
+    }
+    else
+    {
+        append(arrHeader, WAV_HEADER_SIZE);
+    }
+}
+
+bool pcm_writer_t::write(const float* pcm_data, int samples)
+{
+    size_t nCount = (size_t)samples * m_channels;
+    size_t nBytes = nCount * get_sample_size();
+    uint8_t* pOut = reserve(nBytes);
+
+    if (!pOut)
+    {
+        return false;
+    }
+
+    switch (m_format)
+    {
+        case PCM_S16:
+            PCMSamplePack::pack16(pcm_data, nCount, (int16_t*)pOut);
+            break;
+        case PCM_S24:
+            PCMSamplePack::pack24(pcm_data, nCount, pOut);
+            break;
+        case PCM_S32:
+            PCMSamplePack::pack32(pcm_data, nCount, (int32_t*)pOut);
+            break;
+        case PCM_F32:
+            memcpy(pOut, pcm_data, nBytes);
+            break;
+        case PCM_F64:
+            PCMSamplePack::widen64(pcm_data, nCount, (double*)pOut);
+            break;
+    }
+
+    commit(nBytes);
+    m_data_size += nBytes;
+    flush_stream();
+
+    return !m_error;
+}
+
+// Pipes get every write passed on right away so a consumer can start within one frame. With both blocks in flight
+// submit() waits for the consumer, which throttles decoding to the pace it reads at.
+void pcm_writer_t::flush_stream()
+{
+    if (!m_seekable)
+    {
+        submit();
+    }
+}
+
+bool pcm_writer_t::failed()
+{
+    return m_error;
+}
+
+// Room for 'size' bytes at the end of the current block, handing the block off first if it does not fit
+uint8_t* pcm_writer_t::reserve(size_t size)
+{
+    if (size > PCM_WRITER_BLOCK_SIZE)
+    {
+        return nullptr;
+    }
+
+    if (m_block_fill + size > PCM_WRITER_BLOCK_SIZE)
+    {
+        submit();
+    }
+
+    return m_blocks[m_block_nr] + m_block_fill;
+}
+
+void pcm_writer_t::commit(size_t size)
+{
+    m_block_fill += size;
+}
+
+bool pcm_writer_t::append(const void* data, size_t size)
+{
+    const uint8_t* pData = (const uint8_t*)data;
+
+    while (size > 0)
+    {
+        size_t nChunk = MIN(size, PCM_WRITER_BLOCK_SIZE);
+        uint8_t* pOut = reserve(nChunk);
+        memcpy(pOut, pData, nChunk);
+        commit(nChunk);
+        pData += nChunk;
+        size -= nChunk;
+    }
+
+    return !m_error;
+}
+
+void pcm_writer_t::submit()
+{
+    if (m_block_fill == 0)
+    {
+        return;
+    }
+
+    if (m_async)
+    {
+        // Only one block can be in flight, the other one is ours to fill. The switch happens under the lock
+        // so the flush thread always picks up the block that was just handed over.
+        wait_pending();
+        pthread_mutex_lock(&m_mutex);
+        m_pending_size = m_block_fill;
+        m_block_nr ^= 1;
+        pthread_cond_broadcast(&m_cond);
+        pthread_mutex_unlock(&m_mutex);
+    }
+    else
+    {
+        if (!write_all(m_blocks[m_block_nr], m_block_fill))
+        {
+            m_error = true;
+        }
+
+        m_block_nr ^= 1;
+    }
+
+    m_block_fill = 0;
+}
+
+void pcm_writer_t::wait_pending()
+{
+    pthread_mutex_lock(&m_mutex);
+
+    while (m_pending_size > 0)
+    {
+        pthread_cond_wait(&m_cond, &m_mutex);
+    }
+
+    pthread_mutex_unlock(&m_mutex);
+}
+
+bool pcm_writer_t::write_all(const uint8_t* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t nWritten = ::write(m_fd, data, size);
+
+        if (nWritten < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            return false;
+        }
+
+        data += nWritten;
+        size -= nWritten;
+    }
+
+    return true;
+}
+
+void* pcm_writer_t::flush_thread(void* threadarg)
+{
+    pcm_writer_t* pWriter = (pcm_writer_t*)threadarg;
+
+    pthread_mutex_lock(&pWriter->m_mutex);
+
+    while (1)
+    {
+        while (pWriter->m_pending_size == 0 && !pWriter->m_terminate)
+        {
+            pthread_cond_wait(&pWriter->m_cond, &pWriter->m_mutex);
+        }
+
+        if (pWriter->m_pending_size == 0)
+        {
+            break;
+        }
+
+        // The block that was just submitted is the one the writer is no longer filling
+        const uint8_t* pBlock = pWriter->m_blocks[pWriter->m_block_nr ^ 1];
+        size_t nSize = pWriter->m_pending_size;
+        pthread_mutex_unlock(&pWriter->m_mutex);
+
+        bool bOk = pWriter->write_all(pBlock, nSize);
+
+        pthread_mutex_lock(&pWriter->m_mutex);
+        if (!bOk)
+        {
+            pWriter->m_error = true;
+        }
+
+        pWriter->m_pending_size = 0;
+        pthread_cond_broadcast(&pWriter->m_cond);
+    }
+
+    pthread_mutex_unlock(&pWriter->m_mutex);
+
+    return 0;
+}
+
+bool pcm_writer_t::close()
+{
+    if (m_fd < 0)
+    {
+        return true;
+    }
+
+    if (m_blocks[0] && m_blocks[1])
+    {
+        // odd sized data chunks get a pad byte
+        if (m_container == CONTAINER_WAV && (m_data_size & 1))
+        {
+            append("", 1);
+        }
+
+        submit();
+    }
+
+    if (m_async)
+    {
+        pthread_mutex_lock(&m_mutex);
+        m_terminate = true;
+        pthread_cond_broadcast(&m_cond);
+        pthread_mutex_unlock(&m_mutex);
+        pthread_join(m_thread, NULL);
+        pthread_cond_destroy(&m_cond);
+        pthread_mutex_destroy(&m_mutex);
+    }
+
+    if (m_preallocated)
+    {
+        off_t nEnd = lseek(m_fd, 0, SEEK_CUR);
+        if (nEnd < 0 || ftruncate(m_fd, nEnd) != 0)
+        {
+            m_error = true;
+        }
+    }
+
+    if (m_container != CONTAINER_RAW && m_seekable)
+    {
+        write_header(true);
+    }
+
+    free(m_blocks[0]);
+    free(m_blocks[1]);
+    m_blocks[0] = nullptr;
+    m_blocks[1] = nullptr;
+
+    bool bOk = (!m_owns_fd || ::close(m_fd) == 0) && !m_error;
+    m_fd = -1;
+
+    return bOk;
+}
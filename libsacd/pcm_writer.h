@@ -0,0 +1,89 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#ifndef _PCM_WRITER_H_INCLUDED
+#define _PCM_WRITER_H_INCLUDED
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <string>
+#include <atomic>
+
+using namespace std;
+
+// write() takes floats, so PCM_F64 holds exactly the PCM_F32 samples widened: no more precision or headroom
+enum pcm_format_t {PCM_S16 = 0, PCM_S24 = 1, PCM_S32 = 2, PCM_F32 = 3, PCM_F64 = 4};
+enum pcm_container_t {CONTAINER_WAV = 0, CONTAINER_RAW = 1, CONTAINER_FLAC = 2};
+
+constexpr size_t PCM_WRITER_BLOCK_SIZE = 4 * 1024 * 1024;
+constexpr size_t PCM_WRITER_BLOCK_ALIGN = 4096;
+
+// Writes interleaved float frames from the converters as WAVE_FORMAT_EXTENSIBLE or headerless PCM in the requested sample format.
+// Output is collected in two large aligned blocks, a full block is written either right away or by a background thread (async)
+// while the other one fills up.
+class pcm_writer_t
+{
+protected:
+    int m_fd;
+    pcm_format_t m_format;
+    pcm_container_t m_container;
+    int m_channels;
+    int m_samplerate;
+    unsigned int m_channel_map;
+    uint64_t m_data_size;
+    bool m_async;
+    uint8_t* m_blocks[2];
+    int m_block_nr;
+    size_t m_block_fill;
+    size_t m_pending_size;
+    bool m_terminate;
+    atomic<bool> m_error; // also set by the flush thread
+    bool m_preallocated;
+    bool m_owns_fd;
+    bool m_seekable;
+    off_t m_start_offset;
+    pthread_t m_thread;
+    pthread_mutex_t m_mutex;
+    pthread_cond_t m_cond;
+    virtual bool attach(int fd, bool owns_fd, int channels, int samplerate, unsigned int channel_map, uint64_t expected_samples);
+    virtual void write_header(bool final);
+    void flush_stream();
+    uint8_t* reserve(size_t size);
+    void commit(size_t size);
+    bool append(const void* data, size_t size);
+    void submit();
+    void wait_pending();
+    bool write_all(const uint8_t* data, size_t size);
+    static void* flush_thread(void* threadarg);
+public:
+    static pcm_writer_t* create(pcm_format_t format, pcm_container_t container, bool async = false, int threads = 1);
+    pcm_writer_t(pcm_format_t format, pcm_container_t container, bool async = false);
+    virtual ~pcm_writer_t();
+    bool open(const string& path, int channels, int samplerate, unsigned int channel_map, uint64_t expected_samples = 0);
+    bool open_fd(int fd, int channels, int samplerate, unsigned int channel_map);
+    virtual bool write(const float* pcm_data, int samples);
+    virtual bool close();
+    virtual string get_extension();
+    int get_sample_size();
+    bool failed();
+};
+
+#endif
@@ -23,6 +23,9 @@
 #include <stdlib.h>
 #include "sacd_disc.h"
 
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#define MAX(a,b) (((a)>(b))?(a):(b))
+
 using namespace std;
 
 static inline string stringReplace(string str, const string& from, const string& to)
@@ -113,6 +116,8 @@ sacd_disc_t::sacd_disc_t()
 {
     m_audio_sector.header.dst_encoded = 0;
     m_sector_bad_reads = 0;
+    m_planar = false;
+    m_track_area = AREA_BOTH;
 }
 
 sacd_disc_t::~sacd_disc_t()
@@ -172,7 +177,14 @@ float sacd_disc_t::getProgress()
 
 bool sacd_disc_t::is_dst()
 {
-    return false;
+    return get_area(m_track_area) ? get_area(m_track_area)->area_toc->frame_format == FRAME_FORMAT_DST : false;
+}
+
+bool sacd_disc_t::set_planar(bool planar)
+{
+    m_planar = planar;
+
+    return true;
 }
 
 int sacd_disc_t::open(sacd_media_t* p_file)
@@ -343,13 +355,26 @@ void sacd_disc_t::getTrackDetails(uint32_t track_number, area_id_e area_id, Trac
     cTrackDetails->strArtist = cAreaTrackText.track_type_performer.size() ? cAreaTrackText.track_type_performer : "Unknown Artist";
     cTrackDetails->strTitle = cAreaTrackText.track_type_title;
     cTrackDetails->nChannels = cArea->area_toc->channel_count;
+    cTrackDetails->bDst = cArea->area_toc->frame_format == FRAME_FORMAT_DST;
+    cTrackDetails->fDuration = 0;
+    cTrackDetails->fStart = 0;
+
+    if (cArea->area_tracklist_time)
+    {
+        area_tracklist_time_start_t cStart = cArea->area_tracklist_time->start[track_number];
+        area_tracklist_time_duration_t cDuration = cArea->area_tracklist_time->duration[track_number];
+        cTrackDetails->fStart = cStart.minutes * 60.0 + cStart.seconds + cStart.frames / 75.0;
+        cTrackDetails->fDuration = cDuration.minutes * 60.0 + cDuration.seconds + cDuration.frames / 75.0;
+    }
 }
 
-string sacd_disc_t::set_track(uint32_t track_number, area_id_e area_id, uint32_t offset)
+// track_count > 1 reads that many consecutive tracks as one uninterrupted range
+string sacd_disc_t::set_track(uint32_t track_number, area_id_e area_id, uint32_t offset, uint32_t track_count)
 {
     if (track_number < get_track_count(area_id))
     {
         scarletbook_area_t* area = get_area(area_id);
+        uint32_t last_track = MIN(track_number + MAX(track_count, 1U), get_track_count(area_id)) - 1;
         m_track_area = area_id;
 
         if (track_number > 0)
@@ -361,9 +386,9 @@ string sacd_disc_t::set_track(uint32_t track_number, area_id_e area_id, uint32_t
             m_track_start_lsn = area->area_toc->track_start;
         }
 
-        if (track_number < get_track_count(area_id) - 1)
+        if (last_track < get_track_count(area_id) - 1)
         {
-            m_track_length_lsn = area->area_tracklist_offset->track_start_lsn[track_number + 1] - m_track_start_lsn + 1;
+            m_track_length_lsn = area->area_tracklist_offset->track_start_lsn[last_track + 1] - m_track_start_lsn + 1;
         }
         else
         {
@@ -377,29 +402,41 @@ string sacd_disc_t::set_track(uint32_t track_number, area_id_e area_id, uint32_t
         m_packet_info_idx = 0;
         m_file->seek((uint64_t)m_track_current_lsn * (uint64_t)m_sector_size);
 
-        char * buf;
+        return get_track_name(track_number, area_id);
+    }
 
-        if(area->area_track_text[track_number].track_type_performer.size())
-        {
-            buf = (char*) calloc(6 + 2 + 2 + area->area_track_text[track_number].track_type_performer.size() + 3 + area->area_track_text[track_number].track_type_title.size() + 4 + 1, 1);
-            sprintf(buf, "(%ich) %.2i. %s - %s.wav", m_channel_count, track_number + 1, area->area_track_text[track_number].track_type_performer.data(), area->area_track_text[track_number].track_type_title.data());
-        }
-        else
-        {
-            buf = (char*) calloc(6 + 2 + 2 + area->area_track_text[track_number].track_type_title.size() + 4 + 1, 1);
-            sprintf(buf, "(%ich) %.2i. %s.wav", m_channel_count, track_number + 1, area->area_track_text[track_number].track_type_title.data());
-        }
+    m_track_area = AREA_BOTH;
 
-        string s = buf;
-        s = stringReplace(s, "/", "-");
-        free(buf);
+    return "";
+}
 
-        return stringReplace(s, "\\", "-");
+string sacd_disc_t::get_track_name(uint32_t track_number, area_id_e area_id)
+{
+    if (track_number >= get_track_count(area_id))
+    {
+        return "";
     }
 
-    m_track_area = AREA_BOTH;
+    scarletbook_area_t* area = get_area(area_id);
+    int channel_count = area->area_toc->channel_count;
+    char * buf;
 
-    return "";
+    if(area->area_track_text[track_number].track_type_performer.size())
+    {
+        buf = (char*) calloc(6 + 2 + 2 + area->area_track_text[track_number].track_type_performer.size() + 3 + area->area_track_text[track_number].track_type_title.size() + 4 + 1, 1);
+        sprintf(buf, "(%ich) %.2i. %s - %s.wav", channel_count, track_number + 1, area->area_track_text[track_number].track_type_performer.data(), area->area_track_text[track_number].track_type_title.data());
+    }
+    else
+    {
+        buf = (char*) calloc(6 + 2 + 2 + area->area_track_text[track_number].track_type_title.size() + 4 + 1, 1);
+        sprintf(buf, "(%ich) %.2i. %s.wav", channel_count, track_number + 1, area->area_track_text[track_number].track_type_title.data());
+    }
+
+    string s = buf;
+    s = stringReplace(s, "/", "-");
+    free(buf);
+
+    return stringReplace(s, "\\", "-");
 }
 
 bool sacd_disc_t::read_frame(uint8_t* frame_data, size_t* frame_size, frame_type_e* frame_type)
@@ -472,7 +509,7 @@ bool sacd_disc_t::read_frame(uint8_t* frame_data, size_t* frame_size, frame_type
                         {
                             if (m_frame.size <= (int)(*frame_size))
                             {
-                                memcpy(frame_data, m_frame.data, m_frame.size);
+                                copy_frame(frame_data);
                                 *frame_size = m_frame.size;
                             }
                             else
@@ -527,7 +564,7 @@ bool sacd_disc_t::read_frame(uint8_t* frame_data, size_t* frame_size, frame_type
     {
         if (m_frame.size <= (int)(*frame_size))
         {
-            memcpy(frame_data, m_frame.data, m_frame.size);
+            copy_frame(frame_data);
             *frame_size = m_frame.size;
         }
         else
@@ -548,6 +585,21 @@ bool sacd_disc_t::read_frame(uint8_t* frame_data, size_t* frame_size, frame_type
     return false;
 }
 
+void sacd_disc_t::copy_frame(uint8_t* frame_data)
+{
+    // DST frames are split per channel by the decoder, plain DSD ones are byte interleaved on the disc
+    if (m_planar && !m_frame.dst_encoded && m_channel_count > 0)
+    {
+        size_t samples = m_frame.size / m_channel_count;
+        m_frame.size = samples * m_channel_count;
+        dsd_deinterleave(m_frame.data, m_channel_count, samples, frame_data, samples);
+    }
+    else
+    {
+        memcpy(frame_data, m_frame.data, m_frame.size);
+    }
+}
+
 bool sacd_disc_t::read_blocks_raw(uint32_t lb_start, size_t block_count, uint8_t* data)
 {
     switch (m_sector_size)
@@ -718,6 +770,7 @@ bool sacd_disc_t::read_area_toc(int area_idx)
 
     p = area_data = area->area_data;
     area_toc = area->area_toc = (area_toc_t*)area_data;
+    area->area_tracklist_time = nullptr;
 
     if (strncmp("TWOCHTOC", area_toc->id, 8) != 0 && strncmp("MULCHTOC", area_toc->id, 8) != 0)
         return false;
@@ -25,6 +25,7 @@
 #include "endianess.h"
 #include "scarletbook.h"
 #include "sacd_reader.h"
+#include "dsd_transpose.h"
 
 constexpr int SACD_PSN_SIZE = 2064;
 
@@ -57,6 +58,7 @@ private:
     int m_sector_bad_reads;
     uint8_t* m_buffer;
     int m_buffer_offset;
+    bool m_planar;
 public:
     static bool g_is_sacd(const char* p_path);
     sacd_disc_t();
@@ -68,9 +70,11 @@ public:
     int get_framerate();
     float getProgress();
     bool is_dst();
+    bool set_planar(bool planar);
     int open(sacd_media_t* p_file);
     bool close();
-    string set_track(uint32_t track_number, area_id_e area_id = AREA_BOTH, uint32_t offset = 0);
+    string set_track(uint32_t track_number, area_id_e area_id = AREA_BOTH, uint32_t offset = 0, uint32_t track_count = 1);
+    string get_track_name(uint32_t track_number, area_id_e area_id = AREA_BOTH);
     bool read_frame(uint8_t* frame_data, size_t* frame_size, frame_type_e* frame_type);
     bool read_blocks_raw(uint32_t lb_start, size_t block_count, uint8_t* data);
     void getTrackDetails(uint32_t track_number, area_id_e area_id, TrackDetails* cTrackDetails);
@@ -78,6 +82,7 @@ private:
     bool read_master_toc();
     bool read_area_toc(int area_idx);
     void free_area(scarletbook_area_t* area);
+    void copy_frame(uint8_t* frame_data);
 };
 
 #endif
@@ -27,6 +27,10 @@ sacd_dsdiff_t::sacd_dsdiff_t()
 {
     m_current_subsong = 0;
     m_dst_encoded = 0;
+    m_planar = false;
+    m_window_offset = 0;
+    m_window_size = 0;
+    m_position = 0;
 }
 
 sacd_dsdiff_t::~sacd_dsdiff_t()
@@ -61,7 +65,7 @@ int sacd_dsdiff_t::get_framerate()
 
 float sacd_dsdiff_t::getProgress()
 {
-    return ((float)(m_file->get_position() - m_current_offset) * 100.0) / (float)m_current_size;
+    return ((float)(get_position() - m_current_offset) * 100.0) / (float)m_current_size;
 }
 
 bool sacd_dsdiff_t::is_dst()
@@ -69,9 +73,19 @@ bool sacd_dsdiff_t::is_dst()
     return m_dst_encoded != 0;
 }
 
+bool sacd_dsdiff_t::set_planar(bool planar)
+{
+    m_planar = planar;
+
+    return true;
+}
+
 int sacd_dsdiff_t::open(sacd_media_t* p_file)
 {
     m_file = p_file;
+    m_window_offset = 0;
+    m_window_size = 0;
+    m_position = 0;
     m_dsti_size = 0;
     Chunk ck;
     ID id;
@@ -80,26 +94,26 @@ int sacd_dsdiff_t::open(sacd_media_t* p_file)
     m_subsong.resize(0);
     m_id3tags.resize(0);
 
-    if (!m_file->seek(0))
+    if (!seek(0))
     {
         return 0;
     }
 
-    if (!(m_file->read(&ck, sizeof(ck)) == sizeof(ck) && ck == "FRM8"))
+    if (!(read(&ck, sizeof(ck)) == sizeof(ck) && ck == "FRM8"))
     {
         return 0;
     }
 
-    if (!(m_file->read(&id, sizeof(id)) == sizeof(id) && id == "DSD "))
+    if (!(read(&id, sizeof(id)) == sizeof(id) && id == "DSD "))
     {
         return 0;
     }
 
     m_frm8_size = ck.get_size();
 
-    while ((uint64_t)m_file->get_position() < m_frm8_size + sizeof(ck))
+    while ((uint64_t)get_position() < m_frm8_size + sizeof(ck))
     {
-        if (!(m_file->read(&ck, sizeof(ck)) == sizeof(ck)))
+        if (!(read(&ck, sizeof(ck)) == sizeof(ck)))
         {
             return 0;
         }
@@ -108,7 +122,7 @@ int sacd_dsdiff_t::open(sacd_media_t* p_file)
         {
             uint32_t version;
 
-            if (!(m_file->read(&version, sizeof(version)) == sizeof(version)))
+            if (!(read(&version, sizeof(version)) == sizeof(version)))
             {
                 return 0;
             }
@@ -117,16 +131,16 @@ int sacd_dsdiff_t::open(sacd_media_t* p_file)
         }
         else if (ck == "PROP")
         {
-            if (!(m_file->read(&id, sizeof(id)) == sizeof(id) && id == "SND "))
+            if (!(read(&id, sizeof(id)) == sizeof(id) && id == "SND "))
             {
                 return 0;
             }
 
-            int64_t id_prop_end = m_file->get_position() - sizeof(id) + ck.get_size();
+            uint64_t id_prop_end = get_position() - sizeof(id) + ck.get_size();
 
-            while (m_file->get_position() < id_prop_end)
+            while (get_position() < id_prop_end)
             {
-                if (!(m_file->read(&ck, sizeof(ck)) == sizeof(ck)))
+                if (!(read(&ck, sizeof(ck)) == sizeof(ck)))
                 {
                     return 0;
                 }
@@ -135,7 +149,7 @@ int sacd_dsdiff_t::open(sacd_media_t* p_file)
                 {
                     uint32_t samplerate;
 
-                    if (!(m_file->read(&samplerate, sizeof(samplerate)) == sizeof(samplerate)))
+                    if (!(read(&samplerate, sizeof(samplerate)) == sizeof(samplerate)))
                     {
                         return 0;
                     }
@@ -146,7 +160,7 @@ int sacd_dsdiff_t::open(sacd_media_t* p_file)
                 {
                     uint16_t channel_count;
 
-                    if (!(m_file->read(&channel_count, sizeof(channel_count)) == sizeof(channel_count)))
+                    if (!(read(&channel_count, sizeof(channel_count)) == sizeof(channel_count)))
                     {
                         return false;
                     }
@@ -169,11 +183,11 @@ int sacd_dsdiff_t::open(sacd_media_t* p_file)
                             break;
                     }
 
-                    m_file->skip(ck.get_size() - sizeof(channel_count));
+                    skip(ck.get_size() - sizeof(channel_count));
                 }
                 else if (ck == "CMPR")
                 {
-                    if (!(m_file->read(&id, sizeof(id)) == sizeof(id)))
+                    if (!(read(&id, sizeof(id)) == sizeof(id)))
                     {
                         return 0;
                     }
@@ -188,54 +202,60 @@ int sacd_dsdiff_t::open(sacd_media_t* p_file)
                         m_dst_encoded = 1;
                     }
 
-                    m_file->skip(ck.get_size() - sizeof(id));
+                    skip(ck.get_size() - sizeof(id));
                 }
                 else if (ck == "LSCO")
                 {
                     uint16_t loudspeaker_config;
 
-                    if (!(m_file->read(&loudspeaker_config, sizeof(loudspeaker_config)) == sizeof(loudspeaker_config)))
+                    if (!(read(&loudspeaker_config, sizeof(loudspeaker_config)) == sizeof(loudspeaker_config)))
                     {
                         return 0;
                     }
 
                     m_loudspeaker_config = hton16(loudspeaker_config);
-                    m_file->skip(ck.get_size() - sizeof(loudspeaker_config));
+                    skip(ck.get_size() - sizeof(loudspeaker_config));
                 }
                 else if (ck == "ID3 ")
                 {
                     t_old.index  = 0;
-                    t_old.offset = m_file->get_position();
+                    t_old.offset = get_position();
                     t_old.id3_value.resize((uint32_t)ck.get_size());
-                    m_file->read(t_old.id3_value.data(), t_old.id3_value.size());
+                    read(t_old.id3_value.data(), t_old.id3_value.size());
                 }
                 else
                 {
-                    m_file->skip(ck.get_size());
+                    skip(ck.get_size());
                 }
 
-                m_file->skip(m_file->get_position() & 1);
+                skip(get_position() & 1);
             }
         }
         else if (ck == "DSD ")
         {
-            m_data_offset = m_file->get_position();
+            m_data_offset = get_position();
             m_data_size = ck.get_size();
             m_framerate = 75;
             m_frame_size = m_samplerate / 8 * m_channel_count / m_framerate;
             m_frame_count = (uint32_t)(m_data_size / m_frame_size);
-            m_file->skip(ck.get_size());
+            skip(ck.get_size());
             subsong_t s;
             s.start_time = 0.0;
             s.stop_time  = (double) m_frame_count / m_framerate;
             m_subsong.push_back(s);
+
+            // Markers and tags behind the sound data are out of reach on a pipe
+            if (!m_file->can_seek())
+            {
+                break;
+            }
         }
         else if (ck == "DST ")
         {
-            m_data_offset = m_file->get_position();
+            m_data_offset = get_position();
             m_data_size = ck.get_size();
 
-            if (!(m_file->read(&ck, sizeof(ck)) == sizeof(ck) && ck == "FRTE" && ck.get_size() == 6))
+            if (!(read(&ck, sizeof(ck)) == sizeof(ck) && ck == "FRTE" && ck.get_size() == 6))
             {
                 return 0;
             }
@@ -246,7 +266,7 @@ int sacd_dsdiff_t::open(sacd_media_t* p_file)
             m_current_size = m_data_size;
             uint32_t frame_count;
 
-            if (!(m_file->read(&frame_count, sizeof(frame_count)) == sizeof(frame_count)))
+            if (!(read(&frame_count, sizeof(frame_count)) == sizeof(frame_count)))
             {
                 return 0;
             }
@@ -254,32 +274,37 @@ int sacd_dsdiff_t::open(sacd_media_t* p_file)
             m_frame_count = hton32(frame_count);
             uint16_t framerate;
 
-            if (!(m_file->read(&framerate, sizeof(framerate)) == sizeof(framerate)))
+            if (!(read(&framerate, sizeof(framerate)) == sizeof(framerate)))
             {
                 return 0;
             }
 
             m_framerate = hton16(framerate);
             m_frame_size = m_samplerate / 8 * m_channel_count / m_framerate;
-            m_file->seek(m_data_offset + m_data_size);
+            seek(m_data_offset + m_data_size);
             subsong_t s;
             s.start_time = 0.0;
             s.stop_time = (double)m_frame_count / m_framerate;
             m_subsong.push_back(s);
+
+            if (!m_file->can_seek())
+            {
+                break;
+            }
         }
         else if (ck == "DSTI")
         {
-            m_dsti_offset = m_file->get_position();
+            m_dsti_offset = get_position();
             m_dsti_size = ck.get_size();
-            m_file->skip(ck.get_size());
+            skip(ck.get_size());
         }
         else if (ck == "DIIN")
         {
-            int64_t id_diin_end = m_file->get_position() + ck.get_size();
+            uint64_t id_diin_end = get_position() + ck.get_size();
 
-            while (m_file->get_position() < id_diin_end)
+            while (get_position() < id_diin_end)
             {
-                if (!(m_file->read(&ck, sizeof(ck)) == sizeof(ck)))
+                if (!(read(&ck, sizeof(ck)) == sizeof(ck)))
                 {
                     return false;
                 }
@@ -288,7 +313,7 @@ int sacd_dsdiff_t::open(sacd_media_t* p_file)
                 {
                     Marker m;
 
-                    if (m_file->read(&m, sizeof(Marker)) == sizeof(Marker))
+                    if (read(&m, sizeof(Marker)) == sizeof(Marker))
                     {
                         m.hours = hton16(m.hours);
                         m.samples = hton32(m.samples);
@@ -338,31 +363,31 @@ int sacd_dsdiff_t::open(sacd_media_t* p_file)
                         }
                     }
 
-                    m_file->skip(ck.get_size() - sizeof(Marker));
+                    skip(ck.get_size() - sizeof(Marker));
                 }
                 else
                 {
-                    m_file->skip(ck.get_size());
+                    skip(ck.get_size());
                 }
 
-                m_file->skip(m_file->get_position() & 1);
+                skip(get_position() & 1);
             }
         }
         else if (ck == "ID3 ")
         {
             id3tags_t t;
             t.index = m_id3tags.size();
-            t.offset = m_file->get_position();
+            t.offset = get_position();
             t.id3_value.resize((uint32_t)ck.get_size());
-            m_file->read(t.id3_value.data(), t.id3_value.size());
+            read(t.id3_value.data(), t.id3_value.size());
             m_id3tags.push_back(t);
         }
         else
         {
-            m_file->skip(ck.get_size());
+            skip(ck.get_size());
         }
 
-        m_file->skip(m_file->get_position() & 1);
+        skip(get_position() & 1);
     }
 
     if (m_id3tags.size() == 0)
@@ -373,7 +398,7 @@ int sacd_dsdiff_t::open(sacd_media_t* p_file)
         }
     }
 
-    m_file->seek(m_data_offset);
+    seek(m_data_offset);
 
     return m_subsong.size();
 }
@@ -393,15 +418,19 @@ void sacd_dsdiff_t::getTrackDetails(uint32_t track_number, area_id_e area_id, Tr
     cTrackDetails->strArtist = "Unknown Artist";
     cTrackDetails->strTitle = "Unknown Title";
     cTrackDetails->nChannels = m_channel_count;
+    cTrackDetails->fDuration = track_number < m_subsong.size() ? m_subsong[track_number].stop_time - m_subsong[track_number].start_time : 0;
+    cTrackDetails->fStart = track_number < m_subsong.size() ? m_subsong[track_number].start_time : 0;
+    cTrackDetails->bDst = m_dst_encoded != 0;
 }
 
-string sacd_dsdiff_t::set_track(uint32_t track_number, area_id_e area_id, uint32_t offset)
+// track_count > 1 reads that many consecutive subsongs as one uninterrupted range
+string sacd_dsdiff_t::set_track(uint32_t track_number, area_id_e area_id, uint32_t offset, uint32_t track_count)
 {
     if (track_number < m_subsong.size())
     {
         m_current_subsong = track_number;
         double t0 = m_subsong[m_current_subsong].start_time;
-        double t1 = m_subsong[m_current_subsong].stop_time;
+        double t1 = m_subsong[MIN(track_number + MAX(track_count, 1U), m_subsong.size()) - 1].stop_time;
         uint64_t offset = (uint64_t)(t0 * m_framerate / m_frame_count * m_data_size);
         uint64_t size = (uint64_t)(t1 * m_framerate / m_frame_count * m_data_size) - offset;
 
@@ -440,8 +469,13 @@ string sacd_dsdiff_t::set_track(uint32_t track_number, area_id_e area_id, uint32
         }
     }
 
-    m_file->seek(m_current_offset);
+    seek(m_current_offset);
 
+    return get_track_name(track_number, area_id);
+}
+
+string sacd_dsdiff_t::get_track_name(uint32_t track_number, area_id_e area_id)
+{
     return m_file->getFileName();
 }
 
@@ -451,13 +485,13 @@ bool sacd_dsdiff_t::read_frame(uint8_t* frame_data, size_t* frame_size, frame_ty
     {
         Chunk ck;
 
-        while ((uint64_t)m_file->get_position() < m_current_offset + m_current_size && m_file->read(&ck, sizeof(ck)) == sizeof(ck))
+        while ((uint64_t)get_position() < m_current_offset + m_current_size && read(&ck, sizeof(ck)) == sizeof(ck))
         {
             if (ck == "DSTF" && ck.get_size() <= (uint64_t)*frame_size)
             {
-                if (m_file->read(frame_data, (size_t)ck.get_size()) == ck.get_size())
+                if (read(frame_data, (size_t)ck.get_size()) == ck.get_size())
                 {
-                    m_file->skip(ck.get_size() & 1);
+                    skip(ck.get_size() & 1);
                     *frame_size = (size_t)ck.get_size();
                     *frame_type = FRAME_DST;
 
@@ -472,35 +506,47 @@ bool sacd_dsdiff_t::read_frame(uint8_t* frame_data, size_t* frame_size, frame_ty
 
                 if (ck.get_size() == sizeof(crc))
                 {
-                    if (m_file->read(&crc, sizeof(crc)) != sizeof(crc))
+                    if (read(&crc, sizeof(crc)) != sizeof(crc))
                     {
                         break;
                     }
                 }
                 else
                 {
-                    m_file->skip(ck.get_size());
-                    m_file->skip(ck.get_size() & 1);
+                    skip(ck.get_size());
+                    skip(ck.get_size() & 1);
                 }
             }
             else
             {
-                m_file->seek(1 - (int)sizeof(ck), SEEK_CUR);
+                skip(1 - (int)sizeof(ck));
             }
         }
     }
     else
     {
-        uint64_t position = m_file->get_position();
+        uint64_t position = get_position();
         *frame_size = (size_t)MIN((int64_t)m_frame_size, (int64_t)MAX(0, (int64_t)(m_current_offset + m_current_size) - (int64_t)position));
 
         if (*frame_size > 0)
         {
-            *frame_size = m_file->read(frame_data, *frame_size);
+            *frame_size = fill(*frame_size);
             *frame_size -= *frame_size % m_channel_count;
 
             if (*frame_size > 0)
             {
+                const uint8_t* data = m_window.data() + (m_position - m_window_offset);
+
+                if (m_planar)
+                {
+                    dsd_deinterleave(data, m_channel_count, *frame_size / m_channel_count, frame_data, *frame_size / m_channel_count);
+                }
+                else
+                {
+                    memcpy(frame_data, data, *frame_size);
+                }
+
+                skip(*frame_size);
                 *frame_type = FRAME_DSD;
                 return true;
             }
@@ -520,12 +566,68 @@ uint64_t sacd_dsdiff_t::get_dsti_for_frame(uint32_t frame_nr)
 {
     uint64_t cur_offset;
     DSTFrameIndex frame_index;
-    cur_offset = m_file->get_position();
+    cur_offset = get_position();
     frame_nr = min(frame_nr, (uint32_t)(m_dsti_size / sizeof(DSTFrameIndex) - 1));
-    m_file->seek(m_dsti_offset + frame_nr * sizeof(DSTFrameIndex));
-    cur_offset = m_file->get_position();
-    m_file->read(&frame_index, sizeof(DSTFrameIndex));
-    m_file->seek(cur_offset);
+    seek(m_dsti_offset + frame_nr * sizeof(DSTFrameIndex));
+    cur_offset = get_position();
+    read(&frame_index, sizeof(DSTFrameIndex));
+    seek(cur_offset);
 
     return hton64(frame_index.offset) - sizeof(Chunk);
 }
+
+// Make up to 'size' bytes from the current position available in the window, reading ahead DSDIFF_WINDOW_SIZE bytes at a time
+size_t sacd_dsdiff_t::fill(size_t size)
+{
+    uint64_t window_end = m_window_offset + m_window_size;
+
+    if (m_position >= m_window_offset && m_position + size <= window_end)
+    {
+        return size;
+    }
+
+    size_t keep = 0;
+
+    if (m_position >= m_window_offset && m_position < window_end)
+    {
+        // Keep the unread tail and append to it, the file position is already at the window end
+        keep = (size_t)(window_end - m_position);
+        memmove(m_window.data(), m_window.data() + (m_position - m_window_offset), keep);
+    }
+    else
+    {
+        m_file->seek(m_position);
+    }
+
+    m_window.resize(MAX(m_file->can_seek() ? DSDIFF_WINDOW_SIZE : DSDIFF_STREAM_WINDOW_SIZE, size));
+    m_window_offset = m_position;
+    m_window_size = keep + m_file->read(m_window.data() + keep, m_window.size() - keep);
+
+    return MIN(size, m_window_size);
+}
+
+size_t sacd_dsdiff_t::read(void* data, size_t size)
+{
+    size = fill(size);
+    memcpy(data, m_window.data() + (m_position - m_window_offset), size);
+    m_position += size;
+
+    return size;
+}
+
+bool sacd_dsdiff_t::seek(uint64_t position)
+{
+    m_position = position;
+
+    return true;
+}
+
+void sacd_dsdiff_t::skip(int64_t bytes)
+{
+    m_position += bytes;
+}
+
+uint64_t sacd_dsdiff_t::get_position()
+{
+    return m_position;
+}
@@ -26,8 +26,12 @@
 #include "endianess.h"
 #include "scarletbook.h"
 #include "sacd_reader.h"
+#include "dsd_transpose.h"
 #include "sacd_dsd.h"
 
+constexpr size_t DSDIFF_WINDOW_SIZE = 4 * 1024 * 1024;
+constexpr size_t DSDIFF_STREAM_WINDOW_SIZE = 64 * 1024; // small enough not to hold back the first frames of a pipe
+
 #pragma pack(1)
 
 class FormDSDChunk : public Chunk
@@ -97,6 +101,11 @@ class sacd_dsdiff_t : public sacd_reader_t
     uint32_t m_current_subsong;
     uint64_t m_current_offset;
     uint64_t m_current_size;
+    bool m_planar;
+    vector<uint8_t> m_window;
+    uint64_t m_window_offset;
+    size_t m_window_size;
+    uint64_t m_position;
 public:
     sacd_dsdiff_t();
     virtual ~sacd_dsdiff_t();
@@ -106,14 +115,21 @@ public:
     int get_framerate();
     float getProgress();
     bool is_dst();
+    bool set_planar(bool planar);
     int open(sacd_media_t* p_file);
     bool close();
-    string set_track(uint32_t track_number, area_id_e area_id = AREA_BOTH, uint32_t offset = 0);
+    string set_track(uint32_t track_number, area_id_e area_id = AREA_BOTH, uint32_t offset = 0, uint32_t track_count = 1);
+    string get_track_name(uint32_t track_number, area_id_e area_id = AREA_BOTH);
     bool read_frame(uint8_t* frame_data, size_t* frame_size, frame_type_e* frame_type);
     void getTrackDetails(uint32_t track_number, area_id_e area_id, TrackDetails* cTrackDetails);
 private:
     double get_marker_time(const Marker& m);
     uint64_t get_dsti_for_frame(uint32_t frame_nr);
+    size_t fill(size_t size);
+    size_t read(void* data, size_t size);
+    bool seek(uint64_t position);
+    void skip(int64_t bytes);
+    uint64_t get_position();
 };
 
 #endif
@@ -18,21 +18,14 @@
     along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
 */
 
+#include "dsd_transpose.h"
 #include "sacd_dsf.h"
 
 #define MIN(a,b) (((a)<(b))?(a):(b))
 
 sacd_dsf_t::sacd_dsf_t()
 {
-    for (int i = 0; i < 256; i++)
-    {
-        swap_bits[i] = 0;
-
-        for (int j = 0; j < 8; j++)
-        {
-            swap_bits[i] |= ((i >> j) & 1) << (7 - j);
-        }
-    }
+    m_planar = false;
 }
 
 sacd_dsf_t::~sacd_dsf_t()
@@ -75,6 +68,13 @@ bool sacd_dsf_t::is_dst()
     return false;
 }
 
+bool sacd_dsf_t::set_planar(bool planar)
+{
+    m_planar = planar;
+
+    return true;
+}
+
 int sacd_dsf_t::open(sacd_media_t* p_file)
 {
     m_file = p_file;
@@ -164,8 +164,8 @@ int sacd_dsf_t::open(sacd_media_t* p_file)
 
     m_sample_count = fmt.sample_count;
     m_block_size = fmt.block_size;
-    m_block_offset = m_block_size;
-    m_block_data_end = 0;
+    m_block_offset = 0;
+    m_block_samples = 0;
     m_file->seek(pos + hton64(fmt.get_size()));
 
     if (!(m_file->read(&ck, sizeof(ck)) == sizeof(ck) && ck == "data"))
@@ -175,8 +175,8 @@ int sacd_dsf_t::open(sacd_media_t* p_file)
 
     m_block_data.resize(m_channel_count * m_block_size);
     m_data_offset = m_file->get_position();
-    m_data_end_offset = m_data_offset + ((m_sample_count / 8) * m_channel_count);
     m_data_size = hton64(ck.get_size()) - sizeof(ck);
+    m_data_end_offset = m_data_offset + m_data_size;
     m_read_offset = m_data_offset;
 
     return 1;
@@ -192,9 +192,12 @@ void sacd_dsf_t::getTrackDetails(uint32_t track_number, area_id_e area_id, Track
     cTrackDetails->strArtist = "Unknown Artist";
     cTrackDetails->strTitle = "Unknown Title";
     cTrackDetails->nChannels = m_channel_count;
+    cTrackDetails->fDuration = (double)m_sample_count / m_samplerate;
+    cTrackDetails->fStart = 0;
+    cTrackDetails->bDst = false;
 }
 
-string sacd_dsf_t::set_track(uint32_t track_number, area_id_e area_id, uint32_t offset)
+string sacd_dsf_t::set_track(uint32_t track_number, area_id_e area_id, uint32_t offset, uint32_t track_count)
 {
     if (track_number)
     {
@@ -202,43 +205,54 @@ string sacd_dsf_t::set_track(uint32_t track_number, area_id_e area_id, uint32_t
     }
 
     m_file->seek(m_data_offset);
+    m_block_offset = 0;
+    m_block_samples = 0;
+
+    return get_track_name(track_number, area_id);
+}
 
+string sacd_dsf_t::get_track_name(uint32_t track_number, area_id_e area_id)
+{
     return m_file->getFileName();
 }
 
 bool sacd_dsf_t::read_frame(uint8_t* frame_data, size_t* frame_size, frame_type_e* frame_type)
 {
+    int frame_samples = (int)*frame_size / m_channel_count;
     int samples_read = 0;
 
-    for (int i = 0; i < (int)*frame_size / m_channel_count; i++)
+    while (samples_read < frame_samples)
     {
-        if (m_block_offset * m_channel_count >= m_block_data_end)
+        if (m_block_offset >= m_block_samples && !read_block())
         {
-                m_block_data_end = (int)MIN(m_data_end_offset - m_file->get_position(), m_block_data.size());
+            break;
+        }
 
-            if (m_block_data_end > 0)
-            {
-                m_block_data_end = m_file->read(m_block_data.data(), m_block_data_end);
-            }
+        int samples = MIN(frame_samples - samples_read, m_block_samples - m_block_offset);
 
-            if (m_block_data_end > 0)
-            {
-                m_block_offset = 0;
-            }
-            else
+        if (m_planar)
+        {
+            for (int ch = 0; ch < m_channel_count; ch++)
             {
-                break;
+                memcpy(frame_data + ch * frame_samples + samples_read, m_block_data.data() + ch * m_block_size + m_block_offset, samples);
             }
         }
-
-        for (int ch = 0; ch < m_channel_count; ch++)
+        else
         {
-            uint8_t b = m_block_data.data()[ch * m_block_size + m_block_offset];
-            frame_data[i * m_channel_count + ch] = m_is_lsb ? swap_bits[b] : b;
+            dsd_interleave(m_block_data.data() + m_block_offset, m_block_size, m_channel_count, samples, frame_data + samples_read * m_channel_count);
         }
 
-        m_block_offset++;
-        samples_read++;
+        m_block_offset += samples;
+        samples_read += samples;
+    }
+
+    // keep the planar channels contiguous on a short (last) frame
+    if (m_planar && samples_read > 0 && samples_read < frame_samples)
+    {
+        for (int ch = 1; ch < m_channel_count; ch++)
+        {
+            memmove(frame_data + ch * samples_read, frame_data + ch * frame_samples, samples_read);
+        }
     }
 
     *frame_size = samples_read * m_channel_count;
@@ -246,3 +260,33 @@ bool sacd_dsf_t::read_frame(uint8_t* frame_data, size_t* frame_size, frame_type_
 
     return samples_read > 0;
 }
+
+bool sacd_dsf_t::read_block()
+{
+    uint64_t position = m_file->get_position();
+
+    if (position >= m_data_end_offset)
+    {
+        return false;
+    }
+
+    int block_data_end = m_file->read(m_block_data.data(), (size_t)MIN(m_data_end_offset - position, m_block_data.size()));
+
+    // the last block of every channel is zero padded, only sample_count bits are valid
+    int64_t samples_left = (int64_t)(m_sample_count / 8) - (int64_t)((position - m_data_offset) / m_channel_count);
+    m_block_samples = (int)MIN(MIN((int64_t)m_block_size, samples_left), (int64_t)(block_data_end - (m_channel_count - 1) * m_block_size));
+    m_block_offset = 0;
+
+    if (m_block_samples <= 0)
+    {
+        m_block_samples = 0;
+        return false;
+    }
+
+    if (m_is_lsb)
+    {
+        dsd_bit_reverse(m_block_data.data(), m_block_data.data(), block_data_end);
+    }
+
+    return true;
+}
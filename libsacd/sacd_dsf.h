@@ -56,7 +56,7 @@ class sacd_dsf_t : public sacd_reader_t
     vector<uint8_t> m_block_data;
     int m_block_size;
     int m_block_offset;
-    int m_block_data_end;
+    int m_block_samples;
     uint64_t m_sample_count;
     uint64_t m_data_offset;
     uint64_t m_data_size;
@@ -65,7 +65,7 @@ class sacd_dsf_t : public sacd_reader_t
     bool m_is_lsb;
     uint64_t m_id3_offset;
     vector<uint8_t> m_id3_data;
-    uint8_t swap_bits[256];
+    bool m_planar;
 public:
     sacd_dsf_t();
     ~sacd_dsf_t();
@@ -75,11 +75,15 @@ public:
     int get_framerate();
     float getProgress();
     bool is_dst();
+    bool set_planar(bool planar);
     int open(sacd_media_t* p_file);
     bool close();
-    string set_track(uint32_t track_number, area_id_e area_id = AREA_BOTH, uint32_t offset = 0);
+    string set_track(uint32_t track_number, area_id_e area_id = AREA_BOTH, uint32_t offset = 0, uint32_t track_count = 1);
+    string get_track_name(uint32_t track_number, area_id_e area_id = AREA_BOTH);
     bool read_frame(uint8_t* frame_data, size_t* frame_size, frame_type_e* frame_type);
     void getTrackDetails(uint32_t track_number, area_id_e area_id, TrackDetails* cTrackDetails);
+private:
+    bool read_block();
 };
 
 #endif
@@ -18,19 +18,40 @@
     along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
 */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include "scarletbook.h"
 #include "sacd_media.h"
 
 #define MIN(a,b) (((a)<(b))?(a):(b))
 
+sacd_media_t* sacd_media_t::create(media_access_t access)
+{
+    switch (access)
+    {
+        case ACCESS_DIRECT:
+            return new sacd_media_direct_t();
+        case ACCESS_MMAP:
+            return new sacd_media_mmap_t();
+        case ACCESS_STREAM:
+            return new sacd_media_stream_t();
+        default:
+            return new sacd_media_t();
+    }
+}
+
 sacd_media_t::sacd_media_t()
 {
+    media_file = nullptr;
 }
 
 sacd_media_t::~sacd_media_t()
 {
+    close();
 }
 
 bool sacd_media_t::open(const char* path)
@@ -39,7 +60,7 @@ bool sacd_media_t::open(const char* path)
     {
         media_file = fopen(path, "r");
         m_strFilePath = path;
-        return true;
+        return media_file != nullptr;
     }
     catch (...)
     {
@@ -50,20 +71,24 @@ bool sacd_media_t::open(const char* path)
 
 bool sacd_media_t::close()
 {
-    fclose(media_file);
+    if (media_file)
+    {
+        fclose(media_file);
+        media_file = nullptr;
+    }
 
     return true;
 }
 
 bool sacd_media_t::seek(int64_t position, int mode)
 {
-    fseek(media_file, position, mode);
+    fseeko(media_file, position, mode);
     return true;
 }
 
 int64_t sacd_media_t::get_position()
 {
-    return ftell(media_file);
+    return ftello(media_file);
 }
 
 size_t sacd_media_t::read(void* data, size_t size)
@@ -73,7 +98,7 @@ size_t sacd_media_t::read(void* data, size_t size)
 
 int64_t sacd_media_t::skip(int64_t bytes)
 {
-    return fseek(media_file, bytes, SEEK_CUR);
+    return fseeko(media_file, bytes, SEEK_CUR);
 }
 
 string sacd_media_t::getFileName()
@@ -81,3 +106,381 @@ string sacd_media_t::getFileName()
     m_strFilePath = m_strFilePath.substr(m_strFilePath.find_last_of("/") + 1, string::npos);
     return m_strFilePath.substr(0, m_strFilePath.find_last_of(".")) + ".wav";
 }
+
+sacd_media_direct_t::sacd_media_direct_t()
+{
+    m_fd = -1;
+    m_direct = false;
+    m_buffer = nullptr;
+    m_buffer_offset = 0;
+    m_buffer_size = 0;
+    m_position = 0;
+    m_size = 0;
+}
+
+sacd_media_direct_t::~sacd_media_direct_t()
+{
+    close();
+}
+
+bool sacd_media_direct_t::open(const char* path)
+{
+    m_fd = ::open(path, O_RDONLY | O_DIRECT);
+    m_direct = m_fd >= 0;
+
+    // Filesystems like tmpfs refuse O_DIRECT, fall back to dropping the pages behind us
+    if (m_fd < 0)
+    {
+        m_fd = ::open(path, O_RDONLY);
+    }
+
+    struct stat st;
+
+    if (m_fd < 0 || fstat(m_fd, &st) != 0 || posix_memalign((void**)&m_buffer, MEDIA_DIRECT_ALIGN, MEDIA_DIRECT_READAHEAD) != 0)
+    {
+        m_buffer = nullptr;
+        close();
+        return false;
+    }
+
+    m_size = st.st_size;
+    m_buffer_offset = 0;
+    m_buffer_size = 0;
+    m_position = 0;
+    m_strFilePath = path;
+
+    return true;
+}
+
+bool sacd_media_direct_t::close()
+{
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+
+    free(m_buffer);
+    m_buffer = nullptr;
+
+    return true;
+}
+
+bool sacd_media_direct_t::seek(int64_t position, int mode)
+{
+    switch (mode)
+    {
+        case SEEK_CUR:
+            position += m_position;
+            break;
+        case SEEK_END:
+            position += m_size;
+            break;
+        default:
+            break;
+    }
+
+    if (position < 0)
+    {
+        return false;
+    }
+
+    m_position = position;
+
+    return true;
+}
+
+int64_t sacd_media_direct_t::get_position()
+{
+    return m_position;
+}
+
+size_t sacd_media_direct_t::read(void* data, size_t size)
+{
+    size_t done = 0;
+
+    while (done < size)
+    {
+        if (m_position < m_buffer_offset || m_position >= m_buffer_offset + (int64_t)m_buffer_size)
+        {
+            if (m_position >= m_size)
+            {
+                break;
+            }
+
+            // O_DIRECT wants the file offset, length and buffer aligned to the logical block size
+            m_buffer_offset = m_position & ~(int64_t)(MEDIA_DIRECT_ALIGN - 1);
+            ssize_t read_bytes = pread(m_fd, m_buffer, MEDIA_DIRECT_READAHEAD, m_buffer_offset);
+            m_buffer_size = read_bytes > 0 ? read_bytes : 0;
+
+            if (!m_direct && read_bytes > 0)
+            {
+                posix_fadvise(m_fd, m_buffer_offset, read_bytes, POSIX_FADV_DONTNEED);
+            }
+
+            if (m_position >= m_buffer_offset + (int64_t)m_buffer_size)
+            {
+                break;
+            }
+        }
+
+        size_t chunk = MIN(size - done, (size_t)(m_buffer_offset + m_buffer_size - m_position));
+        memcpy((uint8_t*)data + done, m_buffer + (m_position - m_buffer_offset), chunk);
+        m_position += chunk;
+        done += chunk;
+    }
+
+    return done;
+}
+
+int64_t sacd_media_direct_t::skip(int64_t bytes)
+{
+    return seek(bytes, SEEK_CUR) ? 0 : -1;
+}
+
+sacd_media_mmap_t::sacd_media_mmap_t()
+{
+    m_fd = -1;
+    m_data = nullptr;
+    m_position = 0;
+    m_size = 0;
+}
+
+sacd_media_mmap_t::~sacd_media_mmap_t()
+{
+    close();
+}
+
+bool sacd_media_mmap_t::open(const char* path)
+{
+    m_fd = ::open(path, O_RDONLY);
+
+    struct stat st;
+
+    if (m_fd < 0 || fstat(m_fd, &st) != 0)
+    {
+        close();
+        return false;
+    }
+
+    m_size = st.st_size;
+    m_position = 0;
+    m_strFilePath = path;
+
+    if (m_size > 0)
+    {
+        void* data = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+
+        if (data == MAP_FAILED)
+        {
+            close();
+            return false;
+        }
+
+        m_data = (uint8_t*)data;
+        madvise(m_data, m_size, MADV_SEQUENTIAL);
+    }
+
+    return true;
+}
+
+bool sacd_media_mmap_t::close()
+{
+    if (m_data)
+    {
+        munmap(m_data, m_size);
+        m_data = nullptr;
+    }
+
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+
+    return true;
+}
+
+bool sacd_media_mmap_t::seek(int64_t position, int mode)
+{
+    switch (mode)
+    {
+        case SEEK_CUR:
+            position += m_position;
+            break;
+        case SEEK_END:
+            position += m_size;
+            break;
+        default:
+            break;
+    }
+
+    if (position < 0)
+    {
+        return false;
+    }
+
+    m_position = position;
+
+    return true;
+}
+
+int64_t sacd_media_mmap_t::get_position()
+{
+    return m_position;
+}
+
+size_t sacd_media_mmap_t::read(void* data, size_t size)
+{
+    if (m_position >= m_size)
+    {
+        return 0;
+    }
+
+    size = MIN(size, (size_t)(m_size - m_position));
+    memcpy(data, m_data + m_position, size);
+    m_position += size;
+
+    return size;
+}
+
+int64_t sacd_media_mmap_t::skip(int64_t bytes)
+{
+    return seek(bytes, SEEK_CUR) ? 0 : -1;
+}
+
+sacd_media_stream_t::sacd_media_stream_t()
+{
+    m_fd = -1;
+    m_buffer_offset = 0;
+    m_position = 0;
+    m_eof = false;
+}
+
+sacd_media_stream_t::~sacd_media_stream_t()
+{
+    close();
+}
+
+bool sacd_media_stream_t::open(const char* path)
+{
+    if (strcmp(path, "-") == 0)
+    {
+        m_fd = STDIN_FILENO;
+        m_strFilePath = "stdin";
+    }
+    else
+    {
+        m_fd = ::open(path, O_RDONLY);
+        m_strFilePath = path;
+    }
+
+    m_buffer.clear();
+    m_buffer_offset = 0;
+    m_position = 0;
+    m_eof = false;
+
+    return m_fd >= 0;
+}
+
+bool sacd_media_stream_t::close()
+{
+    if (m_fd > STDIN_FILENO)
+    {
+        ::close(m_fd);
+    }
+
+    m_fd = -1;
+
+    return true;
+}
+
+// Pull bytes from the stream until the buffer reaches 'end', dropping whatever lies further back than the lookback window
+bool sacd_media_stream_t::fill(int64_t end)
+{
+    while (m_buffer_offset + (int64_t)m_buffer.size() < end && !m_eof)
+    {
+        int64_t keep_from = MIN(m_position, m_buffer_offset + (int64_t)m_buffer.size()) - (int64_t)MEDIA_STREAM_LOOKBACK;
+
+        if (keep_from - m_buffer_offset > (int64_t)MEDIA_STREAM_LOOKBACK)
+        {
+            m_buffer.erase(m_buffer.begin(), m_buffer.begin() + (keep_from - m_buffer_offset));
+            m_buffer_offset = keep_from;
+        }
+
+        size_t used = m_buffer.size();
+        size_t want = (size_t)MIN(end - (m_buffer_offset + (int64_t)used), (int64_t)MEDIA_STREAM_LOOKBACK);
+        m_buffer.resize(used + want);
+        ssize_t read_bytes = ::read(m_fd, m_buffer.data() + used, want);
+
+        if (read_bytes < 0 && errno == EINTR)
+        {
+            read_bytes = 0;
+        }
+        else if (read_bytes <= 0)
+        {
+            m_eof = true;
+            read_bytes = 0;
+        }
+
+        m_buffer.resize(used + read_bytes);
+    }
+
+    return m_buffer_offset + (int64_t)m_buffer.size() >= end;
+}
+
+bool sacd_media_stream_t::seek(int64_t position, int mode)
+{
+    switch (mode)
+    {
+        case SEEK_CUR:
+            position += m_position;
+            break;
+        case SEEK_END:
+            return false;
+        default:
+            break;
+    }
+
+    if (position < m_buffer_offset)
+    {
+        return false;
+    }
+
+    m_position = position;
+
+    return true;
+}
+
+int64_t sacd_media_stream_t::get_position()
+{
+    return m_position;
+}
+
+size_t sacd_media_stream_t::read(void* data, size_t size)
+{
+    if (m_position < m_buffer_offset)
+    {
+        return 0;
+    }
+
+    fill(m_position + size);
+
+    int64_t available = m_buffer_offset + (int64_t)m_buffer.size() - m_position;
+
+    if (available <= 0)
+    {
+        return 0;
+    }
+
+    size = MIN(size, (size_t)available);
+    memcpy(data, m_buffer.data() + (m_position - m_buffer_offset), size);
+    m_position += size;
+
+    return size;
+}
+
+int64_t sacd_media_stream_t::skip(int64_t bytes)
+{
+    return seek(bytes, SEEK_CUR) ? 0 : -1;
+}
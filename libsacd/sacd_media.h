@@ -24,15 +24,24 @@
 #include <stdint.h>
 #include <cstring>
 #include <string>
+#include <vector>
 #include <stdio.h>
 
 using namespace std;
 
+enum media_access_t {ACCESS_BUFFERED = 0, ACCESS_DIRECT = 1, ACCESS_MMAP = 2, ACCESS_STREAM = 3};
+
+constexpr size_t MEDIA_DIRECT_ALIGN = 4096;
+constexpr size_t MEDIA_DIRECT_READAHEAD = 2 * 1024 * 1024;
+constexpr size_t MEDIA_STREAM_LOOKBACK = 1024 * 1024;
+
 class sacd_media_t
 {
     FILE * media_file;
+protected:
     string m_strFilePath;
 public:
+    static sacd_media_t* create(media_access_t access);
     sacd_media_t();
     virtual ~sacd_media_t();
     virtual bool open(const char* path);
@@ -41,7 +50,68 @@ public:
     virtual int64_t get_position();
     virtual size_t read(void* data, size_t size);
     virtual int64_t skip(int64_t bytes);
+    virtual bool can_seek() { return true; }
     virtual string getFileName();
 };
 
+// Bypasses the page cache with O_DIRECT, reading ahead MEDIA_DIRECT_READAHEAD bytes into an aligned buffer
+class sacd_media_direct_t : public sacd_media_t
+{
+    int m_fd;
+    bool m_direct;
+    uint8_t* m_buffer;
+    int64_t m_buffer_offset;
+    size_t m_buffer_size;
+    int64_t m_position;
+    int64_t m_size;
+public:
+    sacd_media_direct_t();
+    ~sacd_media_direct_t();
+    bool open(const char* path);
+    bool close();
+    bool seek(int64_t position, int mode = SEEK_SET);
+    int64_t get_position();
+    size_t read(void* data, size_t size);
+    int64_t skip(int64_t bytes);
+};
+
+// Maps the whole file, reads are plain copies out of the mapping
+class sacd_media_mmap_t : public sacd_media_t
+{
+    int m_fd;
+    uint8_t* m_data;
+    int64_t m_position;
+    int64_t m_size;
+public:
+    sacd_media_mmap_t();
+    ~sacd_media_mmap_t();
+    bool open(const char* path);
+    bool close();
+    bool seek(int64_t position, int mode = SEEK_SET);
+    int64_t get_position();
+    size_t read(void* data, size_t size);
+    int64_t skip(int64_t bytes);
+};
+
+// Forward-only input from stdin or a pipe, seeking back is possible within the last MEDIA_STREAM_LOOKBACK bytes
+class sacd_media_stream_t : public sacd_media_t
+{
+    int m_fd;
+    vector<uint8_t> m_buffer;
+    int64_t m_buffer_offset;
+    int64_t m_position;
+    bool m_eof;
+    bool fill(int64_t end);
+public:
+    sacd_media_stream_t();
+    ~sacd_media_stream_t();
+    bool open(const char* path);
+    bool close();
+    bool seek(int64_t position, int mode = SEEK_SET);
+    int64_t get_position();
+    size_t read(void* data, size_t size);
+    int64_t skip(int64_t bytes);
+    bool can_seek() { return false; }
+};
+
 #endif
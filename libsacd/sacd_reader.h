@@ -36,6 +36,9 @@ struct TrackDetails
     string strArtist;
     string strTitle;
     int nChannels;
+    double fDuration;
+    double fStart;
+    bool bDst;
 };
 
 class sacd_reader_t {
@@ -50,7 +53,9 @@ public:
     virtual int get_framerate() = 0;
     virtual float getProgress() = 0;
     virtual bool is_dst() = 0;
-    virtual string set_track(uint32_t track_number, area_id_e area_id = AREA_BOTH, uint32_t offset = 0) = 0;
+    virtual bool set_planar(bool planar) { return !planar; }
+    virtual string set_track(uint32_t track_number, area_id_e area_id = AREA_BOTH, uint32_t offset = 0, uint32_t track_count = 1) = 0;
+    virtual string get_track_name(uint32_t track_number, area_id_e area_id = AREA_BOTH) = 0;
     virtual bool read_frame(uint8_t* frame_data, size_t* frame_size, frame_type_e* frame_type) = 0;
     virtual void getTrackDetails(uint32_t track_number, area_id_e area_id, TrackDetails* cTrackDetails) = 0;
 };
@@ -0,0 +1,529 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+    Copyright 2011-2016 Maxim V.Anisiutkin <maxim.anisiutkin@gmail.com>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#include <ctype.h>
+#include <string.h>
+#include "sacd_session.h"
+#include "sacd_disc.h"
+#include "sacd_dsdiff.h"
+#include "sacd_dsf.h"
+#include "dsd_pcm_converter_hq.h"
+#include "dsd_pcm_converter_engine.h"
+#include "dst_decoder_mt.h"
+
+sacd_session_t::sacd_session_t(int threads)
+{
+    m_threads = threads > 0 ? threads : 1;
+    m_media = nullptr;
+    m_reader = nullptr;
+    m_dst_decoder = nullptr;
+    m_converter_hq = nullptr;
+    m_converter = nullptr;
+    m_frame_size = 0;
+    m_channels = 0;
+    m_channel_map = 0;
+    m_dsd_samplerate = 0;
+    m_pcm_samplerate = 0;
+    m_framerate = 0;
+    m_planar = false;
+    m_selected = false;
+    m_completed = false;
+    m_pcm_out_samples = 0;
+    m_pcm_out_delta = 0;
+    m_pcm_pending = nullptr;
+    m_pcm_pending_samples = 0;
+    m_dsd_pending = nullptr;
+    m_dsd_pending_size = 0;
+}
+
+sacd_session_t::~sacd_session_t()
+{
+    close();
+
+    delete m_converter_hq;
+    delete m_converter;
+    delete m_dst_decoder;
+}
+
+// The converters are replaced by the next select_track() if they do not fit anyway
+void sacd_session_t::close()
+{
+    if (m_reader)
+    {
+        m_reader->close();
+        delete m_reader;
+        m_reader = nullptr;
+    }
+
+    if (m_media)
+    {
+        m_media->close();
+        delete m_media;
+        m_media = nullptr;
+    }
+
+    m_selected = false;
+}
+
+int sacd_session_t::open(const string& path, media_access_t access)
+{
+    close();
+    m_error.clear();
+
+    m_media = sacd_media_t::create(access);
+
+    if (!m_media)
+    {
+        m_error = "exception_overflow";
+        return 0;
+    }
+
+    if (!m_media->open(path.c_str()))
+    {
+        m_error = "exception_io_data";
+        return 0;
+    }
+
+    // Sniff the magic bytes first, the extension only identifies disc images (and pipes have none)
+    string ext = path.length() >= 3 ? path.substr(path.length() - 3, 3) : "";
+    media_type_t media_type = UNK_TYPE;
+    char magic[4];
+    int tracks;
+
+    for (size_t i = 0; i < ext.length(); i++)
+    {
+        ext[i] = tolower(ext[i]);
+    }
+
+    if (m_media->read(magic, 4) == 4 && m_media->seek(0))
+    {
+        if (memcmp(magic, "DSD ", 4) == 0)
+        {
+            media_type = DSF_TYPE;
+        }
+        else if (memcmp(magic, "FRM8", 4) == 0)
+        {
+            media_type = DSDIFF_TYPE;
+        }
+    }
+
+    if (media_type == UNK_TYPE && (ext == "iso" || ext == "dat") && m_media->can_seek())
+    {
+        media_type = ISO_TYPE;
+    }
+
+    switch (media_type)
+    {
+        case ISO_TYPE:
+            m_reader = new sacd_disc_t;
+            break;
+        case DSDIFF_TYPE:
+            m_reader = new sacd_dsdiff_t;
+            break;
+        case DSF_TYPE:
+            m_reader = new sacd_dsf_t;
+            break;
+        default:
+            m_error = "exception_io_unsupported_format";
+            return 0;
+    }
+
+    if ((tracks = m_reader->open(m_media)) == 0)
+    {
+        m_error = "Failed to parse SACD media";
+        return 0;
+    }
+
+    return tracks;
+}
+
+bool sacd_session_t::select_track(uint32_t track, area_id_e area, int pcm_samplerate, uint32_t track_count)
+{
+    int prev_channels = m_channels;
+    int prev_dsd_samplerate = m_dsd_samplerate;
+    int prev_pcm_samplerate = m_pcm_samplerate;
+    int prev_framerate = m_framerate;
+    bool prev_planar = m_planar;
+
+    m_selected = false;
+    m_error.clear();
+
+    if (!m_reader)
+    {
+        m_error = "No input open";
+        return false;
+    }
+
+    if (pcm_samplerate != 0 && pcm_samplerate != 88200 && pcm_samplerate != 176400 && pcm_samplerate != 96000 && pcm_samplerate != 192000)
+    {
+        m_error = "exception_io_unsupported_format";
+        return false;
+    }
+
+    m_reader->set_track(track, area, 0, track_count);
+    m_dsd_samplerate = m_reader->get_samplerate();
+    m_framerate = m_reader->get_framerate();
+    m_channels = m_reader->get_channels();
+    m_pcm_samplerate = pcm_samplerate;
+    m_pcm_out_samples = pcm_samplerate / m_framerate;
+
+    switch (m_channels)
+    {
+        case 1:
+            m_channel_map = 1<<2;
+            break;
+        case 2:
+            m_channel_map = 1<<0 | 1<<1;
+            break;
+        case 3:
+            m_channel_map = 1<<0 | 1<<1 | 1<<2;
+            break;
+        case 4:
+            m_channel_map = 1<<0 | 1<<1 | 1<<4 | 1<<5;
+            break;
+        case 5:
+            m_channel_map = 1<<0 | 1<<1 | 1<<2 | 1<<4 | 1<<5;
+            break;
+        case 6:
+            m_channel_map = 1<<0 | 1<<1 | 1<<2 | 1<<3 | 1<<4 | 1<<5;
+            break;
+        default:
+            m_channel_map = 0;
+            break;
+    }
+
+    // A DST frame that stores the DSD uncompressed is one byte longer than the DSD frame
+    m_frame_size = m_dsd_samplerate / 8 / m_framerate * m_channels;
+    m_dsd_buf.resize(m_frame_size * m_threads);
+    m_dst_buf.resize((m_frame_size + 1) * m_threads);
+    m_pcm_buf.resize(m_channels * m_pcm_out_samples);
+
+    // Frames travel channel after channel from the reader (or DST decoder) to the converter, DSD is handed out interleaved
+    m_planar = m_reader->set_planar(pcm_samplerate != 0) && pcm_samplerate != 0;
+
+    // The converter and DST decoder, with their threads and filters, carry over to the next track in the same format
+    bool reuse = m_channels == prev_channels && m_dsd_samplerate == prev_dsd_samplerate && m_pcm_samplerate == prev_pcm_samplerate && m_framerate == prev_framerate && m_planar == prev_planar;
+
+    if (!reuse)
+    {
+        delete m_converter_hq;
+        delete m_converter;
+        m_converter_hq = nullptr;
+        m_converter = nullptr;
+    }
+
+    // Frames of an unfinished track may still be in the decoder
+    if (m_dst_decoder && (!reuse || !m_completed))
+    {
+        delete m_dst_decoder;
+        m_dst_decoder = nullptr;
+    }
+
+    if (m_converter_hq)
+    {
+        m_converter_hq->reset();
+    }
+    else if (m_converter)
+    {
+        m_converter->reset();
+    }
+    else if (pcm_samplerate == 96000 || pcm_samplerate == 192000)
+    {
+        m_converter_hq = new dsdpcm_converter_hq();
+
+        if (m_converter_hq->init(m_channels, m_dsd_samplerate, pcm_samplerate) != 0)
+        {
+            delete m_converter_hq;
+            m_converter_hq = nullptr;
+            m_pcm_samplerate = 0;
+            m_error = "exception_io_unsupported_format";
+            return false;
+        }
+    }
+    else if (pcm_samplerate != 0)
+    {
+        m_converter = new DSDPCMConverterEngine();
+
+        if (m_converter->init(m_channels, m_framerate, m_dsd_samplerate, pcm_samplerate) < 0)
+        {
+            delete m_converter;
+            m_converter = nullptr;
+            m_pcm_samplerate = 0;
+            m_error = "exception_io_unsupported_format";
+            return false;
+        }
+    }
+
+    float pcm_out_delay = 0.0f;
+
+    if (m_converter_hq)
+    {
+        m_converter_hq->set_planar(m_planar);
+        pcm_out_delay = m_converter_hq->get_delay();
+    }
+    else if (m_converter)
+    {
+        m_converter->set_planar(m_planar);
+        pcm_out_delay = m_converter->get_delay();
+    }
+
+    m_pcm_out_delta = (int)(pcm_out_delay - 0.5f);//  + 0.5f originally
+
+    if (m_pcm_out_delta > m_pcm_out_samples - 1)
+    {
+        m_pcm_out_delta = MAX(m_pcm_out_samples - 1, 0);
+    }
+
+    m_pcm_pending_samples = 0;
+    m_dsd_pending_size = 0;
+    m_completed = false;
+    m_selected = true;
+
+    return true;
+}
+
+float sacd_session_t::get_progress()
+{
+    return m_reader ? m_reader->getProgress() : 0;
+}
+
+// Next decoded frame, channel after channel if planar, false at the end of the selection
+bool sacd_session_t::next_dsd(uint8_t** dsd_data, size_t* dsd_size)
+{
+    uint8_t* dst_data;
+    size_t dst_size;
+    frame_type_e frame_type;
+    int slot;
+
+    *dsd_size = 0;
+
+    while (1)
+    {
+        slot = m_dst_decoder ? m_dst_decoder->slot_nr : 0;
+        *dsd_data = m_dsd_buf.data() + m_frame_size * slot;
+        dst_data = m_dst_buf.data() + (m_frame_size + 1) * slot;
+        dst_size = m_frame_size + 1;
+
+        if (!m_reader->read_frame(dst_data, &dst_size, &frame_type))
+        {
+            break;
+        }
+
+        if (dst_size > 0)
+        {
+            if (frame_type == FRAME_INVALID)
+            {
+                dst_size = m_frame_size;
+                memset(dst_data, DSD_SILENCE_BYTE, dst_size);
+            }
+
+            if (frame_type == FRAME_DST)
+            {
+                if (!m_dst_decoder)
+                {
+                    m_dst_decoder = new dst_decoder_t(m_threads);
+
+                    if (m_dst_decoder->init(m_channels, m_dsd_samplerate, m_framerate, m_planar) != 0)
+                    {
+                        delete m_dst_decoder;
+                        m_dst_decoder = nullptr;
+                        return false;
+                    }
+                }
+
+                m_dst_decoder->decode(dst_data, dst_size, dsd_data, dsd_size);
+            }
+            else
+            {
+                *dsd_data = dst_data;
+                *dsd_size = dst_size;
+            }
+
+            if (*dsd_size > 0)
+            {
+                return true;
+            }
+        }
+    }
+
+    // The DST decoder hands out the frames still in its threads one by one
+    if (m_dst_decoder)
+    {
+        m_dst_decoder->decode(nullptr, 0, dsd_data, dsd_size);
+    }
+
+    return *dsd_size > 0;
+}
+
+void sacd_session_t::fix_pcm_stream(bool is_end, float* pcm_data, int pcm_samples)
+{
+    if (pcm_samples > 1)
+    {
+        for (int ch = 0; ch < m_channels; ch++)
+        {
+            if (!is_end)
+            {
+                pcm_data[0 * m_channels + ch] = pcm_data[1 * m_channels + ch];
+            }
+            else
+            {
+                pcm_data[(pcm_samples - 1) * m_channels + ch] = pcm_data[(pcm_samples - 2) * m_channels + ch];
+            }
+        }
+    }
+}
+
+int sacd_session_t::decode_pcm(float** pcm_data)
+{
+    uint8_t* dsd_data;
+    size_t dsd_size;
+
+    if (!m_selected || (!m_converter_hq && !m_converter))
+    {
+        return -1;
+    }
+
+    if (m_completed)
+    {
+        return 0;
+    }
+
+    *pcm_data = m_pcm_buf.data();
+
+    if (next_dsd(&dsd_data, &dsd_size))
+    {
+        // The first samples are the delay of the filters
+        bool first = m_converter_hq ? !m_converter_hq->is_convert_called() : !m_converter->is_convert_called();
+        int remove_samples = first ? m_pcm_out_delta : 0;
+
+        if (m_converter_hq)
+        {
+            m_converter_hq->convert(dsd_data, dsd_size, m_pcm_buf.data());
+        }
+        else
+        {
+            m_converter->convert(dsd_data, dsd_size, m_pcm_buf.data());
+        }
+
+        if (remove_samples > 0)
+        {
+            fix_pcm_stream(false, m_pcm_buf.data() + m_channels * remove_samples, m_pcm_out_samples - remove_samples);
+        }
+
+        *pcm_data += m_channels * remove_samples;
+
+        return m_pcm_out_samples - remove_samples;
+    }
+
+    m_completed = true;
+
+    // Flush the filters for the samples held back at the start
+    if (m_pcm_out_delta > 0)
+    {
+        if (m_converter_hq)
+        {
+            m_converter_hq->convert(nullptr, 0, m_pcm_buf.data());
+        }
+        else
+        {
+            m_converter->convert(nullptr, 0, m_pcm_buf.data());
+        }
+
+        fix_pcm_stream(true, m_pcm_buf.data(), m_pcm_out_delta);
+    }
+
+    return m_pcm_out_delta > 0 ? m_pcm_out_delta : 0;
+}
+
+int sacd_session_t::read_pcm(float* pcm_data, int samples)
+{
+    int done = 0;
+
+    while (done < samples)
+    {
+        if (m_pcm_pending_samples == 0)
+        {
+            int decoded = decode_pcm(&m_pcm_pending);
+
+            if (decoded <= 0)
+            {
+                return done > 0 ? done : decoded;
+            }
+
+            m_pcm_pending_samples = decoded;
+        }
+
+        int count = samples - done < m_pcm_pending_samples ? samples - done : m_pcm_pending_samples;
+
+        memcpy(pcm_data + done * m_channels, m_pcm_pending, count * m_channels * sizeof(float));
+        m_pcm_pending += count * m_channels;
+        m_pcm_pending_samples -= count;
+        done += count;
+    }
+
+    return done;
+}
+
+int sacd_session_t::read_dsd(uint8_t* dsd_data, int samples)
+{
+    int done = 0;
+
+    if (!m_selected || m_pcm_samplerate != 0)
+    {
+        return -1;
+    }
+
+    while (done < samples)
+    {
+        if (m_dsd_pending_size == 0)
+        {
+            if (m_completed || !next_dsd(&m_dsd_pending, &m_dsd_pending_size))
+            {
+                m_completed = true;
+                break;
+            }
+        }
+
+        size_t count = MIN((size_t)(samples - done) * m_channels, m_dsd_pending_size);
+
+        memcpy(dsd_data + done * m_channels, m_dsd_pending, count);
+        m_dsd_pending += count;
+        m_dsd_pending_size -= count;
+        done += count / m_channels;
+    }
+
+    return done;
+}
+
+bool sacd_session_t::read_frame(uint8_t* frame_data, size_t* frame_size, frame_type_e* frame_type)
+{
+    if (!m_selected || m_pcm_samplerate != 0 || m_completed)
+    {
+        return false;
+    }
+
+    if (!m_reader->read_frame(frame_data, frame_size, frame_type))
+    {
+        m_completed = true;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,118 @@
+/*
+    Copyright 2015-2019 Robert Tari <robert@tari.in>
+    Copyright 2011-2016 Maxim V.Anisiutkin <maxim.anisiutkin@gmail.com>
+
+    This file is part of SACD.
+
+    SACD is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    SACD is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SACD.  If not, see <http://www.gnu.org/licenses/gpl-3.0.txt>.
+*/
+
+#ifndef _SACD_SESSION_H_INCLUDED
+#define _SACD_SESSION_H_INCLUDED
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "sacd_media.h"
+#include "sacd_reader.h"
+
+using namespace std;
+
+class dst_decoder_t;
+class dsdpcm_converter_hq;
+class DSDPCMConverterEngine;
+
+// Decoding of one input without any output attached: open a disc image, DSF or DSDIFF file, select a track (or a run of
+// tracks) and pull its audio into caller provided buffers, either as PCM from the converters or as the DSD bitstream.
+// A session shares no state with other sessions, any number of them can be used from different threads.
+//
+//  sacd_session_t s;
+//  s.open("disc.iso");
+//  s.select_track(0, AREA_TWOCH, 96000);
+//  while ((n = s.read_pcm(buf, 4096)) > 0) ...
+class sacd_session_t
+{
+    int m_threads;
+    sacd_media_t* m_media;
+    sacd_reader_t* m_reader;
+    dst_decoder_t* m_dst_decoder;
+    dsdpcm_converter_hq* m_converter_hq;
+    DSDPCMConverterEngine* m_converter;
+    vector<uint8_t> m_dst_buf;
+    vector<uint8_t> m_dsd_buf;
+    vector<float> m_pcm_buf;
+    int m_frame_size;
+    int m_channels;
+    unsigned int m_channel_map;
+    int m_dsd_samplerate;
+    int m_pcm_samplerate;
+    int m_framerate;
+    bool m_planar;
+    bool m_selected;
+    bool m_completed;
+    int m_pcm_out_samples;
+    int m_pcm_out_delta;
+    float* m_pcm_pending;
+    int m_pcm_pending_samples;
+    uint8_t* m_dsd_pending;
+    size_t m_dsd_pending_size;
+    string m_error;
+    bool next_dsd(uint8_t** dsd_data, size_t* dsd_size);
+    void fix_pcm_stream(bool is_end, float* pcm_data, int pcm_samples);
+public:
+    sacd_session_t(int threads = 2);
+    ~sacd_session_t();
+
+    // Opens the input (magic bytes, or the .iso/.dat extension for disc images), returns the number of tracks or 0
+    int open(const string& path, media_access_t access = ACCESS_BUFFERED);
+
+    // Why the last open() or select_track() failed, nothing is printed by the session itself
+    const string& get_error() { return m_error; }
+    void close();
+
+    // Track list and metadata of the open input
+    sacd_reader_t* get_reader() { return m_reader; }
+
+    // Starts decoding track_count tracks from track on as one stream. pcm_samplerate selects the PCM output
+    // (88200, 176400, 96000 or 192000), 0 selects DSD output. Returns false if the format cannot be converted.
+    // The converters and the DST decoder are kept for the next track as long as the format does not change.
+    bool select_track(uint32_t track, area_id_e area, int pcm_samplerate, uint32_t track_count = 1);
+
+    int get_channels() { return m_channels; }
+    unsigned int get_channel_map() { return m_channel_map; }
+    int get_dsd_samplerate() { return m_dsd_samplerate; }
+    int get_pcm_samplerate() { return m_pcm_samplerate; }
+    int get_framerate() { return m_framerate; }
+    int get_frame_size() { return m_frame_size; }
+    bool is_dst() { return m_reader && m_reader->is_dst(); }
+    float get_progress();
+    bool is_completed() { return m_completed; }
+
+    // Converts the next frame and returns its samples, which stay in the session until the next call.
+    // 0 at the end of the selection, -1 on errors.
+    int decode_pcm(float** pcm_data);
+
+    // Up to 'samples' interleaved float sample frames into pcm_data, returns the number stored, 0 at the end, -1 on errors
+    int read_pcm(float* pcm_data, int samples);
+
+    // Up to 'samples' bytes of every channel, interleaved byte by byte and MSB first (as in DSDIFF), into dsd_data.
+    // Returns the number of bytes per channel stored, 0 at the end, -1 on errors
+    int read_dsd(uint8_t* dsd_data, int samples);
+
+    // The next frame as the reader delivers it, DST frames are not decoded. frame_size is the size of frame_data on
+    // input (get_frame_size() + 1 holds any frame), the size of the frame on return. DSD output only.
+    bool read_frame(uint8_t* frame_data, size_t* frame_size, frame_type_e* frame_type);
+};
+
+#endif
@@ -20,52 +20,73 @@
 */
 
 #include <vector>
+#include <algorithm>
 #include <string>
 #include <cstring>
 #include <cmath>
 #include <thread>
+#include <atomic>
 #include <stdio.h>
 #include <locale>
 #include <getopt.h>
 #include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <dirent.h>
 #include <linux/limits.h>
 #include "libsacd/sacd_reader.h"
-#include "libsacd/sacd_disc.h"
-#include "libsacd/sacd_dsdiff.h"
-#include "libsacd/sacd_dsf.h"
+#include "libsacd/sacd_session.h"
+#include "libsacd/pcm_writer.h"
+#include "libsacd/dsd_writer.h"
 #include "libsacd/version.h"
 #include "libdsd2pcm/dsd_pcm_converter_hq.h"
 #include "libdsd2pcm/dsd_pcm_converter_engine.h"
 #include "libdstdec/dst_decoder_mt.h"
+#include "libdstdec/dst_encoder_mt.h"
 
 struct TrackInfo
 {
     int nTrack;
     area_id_e nArea;
+    int nCount;
+    int nInput;
+    double fCost;
+};
+
+struct InputInfo
+{
+    string strPath;
+    string strName;
+    string strOut;
 };
 
 int g_nCPUs = 2;
 int g_nThreads = 2;
 vector<TrackInfo> g_arrQueue;
+size_t g_nNextJob = 0;
+vector<InputInfo> g_arrInputs;
 pthread_mutex_t g_hMutex = PTHREAD_MUTEX_INITIALIZER;
 string g_strOut = "";
 int g_nSampleRate = 88200;
 bool g_bProgressLine = false;
-int g_nFinished = 0;
+atomic<int> g_nFinished(0);
 area_id_e g_nArea = AREA_MULCH;
-
-void packageInt(unsigned char * buf, int offset, int num, int bytes)
-{
-    buf[offset + 0] = (unsigned char)(num & 0xff);
-    buf[offset + 1] = (unsigned char)((num >> 8) & 0xff);
-
-    if (bytes == 4)
-    {
-        buf[offset + 2] = (unsigned char) ((num >> 0x10) & 0xff);
-        buf[offset + 3] = (unsigned char) ((num >> 0x18) & 0xff);
-    }
-}
+media_access_t g_nAccess = ACCESS_BUFFERED;
+pcm_format_t g_nFormat = PCM_S24;
+pcm_container_t g_nContainer = CONTAINER_WAV;
+bool g_bDsd = false;
+dsd_container_t g_nDsdContainer = DSD_CONTAINER_DSF;
+int g_nDstEffort = DST_EFFORT_DEFAULT;
+bool g_bAsync = false;
+int g_nTrack = -1;
+bool g_bGapless = false;
+bool g_bExact = false;
+int g_nPipeFd = -1;
+pcm_writer_t* g_pPipeWriter = nullptr;
+bool g_bPipeOpen = false;
+int g_nQueued = 0;
+atomic<int> g_nFailed(0);
 
 string toLower(const string& s)
 {
@@ -80,564 +101,700 @@ string toLower(const string& s)
     return result;
 }
 
+// Both paths name the same existing file (through links too)
+bool isSameFile(const string& strPath1, const string& strPath2)
+{
+    struct stat tStat1;
+    struct stat tStat2;
+
+    return stat(strPath1.c_str(), &tStat1) == 0 && stat(strPath2.c_str(), &tStat2) == 0 && tStat1.st_dev == tStat2.st_dev && tStat1.st_ino == tStat2.st_ino;
+}
+
+// Output side of a conversion job: the decoding is done by the session, this spreads its PCM over the track files
 class SACD
 {
 private:
 
-    sacd_media_t* m_pSacdMedia;
-    dst_decoder_t* m_pDstDecoder;
-    vector<uint8_t> m_arrDstBuf;
+    sacd_session_t m_cSession;
     vector<uint8_t> m_arrDsdBuf;
-    vector<float> m_arrPcmBuf;
-    int m_nDsdBufSize;
-    int m_nDstBufSize;
-    dsdpcm_converter_hq* m_pDsdPcmConverter480;
-    DSDPCMConverterEngine* m_pDsdPcmConverter441;
-    int m_nDsdSamplerate;
-    int m_nFramerate;
-    int m_nPcmOutSamples;
-    int m_nPcmOutDelta;
+    bool m_bSplit;
+    uint64_t m_nPcmOutPos;
+    float* m_pHeldData;
+    int m_nHeldSamples;
 
-    void dsd2pcm(uint8_t* dsd_data, int dsd_samples, float* pcm_data)
+    void writeData(pcm_writer_t* pWriter, float* pPcmData, int nSamples)
     {
+        m_nHeldSamples = 0;
 
-        if (m_pDsdPcmConverter480)
-        {
-            m_pDsdPcmConverter480->convert(dsd_data, dsd_samples, pcm_data);
-        }
-        else if (m_pDsdPcmConverter441)
+        // Stop at the first sample of the next track, its writer takes the rest through writeHeld()
+        if (m_bSplit && m_nTrackOut + 1 < (int)m_arrTrackStarts.size() && m_nPcmOutPos + nSamples > m_arrTrackStarts[m_nTrackOut + 1])
         {
-            m_pDsdPcmConverter441->convert(dsd_data, dsd_samples, pcm_data);
-        }
-    }
+            int nHead = (int)(m_arrTrackStarts[m_nTrackOut + 1] - MIN(m_nPcmOutPos, m_arrTrackStarts[m_nTrackOut + 1]));
 
-    void writeData(FILE * pFile, int nOffset, int nSamples)
-    {
-        int nFramesIn = nSamples * m_nPcmOutChannels;
-        int nBytesOut = nFramesIn * 3;
-        char * pSrc = (char*)(m_arrPcmBuf.data() + nOffset * m_nPcmOutChannels);
-        char * pDst = new char[nBytesOut];
-        float fSample;
-        int32_t nVal;
-        int nFrame;
-        int nOut = 0;
+            m_pHeldData = pPcmData + nHead * m_nPcmOutChannels;
+            m_nHeldSamples = nSamples - nHead;
+            nSamples = nHead;
+            m_nTrackOut++;
+        }
 
-        for (nFrame = 0; nFrame < nFramesIn; nFrame++, pSrc += 4)
+        if (nSamples > 0)
         {
-            fSample = *(float*)(pSrc);
-            fSample = MIN(fSample, 1.0);
-            fSample = MAX(fSample, -1.0);
-            fSample *= 8388608.0;
-
-            /*const float DITHER_NOISE = rand() / (float)RAND_MAX - 0.5f;
-            const float SHAPED_BS[] = { 2.033f, -2.165f, 1.959f, -1.590f, 0.6149f };
-            float mTriangleState = 0;
-            int mPhase = 0;
-            float mBuffer[8];
-            memset(mBuffer, 0, sizeof(float) * 8);*/
-
-            // 1 RectangleDither
-            /*fSample = fSample - DITHER_NOISE;*/
-
-            // 2 TriangleDither
-            /*float r = DITHER_NOISE;
-            float result = fSample + r - mTriangleState;
-            mTriangleState = r;
-            fSample = result;*/
-
-            // 3 ShapedDither
-            /*// Generate triangular dither, +-1 LSB, flat psd
-            float r = DITHER_NOISE + DITHER_NOISE;
-
-            // test for NaN and do the best we can with it
-            if(fSample != fSample)
-               fSample = 0;
-
-            // Run FIR
-            float xe = fSample + mBuffer[mPhase] * SHAPED_BS[0]
-                + mBuffer[(mPhase - 1) & 7] * SHAPED_BS[1]
-                + mBuffer[(mPhase - 2) & 7] * SHAPED_BS[2]
-                + mBuffer[(mPhase - 3) & 7] * SHAPED_BS[3]
-                + mBuffer[(mPhase - 4) & 7] * SHAPED_BS[4];
-
-            // Accumulate FIR and triangular noise
-            float result = xe + r;
-
-            // Roll buffer and store last error
-            mPhase = (mPhase + 1) & 7;
-            mBuffer[mPhase] = xe - lrintf(result);
-
-            fSample = result;*/
-
-            nVal = lrintf(fSample);
-            nVal = MIN(nVal, 8388607);
-            nVal = MAX(nVal, -8388608);
-
-            pDst[nOut++] = nVal;
-            pDst[nOut++] = nVal >> 8;
-            pDst[nOut++] = nVal >> 16;
+            pWriter->write(pPcmData, nSamples);
+            m_nPcmOutPos += nSamples;
         }
 
-        fwrite(pDst, 1, nBytesOut, pFile);
-        delete [] pDst;
-
-        m_fProgress = m_pSacdReader->getProgress();
+        m_fProgress = m_cSession.get_progress();
     }
 
 public:
 
     int m_nTracks;
-    float m_fProgress;
+    atomic<float> m_fProgress; // read by the progress thread
     int m_nPcmOutChannels;
     unsigned int m_nPcmOutChannelMap;
+    int m_nDsdSamplerate;
+    int m_nOutRate;
     sacd_reader_t* m_pSacdReader;
-    bool m_bTrackCompleted;
+    vector<uint64_t> m_arrTrackStarts;
+    string m_strPath;
+    int m_nTrackOut;
 
-    SACD()
+    SACD() : m_cSession(g_nCPUs)
     {
-        m_pSacdMedia = nullptr;
         m_pSacdReader = nullptr;
-        m_pDsdPcmConverter441 = nullptr;
-        m_pDsdPcmConverter480 = nullptr;
-        m_pDstDecoder = nullptr;
         m_fProgress = 0;
         m_nTracks = 0;
-        m_nPcmOutSamples = 0;
-        m_nPcmOutDelta = 0;
+        m_nPcmOutChannels = 0;
+        m_nPcmOutChannelMap = 0;
+        m_nDsdSamplerate = 0;
+        m_nOutRate = 0;
+        m_bSplit = false;
+        m_nPcmOutPos = 0;
+        m_pHeldData = nullptr;
+        m_nHeldSamples = 0;
+        m_nTrackOut = 0;
     }
 
-    ~SACD()
+    // Releases the input, the converters are replaced by the next init() anyway
+    void close()
     {
-        if (m_pSacdReader)
-        {
-            delete m_pSacdReader;
-        }
+        m_cSession.close();
+        m_pSacdReader = nullptr;
+        m_strPath.clear();
+        m_nTracks = 0;
+    }
+
+    int open(string p_path, media_access_t nAccess = ACCESS_BUFFERED)
+    {
+        m_strPath = p_path;
+        m_nTracks = m_cSession.open(p_path, nAccess);
+        m_pSacdReader = m_cSession.get_reader();
 
-        if (m_pSacdMedia)
+        if (m_nTracks == 0)
         {
-            delete m_pSacdMedia;
+            printf("PANIC: %s\n", m_cSession.get_error().data());
         }
 
-        if (m_pDsdPcmConverter441)
+        return m_nTracks;
+    }
+
+    // nTracks > 1 converts that many tracks as one stream, bSplit cuts it at the track starts (see writeData()).
+    // A samplerate of 0 selects DSD output, its positions count bytes per channel
+    bool init(uint32_t nSubsong, int g_nSampleRate, area_id_e nArea, int nTracks = 1, bool bSplit = false)
+    {
+        if (!m_cSession.select_track(nSubsong, nArea, g_nSampleRate, nTracks))
         {
-            delete m_pDsdPcmConverter441;
+            printf("PANIC: %s\n", m_cSession.get_error().data());
+            return false;
         }
-        else if (m_pDsdPcmConverter480)
+
+        m_nPcmOutChannels = m_cSession.get_channels();
+        m_nPcmOutChannelMap = m_cSession.get_channel_map();
+        m_nDsdSamplerate = m_cSession.get_dsd_samplerate();
+        m_nOutRate = g_nSampleRate ? g_nSampleRate : m_nDsdSamplerate / 8;
+        m_arrDsdBuf.resize(g_nSampleRate ? 0 : m_cSession.get_frame_size() + 1);
+
+        // Output sample position of every track in the range
+        m_arrTrackStarts.clear();
+        m_nTrackOut = 0;
+        m_nPcmOutPos = 0;
+        m_nHeldSamples = 0;
+        m_bSplit = bSplit;
+
+        TrackDetails cFirst;
+        m_pSacdReader->getTrackDetails(nSubsong, nArea, &cFirst);
+
+        for (int i = 0; i < nTracks; i++)
         {
-            delete m_pDsdPcmConverter480;
+            TrackDetails cTrackDetails;
+            m_pSacdReader->getTrackDetails(nSubsong + i, nArea, &cTrackDetails);
+            m_arrTrackStarts.push_back((uint64_t)MAX(llround((cTrackDetails.fStart - cFirst.fStart) * m_nOutRate), 0LL));
         }
 
-        if (m_pDstDecoder)
+        return true;
+    }
+
+    // Converts the next frame, true at the end of the job
+    bool decode(pcm_writer_t* pWriter)
+    {
+        float* pPcmData;
+        int nSamples = m_cSession.decode_pcm(&pPcmData);
+
+        if (nSamples > 0)
         {
-            delete m_pDstDecoder;
+            writeData(pWriter, pPcmData, nSamples);
         }
+
+        return nSamples <= 0 || m_cSession.is_completed();
     }
 
-    int open(string p_path)
+    // Copies the next frame of DSD, true at the end of the job
+    bool decodeDsd(dsd_writer_t* pWriter)
     {
-        string ext = toLower(p_path.substr(p_path.length()-3, 3));
-        media_type_t tMediaType = UNK_TYPE;
+        int nSamples = m_cSession.read_dsd(m_arrDsdBuf.data(), m_cSession.get_frame_size() / m_nPcmOutChannels);
 
-        if (ext == "iso")
+        if (nSamples > 0)
         {
-            tMediaType = ISO_TYPE;
+            pWriter->write(m_arrDsdBuf.data(), nSamples);
         }
-        else if (ext == "dat")
+
+        m_fProgress = m_cSession.get_progress();
+
+        return nSamples <= 0;
+    }
+
+    // Copies the next frame without decoding it, true at the end of the job
+    bool remuxFrame(dsd_writer_t* pWriter)
+    {
+        size_t nSize = m_arrDsdBuf.size();
+        frame_type_e nFrameType;
+
+        if (!m_cSession.read_frame(m_arrDsdBuf.data(), &nSize, &nFrameType))
         {
-            tMediaType = ISO_TYPE;
+            return true;
         }
-        else if (ext == "dff")
+
+        m_fProgress = m_cSession.get_progress();
+
+        if (nFrameType == FRAME_DST)
         {
-            tMediaType = DSDIFF_TYPE;
+            pWriter->write_frame(m_arrDsdBuf.data(), nSize);
         }
-        else if (ext == "dsf")
+        else
         {
-            tMediaType = DSF_TYPE;
-        }
+            // A sector that could not be read becomes a silent frame, stored uncompressed
+            if (nFrameType == FRAME_INVALID)
+            {
+                nSize = m_cSession.get_frame_size();
+                memset(m_arrDsdBuf.data(), DSD_SILENCE_BYTE, nSize);
+            }
 
-        if (tMediaType == UNK_TYPE)
-        {
-            printf("PANIC: exception_io_unsupported_format\n");
-            return 0;
+            pWriter->write_dsd_frame(m_arrDsdBuf.data(), nSize);
         }
 
-        m_pSacdMedia = new sacd_media_t();
+        return false;
+    }
 
-        if (!m_pSacdMedia)
-        {
-            printf("PANIC: exception_overflow\n");
-            return 0;
-        }
+    // DST encodes the next frame of DSD, true at the end of the job once the encoder threads have returned every frame
+    bool encodeFrame(dsd_writer_t* pWriter, dst_encoder_t* pEncoder)
+    {
+        size_t nFrameSize = m_nDsdSamplerate / 8 / 75;
+        uint8_t* pDstData;
+        size_t nDstSize;
 
-        switch (tMediaType)
+        if (m_arrDsdBuf.size() < nFrameSize * m_nPcmOutChannels)
         {
-            case ISO_TYPE:
-                m_pSacdReader = new sacd_disc_t;
-                if (!m_pSacdReader)
-                {
-                    printf("PANIC: exception_overflow\n");
-                    return 0;
-                }
-                break;
-            case DSDIFF_TYPE:
-                m_pSacdReader = new sacd_dsdiff_t;
-                if (!m_pSacdReader)
-                {
-                    printf("PANIC: exception_overflow\n");
-                    return 0;
-                }
-                break;
-            case DSF_TYPE:
-                m_pSacdReader = new sacd_dsf_t;
-                if (!m_pSacdReader)
-                {
-                    printf("PANIC: exception_overflow\n");
-                    return 0;
-                }
-                break;
-            default:
-                printf("PANIC: exception_io_data\n");
-                return 0;
-                break;
+            m_arrDsdBuf.resize(nFrameSize * m_nPcmOutChannels);
         }
 
-        if (!m_pSacdMedia->open(p_path.c_str()))
+        int nSamples = m_cSession.read_dsd(m_arrDsdBuf.data(), nFrameSize);
+
+        m_fProgress = m_cSession.get_progress();
+
+        if (nSamples > 0)
         {
-            printf("PANIC: exception_io_data\n");
-            return 0;
+            pEncoder->encode(m_arrDsdBuf.data(), (size_t)nSamples * m_nPcmOutChannels, &pDstData, &nDstSize);
+
+            if (nDstSize > 0)
+            {
+                pWriter->write_frame(pDstData, nDstSize);
+            }
+
+            return false;
         }
 
-        if ((m_nTracks = m_pSacdReader->open(m_pSacdMedia)) == 0)
+        for (int i = 0; i < pEncoder->get_thread_count(); i++)
         {
-            printf("PANIC: Failed to parse SACD media\n");
-            return 0;
+            pEncoder->encode(nullptr, 0, &pDstData, &nDstSize);
+
+            if (nDstSize > 0)
+            {
+                pWriter->write_frame(pDstData, nDstSize);
+            }
         }
 
-        return m_nTracks;
+        return true;
     }
 
-    string init(uint32_t nSubsong, int g_nSampleRate, area_id_e nArea)
+    bool isDst()
     {
-        if (m_pDsdPcmConverter441)
-        {
-            delete m_pDsdPcmConverter441;
-            m_pDsdPcmConverter441 = nullptr;
-        }
-        else if (m_pDsdPcmConverter480)
-        {
-            delete m_pDsdPcmConverter480;
-            m_pDsdPcmConverter480 = nullptr;
-        }
+        return m_cSession.is_dst();
+    }
 
-        if (m_pDstDecoder)
+    // Remainder of the last frame after writeData() stopped at a track start
+    void writeHeld(pcm_writer_t* pWriter)
+    {
+        if (m_nHeldSamples > 0)
         {
-            delete m_pDstDecoder;
-            m_pDstDecoder = nullptr;
+            writeData(pWriter, m_pHeldData, m_nHeldSamples);
         }
+    }
+};
+
+void * fnProgress (void* threadargs)
+{
+    vector<SACD*>* arrSACD = (vector<SACD*>*)threadargs;
 
-        string strFileName = m_pSacdReader->set_track(nSubsong, nArea, 0);
-        m_nDsdSamplerate = m_pSacdReader->get_samplerate();
-        m_nFramerate = m_pSacdReader->get_framerate();
-        m_nPcmOutSamples = g_nSampleRate / m_nFramerate;
-        m_nPcmOutChannels = m_pSacdReader->get_channels();
+    while(1)
+    {
+        float fProgress = 0;
+        int nTracks = g_nQueued;
+        size_t nWaiting;
 
-        switch (m_nPcmOutChannels)
+        for (int i = 0; i < g_nThreads; i++)
         {
-            case 1:
-                m_nPcmOutChannelMap = 1<<2;
-                break;
-            case 2:
-                m_nPcmOutChannelMap = 1<<0 | 1<<1;
-                break;
-            case 3:
-                m_nPcmOutChannelMap = 1<<0 | 1<<1 | 1<<2;
-                break;
-            case 4:
-                m_nPcmOutChannelMap = 1<<0 | 1<<1 | 1<<4 | 1<<5;
-                break;
-            case 5:
-                m_nPcmOutChannelMap = 1<<0 | 1<<1 | 1<<2 | 1<<4 | 1<<5;
-                break;
-            case 6:
-                m_nPcmOutChannelMap = 1<<0 | 1<<1 | 1<<2 | 1<<3 | 1<<4 | 1<<5;
-                break;
-            default:
-                m_nPcmOutChannelMap = 0;
-                break;
+            fProgress += (*arrSACD).at(i)->m_fProgress;
         }
 
-        m_nDstBufSize = m_nDsdBufSize = m_nDsdSamplerate / 8 / m_nFramerate * m_nPcmOutChannels;
-        m_arrDsdBuf.resize(m_nDsdBufSize * g_nCPUs);
-        m_arrDstBuf.resize(m_nDstBufSize * g_nCPUs);
-        m_arrPcmBuf.resize(m_nPcmOutChannels * m_nPcmOutSamples);
+        // The workers take jobs under the lock
+        pthread_mutex_lock(&g_hMutex);
+        nWaiting = g_arrQueue.size() - MIN(g_nNextJob, g_arrQueue.size());
+        pthread_mutex_unlock(&g_hMutex);
+
+        fProgress = MAX(((((float)nTracks - (float)MIN(g_nThreads, nTracks) - (float)nWaiting) * 100.0) + fProgress) / (float)nTracks, 0);
 
-        if (g_nSampleRate == 96000 or g_nSampleRate == 192000)
+        if (g_bProgressLine)
         {
-            m_pDsdPcmConverter480 = new dsdpcm_converter_hq();
-            m_pDsdPcmConverter480->init(m_nPcmOutChannels, m_nDsdSamplerate, g_nSampleRate);
+            printf("PROGRESS\t%.2f\n", fProgress);
         }
         else
         {
-            m_pDsdPcmConverter441 = new DSDPCMConverterEngine();
-            m_pDsdPcmConverter441->init(m_nPcmOutChannels, m_nFramerate, m_nDsdSamplerate, g_nSampleRate);
+            printf("\r%.2f%%", fProgress);
         }
 
-        float fPcmOutDelay = 0.0f;
+        fflush(stdout);
 
-        if (m_pDsdPcmConverter480)
+        if (g_nFinished == nTracks)
         {
-            fPcmOutDelay = m_pDsdPcmConverter480->get_delay();
+            break;
         }
-        else
+
+        sleep(1);
+    }
+
+    return 0;
+}
+
+// Relative conversion time of a job: length times channels, DST frames have to be decoded first
+double getCost(SACD* pSACD, const TrackInfo& cTrackInfo)
+{
+    double fCost = 0.0;
+
+    for (int i = 0; i < cTrackInfo.nCount; i++)
+    {
+        TrackDetails cTrackDetails;
+
+        pSACD->m_pSacdReader->getTrackDetails(cTrackInfo.nTrack + i, cTrackInfo.nArea, &cTrackDetails);
+        fCost += cTrackDetails.fDuration * cTrackDetails.nChannels * (cTrackDetails.bDst ? 2.0 : 1.0);
+    }
+
+    return fCost;
+}
+
+bool compareCost(const TrackInfo& a, const TrackInfo& b)
+{
+    return a.fCost > b.fCost;
+}
+
+// Hands out the queued jobs in order, the queue itself is never changed once the threads run
+bool nextJob(TrackInfo& cTrackInfo)
+{
+    bool bFound = false;
+
+    pthread_mutex_lock(&g_hMutex);
+
+    if (g_nNextJob < g_arrQueue.size())
+    {
+        cTrackInfo = g_arrQueue[g_nNextJob++];
+        bFound = true;
+    }
+
+    pthread_mutex_unlock(&g_hMutex);
+
+    return bFound;
+}
+
+// mm:ss:ff, 75 frames per second
+string toCueTime(uint64_t nSamples, int nRate)
+{
+    char buf[32];
+    uint64_t nFrames = nSamples * 75 / nRate;
+
+    sprintf(buf, "%.2i:%.2i:%.2i", (int)(nFrames / 75 / 60), (int)(nFrames / 75 % 60), (int)(nFrames % 75));
+
+    return buf;
+}
+
+bool writeCueSheet(SACD* pSACD, const TrackInfo& cTrackInfo, const string& strAudioFile)
+{
+    string strCueFile = strAudioFile.substr(0, strAudioFile.find_last_of(".")) + ".cue";
+    FILE* pFile = fopen(strCueFile.data(), "w");
+
+    if (!pFile)
+    {
+        printf("PANIC: Failed to create %s\n", strCueFile.data());
+        return false;
+    }
+
+    // Players take WAVE for any decodable audio file, BINARY is headerless little endian data
+    fprintf(pFile, "FILE \"%s\" %s\n", strAudioFile.substr(strAudioFile.find_last_of("/") + 1).data(), g_nContainer == CONTAINER_RAW && !g_bDsd ? "BINARY" : "WAVE");
+
+    for (int i = 0; i < cTrackInfo.nCount; i++)
+    {
+        TrackDetails cTrackDetails;
+
+        pSACD->m_pSacdReader->getTrackDetails(cTrackInfo.nTrack + i, cTrackInfo.nArea, &cTrackDetails);
+        fprintf(pFile, "  TRACK %.2i AUDIO\n", cTrackInfo.nTrack + i + 1);
+
+        if (!cTrackDetails.strTitle.empty())
         {
-            fPcmOutDelay = m_pDsdPcmConverter441->get_delay();
+            fprintf(pFile, "    TITLE \"%s\"\n", cTrackDetails.strTitle.data());
         }
 
-        m_nPcmOutDelta = (int)(fPcmOutDelay - 0.5f);//  + 0.5f originally
-
-        if (m_nPcmOutDelta > m_nPcmOutSamples - 1)
+        if (!cTrackDetails.strArtist.empty())
         {
-            m_nPcmOutDelta = m_nPcmOutSamples - 1;
+            fprintf(pFile, "    PERFORMER \"%s\"\n", cTrackDetails.strArtist.data());
         }
 
-        m_bTrackCompleted = false;
+        fprintf(pFile, "    INDEX 01 %s\n", toCueTime(pSACD->m_arrTrackStarts[i], pSACD->m_nOutRate).data());
+    }
+
+    return fclose(pFile) == 0;
+}
+
+string getOutFile(SACD* pSACD, const TrackInfo& cTrackInfo, int nIndex, const string& strExtension)
+{
+    string strOutFile;
+
+    if (g_bGapless)
+    {
+        char buf[32];
+
+        sprintf(buf, "(%ich) ", pSACD->m_nPcmOutChannels);
+        strOutFile = g_arrInputs[cTrackInfo.nInput].strOut + buf + g_arrInputs[cTrackInfo.nInput].strName + strExtension;
+    }
+    else
+    {
+        // Readers name their tracks *.wav
+        sacd_reader_t* pReader = pSACD->m_pSacdReader;
+        int nTrack = cTrackInfo.nTrack + nIndex;
+        string strName = pReader->get_track_name(nTrack, cTrackInfo.nArea);
+
+        // The tracks of a DSDIFF file with several markers all carry the name of the file, numbered they do not
+        // overwrite each other
+        if (pReader->get_track_count(cTrackInfo.nArea) > 1 && strName == pReader->get_track_name(nTrack == 0 ? 1 : 0, cTrackInfo.nArea))
+        {
+            char buf[16];
+
+            sprintf(buf, "%.2i. ", nTrack + 1);
+            strName = buf + strName;
+        }
 
-        return strFileName;
+        strOutFile = g_arrInputs[cTrackInfo.nInput].strOut + strName;
+        strOutFile = strOutFile.substr(0, strOutFile.find_last_of(".")) + strExtension;
     }
 
-    void fixPcmStream(bool bIsEnd, float* pPcmData, int nPcmSamples)
+    return strOutFile;
+}
+
+// Output of track nIndex of the job, or of all its tracks when they go into one gapless file or the pipe
+pcm_writer_t* openWriter(SACD* pSACD, const TrackInfo& cTrackInfo, int nIndex, string& strOutFile)
+{
+    pcm_writer_t* pWriter = g_pPipeWriter;
+
+    if (pWriter)
     {
-        if (!bIsEnd)
+        // All queued tracks go back to back into the one stream, which takes the format of the first
+        strOutFile = "pipe";
+
+        if (!g_bPipeOpen && !(g_bPipeOpen = pWriter->open_fd(g_nPipeFd, pSACD->m_nPcmOutChannels, g_nSampleRate, pSACD->m_nPcmOutChannelMap)))
         {
-            if (nPcmSamples > 1)
-            {
-                for (int ch = 0; ch < m_nPcmOutChannels; ch++)
-                {
-                    pPcmData[0 * m_nPcmOutChannels + ch] = pPcmData[1 * m_nPcmOutChannels + ch];
-                }
-            }
+            printf("PANIC: Failed to create %s\n", strOutFile.data());
+            g_nFailed++;
+            return nullptr;
         }
-        else
+
+        return pWriter;
+    }
+
+    int nCount = g_bGapless ? cTrackInfo.nCount : 1;
+    double fDuration = 0.0;
+
+    for (int i = nIndex; i < nIndex + nCount; i++)
+    {
+        TrackDetails cTrackDetails;
+
+        pSACD->m_pSacdReader->getTrackDetails(cTrackInfo.nTrack + i, cTrackInfo.nArea, &cTrackDetails);
+        fDuration += cTrackDetails.fDuration;
+    }
+
+    pWriter = pcm_writer_t::create(g_nFormat, g_nContainer, g_bAsync, MAX(g_nCPUs / g_nThreads, 1));
+    strOutFile = getOutFile(pSACD, cTrackInfo, nIndex, pWriter->get_extension());
+
+    if (!pWriter->open(strOutFile, pSACD->m_nPcmOutChannels, g_nSampleRate, pSACD->m_nPcmOutChannelMap, (uint64_t)(fDuration * g_nSampleRate)))
+    {
+        printf("PANIC: Failed to create %s\n", strOutFile.data());
+        g_nFailed++;
+        delete pWriter;
+        return nullptr;
+    }
+
+    return pWriter;
+}
+
+void closeWriter(SACD* pSACD, const TrackInfo& cTrackInfo, int nIndex, pcm_writer_t* pWriter, const string& strOutFile)
+{
+    if (pWriter != g_pPipeWriter)
+    {
+        delete pWriter;
+
+        if (g_bGapless)
         {
-            if (nPcmSamples > 1)
-            {
-                for (int ch = 0; ch < m_nPcmOutChannels; ch++)
-                {
-                    pPcmData[(nPcmSamples - 1) * m_nPcmOutChannels + ch] = pPcmData[(nPcmSamples - 2) * m_nPcmOutChannels + ch];
-                }
-            }
+            writeCueSheet(pSACD, cTrackInfo, strOutFile);
         }
     }
 
-    bool decode(FILE* pFile)
+    if (g_bProgressLine)
+    {
+        printf("FILE\t%s\t%.2i\t%.2i\n", strOutFile.data(), cTrackInfo.nTrack + nIndex + 1, pSACD->m_nTracks);
+    }
+}
+
+// The DSD of the job goes into a single file, tracks end on frame boundaries so no split is needed. DST audio is
+// decoded, unless it is copied into a DST container; other input written to a DST container is DST encoded.
+void convertDsd(SACD* pSACD, const TrackInfo& cTrackInfo)
+{
+    bool bRemux = g_nDsdContainer == DSD_CONTAINER_DST && pSACD->isDst();
+    dst_encoder_t* pEncoder = nullptr;
+
+    if (g_nDsdContainer == DSD_CONTAINER_DST && !bRemux)
     {
-        if (m_bTrackCompleted)
+        pEncoder = new dst_encoder_t(MAX(g_nCPUs / g_nThreads, 1));
+
+        if (pEncoder->init(pSACD->m_nPcmOutChannels, pSACD->m_nDsdSamplerate, 75, g_nDstEffort) != 0)
         {
-            return true;
+            printf("PANIC: exception_io_unsupported_format\n");
+            g_nFailed++;
+            delete pEncoder;
+            return;
         }
+    }
 
-        uint8_t* pDsdData;
-        uint8_t* pDstData;
-        size_t nDsdSize = 0;
-        size_t nDstSize = 0;
-        int nThread = 0;
+    dsd_writer_t cWriter(g_nDsdContainer);
+    string strOutFile = getOutFile(pSACD, cTrackInfo, 0, cWriter.get_extension());
 
-        while (1)
+    // A DSF or DSDIFF track written next to itself gets the name of the input, opening it would truncate the source
+    if (isSameFile(strOutFile, g_arrInputs[cTrackInfo.nInput].strPath))
+    {
+        printf("PANIC: %s would overwrite the input, choose another output folder with -o\n", strOutFile.data());
+        g_nFailed++;
+        delete pEncoder;
+        return;
+    }
+
+    if (!cWriter.open(strOutFile, pSACD->m_nPcmOutChannels, pSACD->m_nDsdSamplerate, pSACD->m_nPcmOutChannelMap))
+    {
+        printf("PANIC: Failed to create %s\n", strOutFile.data());
+        g_nFailed++;
+        delete pEncoder;
+        return;
+    }
+
+    // A DSDIFF file with several tracks marks where each of them starts
+    for (int i = 0; cTrackInfo.nCount > 1 && i < cTrackInfo.nCount; i++)
+    {
+        cWriter.add_marker(pSACD->m_arrTrackStarts[i] * 8);
+    }
+
+    while (!(bRemux ? pSACD->remuxFrame(&cWriter) : pEncoder ? pSACD->encodeFrame(&cWriter, pEncoder) : pSACD->decodeDsd(&cWriter)) && !cWriter.failed())
+    {
+    }
+
+    delete pEncoder;
+
+    if (!cWriter.close())
+    {
+        printf("PANIC: Failed to write %s\n", strOutFile.data());
+        g_nFailed++;
+    }
+
+    if (g_bGapless)
+    {
+        writeCueSheet(pSACD, cTrackInfo, strOutFile);
+    }
+
+    if (g_bProgressLine)
+    {
+        printf("FILE\t%s\t%.2i\t%.2i\n", strOutFile.data(), cTrackInfo.nTrack + 1, pSACD->m_nTracks);
+    }
+}
+
+void * fnDecoder (void* threadargs)
+{
+    SACD* pSACD = (SACD*)threadargs;
+
+    TrackInfo cTrackInfo;
+
+    while (nextJob(cTrackInfo))
+    {
+        if (pSACD->m_strPath != g_arrInputs[cTrackInfo.nInput].strPath)
         {
-            nThread = m_pDstDecoder ? m_pDstDecoder->slot_nr : 0;
-            pDsdData = m_arrDsdBuf.data() + m_nDsdBufSize * nThread;
-            pDstData = m_arrDstBuf.data() + m_nDstBufSize * nThread;
-            nDstSize = m_nDstBufSize;
-            frame_type_e nFrameType;
+            pSACD->close();
 
-            if (m_pSacdReader->read_frame(pDstData, &nDstSize, &nFrameType))
-            {
-                if (nDstSize > 0)
-                {
-                    if (nFrameType == FRAME_INVALID)
-                    {
-                        nDstSize = m_nDstBufSize;
-                        memset(pDstData, DSD_SILENCE_BYTE, nDstSize);
-                    }
-
-                    if (nFrameType == FRAME_DST)
-                    {
-                        if (!m_pDstDecoder)
-                        {
-                            m_pDstDecoder = new dst_decoder_t(g_nCPUs);
-
-                            if (!m_pDstDecoder || m_pDstDecoder->init(m_nPcmOutChannels, m_nDsdSamplerate, m_nFramerate) != 0)
-                            {
-                                return true;
-                            }
-                        }
-
-                        m_pDstDecoder->decode(pDstData, nDstSize, &pDsdData, &nDsdSize);
-                    }
-                    else
-                    {
-                        pDsdData = pDstData;
-                        nDsdSize = nDstSize;
-                    }
-
-                    if (nDsdSize > 0)
-                    {
-                        int nRemoveSamples = 0;
-
-                        if ((m_pDsdPcmConverter480 && !m_pDsdPcmConverter480->is_convert_called()) || (m_pDsdPcmConverter441 && !m_pDsdPcmConverter441->is_convert_called()))
-                        {
-                            nRemoveSamples = m_nPcmOutDelta;
-                        }
-
-                        dsd2pcm(pDsdData, nDsdSize, m_arrPcmBuf.data());
-
-                        if (nRemoveSamples > 0)
-                        {
-                            fixPcmStream(false, m_arrPcmBuf.data() + m_nPcmOutChannels * nRemoveSamples, m_nPcmOutSamples - nRemoveSamples);
-                        }
-
-                        writeData(pFile, nRemoveSamples, m_nPcmOutSamples - nRemoveSamples);
-
-                        return false;
-                    }
-                }
-            }
-            else
+            if (!pSACD->open(g_arrInputs[cTrackInfo.nInput].strPath, g_nAccess))
             {
-                break;
+                pSACD->close();
+                g_nFailed++;
+                g_nFinished++;
+                continue;
             }
         }
 
-        pDsdData = nullptr;
-        pDstData = nullptr;
-        nDstSize = 0;
+        if (!pSACD->init(cTrackInfo.nTrack, g_bDsd ? 0 : g_nSampleRate, cTrackInfo.nArea, cTrackInfo.nCount, g_bExact && !g_bGapless && !g_pPipeWriter))
+        {
+            g_nFailed++;
+            g_nFinished++;
+            continue;
+        }
 
-        if (m_pDstDecoder)
+        if (g_bDsd)
         {
-            m_pDstDecoder->decode(pDstData, nDstSize, &pDsdData, &nDsdSize);
+            convertDsd(pSACD, cTrackInfo);
+            g_nFinished++;
+            continue;
         }
 
-        if (nDsdSize > 0)
+        string strOutFile;
+        int nIndex = 0;
+        bool bDone = false;
+        pcm_writer_t* pWriter = openWriter(pSACD, cTrackInfo, nIndex, strOutFile);
+
+        // A failed write (full disk, closed pipe) ends the track
+        while (pWriter && !bDone && !pWriter->failed())
         {
-            dsd2pcm(pDsdData, nDsdSize, m_arrPcmBuf.data());
-            writeData(pFile, 0, m_nPcmOutSamples);
+            bDone = pSACD->decode(pWriter);
 
-            return false;
+            // The stream of an exact split crossed into the next track, which takes the rest of the decoded frame
+            while (pWriter && pSACD->m_nTrackOut != nIndex)
+            {
+                closeWriter(pSACD, cTrackInfo, nIndex, pWriter, strOutFile);
+
+                if ((pWriter = openWriter(pSACD, cTrackInfo, ++nIndex, strOutFile)))
+                {
+                    pSACD->writeHeld(pWriter);
+                }
+            }
         }
 
-        if (m_nPcmOutDelta > 0)
+        if (pWriter)
         {
-            dsd2pcm(nullptr, 0, m_arrPcmBuf.data());
-            fixPcmStream(true, m_arrPcmBuf.data(), m_nPcmOutDelta);
-            writeData(pFile, 0, m_nPcmOutDelta);
+            closeWriter(pSACD, cTrackInfo, nIndex, pWriter, strOutFile);
         }
 
-        m_bTrackCompleted = true;
-
-        return true;
+        g_nFinished++;
     }
-};
 
-void * fnProgress (void* threadargs)
+    return 0;
+}
+
+// Every file in the tree below strDir that can be converted, in name order per folder
+void findInputs(const string& strDir, vector<string>& arrFiles)
 {
-    vector<SACD*>* arrSACD = (vector<SACD*>*)threadargs;
+    DIR* pDir = opendir(strDir.data());
 
-    while(1)
+    if (!pDir)
     {
-        float fProgress = 0;
-        int nTracks = (*arrSACD).at(0)->m_nTracks;
+        return;
+    }
 
-        for (int i = 0; i < g_nThreads; i++)
+    vector<string> arrNames;
+    struct dirent* pEntry;
+
+    while ((pEntry = readdir(pDir)) != NULL)
+    {
+        if (pEntry->d_name[0] != '.')
         {
-            fProgress += (*arrSACD).at(i)->m_fProgress;
+            arrNames.push_back(pEntry->d_name);
         }
+    }
 
-        fProgress = MAX(((((float)nTracks - (float)MIN(g_nThreads, nTracks) - (float)g_arrQueue.size()) * 100.0) + fProgress) / (float)nTracks, 0);
+    closedir(pDir);
+    sort(arrNames.begin(), arrNames.end());
 
-        if (g_bProgressLine)
+    for (size_t i = 0; i < arrNames.size(); i++)
+    {
+        string strPath = strDir + (strDir[strDir.size() - 1] == '/' ? "" : "/") + arrNames[i];
+        string ext = toLower(strPath.substr(strPath.size() - MIN(strPath.size(), 4)));
+        struct stat tStat;
+
+        if (stat(strPath.c_str(), &tStat) == -1)
         {
-            printf("PROGRESS\t%.2f\n", fProgress);
+            continue;
         }
-        else
+
+        if (S_ISDIR(tStat.st_mode))
         {
-            printf("\r%.2f%%", fProgress);
+            findInputs(strPath, arrFiles);
         }
-
-        fflush(stdout);
-
-        if (g_nFinished == nTracks)
+        else if (S_ISREG(tStat.st_mode) && (ext == ".iso" || ext == ".dsf" || ext == ".dff"))
         {
-            break;
+            arrFiles.push_back(strPath);
         }
-
-        sleep(1);
-    }
-
-    return 0;
+    }
 }
 
-void * fnDecoder (void* threadargs)
+bool readInputList(const string& strList, vector<string>& arrIn)
 {
-    SACD* pSACD = (SACD*)threadargs;
+    FILE* pFile = strList == "-" ? stdin : fopen(strList.data(), "r");
 
-    while(!g_arrQueue.empty())
+    if (!pFile)
     {
-        pthread_mutex_lock(&g_hMutex);
-
-        TrackInfo cTrackInfo = g_arrQueue.front();
-        g_arrQueue.erase(g_arrQueue.begin());
-
-        pthread_mutex_unlock(&g_hMutex);
+        return false;
+    }
 
-        string strOutFile = g_strOut + pSACD->init(cTrackInfo.nTrack, g_nSampleRate, cTrackInfo.nArea);
-        unsigned int nSize = 0x7fffffff;
-        unsigned char arrHeader[68];
-        unsigned char arrFormat[2] = {0xFE, 0xFF};
-        unsigned char arrSubtype[16] = {0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71};
-
-        memcpy (arrHeader, "RIFF", 4);
-        packageInt (arrHeader, 4, nSize - 8, 4);
-        memcpy (arrHeader + 8, "WAVE", 4);
-        memcpy (arrHeader + 12, "fmt ", 4);
-        packageInt (arrHeader, 16, 40, 4);
-        memcpy (arrHeader + 20, arrFormat, 2);
-        packageInt (arrHeader, 22, pSACD->m_nPcmOutChannels, 2);
-        packageInt (arrHeader, 24, g_nSampleRate, 4);
-        packageInt (arrHeader, 28, (g_nSampleRate * 24 * pSACD->m_nPcmOutChannels) / 8, 4);
-        packageInt (arrHeader, 32, pSACD->m_nPcmOutChannels * 3, 2);
-        packageInt (arrHeader, 34, 24, 2);
-        packageInt (arrHeader, 36, 22, 2);
-        packageInt (arrHeader, 38, 24, 2);
-        packageInt (arrHeader, 40, pSACD->m_nPcmOutChannelMap, 4);
-        memcpy (arrHeader + 44, arrSubtype, 16);
-        memcpy (arrHeader + 60, "data", 4);
-        packageInt (arrHeader, 64, nSize - 68, 4);
-        FILE * pFile = fopen(strOutFile.data(), "wb");
-        fwrite(arrHeader, 1, 68, pFile);
+    char buf[PATH_MAX + 2];
 
-        bool bDone = false;
+    while (fgets(buf, sizeof(buf), pFile))
+    {
+        string s = buf;
 
-        while (!bDone || !pSACD->m_bTrackCompleted)
+        while (!s.empty() && (s[s.size() - 1] == '\n' || s[s.size() - 1] == '\r'))
         {
-            bDone = pSACD->decode(pFile);
+            s.erase(s.size() - 1);
         }
 
-        nSize = ftell (pFile);
-        packageInt (arrHeader, 4, nSize - 8, 4);
-        packageInt (arrHeader, 64, nSize - 68, 4);
-        fseek (pFile, 0, SEEK_SET);
-        fwrite (arrHeader, 1, 68, pFile);
-        fclose(pFile);
-
-        if (g_bProgressLine)
+        if (!s.empty())
         {
-            printf("FILE\t%s\t%.2i\t%.2i\n", strOutFile.data(), cTrackInfo.nTrack + 1, pSACD->m_nTracks);
+            arrIn.push_back(s);
         }
+    }
 
-        g_nFinished++;
+    if (pFile != stdin)
+    {
+        fclose(pFile);
     }
 
-    return 0;
+    return true;
 }
 
 int main(int argc, char* argv[])
@@ -654,7 +811,7 @@ int main(int argc, char* argv[])
         g_nCPUs = nCPUs;
     }
 
-    string strIn = "";
+    vector<string> arrIn;
     char strPath[PATH_MAX];
     int nOpt;
     bool bPrintDetails = false;
@@ -662,16 +819,56 @@ int main(int argc, char* argv[])
 
     const char strHelpText[] =
     "\n"
-    "Usage: sacd -i infile [-o outdir] [options]\n\n"
-    "  -i, --infile         : Specify the input file (*.iso, *.dsf, *.dff)\n"
+    "Usage: sacd -i infile [-i infile ...] [-o outdir] [options]\n\n"
+    "  -i, --infile         : Specify the input file (*.iso, *.dsf, *.dff). DSF and DSDIFF\n"
+    "                         input can also be streamed from a pipe, use - for stdin.\n"
+    "                         Repeat it to convert several files in one run, the\n"
+    "                         tracks of all of them share the threads. A folder\n"
+    "                         stands for all *.iso, *.dsf and *.dff files in it\n"
+    "                         and its subfolders.\n"
+    "  -l, --list           : Read more input files from this list, one per line\n"
+    "                         (- for stdin).\n"
     "  -o, --outdir         : The folder to write the WAVE files to. If you omit\n"
     "                         this, the files will be placed in the input file's\n"
-    "                         directory\n"
+    "                         directory. The tracks of a DSDIFF file with several\n"
+    "                         track markers are written as \"NN. <file name>\".\n"
     "  -r, --rate           : The output samplerate.\n"
     "                         Valid rates are: 88200, 96000, 176400 and 192000.\n"
     "                         If you omit this, 88.2KHz will be used.\n"
     "  -s, --stereo         : Only extract the 2-channel area if it exists.\n"
     "                         If you omit this, the multichannel area will have priority.\n"
+    "  -f, --format         : The output sample format: s16, s24, s32 (integer) or\n"
+    "                         f32, f64 (floating point, not clipped). The samples\n"
+    "                         are 32-bit floats internally, f64 only widens them\n"
+    "                         for programs that want doubles.\n"
+    "                         If you omit this, s24 will be used.\n"
+    "  -c, --container      : wav, raw (headerless little endian PCM) or flac\n"
+    "                         (s16 and s24 only, frames are encoded in parallel).\n"
+    "                         dsf or dff store the decoded DSD as it is, without\n"
+    "                         PCM conversion (the rate and format are ignored).\n"
+    "                         dst writes DSDIFF files with DST compressed audio:\n"
+    "                         DST input is copied without decoding it, anything\n"
+    "                         else is encoded (see -x). With -g the tracks are\n"
+    "                         marked.\n"
+    "                         If you omit this, wav will be used.\n"
+    "  -x, --effort         : How hard the DST encoder tries, 0 (fastest) to 3\n"
+    "                         (smallest files). If you omit this, 1 will be used.\n"
+    "  -m, --media          : How to read the input: buffered, direct or mmap.\n"
+    "                         direct bypasses the page cache (O_DIRECT), which keeps\n"
+    "                         memory use flat when converting many large images.\n"
+    "                         If you omit this, buffered will be used.\n"
+    "  -t, --track          : Only convert this track number.\n"
+    "  -g, --gapless        : Convert each area as one uninterrupted file and write a\n"
+    "                         cue sheet with the track boundaries next to it.\n"
+    "  -e, --exact          : Convert each area as one stream and cut it into the\n"
+    "                         track files at the exact track starts: played back\n"
+    "                         to back the files are identical to the gapless output.\n"
+    "                         An area is then converted by a single thread.\n"
+    "  -P, --pipe           : Stream the PCM to this file descriptor (- for stdout)\n"
+    "                         instead of writing files: the selected track, or the\n"
+    "                         whole area back to back. Messages go to stderr then.\n"
+    "  -a, --async          : Write the output from a background thread so a slow\n"
+    "                         output volume does not stall decoding.\n"
     "  -p, --progress       : Display progress to new lines. Use this if you intend\n"
     "                         to parse the output through a script. This option only\n"
     "                         lists either one progress percentage per line, or one\n"
@@ -683,20 +880,37 @@ int main(int argc, char* argv[])
     {
         {"infile", required_argument, NULL, 'i' },
         {"outdir", required_argument, NULL, 'o' },
+        {"list", required_argument, NULL, 'l' },
         {"rate", required_argument, NULL, 'r' },
         {"stereo", no_argument, NULL, 's'},
+        {"format", required_argument, NULL, 'f'},
+        {"container", required_argument, NULL, 'c'},
+        {"effort", required_argument, NULL, 'x'},
+        {"media", required_argument, NULL, 'm'},
+        {"async", no_argument, NULL, 'a'},
+        {"track", required_argument, NULL, 't'},
+        {"gapless", no_argument, NULL, 'g'},
+        {"exact", no_argument, NULL, 'e'},
+        {"pipe", required_argument, NULL, 'P'},
         {"progress", no_argument, NULL, 'p'},
         {"details", no_argument, NULL, 'd'},
         {"help", no_argument, NULL, 'h' },
         { NULL, 0, NULL, 0 }
     };
 
-    while ((nOpt = getopt_long(argc, argv, "i:o:r:spdh", tOptionsTable, NULL)) >= 0)
+    while ((nOpt = getopt_long(argc, argv, "i:l:o:r:f:c:x:sm:at:geP:pdh", tOptionsTable, NULL)) >= 0)
     {
         switch (nOpt)
         {
             case 'i':
-                strIn = optarg;
+                arrIn.push_back(optarg);
+                break;
+            case 'l':
+                if (!readInputList(optarg, arrIn))
+                {
+                    printf("PANIC: Failed to read the input list\n");
+                    return 0;
+                }
                 break;
             case 'o':
                 g_strOut = optarg;
@@ -716,9 +930,148 @@ int main(int argc, char* argv[])
                 }
                 break;
             }
+            case 'f':
+            {
+                string s = optarg;
+
+                if (s == "s16")
+                {
+                    g_nFormat = PCM_S16;
+                }
+                else if (s == "s24")
+                {
+                    g_nFormat = PCM_S24;
+                }
+                else if (s == "s32")
+                {
+                    g_nFormat = PCM_S32;
+                }
+                else if (s == "f32")
+                {
+                    g_nFormat = PCM_F32;
+                }
+                else if (s == "f64")
+                {
+                    g_nFormat = PCM_F64;
+                }
+                else
+                {
+                    printf("PANIC: Invalid sample format\n");
+                    return 0;
+                }
+                break;
+            }
+            case 'c':
+            {
+                string s = optarg;
+
+                g_bDsd = false;
+
+                if (s == "wav")
+                {
+                    g_nContainer = CONTAINER_WAV;
+                }
+                else if (s == "raw")
+                {
+                    g_nContainer = CONTAINER_RAW;
+                }
+                else if (s == "flac")
+                {
+                    g_nContainer = CONTAINER_FLAC;
+                }
+                else if (s == "dsf" || s == "dff" || s == "dst")
+                {
+                    g_bDsd = true;
+                    g_nDsdContainer = s == "dsf" ? DSD_CONTAINER_DSF : s == "dff" ? DSD_CONTAINER_DFF : DSD_CONTAINER_DST;
+                }
+                else
+                {
+                    printf("PANIC: Invalid container\n");
+                    return 0;
+                }
+                break;
+            }
+            case 'x':
+            {
+                string s = optarg;
+
+                if (s.size() == 1 && s[0] >= '0' + DST_EFFORT_MIN && s[0] <= '0' + DST_EFFORT_MAX)
+                {
+                    g_nDstEffort = s[0] - '0';
+                }
+                else
+                {
+                    printf("PANIC: Invalid DST encoder effort\n");
+                    return 0;
+                }
+                break;
+            }
             case 's':
                 g_nArea = AREA_TWOCH;
                 break;
+            case 'a':
+                g_bAsync = true;
+                break;
+            case 't':
+                g_nTrack = atoi(optarg) - 1;
+
+                if (g_nTrack < 0)
+                {
+                    printf("PANIC: Invalid track number\n");
+                    return 0;
+                }
+                break;
+            case 'g':
+                g_bGapless = true;
+                break;
+            case 'e':
+                g_bExact = true;
+                break;
+            case 'P':
+            {
+                string s = optarg;
+
+                if (s == "-")
+                {
+                    // Keep the real stdout for the audio and send everything printed to stderr
+                    g_nPipeFd = dup(STDOUT_FILENO);
+                    dup2(STDERR_FILENO, STDOUT_FILENO);
+                }
+                else if (!s.empty() && s.find_first_not_of("0123456789") == string::npos)
+                {
+                    g_nPipeFd = stoi(s);
+                }
+
+                if (g_nPipeFd < 0 || fcntl(g_nPipeFd, F_GETFL) == -1)
+                {
+                    printf("PANIC: Invalid file descriptor\n");
+                    return 0;
+                }
+                break;
+            }
+            case 'm':
+            {
+                string s = optarg;
+
+                if (s == "buffered")
+                {
+                    g_nAccess = ACCESS_BUFFERED;
+                }
+                else if (s == "direct")
+                {
+                    g_nAccess = ACCESS_DIRECT;
+                }
+                else if (s == "mmap")
+                {
+                    g_nAccess = ACCESS_MMAP;
+                }
+                else
+                {
+                    printf("PANIC: Invalid media access mode\n");
+                    return 0;
+                }
+                break;
+            }
             case 'p':
                 g_bProgressLine = true;
                 break;
@@ -731,163 +1084,338 @@ int main(int argc, char* argv[])
         }
     }
 
-    if (bPrintHelp || argc == 1 || strIn.empty())
+    if (bPrintHelp || argc == 1 || arrIn.empty())
     {
         printf(g_bProgressLine ? "PANIC: Invalid command-line syntax\n" : strHelpText);
         return 0;
     }
 
-    struct stat tStat;
-
-    if (stat(strIn.c_str(), &tStat) == -1 || !S_ISREG(tStat.st_mode))
+    if (g_bDsd && g_nPipeFd >= 0)
     {
-        printf("PANIC: Input file does not exist\n");
+        printf("PANIC: DSD output can only be written to files\n");
         return 0;
     }
 
-    strIn = realpath(strIn.data(), strPath);
-
-    if (g_strOut.empty())
+    // DSD tracks start and end on frame boundaries, every track file is exact anyway
+    if (g_bDsd)
     {
-        g_strOut = strIn.substr(0, strIn.find_last_of("/") + 1);
+        g_bExact = false;
     }
 
-    if (g_strOut.empty() || stat(g_strOut.c_str(), &tStat) == -1 || !S_ISDIR(tStat.st_mode))
+    if (!g_bDsd && g_nContainer == CONTAINER_FLAC && g_nFormat != PCM_S16 && g_nFormat != PCM_S24)
     {
-        printf("PANIC: Output directory does not exist\n");
+        printf("PANIC: FLAC output needs the s16 or s24 format\n");
         return 0;
     }
 
-    g_strOut = realpath(g_strOut.data(), strPath);
+    struct stat tStat;
+    bool bStream = false;
+    vector<string> arrFiles;
 
-    if (g_strOut.compare(g_strOut.size() - 1, 1, "/") != 0)
+    for (size_t i = 0; i < arrIn.size(); i++)
     {
-        g_strOut += "/";
+        if (arrIn[i] != "-" && stat(arrIn[i].c_str(), &tStat) == 0 && S_ISDIR(tStat.st_mode))
+        {
+            findInputs(arrIn[i], arrFiles);
+        }
+        else
+        {
+            arrFiles.push_back(arrIn[i]);
+        }
     }
 
-    SACD * pSacd = new SACD();
+    arrIn = arrFiles;
+
+    if (arrIn.empty())
+    {
+        printf("PANIC: No input files found\n");
+        return 0;
+    }
 
-    if (!pSacd->open(strIn))
+    for (size_t i = 0; i < arrIn.size(); i++)
     {
-        exit(1);
+        InputInfo cInput;
+        bool bPipe = arrIn[i] == "-";
+
+        if (!bPipe && (stat(arrIn[i].c_str(), &tStat) == -1 || !(S_ISREG(tStat.st_mode) || S_ISFIFO(tStat.st_mode) || S_ISCHR(tStat.st_mode))))
+        {
+            printf("PANIC: Input file does not exist\n");
+            return 0;
+        }
+
+        if (!bPipe)
+        {
+            bPipe = !S_ISREG(tStat.st_mode);
+            arrIn[i] = realpath(arrIn[i].data(), strPath);
+        }
+
+        if (bPipe && arrIn.size() > 1)
+        {
+            printf("PANIC: A stream can only be converted on its own\n");
+            return 0;
+        }
+
+        bStream = bStream || bPipe;
+        cInput.strPath = arrIn[i];
+
+        // Gapless output is named after the input
+        cInput.strName = bPipe ? "stream" : arrIn[i].substr(arrIn[i].find_last_of("/") + 1);
+        cInput.strName = cInput.strName.substr(0, cInput.strName.find_last_of("."));
+        cInput.strOut = g_strOut;
+
+        if (cInput.strOut.empty())
+        {
+            cInput.strOut = bPipe ? "." : arrIn[i].substr(0, arrIn[i].find_last_of("/") + 1);
+        }
+
+        if (cInput.strOut.empty() || stat(cInput.strOut.c_str(), &tStat) == -1 || !S_ISDIR(tStat.st_mode))
+        {
+            printf("PANIC: Output directory does not exist\n");
+            return 0;
+        }
+
+        cInput.strOut = realpath(cInput.strOut.data(), strPath);
+
+        if (cInput.strOut.compare(cInput.strOut.size() - 1, 1, "/") != 0)
+        {
+            cInput.strOut += "/";
+        }
+
+        g_arrInputs.push_back(cInput);
     }
 
-    if (!g_bProgressLine)
+    // Pipes are read once, front to back
+    if (bStream)
     {
-        printf("\n\nsacd\n----\nCommand-line SACD decoder\nversion %s\n\n", APPVERSION);
+        g_nAccess = ACCESS_STREAM;
     }
 
-    int nTwoch = pSacd->m_pSacdReader->get_track_count(AREA_TWOCH);
-    int nMulch = pSacd->m_pSacdReader->get_track_count(AREA_MULCH);
+    SACD * pSacd = nullptr;
 
-    if (bPrintDetails)
+    for (size_t n = 0; n < g_arrInputs.size(); n++)
     {
-        printf("STEREO AREA TRACK LIST:\n");
-        printf("-----------------------\n");
+        pSacd = new SACD();
 
-        if (nTwoch > 0)
+        // An input that cannot be read is skipped, the rest of the batch still runs and the exit status tells
+        if (!pSacd->open(g_arrInputs[n].strPath, g_nAccess))
         {
-            for (int i = 0; i < nTwoch; i++)
+            printf("PANIC: Failed to open %s, skipping it\n", g_arrInputs[n].strPath.data());
+            g_nFailed++;
+            delete pSacd;
+            pSacd = nullptr;
+            continue;
+        }
+
+        if (n == 0 && !g_bProgressLine)
+        {
+            printf("\n\nsacd\n----\nCommand-line SACD decoder\nversion %s\n\n", APPVERSION);
+        }
+
+        int nTwoch = pSacd->m_pSacdReader->get_track_count(AREA_TWOCH);
+        int nMulch = pSacd->m_pSacdReader->get_track_count(AREA_MULCH);
+
+        if (bPrintDetails)
+        {
+            if (g_arrInputs.size() > 1)
+            {
+                printf("INPUT: %s\n\n", g_arrInputs[n].strPath.data());
+            }
+
+            printf("STEREO AREA TRACK LIST:\n");
+            printf("-----------------------\n");
+
+            if (nTwoch > 0)
+            {
+                for (int i = 0; i < nTwoch; i++)
+                {
+                    TrackDetails cTrackDetails;
+
+                    pSacd->m_pSacdReader->getTrackDetails(i, AREA_TWOCH, &cTrackDetails);
+
+                    printf("\nTRACK: %i\n", i + 1);
+                    printf("ARTIST: %s\n", cTrackDetails.strArtist.data());
+                    printf("TITLE: %s\n", cTrackDetails.strTitle.data());
+                    printf("CHANNELS: %i\n", cTrackDetails.nChannels);
+                }
+            }
+            else
             {
-                TrackDetails cTrackDetails;
+                printf("No tracks.\n\n");
+            }
+
+            printf("\nMULTICHANNEL AREA TRACK LIST:\n");
+            printf("-----------------------------\n");
 
-                pSacd->m_pSacdReader->getTrackDetails(i, AREA_TWOCH, &cTrackDetails);
+            if (nMulch > 0)
+            {
+                for (int i = 0; i < nMulch; i++)
+                {
+                    TrackDetails cTrackDetails;
+                    pSacd->m_pSacdReader->getTrackDetails(i, AREA_MULCH, &cTrackDetails);
 
-                printf("\nTRACK: %i\n", i + 1);
-                printf("ARTIST: %s\n", cTrackDetails.strArtist.data());
-                printf("TITLE: %s\n", cTrackDetails.strTitle.data());
-                printf("CHANNELS: %i\n", cTrackDetails.nChannels);
+                    printf("\nTRACK: %i\n", i + 1);
+                    printf("ARTIST: %s\n", cTrackDetails.strArtist.data());
+                    printf("TITLE: %s\n", cTrackDetails.strTitle.data());
+                    printf("CHANNELS: %i\n", cTrackDetails.nChannels);
+                }
+            }
+            else
+            {
+                printf("\nNo tracks.\n\n");
             }
+
+            delete pSacd;
+            continue;
+        }
+
+        bool bWarn = false;
+        area_id_e nArea;
+
+        if (nMulch > 0 && nTwoch > nMulch && g_nArea != AREA_TWOCH)
+        {
+            nArea = AREA_BOTH;
+            bWarn = true;
+        }
+        else if (nTwoch > 0 && nMulch > nTwoch && g_nArea != AREA_TWOCH)
+        {
+            nArea = AREA_BOTH;
+            bWarn = true;
+        }
+        else if (nMulch > 0 && g_nArea != AREA_TWOCH)
+        {
+            nArea = AREA_MULCH;
+        }
+        else if (nTwoch > 0)
+        {
+            nArea = AREA_TWOCH;
         }
         else
         {
-            printf("No tracks.\n\n");
+            nArea = AREA_MULCH;
+        }
+
+        // A stream has a single channel layout
+        if (g_nPipeFd >= 0 && nArea == AREA_BOTH)
+        {
+            nArea = AREA_MULCH;
+            bWarn = false;
         }
 
-        printf("\nMULTICHANNEL AREA TRACK LIST:\n");
-        printf("-----------------------------\n");
+        vector<TrackInfo> arrJobs;
 
-        if (nMulch > 0)
+        if(nArea == AREA_MULCH || nArea == AREA_BOTH)
         {
             for (int i = 0; i < nMulch; i++)
             {
-                TrackDetails cTrackDetails;
-                pSacd->m_pSacdReader->getTrackDetails(i, AREA_MULCH, &cTrackDetails);
+                TrackInfo cTrackInfo = {i, AREA_MULCH, 1, (int)n, 0.0};
+                arrJobs.push_back(cTrackInfo);
+            }
+        }
 
-                printf("\nTRACK: %i\n", i + 1);
-                printf("ARTIST: %s\n", cTrackDetails.strArtist.data());
-                printf("TITLE: %s\n", cTrackDetails.strTitle.data());
-                printf("CHANNELS: %i\n", cTrackDetails.nChannels);
+        if(nArea == AREA_TWOCH || nArea == AREA_BOTH)
+        {
+            for (int i = 0; i < nTwoch; i++)
+            {
+                TrackInfo cTrackInfo = {i, AREA_TWOCH, 1, (int)n, 0.0};
+                arrJobs.push_back(cTrackInfo);
             }
         }
-        else
+
+        if (g_nTrack >= 0)
         {
-            printf("\nNo tracks.\n\n");
+            vector<TrackInfo> arrSelected;
+
+            for (size_t i = 0; i < arrJobs.size(); i++)
+            {
+                if (arrJobs[i].nTrack == g_nTrack)
+                {
+                    arrSelected.push_back(arrJobs[i]);
+                }
+            }
+
+            arrJobs = arrSelected;
         }
 
-        delete pSacd;
-        return 0;
-    }
+        if (g_bGapless || g_bExact)
+        {
+            // One job per area reading all of its consecutive tracks as a single range
+            vector<TrackInfo> arrAreas;
 
-    bool bWarn = false;
-    area_id_e nArea;
+            for (size_t i = 0; i < arrJobs.size(); i++)
+            {
+                if (!arrAreas.empty() && arrAreas.back().nArea == arrJobs[i].nArea && arrAreas.back().nTrack + arrAreas.back().nCount == arrJobs[i].nTrack)
+                {
+                    arrAreas.back().nCount++;
+                }
+                else
+                {
+                    arrAreas.push_back(arrJobs[i]);
+                }
+            }
 
-    if (nMulch > 0 && nTwoch > nMulch && g_nArea != AREA_TWOCH)
-    {
-        nArea = AREA_BOTH;
-        bWarn = true;
-    }
-    else if (nTwoch > 0 && nMulch > nTwoch && g_nArea != AREA_TWOCH)
-    {
-        nArea = AREA_BOTH;
-        bWarn = true;
-    }
-    else if (nMulch > 0 && g_nArea != AREA_TWOCH)
-    {
-        nArea = AREA_MULCH;
-    }
-    else if (nTwoch > 0)
-    {
-        nArea = AREA_TWOCH;
-    }
-    else
-    {
-        nArea = AREA_MULCH;
-    }
+            arrJobs = arrAreas;
+        }
 
-    if(nArea == AREA_MULCH || nArea == AREA_BOTH)
-    {
-        for (int i = 0; i < nMulch; i++)
+        for (size_t i = 0; i < arrJobs.size(); i++)
         {
-            TrackInfo cTrackInfo = {i, AREA_MULCH};
-            g_arrQueue.push_back(cTrackInfo);
+            arrJobs[i].fCost = getCost(pSacd, arrJobs[i]);
+            g_arrQueue.push_back(arrJobs[i]);
         }
-    }
 
-    if(nArea == AREA_TWOCH || nArea == AREA_BOTH)
-    {
-        for (int i = 0; i < nTwoch; i++)
+        if(bWarn)
+        {
+            if (g_bProgressLine)
+            {
+                printf("WARNINGThe multichannel and stereo areas have a different track count: extracting both.\n");
+            }
+            else
+            {
+                printf("WARNING: The multichannel and stereo areas have a different track count: extracting both.\n\n");
+            }
+        }
+
+        if (!bStream)
         {
-            TrackInfo cTrackInfo = {i, AREA_TWOCH};
-            g_arrQueue.push_back(cTrackInfo);
+            delete pSacd;
         }
     }
 
-    if(bWarn)
+    if (bPrintDetails)
     {
-        if (g_bProgressLine)
+        return 0;
+    }
+
+    if (g_arrQueue.empty())
+    {
+        if (g_nFailed == 0)
         {
-            printf("WARNINGThe multichannel and stereo areas have a different track count: extracting both.\n");
+            printf("PANIC: Invalid track number\n");
         }
-        else
+
+        if (bStream)
         {
-            printf("WARNING: The multichannel and stereo areas have a different track count: extracting both.\n\n");
+            delete pSacd;
         }
+
+        return g_nFailed > 0 ? 1 : 0;
+    }
+
+    // A stream or pipe keeps the TOC order, everything else starts with the most expensive job so that no long track is
+    // left for the end while the other threads run idle
+    if (!bStream && g_nPipeFd < 0)
+    {
+        stable_sort(g_arrQueue.begin(), g_arrQueue.end(), compareCost);
     }
 
-    delete pSacd;
+    g_nQueued = g_arrQueue.size();
+    g_nThreads = bStream || g_nPipeFd >= 0 ? 1 : MIN(g_nCPUs, (int)g_arrQueue.size());
 
-    g_nThreads = MIN(g_nCPUs, (int)g_arrQueue.size());
+    if (g_nPipeFd >= 0)
+    {
+        // A reader that goes away should end the conversion with an error instead of killing us
+        signal(SIGPIPE, SIG_IGN);
+        g_pPipeWriter = pcm_writer_t::create(g_nFormat, g_nContainer, g_bAsync, g_nCPUs);
+    }
 
     time_t nNow = time(0);
     pthread_t hThreadProgress;
@@ -896,8 +1424,16 @@ int main(int argc, char* argv[])
 
     for (int i = 0; i < g_nThreads; i++)
     {
-        arrSACD[i] = new SACD();
-        arrSACD[i]->open(strIn);
+        if (bStream)
+        {
+            // Keep the instance that already consumed the header
+            arrSACD[i] = pSacd;
+        }
+        else
+        {
+            // Opened on the first job, and again whenever the thread moves on to another input
+            arrSACD[i] = new SACD();
+        }
         pthread_create(&arrThreads[i], NULL, fnDecoder, arrSACD[i]);
         pthread_detach(arrThreads[i]);
     }
@@ -911,6 +1447,12 @@ int main(int argc, char* argv[])
         delete arrSACD[i];
     }
 
+    if (g_pPipeWriter)
+    {
+        g_pPipeWriter->close();
+        delete g_pPipeWriter;
+    }
+
     int nSeconds = time(0) - nNow;
 
     if (g_bProgressLine)
@@ -922,5 +1464,5 @@ int main(int argc, char* argv[])
         printf("\nFinished in %d seconds.\n\n", nSeconds);
     }
 
-    return 0;
+    return g_nFailed > 0 ? 1 : 0;
 }